@@ -0,0 +1,278 @@
+// Emits synthetic SystemVerilog designs for benchmarking the simulator.
+//
+// Usage: gen_design --kind <kind> --size N [--width W] [--cycles C] [--parts P] --out <dir>
+//
+// Each run writes <dir>/<top>.sv and <dir>/<top>.f, where <top> is bench_<kind>_<size>.
+// The top module is self-contained: it owns a free-running clock with a period of 10 time
+// units and calls $finish after C cycles, so simulated cycles = final time / 10.
+// Designs only use the subset both backends support (assign, always_ff, always_comb,
+// module instances, initial delays), so the same file exercises the interpreter and the
+// generated C++.
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+struct Options {
+    std::string kind;
+    uint32_t size = 64;
+    uint32_t width = 32;
+    uint64_t cycles = 10000;
+    uint32_t parts = 4;
+    std::string outDir = ".";
+};
+
+constexpr uint32_t kClockPeriod = 10;
+
+void emitHeader(std::ostream& out, const std::string& top) {
+    out << "module " << top << "();\n";
+    out << "    logic clk = 1'b0;\n";
+    out << "    initial forever #(" << kClockPeriod / 2 << ") clk = ~clk;\n\n";
+}
+
+void emitFooter(std::ostream& out, const Options& options) {
+    out << "\n    initial begin\n";
+    out << "        #(" << options.cycles * kClockPeriod << ");\n";
+    out << "        $finish();\n";
+    out << "    end\n";
+    out << "endmodule\n";
+}
+
+std::string vec(uint32_t width) {
+    return width > 1 ? "logic [" + std::to_string(width - 1) + ":0]" : "logic";
+}
+
+// A free-running counter feeding a chain of `size` dependent continuous assignments.
+void emitCombChain(std::ostream& out, const std::string& top, const Options& options) {
+    emitHeader(out, top);
+    out << "    " << vec(options.width) << " c0;\n";
+    for (uint32_t i = 1; i <= options.size; ++i)
+        out << "    " << vec(options.width) << " c" << i << ";\n";
+    out << "\n    always_ff @(posedge clk) c0 <= c0 + 1;\n";
+    for (uint32_t i = 1; i <= options.size; ++i)
+        out << "    assign c" << i << " = c" << (i - 1) << " + " << i << ";\n";
+    emitFooter(out, options);
+}
+
+// `size` registers updated from one clocked block, each depending on its neighbour.
+void emitRegFile(std::ostream& out, const std::string& top, const Options& options) {
+    emitHeader(out, top);
+    for (uint32_t i = 0; i < options.size; ++i)
+        out << "    " << vec(options.width) << " r" << i << ";\n";
+    out << "\n    always_ff @(posedge clk) begin\n";
+    out << "        r0 <= r0 + 1;\n";
+    for (uint32_t i = 1; i < options.size; ++i)
+        out << "        r" << i << " <= r" << i << " + r" << (i - 1) << ";\n";
+    out << "    end\n";
+    emitFooter(out, options);
+}
+
+// A `size`-stage pipeline with one clocked block per stage.
+void emitPipeline(std::ostream& out, const std::string& top, const Options& options) {
+    emitHeader(out, top);
+    for (uint32_t i = 0; i <= options.size; ++i)
+        out << "    " << vec(options.width) << " p" << i << ";\n";
+    out << "\n    always_ff @(posedge clk) p0 <= p0 + 1;\n";
+    for (uint32_t i = 1; i <= options.size; ++i)
+        out << "    always_ff @(posedge clk) p" << i << " <= p" << (i - 1) << " * 3 + " << i
+            << ";\n";
+    emitFooter(out, options);
+}
+
+// `size` independent flops on the same clock: stresses edge fanout in the kernel.
+void emitFanout(std::ostream& out, const std::string& top, const Options& options) {
+    emitHeader(out, top);
+    for (uint32_t i = 0; i < options.size; ++i)
+        out << "    " << vec(options.width) << " f" << i << ";\n";
+    out << "\n";
+    for (uint32_t i = 0; i < options.size; ++i)
+        out << "    always_ff @(posedge clk) f" << i << " <= f" << i << " + " << (i + 1) << ";\n";
+    emitFooter(out, options);
+}
+
+// `size` leaf registers (rounded up to a power of two) summed by a balanced adder tree.
+void emitAdderTree(std::ostream& out, const std::string& top, const Options& options) {
+    uint32_t leaves = 1;
+    while (leaves < options.size)
+        leaves <<= 1;
+
+    emitHeader(out, top);
+    for (uint32_t i = 0; i < leaves; ++i)
+        out << "    " << vec(options.width) << " t0_" << i << ";\n";
+    for (uint32_t level = 1, count = leaves / 2; count >= 1; ++level, count /= 2) {
+        for (uint32_t i = 0; i < count; ++i)
+            out << "    " << vec(options.width) << " t" << level << "_" << i << ";\n";
+    }
+    out << "\n";
+    for (uint32_t i = 0; i < leaves; ++i)
+        out << "    always_ff @(posedge clk) t0_" << i << " <= t0_" << i << " + " << (i + 1)
+            << ";\n";
+    for (uint32_t level = 1, count = leaves / 2; count >= 1; ++level, count /= 2) {
+        for (uint32_t i = 0; i < count; ++i) {
+            out << "    assign t" << level << "_" << i << " = t" << (level - 1) << "_" << (2 * i)
+                << " + t" << (level - 1) << "_" << (2 * i + 1) << ";\n";
+        }
+    }
+    emitFooter(out, options);
+}
+
+// `size` instances of a small accumulator module sharing clock and input.
+void emitInstances(std::ostream& out, const std::string& top, const Options& options) {
+    out << "module bench_leaf #(parameter WIDTH = " << options.width << ") (\n";
+    out << "    input logic clk,\n";
+    out << "    input logic [WIDTH-1:0] in,\n";
+    out << "    output logic [WIDTH-1:0] acc\n";
+    out << ");\n";
+    out << "    logic [WIDTH-1:0] next;\n";
+    out << "    assign next = acc + in;\n";
+    out << "    always_ff @(posedge clk) acc <= next;\n";
+    out << "endmodule\n\n";
+
+    emitHeader(out, top);
+    out << "    " << vec(options.width) << " in;\n";
+    for (uint32_t i = 0; i < options.size; ++i)
+        out << "    " << vec(options.width) << " acc" << i << ";\n";
+    out << "\n    always_ff @(posedge clk) in <= in + 1;\n";
+    for (uint32_t i = 0; i < options.size; ++i) {
+        out << "    bench_leaf #(.WIDTH(" << options.width << ")) u" << i
+            << " (.clk(clk), .in(in), .acc(acc" << i << "));\n";
+    }
+    emitFooter(out, options);
+}
+
+// `parts` cores of `size` registers in a ring, each core's registered output feeding the
+// next one's input. The cores sit in <top>_dut, the design under test for cycle mode, so
+// `--top <top>_dut --partition <top>_core` runs every core in its own process.
+void emitPartitioned(std::ostream& out, const std::string& top, const Options& options) {
+    std::string w = vec(options.width);
+    out << "module " << top << "_core (\n";
+    out << "    input logic clk,\n";
+    out << "    input " << w << " in,\n";
+    out << "    output " << w << " out\n";
+    out << ");\n";
+    for (uint32_t i = 0; i < options.size; ++i)
+        out << "    " << w << " r" << i << ", m" << i << ";\n";
+    out << "\n    assign m0 = r0 ^ in;\n";
+    for (uint32_t i = 1; i < options.size; ++i)
+        out << "    assign m" << i << " = (r" << i << " + m" << (i - 1) << ") ^ (m" << (i - 1)
+            << " >> 3);\n";
+    out << "    always_ff @(posedge clk) begin\n";
+    out << "        r0 <= m0 + 1;\n";
+    for (uint32_t i = 1; i < options.size; ++i)
+        out << "        r" << i << " <= m" << i << ";\n";
+    out << "        out <= m" << (options.size - 1) << ";\n";
+    out << "    end\n";
+    out << "endmodule\n\n";
+
+    out << "module " << top << "_dut (\n";
+    out << "    input logic clk,\n";
+    out << "    output " << w << " sum\n";
+    out << ");\n";
+    for (uint32_t i = 0; i < options.parts; ++i)
+        out << "    " << w << " link" << i << ";\n";
+    for (uint32_t i = 0; i < options.parts; ++i) {
+        out << "    " << top << "_core u_core" << i << " (.clk(clk), .in(link"
+            << (i + options.parts - 1) % options.parts << "), .out(link" << i << "));\n";
+    }
+    out << "    always_ff @(posedge clk) sum <= link0";
+    for (uint32_t i = 1; i < options.parts; ++i)
+        out << " + link" << i;
+    out << ";\n";
+    out << "endmodule\n\n";
+
+    emitHeader(out, top);
+    out << "    " << w << " sum;\n";
+    out << "    " << top << "_dut dut (.clk(clk), .sum(sum));\n";
+    emitFooter(out, options);
+}
+
+bool parseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--kind" && i + 1 < argc) {
+            options.kind = argv[++i];
+        } else if (arg == "--size" && i + 1 < argc) {
+            options.size = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (arg == "--width" && i + 1 < argc) {
+            options.width = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (arg == "--cycles" && i + 1 < argc) {
+            options.cycles = std::strtoull(argv[++i], nullptr, 0);
+        } else if (arg == "--parts" && i + 1 < argc) {
+            options.parts = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (arg == "--out" && i + 1 < argc) {
+            options.outDir = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return false;
+        }
+    }
+    if (options.kind.empty() || options.size == 0 || options.width == 0 ||
+        options.width > 64 || options.parts == 0) {
+        std::cerr << "Usage: gen_design --kind <comb_chain|regfile|pipeline|fanout|adder_tree|"
+                     "instances|partitioned> --size N [--width 1..64] [--cycles C] [--parts P] "
+                     "--out <dir>\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArgs(argc, argv, options))
+        return 1;
+
+    std::string top = "bench_" + options.kind + "_" + std::to_string(options.size);
+    std::ostringstream sv;
+    if (options.kind == "comb_chain") {
+        emitCombChain(sv, top, options);
+    } else if (options.kind == "regfile") {
+        emitRegFile(sv, top, options);
+    } else if (options.kind == "pipeline") {
+        emitPipeline(sv, top, options);
+    } else if (options.kind == "fanout") {
+        emitFanout(sv, top, options);
+    } else if (options.kind == "adder_tree") {
+        emitAdderTree(sv, top, options);
+    } else if (options.kind == "instances") {
+        emitInstances(sv, top, options);
+    } else if (options.kind == "partitioned") {
+        emitPartitioned(sv, top, options);
+    } else {
+        std::cerr << "Unknown design kind: " << options.kind << "\n";
+        return 1;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(options.outDir, ec);
+    if (ec) {
+        std::cerr << "Failed to create output directory: " << options.outDir << "\n";
+        return 1;
+    }
+
+    auto svPath = std::filesystem::path(options.outDir) / (top + ".sv");
+    std::ofstream svOut(svPath);
+    if (!svOut) {
+        std::cerr << "Failed to open output file: " << svPath << "\n";
+        return 1;
+    }
+    svOut << sv.str();
+
+    auto listPath = std::filesystem::path(options.outDir) / (top + ".f");
+    std::ofstream listOut(listPath);
+    if (!listOut) {
+        std::cerr << "Failed to open output file: " << listPath << "\n";
+        return 1;
+    }
+    listOut << svPath.string() << "\n";
+
+    std::cout << top << "\n";
+    return 0;
+}
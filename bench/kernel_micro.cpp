@@ -0,0 +1,380 @@
+// Microbenchmarks for the scheduling primitives of sim::Kernel.
+//
+// Usage: kernel_micro [--filter <substr>] [--warmup N] [--reps N] [--json <out>]
+//                     [--baseline <file>] [--max-regress <percent>]
+//
+// Every case builds a fresh fixture outside the timed region, then times one body run and
+// divides by the number of primitive operations the body performs. Allocations are counted
+// by replacing the global operator new, so allocs/op covers std::function captures, queue
+// growth and Process bookkeeping. `--json` writes results in the same format as the
+// committed baseline (bench/kernel_micro_baseline.json); `--baseline` prints the p50 delta
+// per case and, with `--max-regress`, exits non-zero if any case got slower than allowed.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "sim/runtime.h"
+
+namespace {
+
+std::atomic<uint64_t> allocationCount{0};
+
+} // namespace
+
+// GCC flags free() on memory from the replaced operator new once both are inlined.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+using Body = std::function<void()>;
+
+struct Case {
+    std::string name;
+    uint64_t ops = 1;
+    // Builds a fresh fixture and returns the timed body; fixture setup is not measured.
+    std::function<Body()> prepare;
+};
+
+struct Result {
+    std::string name;
+    double min = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double max = 0;
+    double allocsPerOp = 0;
+};
+
+struct Options {
+    std::string filter;
+    uint32_t warmup = 3;
+    uint32_t reps = 21;
+    std::string jsonOut;
+    std::string baseline;
+    double maxRegress = -1;
+};
+
+// Number of time steps a body spreads its work over, so per-step costs (time advance,
+// NBA phase entry) are amortised the same way for every grid point.
+constexpr uint64_t kSteps = 64;
+
+void noop() {}
+
+// D events pushed at scattered future times and drained by run(): priority-queue push,
+// pop and dispatch.
+Case scheduleAtCase(uint64_t depth) {
+    return {"schedule_at/depth=" + std::to_string(depth), depth, [depth]() -> Body {
+                auto kernel = std::make_shared<sim::Kernel>();
+                return [kernel, depth]() {
+                    for (uint64_t i = 0; i < depth; ++i)
+                        kernel->schedule_at(1 + (i * 7919) % depth, noop);
+                    kernel->run();
+                };
+            }};
+}
+
+// One signal with F level-sensitive processes, changed once per time step: measures the
+// wakeup path (onSignalChange -> scheduleProcess -> dispatch) per woken process.
+Case fanoutCase(uint64_t fanout) {
+    return {"continuous_fanout/fanout=" + std::to_string(fanout), kSteps * fanout,
+            [fanout]() -> Body {
+                struct Fixture {
+                    sim::Kernel kernel;
+                    sim::Signal signal{32};
+                    uint64_t wakeups = 0;
+                };
+                auto fx = std::make_shared<Fixture>();
+                for (uint64_t i = 0; i < fanout; ++i)
+                    fx->kernel.register_continuous([f = fx.get()]() { f->wakeups++; },
+                                                   {&fx->signal});
+                // Flush the initial evaluation of every process before timing.
+                fx->kernel.run();
+                return [fx]() {
+                    uint64_t base = fx->kernel.time();
+                    for (uint64_t step = 1; step <= kSteps; ++step) {
+                        fx->kernel.schedule_at(base + step, [f = fx.get()]() {
+                            f->signal.set(f->signal.value() + 1);
+                        });
+                    }
+                    fx->kernel.run();
+                };
+            }};
+}
+
+// N non-blocking assignments per time step: nba_assign queueing plus the applyNba commit
+// (which goes through Signal::set) at the end of each step.
+Case nbaCase(uint64_t count) {
+    return {"nba_assign/count=" + std::to_string(count), kSteps * count, [count]() -> Body {
+                struct Fixture {
+                    sim::Kernel kernel;
+                    std::vector<std::unique_ptr<sim::Signal>> signals;
+                };
+                auto fx = std::make_shared<Fixture>();
+                for (uint64_t i = 0; i < count; ++i)
+                    fx->signals.push_back(std::make_unique<sim::Signal>(32));
+                return [fx]() {
+                    for (uint64_t step = 1; step <= kSteps; ++step) {
+                        fx->kernel.schedule_at(step, [f = fx.get(), step]() {
+                            for (auto& sig : f->signals)
+                                f->kernel.nba_assign(*sig, step);
+                        });
+                    }
+                    fx->kernel.run();
+                };
+            }};
+}
+
+constexpr uint64_t kSetOps = 4096;
+
+// Signal::set on a signal without a kernel: masking and the change check only.
+Case signalSetDetachedCase(bool changing) {
+    return {std::string("signal_set/") + (changing ? "changed" : "unchanged"), kSetOps,
+            [changing]() -> Body {
+                auto signal = std::make_shared<sim::Signal>(32);
+                return [signal, changing]() {
+                    for (uint64_t i = 0; i < kSetOps; ++i)
+                        signal->set(changing ? i : 0);
+                };
+            }};
+}
+
+// Signal::set on a signal with one posedge process: every set runs edge detection and
+// the first rising edge of the step schedules the process.
+Case signalSetEdgeCase() {
+    return {"signal_set/posedge_sensitive", kSetOps, []() -> Body {
+                struct Fixture {
+                    sim::Kernel kernel;
+                    sim::Signal signal{1};
+                };
+                auto fx = std::make_shared<Fixture>();
+                fx->kernel.register_edge(noop, {{&fx->signal, sim::Edge::Pos}});
+                return [fx]() {
+                    fx->kernel.schedule_at(fx->kernel.time() + 1, [f = fx.get()]() {
+                        for (uint64_t i = 0; i < kSetOps; ++i)
+                            f->signal.set(i & 1);
+                    });
+                    fx->kernel.run();
+                };
+            }};
+}
+
+std::vector<Case> buildCases() {
+    std::vector<Case> cases;
+    for (uint64_t depth : {16, 1024, 65536})
+        cases.push_back(scheduleAtCase(depth));
+    for (uint64_t fanout : {1, 16, 256})
+        cases.push_back(fanoutCase(fanout));
+    for (uint64_t count : {1, 64, 1024})
+        cases.push_back(nbaCase(count));
+    cases.push_back(signalSetDetachedCase(false));
+    cases.push_back(signalSetDetachedCase(true));
+    cases.push_back(signalSetEdgeCase());
+    return cases;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t index = static_cast<size_t>(p * double(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+Result runCase(const Case& benchCase, const Options& options) {
+    for (uint32_t i = 0; i < options.warmup; ++i)
+        benchCase.prepare()();
+
+    std::vector<double> nsPerOp;
+    std::vector<double> allocsPerOp;
+    nsPerOp.reserve(options.reps);
+    allocsPerOp.reserve(options.reps);
+    for (uint32_t i = 0; i < options.reps; ++i) {
+        Body body = benchCase.prepare();
+        uint64_t allocsBefore = allocationCount.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        uint64_t allocs = allocationCount.load(std::memory_order_relaxed) - allocsBefore;
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        nsPerOp.push_back(ns / double(benchCase.ops));
+        allocsPerOp.push_back(double(allocs) / double(benchCase.ops));
+    }
+
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+    std::sort(allocsPerOp.begin(), allocsPerOp.end());
+    Result result;
+    result.name = benchCase.name;
+    result.min = nsPerOp.front();
+    result.p50 = percentile(nsPerOp, 0.5);
+    result.p90 = percentile(nsPerOp, 0.9);
+    result.max = nsPerOp.back();
+    result.allocsPerOp = percentile(allocsPerOp, 0.5);
+    return result;
+}
+
+// Reads `"name"` and `"p50_ns"` from each result line written by writeJson.
+std::map<std::string, double> loadBaseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open baseline file: " << path << "\n";
+        return baseline;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        auto namePos = line.find("\"name\": \"");
+        auto p50Pos = line.find("\"p50_ns\": ");
+        if (namePos == std::string::npos || p50Pos == std::string::npos)
+            continue;
+        namePos += 9;
+        auto nameEnd = line.find('"', namePos);
+        if (nameEnd == std::string::npos)
+            continue;
+        baseline[line.substr(namePos, nameEnd - namePos)] = std::strtod(line.c_str() + p50Pos + 10,
+                                                                        nullptr);
+    }
+    return baseline;
+}
+
+bool writeJson(const std::string& path, const std::vector<Result>& results,
+               const Options& options) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to open output file: " << path << "\n";
+        return false;
+    }
+    out << "{\n";
+    out << "  \"warmup\": " << options.warmup << ",\n";
+    out << "  \"reps\": " << options.reps << ",\n";
+    out << "  \"results\": [\n";
+    out << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"min_ns\": " << r.min
+            << ", \"p50_ns\": " << r.p50 << ", \"p90_ns\": " << r.p90 << ", \"max_ns\": " << r.max
+            << ", \"allocs_per_op\": " << r.allocsPerOp << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+    return true;
+}
+
+bool parseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            options.warmup = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (arg == "--reps" && i + 1 < argc) {
+            options.reps = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (arg == "--json" && i + 1 < argc) {
+            options.jsonOut = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            options.baseline = argv[++i];
+        } else if (arg == "--max-regress" && i + 1 < argc) {
+            options.maxRegress = std::strtod(argv[++i], nullptr);
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return false;
+        }
+    }
+    if (options.reps == 0) {
+        std::cerr << "--reps must be at least 1\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArgs(argc, argv, options))
+        return 1;
+
+    std::map<std::string, double> baseline;
+    if (!options.baseline.empty())
+        baseline = loadBaseline(options.baseline);
+
+    std::cout << std::left << std::setw(34) << "case" << std::right << std::setw(10) << "min"
+              << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "max"
+              << std::setw(12) << "allocs/op";
+    if (!baseline.empty())
+        std::cout << std::setw(10) << "vs base";
+    std::cout << "   (ns/op)\n";
+
+    std::vector<Result> results;
+    bool regressed = false;
+    for (const auto& benchCase : buildCases()) {
+        if (!options.filter.empty() && benchCase.name.find(options.filter) == std::string::npos)
+            continue;
+        Result r = runCase(benchCase, options);
+        std::cout << std::left << std::setw(34) << r.name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(10) << r.min << std::setw(10) << r.p50
+                  << std::setw(10) << r.p90 << std::setw(10) << r.max << std::setw(12)
+                  << r.allocsPerOp;
+        auto it = baseline.find(r.name);
+        if (it != baseline.end() && it->second > 0) {
+            double delta = (r.p50 / it->second - 1.0) * 100.0;
+            std::ostringstream text;
+            text << std::showpos << std::fixed << std::setprecision(1) << delta << "%";
+            std::cout << std::setw(10) << text.str();
+            if (options.maxRegress >= 0 && delta > options.maxRegress)
+                regressed = true;
+        }
+        std::cout << "\n";
+        results.push_back(r);
+    }
+
+    if (!options.jsonOut.empty() && !writeJson(options.jsonOut, results, options))
+        return 1;
+    if (regressed) {
+        std::cerr << "kernel_micro: p50 regressed by more than " << options.maxRegress
+                  << "% against " << options.baseline << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#!/usr/bin/env bash
+# Runs the synthetic benchmark suite against the interpreter and the generated C++ and
+# appends one JSON object per (design, backend) to the results file.
+#
+# Usage: bench/run_bench.sh [results.jsonl]
+# Environment: SIM (./sim), GEN_DESIGN (bench/gen_design), BENCH_DIR (bench/out),
+#              CXX (g++), BENCH_CXXFLAGS (-std=c++20 -O2), BENCH_CYCLES (20000),
+#              BENCH_CONFIGS (override the "kind:size:width" list below).
+set -euo pipefail
+
+RESULTS=${1:-bench/results.jsonl}
+SIM=${SIM:-./sim}
+GEN_DESIGN=${GEN_DESIGN:-bench/gen_design}
+BENCH_DIR=${BENCH_DIR:-bench/out}
+CXX=${CXX:-g++}
+BENCH_CXXFLAGS=${BENCH_CXXFLAGS:--std=c++20 -O2}
+BENCH_CYCLES=${BENCH_CYCLES:-20000}
+BENCH_CONFIGS=${BENCH_CONFIGS:-"comb_chain:256:32 regfile:256:32 pipeline:64:64 fanout:512:16 adder_tree:256:32 instances:128:32"}
+
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+STAMP=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+
+now_ms() {
+    date +%s%3N
+}
+
+# Extracts `key=value` from the last `stats:` line of a log.
+stat_field() {
+    grep '^stats:' "$1" | tail -n 1 | tr ' ' '\n' | sed -n "s/^$2=//p"
+}
+
+emit_result() {
+    local design=$1 backend=$2 gen_ms=$3 compile_ms=$4 log=$5
+    local events time wall rss
+    events=$(stat_field "$log" events)
+    time=$(stat_field "$log" time)
+    wall=$(stat_field "$log" wall_s)
+    rss=$(stat_field "$log" peak_rss_kb)
+    awk -v commit="$COMMIT" -v stamp="$STAMP" -v design="$design" -v backend="$backend" \
+        -v gen_ms="$gen_ms" -v compile_ms="$compile_ms" -v events="$events" -v time="$time" \
+        -v wall="$wall" -v rss="$rss" 'BEGIN {
+        cycles = time / 10
+        cps = wall > 0 ? cycles / wall : 0
+        eps = wall > 0 ? events / wall : 0
+        printf "{\"commit\":\"%s\",\"date\":\"%s\",\"design\":\"%s\",\"backend\":\"%s\",", commit, stamp, design, backend
+        printf "\"gen_ms\":%d,\"compile_ms\":%d,\"run_ms\":%.3f,\"cycles\":%d,", gen_ms, compile_ms, wall * 1000, cycles
+        printf "\"cycles_per_sec\":%.1f,\"events\":%d,\"events_per_sec\":%.1f,\"peak_rss_kb\":%d}\n", cps, events, eps, rss
+    }' >> "$RESULTS"
+}
+
+mkdir -p "$BENCH_DIR" "$(dirname "$RESULTS")"
+
+for config in $BENCH_CONFIGS; do
+    IFS=: read -r kind size width <<< "$config"
+    out="$BENCH_DIR/${kind}_${size}"
+    top=$("$GEN_DESIGN" --kind "$kind" --size "$size" --width "$width" \
+        --cycles "$BENCH_CYCLES" --out "$out")
+    filelist="$out/$top.f"
+    echo "== $top"
+
+    "$SIM" --top "$top" -file "$filelist" --stats > "$out/interp.log" 2>&1
+    emit_result "$top" interp 0 0 "$out/interp.log"
+
+    start=$(now_ms)
+    "$SIM" --top "$top" -file "$filelist" --cpp-out "$out/gen" --no-sim > "$out/gen.log" 2>&1
+    gen_ms=$(( $(now_ms) - start ))
+
+    start=$(now_ms)
+    # shellcheck disable=SC2086
+    "$CXX" $BENCH_CXXFLAGS -Iinclude -pthread "$out/gen/sim_main.cpp" src/runtime.cpp \
+        -o "$out/gen/sim"
+    compile_ms=$(( $(now_ms) - start ))
+
+    "$out/gen/sim" --stats > "$out/cpp.log" 2>&1
+    emit_result "$top" cpp "$gen_ms" "$compile_ms" "$out/cpp.log"
+done
+
+echo "Results appended to $RESULTS"
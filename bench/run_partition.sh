@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+# Measures multi-process partitioned simulation (`--partition`) against one process on the
+# synthetic `partitioned` design: a ring of cores, each run in its own process.
+#
+# Usage: bench/run_partition.sh
+# Environment: SIM (./sim), GEN_DESIGN (bench/gen_design), BENCH_DIR (bench/out),
+#              CXX (g++), BENCH_CXXFLAGS (-std=c++20 -O2), PARTS (4), CORE_SIZE (2000),
+#              CORE_WIDTH (32), BENCH_CYCLES (20000).
+set -euo pipefail
+
+SIM=${SIM:-./sim}
+GEN_DESIGN=${GEN_DESIGN:-bench/gen_design}
+BENCH_DIR=${BENCH_DIR:-bench/out}
+CXX=${CXX:-g++}
+BENCH_CXXFLAGS=${BENCH_CXXFLAGS:--std=c++20 -O2}
+PARTS=${PARTS:-4}
+CORE_SIZE=${CORE_SIZE:-2000}
+CORE_WIDTH=${CORE_WIDTH:-32}
+BENCH_CYCLES=${BENCH_CYCLES:-20000}
+
+now_ms() {
+    date +%s%3N
+}
+
+out="$BENCH_DIR/partitioned_${CORE_SIZE}x${PARTS}"
+top=$("$GEN_DESIGN" --kind partitioned --size "$CORE_SIZE" --width "$CORE_WIDTH" \
+    --parts "$PARTS" --out "$out")
+"$SIM" --top "${top}_dut" -file "$out/$top.f" --cpp-out "$out/gen" --no-sim \
+    --partition "${top}_core" > "$out/gen.log" 2>&1
+
+# shellcheck disable=SC2086
+"$CXX" $BENCH_CXXFLAGS -Iinclude -pthread "$out/gen/sim_main.cpp" src/runtime.cpp \
+    -o "$out/gen/sim"
+for src in "$out"/gen/sim_part*.cpp; do
+    # shellcheck disable=SC2086
+    "$CXX" $BENCH_CXXFLAGS -Iinclude -pthread "$src" src/runtime.cpp -o "${src%.cpp}"
+done
+
+start=$(now_ms)
+"$out/gen/sim" --cycles "$BENCH_CYCLES" > "$out/single.log" 2>&1
+single_ms=$(( $(now_ms) - start ))
+
+start=$(now_ms)
+"$out/gen/sim_part0" --cycles "$BENCH_CYCLES" > "$out/partitioned.log" 2>&1
+partitioned_ms=$(( $(now_ms) - start ))
+
+awk -v design="$top" -v parts="$PARTS" -v cycles="$BENCH_CYCLES" -v single="$single_ms" \
+    -v partitioned="$partitioned_ms" -v cores="$(nproc)" 'BEGIN {
+    printf "%s: %d cycles, 1 process %d ms, %d+1 processes %d ms (%d cores): speedup %.2fx\n", design, cycles, single, parts, partitioned, cores, partitioned > 0 ? single / partitioned : 0
+}'
@@ -1,6 +1,7 @@
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 #include "sim/runtime.h"
 
@@ -8,10 +9,14 @@ namespace gen {
 
 class adder {
 public:
-    adder(sim::Kernel& kernel, sim::Signal& clk, sim::Signal& rstn, sim::Signal& a, sim::Signal& b, sim::Signal& sum, uint32_t WIDTH = 8)
+    adder(sim::Kernel& kernel, const std::string& scope, sim::Signal& clk, sim::Signal& rstn, sim::Signal& a, sim::Signal& b, sim::Signal& sum, uint32_t WIDTH = 8)
         : kernel(kernel), clk(clk), rstn(rstn), a(a), b(b), sum(sum), wSum(8) {
+        kernel.track(scope, {{"wSum", &wSum}});
+        kernel.set_site(kernel.add_site(scope, "always_ff", "tests/adder.sv", 12)); // sv: tests/adder.sv:12
         kernel.register_edge([this]() { eval_ff_0(); },         {{&clk, sim::Edge::Pos}, {&rstn, sim::Edge::Neg}});
+        kernel.set_site(kernel.add_site(scope, "assign", "tests/adder.sv", 10)); // sv: tests/adder.sv:10
         kernel.register_continuous([this]() { eval_comb_proc_0(); }, {&b, &a});
+        kernel.set_site(0);
     }
 
 private:
@@ -23,15 +28,15 @@ private:
     sim::Signal& sum; // output
     sim::Signal wSum;
 
-    void eval_ff_0() {
-        if ((!rstn.value())) {
-            kernel.nba_assign(sum, 0);
+    void eval_ff_0() { // sv: tests/adder.sv:12
+        if ((!rstn.value())) { // sv: tests/adder.sv:13
+            kernel.nba_assign(sum, 0); // sv: tests/adder.sv:14
         } else {
-            kernel.nba_assign(sum, wSum.value());
+            kernel.nba_assign(sum, wSum.value()); // sv: tests/adder.sv:16
         }
     }
 
-    void eval_comb_proc_0() {
+    void eval_comb_proc_0() { // sv: tests/adder.sv:10
         wSum.set((a.value() + b.value()));
     }
 };
@@ -1,6 +1,7 @@
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 #include "sim/runtime.h"
 
@@ -8,54 +9,58 @@ namespace gen {
 
 class adder_tb {
 public:
-    adder_tb(sim::Kernel& kernel, uint32_t CLK_PERIOD = 10, uint32_t WIDTH = 8)
-        : kernel(kernel), clk(1), rstn(1), a(8), b(8), sum(8), product(16), adder_inst(kernel, clk, rstn, a, b, sum), multiplier(kernel, a, b, product) {
-        {
-            auto tick = std::make_shared<std::function<void()>>();
-            *tick = [this, tick]() {
-                clk.set((~clk.value()));
-                this->kernel.schedule_at(this->kernel.time() + static_cast<uint64_t>((10 / 2)), *tick);
-            };
-            kernel.schedule_at(static_cast<uint64_t>((10 / 2)), *tick);
-        }
+    adder_tb(sim::Kernel& kernel, const std::string& scope, uint32_t CLK_PERIOD = 10, uint32_t WIDTH = 8)
+        : kernel(kernel), clk(1), rstn(1), a(8), b(8), sum(8), product(16), adder_inst(kernel, scope + ".adder", clk, rstn, a, b, sum), multiplier(kernel, scope + ".multiplier", a, b, product) {
+        kernel.track(scope, {{"clk", &clk}, {"rstn", &rstn}, {"a", &a}, {"b", &b}, {"sum", &sum}, {"product", &product}});
+        kernel.set_site(kernel.add_site(scope, "initial", "tests/adder_tb.sv", 7)); // sv: tests/adder_tb.sv:7
+        kernel.schedule_resumable(static_cast<uint64_t>((10 / 2)), kernel.add_resumable([this](uint32_t self) {
+            clk.set((~clk.value())); // sv: tests/adder_tb.sv:7
+            this->kernel.schedule_resumable(this->kernel.time() + static_cast<uint64_t>((10 / 2)), self);
+        }));
+        kernel.set_site(kernel.add_site(scope, "initial", "tests/adder_tb.sv", 34)); // sv: tests/adder_tb.sv:34
         {
             uint64_t t1 = 0;
-            kernel.schedule_at(t1, [this]() {
-                rstn.set(0);
-            });
-            t1 += static_cast<uint64_t>(10);
-            kernel.schedule_at(t1, [this]() {
-                rstn.set(1);
-            });
-            kernel.schedule_at(t1, [this]() {
-                a.set(0);
-            });
-            kernel.schedule_at(t1, [this]() {
-                b.set(0);
-            });
-            t1 += static_cast<uint64_t>(10);
-            kernel.schedule_at(t1, [this]() {
-                a.set(15);
-            });
-            kernel.schedule_at(t1, [this]() {
-                b.set(10);
-            });
-            t1 += static_cast<uint64_t>(10);
-            kernel.schedule_at(t1, [this]() {
-                a.set(25);
-            });
-            kernel.schedule_at(t1, [this]() {
-                b.set(30);
-            });
-            t1 += static_cast<uint64_t>(10);
-            kernel.schedule_at(t1, [this]() { this->kernel.finish(); });
+            kernel.schedule_resumable(t1, kernel.add_resumable([this](uint32_t) {
+                rstn.set(0); // sv: tests/adder_tb.sv:35
+            }));
+            t1 += static_cast<uint64_t>(10); // sv: tests/adder_tb.sv:36
+            kernel.schedule_resumable(t1, kernel.add_resumable([this](uint32_t) {
+                rstn.set(1); // sv: tests/adder_tb.sv:36
+            }));
+            kernel.schedule_resumable(t1, kernel.add_resumable([this](uint32_t) {
+                a.set(0); // sv: tests/adder_tb.sv:37
+            }));
+            kernel.schedule_resumable(t1, kernel.add_resumable([this](uint32_t) {
+                b.set(0); // sv: tests/adder_tb.sv:38
+            }));
+            t1 += static_cast<uint64_t>(10); // sv: tests/adder_tb.sv:40
+            kernel.schedule_resumable(t1, kernel.add_resumable([this](uint32_t) {
+                a.set(15); // sv: tests/adder_tb.sv:41
+            }));
+            kernel.schedule_resumable(t1, kernel.add_resumable([this](uint32_t) {
+                b.set(10); // sv: tests/adder_tb.sv:42
+            }));
+            t1 += static_cast<uint64_t>(10); // sv: tests/adder_tb.sv:44
+            kernel.schedule_resumable(t1, kernel.add_resumable([this](uint32_t) {
+                a.set(25); // sv: tests/adder_tb.sv:45
+            }));
+            kernel.schedule_resumable(t1, kernel.add_resumable([this](uint32_t) {
+                b.set(30); // sv: tests/adder_tb.sv:46
+            }));
+            t1 += static_cast<uint64_t>(10); // sv: tests/adder_tb.sv:48
+            kernel.schedule_resumable(t1, kernel.add_resumable([this](uint32_t) { this->kernel.finish(); })); // sv: tests/adder_tb.sv:49
         }
+        kernel.set_site(kernel.add_site(scope, "initial", "tests/adder_tb.sv", 53)); // sv: tests/adder_tb.sv:53
         {
             uint64_t t2 = 0;
-            kernel.schedule_at(t2, [this]() {
-                this->kernel.register_monitor("Time: %0t | rstn: %b | a: %d | b: %d | sum: %d | product: %d", {sim::MonitorArg::time(), sim::MonitorArg::signalArg(&rstn), sim::MonitorArg::signalArg(&a), sim::MonitorArg::signalArg(&b), sim::MonitorArg::signalArg(&sum), sim::MonitorArg::signalArg(&product)});
-            });
+            {
+                uint32_t monitor = kernel.define_monitor("Time: %0t | rstn: %b | a: %d | b: %d | sum: %d | product: %d", {sim::MonitorArg::time(), sim::MonitorArg::signalArg(&rstn), sim::MonitorArg::signalArg(&a), sim::MonitorArg::signalArg(&b), sim::MonitorArg::signalArg(&sum), sim::MonitorArg::signalArg(&product)}); // sv: tests/adder_tb.sv:54
+                kernel.schedule_resumable(t2, kernel.add_resumable([this, monitor](uint32_t) {
+                    this->kernel.enable_monitor(monitor);
+                }));
+            }
         }
+        kernel.set_site(0);
     }
 
 private:
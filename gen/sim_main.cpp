@@ -3,9 +3,12 @@
 #include "adder.cpp"
 #include "adder_tb.cpp"
 
-int main() {
-    sim::Kernel kernel;
-    gen::adder_tb top(kernel);
-    kernel.run();
-    return 0;
+int main(int argc, char** argv) {
+    sim::BatchOptions options;
+    if (!sim::parseBatchArgs(argc, argv, options))
+        return 1;
+    return sim::runBatch(options, [](sim::Kernel& kernel) {
+        gen::adder_tb top(kernel, "adder_tb");
+        kernel.run();
+    });
 }
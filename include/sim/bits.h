@@ -0,0 +1,108 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include "sim/logic4.h"
+
+namespace sim {
+
+// Word-level helpers for 2-state values held zero-extended in a uint64_t. Generated code
+// and the IR's constant folding both use them, so folded and emitted results agree.
+
+// `value` (canonical at `from` bits, 1..64) sign-extended to 64 bits.
+inline uint64_t sext(uint64_t value, uint32_t from) {
+    uint64_t sign = 1ULL << (from - 1);
+    return (value ^ sign) - sign;
+}
+
+// x / 0 is X in SV; 2-state storage holds that as 0.
+inline uint64_t div2(uint64_t a, uint64_t b) {
+    return b ? a / b : 0;
+}
+
+// Shifts by amounts that may reach 64: SV shifts every bit out, C++ leaves it undefined.
+inline uint64_t shl(uint64_t value, uint64_t amount) {
+    return amount < 64 ? value << amount : 0;
+}
+
+inline uint64_t shr(uint64_t value, uint64_t amount) {
+    return amount < 64 ? value >> amount : 0;
+}
+
+// `>>>` of a signed value canonical at `width` bits; the result is sign-extended to 64 bits.
+inline uint64_t sar(uint64_t value, uint64_t amount, uint32_t width) {
+    return static_cast<uint64_t>(static_cast<int64_t>(sext(value, width)) >>
+                                 (amount < 63 ? amount : 63));
+}
+
+// The `width`-bit part select starting at bit `offset`; bits past the MSB read as 0.
+inline uint64_t bits(uint64_t value, uint64_t offset, uint32_t width) {
+    return shr(value, offset) & widthMask(width);
+}
+
+// Signed comparisons of values canonical at `width` bits.
+inline bool slt(uint64_t a, uint64_t b, uint32_t width) {
+    return static_cast<int64_t>(sext(a, width)) < static_cast<int64_t>(sext(b, width));
+}
+
+inline bool sle(uint64_t a, uint64_t b, uint32_t width) {
+    return static_cast<int64_t>(sext(a, width)) <= static_cast<int64_t>(sext(b, width));
+}
+
+// Reduction `&` of a value canonical at `width` bits (`|` is `value != 0`).
+inline uint64_t red_and(uint64_t value, uint32_t width) {
+    return value == widthMask(width);
+}
+
+// Reduction `^`: one popcnt (or the parity flag) instead of a loop over the bits.
+inline uint64_t parity(uint64_t value) {
+    return static_cast<uint64_t>(std::popcount(value) & 1);
+}
+
+inline uint64_t popcount(uint64_t value) {
+    return static_cast<uint64_t>(std::popcount(value));
+}
+
+// The bits of `value` under `mask`, packed into the low bits in order: a concatenation of
+// selects from one source, as a single pext where BMI2 is available.
+inline uint64_t gather(uint64_t value, uint64_t mask) {
+#if defined(__BMI2__)
+    return _pext_u64(value, mask);
+#else
+    uint64_t out = 0;
+    for (uint64_t bit = 1; mask; bit <<= 1, mask &= mask - 1) {
+        if (value & mask & (~mask + 1))
+            out |= bit;
+    }
+    return out;
+#endif
+}
+
+// The low bits of `value` spread over the set bits of `mask` in order (the inverse of
+// gather): the bits one signal takes from a concatenation target, as a single pdep where BMI2
+// is available.
+inline uint64_t scatter(uint64_t value, uint64_t mask) {
+#if defined(__BMI2__)
+    return _pdep_u64(value, mask);
+#else
+    uint64_t out = 0;
+    for (uint64_t bit = 1; mask; bit <<= 1, mask &= mask - 1) {
+        if (value & bit)
+            out |= mask & (~mask + 1);
+    }
+    return out;
+#endif
+}
+
+// `value` with the bits under `mask` replaced by those of `field`: a part-select or
+// concatenation write merged into the target's current value.
+inline uint64_t deposit(uint64_t value, uint64_t field, uint64_t mask) {
+    return (value & ~mask) | (field & mask);
+}
+
+} // namespace sim
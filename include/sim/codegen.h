@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace slang::ast {
 class InstanceSymbol;
@@ -8,6 +10,42 @@ class InstanceSymbol;
 
 namespace sim {
 
-bool writeCppOutput(const slang::ast::InstanceSymbol& top, const std::string& outputDir);
+struct CodegenOptions {
+    // Number of independent stimulus lanes per signal. 1 emits plain scalar signals; larger
+    // values emit `sim::LaneSignal<N>` storage and lane-parallel process bodies.
+    uint32_t lanes = 1;
+    // Emit 4-state (0/1/X/Z) storage and operations for the signals an X/Z propagation
+    // analysis finds can carry unknowns; all other signals keep the 2-state fast path.
+    bool fourState = false;
+    // Count executions of every process body, function body and `if` arm in a per-class
+    // counter array (written by the generated simulator's `--line-cov <file>`). Off by
+    // default, so uninstrumented builds carry no counters at all.
+    bool coverage = false;
+    // Single-clock synchronous designs (posedge-only always_ff plus combinational logic)
+    // are emitted with a step() per clock edge and driven without the event queue. Designs
+    // that do not qualify fall back to the event kernel with a note saying why.
+    bool cycle = false;
+    // Modules whose instances each run in a separate process (implies `cycle`). Besides
+    // sim_main.cpp, sim_part0.cpp runs the rest of the design and starts sim_part<k> per
+    // instance; boundary signals cross over shared-memory rings once per cycle, which is
+    // why every output of a partitioned module must be registered.
+    std::vector<std::string> partitions;
+    // Run the IR passes (constant propagation, CSE, dead-code elimination, width narrowing)
+    // over every module before emitting it. Off, each expression is emitted as written and
+    // every process and signal is kept.
+    bool optimize = true;
+    // Print each module's IR size and what every pass removed to stderr.
+    bool irStats = false;
+};
+
+// Files touched by a code generation run. Outputs whose contents did not change are left
+// alone on disk so their timestamps (and anything built from them) stay valid.
+struct CodegenResult {
+    std::vector<std::string> written;
+    std::vector<std::string> unchanged;
+};
+
+bool writeCppOutput(const slang::ast::InstanceSymbol& top, const std::string& outputDir,
+                    const CodegenOptions& options = {}, CodegenResult* result = nullptr);
 
 } // namespace sim
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+// Toggle coverage of one signal: the bits that have risen (0->1) and fallen (1->0) at least
+// once, and how often the value changed. Updated on every change from Signal::set (which the
+// NBA commit goes through), so recording is branch-free: two OR-masks and a saturating add.
+struct ToggleCounters {
+    uint64_t rose = 0;
+    uint64_t fell = 0;
+    uint32_t changes = 0;
+
+    void record(uint64_t oldValue, uint64_t newValue) {
+        uint64_t diff = oldValue ^ newValue;
+        rose |= diff & newValue;
+        fell |= diff & oldValue;
+        changes += changes != UINT32_MAX;
+    }
+
+    void merge(const ToggleCounters& other) {
+        rose |= other.rose;
+        fell |= other.fell;
+        uint32_t sum = changes + other.changes;
+        changes = sum < changes ? UINT32_MAX : sum;
+    }
+};
+
+// A toggle coverage database: one entry per tracked signal of one design (identified by the
+// kernel's design signature), accumulated over `runs` runs. Written by `--toggle-cov`,
+// combined by `tools/sim_cov merge`. Defined in runtime.cpp.
+struct ToggleCoverage {
+    uint64_t signature = 0;
+    uint64_t runs = 0;
+    std::vector<std::string> names;
+    std::vector<uint32_t> widths;
+    std::vector<ToggleCounters> counters;
+
+    bool empty() const { return runs == 0; }
+    // Adds `other` to this database; fails (and leaves it unchanged) for another design.
+    bool merge(const ToggleCoverage& other);
+    bool write(const std::string& path) const;
+    bool read(const std::string& path);
+};
+
+// One line/branch coverage point of a generated class (`--coverage`): a process body, a
+// function body or one arm of an `if`. Generated classes hold these in a static table whose
+// order matches their counter array.
+struct CoverPoint {
+    const char* kind;
+    const char* file;
+    uint32_t line;
+};
+
+// A line/branch coverage database: per generated class, its points and how often each was
+// hit, summed over the class's instances and over `runs` runs. Written by `--line-cov`,
+// combined and reported by `tools/sim_cov`. Defined in runtime.cpp.
+struct LineCoverage {
+    struct Module {
+        std::string name;
+        std::vector<std::string> kinds;
+        std::vector<std::string> files;
+        std::vector<uint32_t> lines;
+        std::vector<uint64_t> counts;
+    };
+
+    uint64_t runs = 0;
+    std::vector<Module> modules;
+
+    bool empty() const { return runs == 0; }
+    // Adds `other` to this database; fails (and leaves it unchanged) when a class has other
+    // points than in this one, i.e. the runs were generated from different sources.
+    bool merge(const LineCoverage& other);
+    bool write(const std::string& path) const;
+    bool read(const std::string& path);
+};
+
+} // namespace sim
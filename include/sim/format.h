@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "sim/logic4.h"
+
+namespace sim {
+
+// Formats one `$monitor` argument for the conversion `spec` ("b", "0h", "d", "0t", ...) and
+// appends it to `out`; returns false for a conversion it does not know. Shared by the
+// interpreter and the generated-code kernel so both print the same text. %b and %h/%x print
+// every digit of the value's width (x/z for unknown digits, X/Z when only part of a hex digit
+// is unknown); the 0-prefixed forms drop leading zeros. %d and %t print unpadded decimal.
+inline bool formatMonitorValue(std::string& out, std::string_view spec, uint64_t value,
+                               uint64_t unknown, uint32_t width) {
+    bool compact = spec.size() == 2 && spec[0] == '0';
+    char conv = spec.empty() ? '\0' : spec.back();
+    if (conv >= 'A' && conv <= 'Z')
+        conv = char(conv - 'A' + 'a');
+    if (width == 0)
+        width = 1;
+    if (width > 64)
+        width = 64;
+    value &= widthMask(width);
+    unknown &= widthMask(width);
+
+    if (conv == 'b' || conv == 'h' || conv == 'x') {
+        uint32_t digitBits = conv == 'b' ? 1 : 4;
+        uint32_t digits = (width + digitBits - 1) / digitBits;
+        std::string text;
+        for (int digit = int(digits) - 1; digit >= 0; --digit) {
+            uint32_t shift = uint32_t(digit) * digitBits;
+            uint32_t bits = std::min(digitBits, width - shift);
+            uint64_t mask = widthMask(bits);
+            uint64_t v = (value >> shift) & mask;
+            uint64_t u = (unknown >> shift) & mask;
+            if (u == 0)
+                text.push_back("0123456789abcdef"[v]);
+            else if (u == mask)
+                text.push_back((v & u) ? 'x' : 'z');
+            else
+                text.push_back((v & u) ? 'X' : 'Z');
+        }
+        if (compact) {
+            size_t first = text.find_first_not_of('0');
+            text.erase(0, first == std::string::npos ? text.size() - 1 : first);
+        }
+        out += text;
+        return true;
+    }
+    if (conv == 'd' || conv == 't') {
+        if (unknown == 0) {
+            out += std::to_string(value);
+        } else if (unknown == widthMask(width)) {
+            // All bits unknown prints lowercase x (or z); a partial unknown prints X/Z.
+            out.push_back((value & unknown) ? 'x' : 'z');
+        } else {
+            out.push_back((value & unknown) ? 'X' : 'Z');
+        }
+        return true;
+    }
+    return false;
+}
+
+} // namespace sim
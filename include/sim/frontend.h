@@ -1,14 +1,21 @@
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
 
+namespace slang {
+class SourceManager;
+}
+
 namespace slang::ast {
 class Compilation;
+class InstanceBodySymbol;
 class InstanceSymbol;
+class Scope;
 }
 
 namespace slang::syntax {
@@ -18,9 +25,37 @@ class SyntaxTree;
 namespace sim {
 
 std::optional<std::shared_ptr<slang::syntax::SyntaxTree>> loadFile(const std::string& path);
+// Parses `text` as the file `path` into `sourceManager`, which must outlive the tree; its
+// includes are read into the same manager.
+std::optional<std::shared_ptr<slang::syntax::SyntaxTree>> loadText(
+    const std::string& path, std::string_view text, slang::SourceManager& sourceManager);
 const slang::ast::InstanceSymbol* findTop(slang::ast::Compilation& compilation,
                                           std::string_view name);
 
+// Registers the simulator's own system tasks (`$sim_fork`) so they elaborate; call before
+// adding syntax trees.
+void registerSystemTasks(slang::ast::Compilation& compilation);
+
+// A child instance and its hierarchical name below the parent: `prefix`, or, for a replica
+// of a generate-for loop or instance array, `prefix[index]suffix` with `index` the innermost
+// replicated dimension (outer ones are part of the prefix). Replicas of one instantiation
+// share `prefix` and `suffix` and differ only in `index`.
+struct ChildInstance {
+    const slang::ast::InstanceSymbol* symbol = nullptr;
+    std::string prefix;
+    std::optional<int64_t> index;
+    std::string suffix;
+
+    std::string path() const;
+};
+
+// The instances a module body creates, in declaration order: direct children, elements of
+// instance arrays and instances inside instantiated generate blocks (at any depth).
+std::vector<ChildInstance> childInstances(const slang::ast::InstanceBodySymbol& body);
+
+// Prints all compilation diagnostics; returns false if any of them are errors.
+bool reportDiagnostics(slang::ast::Compilation& compilation);
+
 bool writeAstJson(const std::vector<std::shared_ptr<slang::syntax::SyntaxTree>>& trees,
                   const std::string& outputPath);
 
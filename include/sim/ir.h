@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "sim/bits.h"
+
+namespace sim::ir {
+
+// The simulator IR of one module: its signals, the processes driving them and the
+// expressions those processes evaluate, as one DAG per module. Independent of slang; the
+// frontend lowers to it (sim/ir_lower.h) and the passes below rewrite it in place. Values
+// are 2-state words of at most 64 bits, held zero-extended in a uint64_t.
+
+using NodeId = uint32_t;
+constexpr NodeId kNoNode = ~0U;
+constexpr uint32_t kNoSignal = ~0U;
+
+enum class Op : uint8_t {
+    Const,    // `value`
+    Signal,   // the signal with index `value`
+    MemRead,  // word `a` (already offset by the array's lower bound) of memory `value`
+    Opaque,   // an expression the IR does not model; `value` is the frontend's handle
+    Trunc,    // `a` masked to `width` bits
+    Sext,     // `a` sign-extended from `value` bits
+    Not,
+    LogicNot,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    And,
+    Or,
+    Xor,
+    LogicAnd,
+    LogicOr,
+    Shl,      // `a` << `b`; amounts of 64 or more give 0
+    Shr,      // `a` >> `b`, logical
+    Sar,      // `a` (signed at `value` bits) >>> `b`
+    Eq,
+    Ne,
+    Lt,       // unsigned
+    Le,
+    Slt,      // signed, operands canonical at `value` bits
+    Sle,
+    RedAnd,   // `&a` with `a` canonical at `value` bits
+    RedOr,
+    RedXor,
+    Gather    // the bits of `a` under mask `value`, packed into the low bits (pext)
+};
+
+// Nodes are stored operands first, so a pass can rewrite a module front to back. Only
+// Trunc and Sext produce a canonical value from a non-canonical one: Add, Sub, Mul, Not, Shl
+// and Sar may leave bits set above `width`, which is why lowering follows them with a Trunc.
+struct Node {
+    Op op = Op::Const;
+    uint32_t width = 1;
+    NodeId a = kNoNode;
+    NodeId b = kNoNode;
+    uint64_t value = 0;
+};
+
+struct Signal {
+    std::string name;
+    uint32_t width = 1;
+    bool memory = false;
+    // Read by something the IR does not model: a port, an initial block, a child instance,
+    // a function. Observed signals and the processes feeding them are never removed.
+    bool observed = false;
+    // Written by something the IR does not model (or initialized): never constant-folded
+    // or narrowed.
+    bool driven = false;
+    bool live = true;
+    // Upper bound on the significant bits of the value, set by width narrowing.
+    uint32_t bits = 64;
+};
+
+// An expression a process evaluates: an assignment's right-hand side (`target` is the
+// signal it writes), an `if` condition or a memory address. `demand` is how many low bits
+// of the value the consumer looks at: the target's width for an assignment, since every
+// write masks to it, and 64 when the exact value matters.
+struct Root {
+    NodeId node = kNoNode;
+    uint32_t demand = 64;
+    uint32_t target = kNoSignal;
+};
+
+enum class ProcessKind : uint8_t {
+    Assign,
+    Comb,
+    Seq
+};
+
+struct Process {
+    ProcessKind kind = ProcessKind::Assign;
+    // Indices in Module::roots.
+    std::vector<uint32_t> roots;
+    // Signals read besides through the roots (clock and reset events).
+    std::vector<uint32_t> reads;
+    std::vector<uint32_t> writes;
+    // Calls into code the IR cannot see (functions, DPI, system tasks) or has statements it
+    // does not model; such processes are kept as they are.
+    bool sideEffects = false;
+    bool live = true;
+};
+
+struct Module {
+    std::string name;
+    std::vector<Signal> signals;
+    std::vector<Node> nodes;
+    std::vector<Root> roots;
+    std::vector<Process> processes;
+
+    NodeId add(const Node& node);
+    NodeId constant(uint64_t value, uint32_t width);
+    uint32_t addRoot(NodeId node, uint32_t demand, uint32_t target = kNoSignal);
+
+    size_t liveProcesses() const;
+    size_t liveSignals() const;
+};
+
+// What one pass removed. `nodes` is the net drop in expression nodes reachable from live
+// processes; `bits` counts signal bits width narrowing proved to be always zero.
+struct PassStats {
+    const char* pass = "";
+    uint32_t nodes = 0;
+    uint32_t processes = 0;
+    uint32_t signals = 0;
+    uint32_t bits = 0;
+};
+
+// Folds constant subexpressions and algebraic identities, then replaces reads of signals
+// whose only driver is a continuous assignment of a constant (parameters are constants
+// already) and folds again, until nothing changes.
+PassStats propagateConstants(Module& module);
+// Merges structurally equal nodes across all processes of the module.
+PassStats eliminateCommonSubexpressions(Module& module);
+// Removes processes whose results nobody observes, the signals only they wrote and the
+// nodes no live process evaluates.
+PassStats eliminateDeadCode(Module& module);
+// Bounds every signal's significant bits from its drivers, then drops masks that cannot
+// change a value or whose high bits no consumer looks at.
+PassStats narrowWidths(Module& module);
+
+// All four, in the order above.
+std::vector<PassStats> optimize(Module& module);
+
+// Per node, whether a backend should compute it once per evaluation of a root instead of at
+// every use: operator and memory-read nodes with more than one user (what CSE merged) and no
+// Opaque node below them, so computing them early cannot change what a call observes.
+std::vector<char> sharedNodes(const Module& module);
+
+// The module's size before the passes, then one line per pass with what it removed.
+void printStats(std::ostream& out, const Module& module, const std::vector<PassStats>& stats);
+
+// The value of an operator node (not Const, Signal, MemRead or Opaque) given its operand
+// values. Shared by constant folding and the interpreter so both agree with the emitted C++.
+inline uint64_t apply(const Node& node, uint64_t a, uint64_t b) {
+    switch (node.op) {
+        case Op::Trunc:
+            return a & widthMask(node.width);
+        case Op::Sext:
+            return sext(a, static_cast<uint32_t>(node.value));
+        case Op::Not:
+            return ~a;
+        case Op::LogicNot:
+            return a == 0;
+        case Op::Add:
+            return a + b;
+        case Op::Sub:
+            return a - b;
+        case Op::Mul:
+            return a * b;
+        case Op::Div:
+            return div2(a, b);
+        case Op::And:
+            return a & b;
+        case Op::Or:
+            return a | b;
+        case Op::Xor:
+            return a ^ b;
+        case Op::LogicAnd:
+            return a != 0 && b != 0;
+        case Op::LogicOr:
+            return a != 0 || b != 0;
+        case Op::Shl:
+            return shl(a, b);
+        case Op::Shr:
+            return shr(a, b);
+        case Op::Sar:
+            return sar(a, b, static_cast<uint32_t>(node.value));
+        case Op::Eq:
+            return a == b;
+        case Op::Ne:
+            return a != b;
+        case Op::Lt:
+            return a < b;
+        case Op::Le:
+            return a <= b;
+        case Op::Slt:
+            return slt(a, b, static_cast<uint32_t>(node.value));
+        case Op::Sle:
+            return sle(a, b, static_cast<uint32_t>(node.value));
+        case Op::RedAnd:
+            return red_and(a, static_cast<uint32_t>(node.value));
+        case Op::RedOr:
+            return a != 0;
+        case Op::RedXor:
+            return parity(a);
+        case Op::Gather:
+            return gather(a, node.value);
+        default:
+            return 0;
+    }
+}
+
+} // namespace sim::ir
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "sim/ir.h"
+
+namespace slang::ast {
+class CallExpression;
+class CaseStatement;
+class Expression;
+class ForLoopStatement;
+class InstanceBodySymbol;
+class Scope;
+class Symbol;
+class ValueSymbol;
+}
+
+namespace sim {
+
+// A module lowered to the IR, with the way back to the AST the backends still walk for
+// statements. Continuous assignments, always_comb and always_ff blocks made of blocks,
+// `if`s and assignments become IR processes; every expression they evaluate becomes a
+// root. Everything else (initial blocks, functions, child instances, other statements)
+// stays with the AST, and the signals it touches are marked observed and driven.
+struct LoweredModule {
+    ir::Module ir;
+    // Per IR signal, its symbol.
+    std::vector<const slang::ast::ValueSymbol*> symbols;
+    // Per Opaque node handle, the expression to emit instead.
+    std::vector<const slang::ast::Expression*> opaque;
+    std::unordered_map<const slang::ast::Expression*, uint32_t> roots;
+    std::unordered_map<const slang::ast::Symbol*, uint32_t> processes;
+    std::unordered_map<const slang::ast::ValueSymbol*, uint32_t> signals;
+    std::vector<ir::PassStats> stats;
+    // Per node, ir::sharedNodes: computed once per evaluation of a root by both backends.
+    std::vector<char> shared;
+
+    // The (optimized) node computing `expr`, or kNoNode if `expr` is not a root.
+    ir::NodeId node(const slang::ast::Expression& expr) const;
+    // False once dead-code elimination removed the continuous assignment or block.
+    bool live(const slang::ast::Symbol& process) const;
+    bool liveSignal(const slang::ast::ValueSymbol& signal) const;
+};
+
+// Lowers `body` and, with `optimize`, runs the IR passes over it.
+LoweredModule lowerModule(const slang::ast::InstanceBodySymbol& body, bool optimize);
+
+// The value of a constant index or label: literals, parameters and arithmetic on them.
+std::optional<int64_t> constantInt(const slang::ast::Expression& expr);
+
+// `expr` run through slang's constant evaluator in `scope`, for calls whose arguments only
+// involve literals and parameters. nullopt unless the result is a known integer of at most
+// 64 bits.
+std::optional<uint64_t> evalConstant(const slang::ast::Expression& expr,
+                                     const slang::ast::Scope& scope);
+
+// A constant packed select of a whole signal, as port connections like `.a(data[i])` or
+// `.y(out[2*i +: 2])` in a generate-for make them: `width` bits of `signal` from bit
+// `offset`. A plain reference is the whole signal. nullopt for anything else, including
+// selects of unpacked arrays and signals wider than 64 bits.
+struct SignalSlice {
+    const slang::ast::ValueSymbol* signal = nullptr;
+    uint32_t offset = 0;
+    uint32_t width = 0;
+    bool whole = true;
+};
+
+std::optional<SignalSlice> signalSlice(const slang::ast::Expression& expr);
+
+// Calls that draw from the calling process's random stream (sim/random.h).
+enum class RandomCall : uint8_t {
+    None,
+    Urandom,       // `$urandom[(seed)]`
+    UrandomRange,  // `$urandom_range(max[, min])`
+    Random,        // `$random[(seed)]`
+    Randomize      // `std::randomize(vars...)`
+};
+
+RandomCall randomCall(const slang::ast::CallExpression& call);
+// A `std::randomize` with an inline `with` block, which neither backend solves: it returns 0
+// and leaves its variables alone.
+bool constrainedRandomize(const slang::ast::CallExpression& call);
+// Whether `symbol` (a process or function) contains a random call.
+bool usesRandom(const slang::ast::Symbol& symbol);
+
+// A constant case item as `(selector & mask) == value`, with casez/casex wildcard bits left
+// out of the mask. `never` marks items no 2-state selector matches (x/z bits in a plain
+// `case`). nullopt for items that are not constant.
+struct CasePattern {
+    uint64_t value = 0;
+    uint64_t mask = 0;
+    bool never = false;
+};
+
+std::optional<CasePattern> casePattern(const slang::ast::CaseStatement& stmt,
+                                       const slang::ast::Expression& item);
+
+// A loop body of the form `acc = acc OP x[i]` (or `acc OP= x[i]`) over bits of a packed
+// vector: the whole loop is `acc OP (reduction of count bits of x starting at offset)`.
+// `op` is Xor, Or, And or Add (counting ones).
+struct LoopReduction {
+    const slang::ast::ValueSymbol* acc = nullptr;
+    const slang::ast::Expression* source = nullptr;
+    ir::Op op = ir::Op::Xor;
+    uint32_t offset = 0;
+    uint32_t count = 0;
+
+    uint64_t apply(uint64_t accValue, uint64_t sourceValue) const {
+        uint64_t part = bits(sourceValue, offset, count);
+        switch (op) {
+            case ir::Op::Xor:
+                return accValue ^ parity(part);
+            case ir::Op::Or:
+                return accValue | (part != 0);
+            case ir::Op::And:
+                return accValue & red_and(part, count);
+            default:
+                return accValue + popcount(part);
+        }
+    }
+};
+
+// A `for` loop whose trip count is known at elaboration time: one variable, started at a
+// constant, compared against a constant and stepped by a constant, and not written by the
+// body. `values` are the variable's values in iteration order (canonical at its width) and
+// `exit` the value it leaves with; `declared` is set when the loop declares the variable.
+struct ConstantLoop {
+    const slang::ast::ValueSymbol* var = nullptr;
+    uint32_t width = 0;
+    bool declared = false;
+    std::vector<uint64_t> values;
+    uint64_t exit = 0;
+    std::optional<LoopReduction> reduction;
+};
+
+std::optional<ConstantLoop> constantLoop(const slang::ast::ForLoopStatement& loop);
+
+} // namespace sim
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+
+namespace sim {
+
+// Packed 4-state value using the aval/bval encoding of the Verilog PLI: for each bit,
+// `unknown` (bval) clear means `value` (aval) holds 0/1; bval set means X when aval is 1
+// and Z when aval is 0. Operations produce X (never Z) for unknown result bits.
+struct Logic4 {
+    uint64_t value = 0;
+    uint64_t unknown = 0;
+
+    bool isKnown() const { return unknown == 0; }
+};
+
+inline uint64_t widthMask(uint32_t width) {
+    return width >= 64 ? ~0ULL : ((1ULL << width) - 1);
+}
+
+inline Logic4 l4_all_x(uint32_t width) {
+    return {widthMask(width), widthMask(width)};
+}
+
+inline Logic4 l4_all_z(uint32_t width) {
+    return {0, widthMask(width)};
+}
+
+// True only when at least one bit is a known 1; X/Z conditions take the else branch.
+inline bool l4_true(Logic4 a) {
+    return (a.value & ~a.unknown) != 0;
+}
+
+inline Logic4 l4_not(Logic4 a, uint32_t width) {
+    uint64_t mask = widthMask(width);
+    return {(~a.value | a.unknown) & mask, a.unknown & mask};
+}
+
+inline Logic4 l4_and(Logic4 a, Logic4 b, uint32_t width) {
+    uint64_t mask = widthMask(width);
+    uint64_t zero = (~a.value & ~a.unknown) | (~b.value & ~b.unknown);
+    uint64_t one = (a.value & ~a.unknown) & (b.value & ~b.unknown);
+    uint64_t unknown = ~(zero | one) & mask;
+    return {(one | unknown) & mask, unknown};
+}
+
+inline Logic4 l4_or(Logic4 a, Logic4 b, uint32_t width) {
+    uint64_t mask = widthMask(width);
+    uint64_t one = (a.value & ~a.unknown) | (b.value & ~b.unknown);
+    uint64_t zero = (~a.value & ~a.unknown) & (~b.value & ~b.unknown);
+    uint64_t unknown = ~(zero | one) & mask;
+    return {(one | unknown) & mask, unknown};
+}
+
+inline Logic4 l4_xor(Logic4 a, Logic4 b, uint32_t width) {
+    uint64_t mask = widthMask(width);
+    uint64_t unknown = (a.unknown | b.unknown) & mask;
+    return {((a.value ^ b.value) | unknown) & mask, unknown};
+}
+
+// Arithmetic on a value with any unknown bit yields all X (IEEE 1800 11.4.3).
+inline Logic4 l4_add(Logic4 a, Logic4 b, uint32_t width) {
+    if (a.unknown | b.unknown)
+        return l4_all_x(width);
+    return {(a.value + b.value) & widthMask(width), 0};
+}
+
+inline Logic4 l4_sub(Logic4 a, Logic4 b, uint32_t width) {
+    if (a.unknown | b.unknown)
+        return l4_all_x(width);
+    return {(a.value - b.value) & widthMask(width), 0};
+}
+
+inline Logic4 l4_mul(Logic4 a, Logic4 b, uint32_t width) {
+    if (a.unknown | b.unknown)
+        return l4_all_x(width);
+    return {(a.value * b.value) & widthMask(width), 0};
+}
+
+inline Logic4 l4_div(Logic4 a, Logic4 b, uint32_t width) {
+    if ((a.unknown | b.unknown) || b.value == 0)
+        return l4_all_x(width);
+    return {(a.value / b.value) & widthMask(width), 0};
+}
+
+inline Logic4 l4_lnot(Logic4 a) {
+    if (l4_true(a))
+        return {0, 0};
+    if (a.unknown)
+        return {1, 1};
+    return {1, 0};
+}
+
+inline Logic4 l4_land(Logic4 a, Logic4 b) {
+    bool aFalse = (a.value | a.unknown) == 0;
+    bool bFalse = (b.value | b.unknown) == 0;
+    if (aFalse || bFalse)
+        return {0, 0};
+    if (l4_true(a) && l4_true(b))
+        return {1, 0};
+    return {1, 1};
+}
+
+inline Logic4 l4_lor(Logic4 a, Logic4 b) {
+    if (l4_true(a) || l4_true(b))
+        return {1, 0};
+    if (a.unknown | b.unknown)
+        return {1, 1};
+    return {0, 0};
+}
+
+inline Logic4 l4_eq(Logic4 a, Logic4 b) {
+    // Any known differing bit decides the result even if other bits are unknown.
+    uint64_t known = ~(a.unknown | b.unknown);
+    if ((a.value ^ b.value) & known)
+        return {0, 0};
+    if (a.unknown | b.unknown)
+        return {1, 1};
+    return {1, 0};
+}
+
+inline Logic4 l4_ne(Logic4 a, Logic4 b) {
+    Logic4 eq = l4_eq(a, b);
+    return eq.unknown ? eq : Logic4{eq.value ^ 1, 0};
+}
+
+// `===`/`!==` compare X and Z bits literally and always produce a known result.
+inline Logic4 l4_case_eq(Logic4 a, Logic4 b) {
+    return {(a.value == b.value && a.unknown == b.unknown) ? 1ULL : 0ULL, 0};
+}
+
+} // namespace sim
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sim/logic4.h"
+
+namespace sim {
+
+// Word storage for an unpacked array of up to 64-bit elements (`logic [W-1:0] m [N]`),
+// addressed by offset from the array's lowest index. Arrays of up to kDenseWords words are
+// one flat vector; larger ones use a two-level page table whose pages are allocated on the
+// first nonzero write, so a 2**30-word DRAM model only costs the pages it touches.
+// Unwritten and out-of-range words read as 0; out-of-range writes are dropped.
+class MemoryStorage {
+public:
+    static constexpr uint64_t kDenseWords = 1ULL << 16;
+    static constexpr uint32_t kPageBits = 12; // 4096 words (32 KiB) per page
+    static constexpr uint32_t kTableBits = 10; // 1024 pages per second-level table
+    static constexpr uint64_t kPageWords = 1ULL << kPageBits;
+
+    MemoryStorage(uint32_t width, uint64_t depth)
+        : width_(width ? width : 1), depth_(depth), mask_(widthMask(width_)),
+          sparse_(depth > kDenseWords) {
+        if (sparse_) {
+            uint64_t pages = (depth + kPageWords - 1) >> kPageBits;
+            tables_.resize(static_cast<size_t>((pages + kTableSize - 1) >> kTableBits));
+        } else {
+            dense_.assign(static_cast<size_t>(depth), 0);
+        }
+    }
+
+    uint32_t width() const { return width_; }
+    uint64_t depth() const { return depth_; }
+    bool sparse() const { return sparse_; }
+    uint64_t allocated_pages() const { return allocatedPages_; }
+
+    uint64_t read(uint64_t addr) const {
+        if (addr >= depth_)
+            return 0;
+        if (!sparse_)
+            return dense_[addr];
+        const uint64_t* page = findPage(addr >> kPageBits);
+        return page ? page[addr & (kPageWords - 1)] : 0;
+    }
+
+    // Returns true when the stored word changed, which is what wakes the array's readers.
+    bool write(uint64_t addr, uint64_t value) {
+        if (addr >= depth_)
+            return false;
+        value &= mask_;
+        uint64_t* slot = nullptr;
+        if (!sparse_) {
+            slot = &dense_[addr];
+        } else {
+            uint64_t* page = findPage(addr >> kPageBits);
+            if (!page) {
+                if (value == 0)
+                    return false;
+                page = allocatePage(addr >> kPageBits);
+            }
+            slot = &page[addr & (kPageWords - 1)];
+        }
+        if (*slot == value)
+            return false;
+        *slot = value;
+        return true;
+    }
+
+    // Address of a stored word for in-place access (DPI open arrays), allocating its page
+    // when sparse; nullptr when out of range. Writes through it bypass change detection.
+    uint64_t* word_ptr(uint64_t addr) {
+        if (addr >= depth_)
+            return nullptr;
+        if (!sparse_)
+            return &dense_[addr];
+        uint64_t* page = findPage(addr >> kPageBits);
+        if (!page)
+            page = allocatePage(addr >> kPageBits);
+        return &page[addr & (kPageWords - 1)];
+    }
+    // The flat word array of a dense memory; nullptr when sparse.
+    uint64_t* dense_data() { return sparse_ ? nullptr : dense_.data(); }
+
+    // Drops every word back to 0 (and releases sparse pages).
+    void clear() {
+        if (sparse_) {
+            for (auto& table : tables_)
+                table.reset();
+            allocatedPages_ = 0;
+        } else {
+            std::fill(dense_.begin(), dense_.end(), 0);
+        }
+    }
+
+    // Calls fn(firstAddr, words, count) for every stored run of words: the whole array when
+    // dense, each allocated page when sparse.
+    template<typename Fn>
+    void for_each_block(Fn&& fn) const {
+        if (!sparse_) {
+            if (depth_)
+                fn(uint64_t{0}, dense_.data(), depth_);
+            return;
+        }
+        for (size_t t = 0; t < tables_.size(); ++t) {
+            if (!tables_[t])
+                continue;
+            for (size_t p = 0; p < kTableSize; ++p) {
+                const auto& page = (*tables_[t])[p];
+                if (!page)
+                    continue;
+                uint64_t first = ((static_cast<uint64_t>(t) << kTableBits) + p) << kPageBits;
+                fn(first, page.get(), std::min(kPageWords, depth_ - first));
+            }
+        }
+    }
+
+private:
+    static constexpr size_t kTableSize = size_t{1} << kTableBits;
+    using Table = std::array<std::unique_ptr<uint64_t[]>, kTableSize>;
+
+    uint64_t* findPage(uint64_t page) const {
+        const auto& table = tables_[static_cast<size_t>(page >> kTableBits)];
+        return table ? (*table)[page & (kTableSize - 1)].get() : nullptr;
+    }
+
+    uint64_t* allocatePage(uint64_t page) {
+        auto& table = tables_[static_cast<size_t>(page >> kTableBits)];
+        if (!table)
+            table = std::make_unique<Table>();
+        auto& slot = (*table)[page & (kTableSize - 1)];
+        slot = std::make_unique<uint64_t[]>(kPageWords);
+        allocatedPages_++;
+        return slot.get();
+    }
+
+    uint32_t width_ = 1;
+    uint64_t depth_ = 0;
+    uint64_t mask_ = 0;
+    bool sparse_ = false;
+    uint64_t allocatedPages_ = 0;
+    std::vector<uint64_t> dense_;
+    std::vector<std::unique_ptr<Table>> tables_;
+};
+
+// Memory image files for `$readmemh`/`$readmemb` and `$writememh`/`$writememb` (IEEE 1800
+// 21.4). Addresses (`start`, `end` and `@addr` directives in the file) are SV array indices;
+// `lower` is the array's lowest index. Without `start` loading begins at `lower` and runs
+// upwards; with `end < start` it runs downwards. Words are 2-state: x/z digits load as 0.
+// Both print a diagnostic and return false on failure; defined in runtime.cpp.
+enum class MemFileFormat {
+    Hex,
+    Binary
+};
+
+constexpr int64_t kNoAddress = INT64_MIN;
+
+// Loads through mmap with a SIMD-assisted digit parser that writes straight into `storage`;
+// `changed` is set when any stored word changed.
+bool readMemFile(MemoryStorage& storage, int64_t lower, const std::string& path,
+                 MemFileFormat format, int64_t start, int64_t end, bool& changed);
+// Writes one word per line. Sparse storage only writes allocated pages, each preceded by an
+// `@addr` line, so dumping a mostly empty 2**30-word array stays small and reloads exactly.
+bool writeMemFile(const MemoryStorage& storage, int64_t lower, const std::string& path,
+                  MemFileFormat format, int64_t start, int64_t end);
+
+} // namespace sim
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace sim {
+
+// Multi-process simulation of a design generated with `--partition` (cycle mode only).
+// Partition 0 runs the top and stands in for every partitioned instance; partition k runs
+// the k-th partitioned instance in its own executable. After each cycle every process sends
+// the boundary signals it drives that changed, as one frame over a single-producer
+// single-consumer ring in shared memory. A frame-end message closes the frame, and is the
+// null message when nothing changed. Partitioned modules have registered outputs, so a
+// process can compute cycle n as soon as its peer's frame n-1 arrived: that one-cycle
+// lookahead is the whole of the time synchronization.
+struct PartitionMessage {
+    static constexpr uint32_t kFrameEnd = ~0U;
+
+    // Index in the partitioned module's port list, or kFrameEnd.
+    uint32_t port = 0;
+    uint32_t reserved = 0;
+    // The port's new value; the frame's cycle for kFrameEnd.
+    uint64_t value = 0;
+};
+
+// One direction between two partitions, in the shared region. The producer owns `head` and
+// the consumer `tail`, each on its own cache line; a release store of `head` publishes the
+// slots before it.
+struct PartitionRing {
+    static constexpr uint64_t kSlots = 1ULL << 12;
+
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) PartitionMessage slots[kSlots];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "partition rings need address-free atomics");
+
+class Partition;
+
+// A process's rings to and from one peer. Each side keeps its own index and a cached copy
+// of the other side's, so the shared counters are only touched once per frame or when the
+// cached view runs out.
+class PartitionLink {
+public:
+    // Queues an update of `port` for the peer; it is published with the frame.
+    void send(uint32_t port, uint64_t value) {
+        if (head_ - tailCache_ == PartitionRing::kSlots && !waitForSpace())
+            return;
+        out_->slots[head_ & (PartitionRing::kSlots - 1)] = {port, 0, value};
+        head_++;
+    }
+
+    // Closes frame `cycle` and publishes it.
+    void end_frame(uint64_t cycle) {
+        send(PartitionMessage::kFrameEnd, cycle);
+        out_->head.store(head_, std::memory_order_release);
+    }
+
+    // Passes every update of the peer's frame `cycle` to fn(port, value), waiting for them.
+    // False once the run was aborted: a process failed or the frames got out of step.
+    template<typename Fn>
+    bool receive(uint64_t cycle, Fn&& fn) {
+        while (true) {
+            if (tail_ == headCache_ && !waitForData())
+                return false;
+            const PartitionMessage& message = in_->slots[tail_ & (PartitionRing::kSlots - 1)];
+            tail_++;
+            if (message.port == PartitionMessage::kFrameEnd) {
+                in_->tail.store(tail_, std::memory_order_release);
+                return message.value == cycle || outOfStep(cycle, message.value);
+            }
+            fn(message.port, message.value);
+        }
+    }
+
+private:
+    friend class Partition;
+
+    bool waitForSpace();
+    bool waitForData();
+    bool outOfStep(uint64_t expected, uint64_t received);
+
+    Partition* owner_ = nullptr;
+    PartitionRing* out_ = nullptr;
+    PartitionRing* in_ = nullptr;
+    uint64_t head_ = 0;
+    uint64_t tailCache_ = 0;
+    uint64_t tail_ = 0;
+    uint64_t headCache_ = 0;
+};
+
+// The processes of one partitioned run and the shared region (`/dev/shm/sim_part.<pid>`)
+// holding their rings. Defined in runtime.cpp.
+class Partition {
+public:
+    Partition() = default;
+    Partition(const Partition&) = delete;
+    Partition& operator=(const Partition&) = delete;
+    ~Partition();
+
+    // Partition 0: creates the region and starts one executable per partitioned instance.
+    // `parts` pairs each instance's hierarchical path with its executable, which must sit
+    // next to this one; each is passed `args` plus --partition-region/--partition-index.
+    bool start(const std::vector<std::pair<std::string, std::string>>& parts,
+               const std::vector<std::string>& args);
+    // Partition k: attaches to the region partition 0 created.
+    bool attach(const std::string& region, uint32_t index);
+    // Partition 0 waits for the other processes; false if any of them failed.
+    bool finish();
+
+    uint32_t index() const { return index_; }
+    // In partition 0, the link to the process running the instance at `scope` (nullptr for
+    // any other path); elsewhere the link to partition 0.
+    PartitionLink* link(std::string_view scope);
+    // Set once any process gave up; every wait returns false from then on.
+    bool failed() const;
+    void abort();
+
+private:
+    friend class PartitionLink;
+    struct Region;
+
+    bool map(bool create, uint32_t parts);
+    // Called between spins of a wait on `link`; false when the wait should give up.
+    bool keepWaiting(uint32_t spins, const PartitionLink* link);
+
+    std::string name_;
+    uint32_t index_ = 0;
+    Region* region_ = nullptr;
+    size_t size_ = 0;
+    bool created_ = false;
+    pid_t root_ = 0;
+    std::vector<std::string> scopes_;
+    std::vector<PartitionLink> links_;
+    std::vector<pid_t> children_;
+    // Per child, its exit code once reaped; -1 while it runs.
+    std::vector<int> exitCodes_;
+};
+
+} // namespace sim
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace sim {
+
+class Kernel;
+
+// Random numbers for `$urandom`, `$urandom_range`, `$random` and `std::randomize`. Every
+// process draws from its own xoshiro256** stream, seeded from the run's seed and the
+// process's hierarchical name: no state is shared between processes or threads, and a
+// process sees the same values however instances are spread over threads. Used by generated
+// code (through sim::ProcessRandom) and the interpreter alike.
+
+inline uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+class Random {
+public:
+    Random() { reseed(0, {}); }
+    Random(uint64_t seed, std::string_view name) { reseed(seed, name); }
+
+    void reseed(uint64_t seed, std::string_view name) {
+        // FNV-1a of the name, mixed into the seed and expanded by splitmix64.
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (char c : name)
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+        uint64_t state = seed;
+        state = splitmix64(state) ^ hash;
+        for (auto& word : s_)
+            word = splitmix64(state);
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(s_[1] * 5, 7) * 9;
+        uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    // `$urandom` (and `$random`, whose 32 bits are read as signed).
+    uint32_t urandom() { return static_cast<uint32_t>(next() >> 32); }
+
+    // `$urandom_range(a, b)`: uniform over [min(a, b), max(a, b)], by multiply-shift.
+    uint32_t urandom_range(uint64_t a, uint64_t b) {
+        uint32_t lo = static_cast<uint32_t>(a < b ? a : b);
+        uint32_t hi = static_cast<uint32_t>(a < b ? b : a);
+        uint64_t span = static_cast<uint64_t>(hi - lo) + 1;
+        return lo + static_cast<uint32_t>((static_cast<uint64_t>(urandom()) * span) >> 32);
+    }
+
+    // A `width`-bit value (1..64), for `std::randomize` of a scalar.
+    uint64_t bits(uint32_t width) {
+        uint64_t value = next();
+        return width >= 64 ? value : value >> (64 - width);
+    }
+
+private:
+    // Snapshots save and restore the state words.
+    friend class Kernel;
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    uint64_t s_[4];
+};
+
+// `$random(seed)`: the value for a 32-bit seed variable and the seed's next state. Like the
+// standard's, the sequence depends on the variable alone, not on the calling process; the
+// generator differs, so the values do not match other simulators.
+struct SeededRandom {
+    uint32_t value = 0;
+    uint32_t seed = 0;
+};
+
+inline SeededRandom random_step(uint64_t seed) {
+    uint64_t state = seed & 0xffffffffULL;
+    uint64_t z = splitmix64(state);
+    return {static_cast<uint32_t>(z >> 32), static_cast<uint32_t>(z)};
+}
+
+} // namespace sim
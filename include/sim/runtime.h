@@ -1,18 +1,38 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
 #include <cstdint>
 #include <deque>
 #include <functional>
+#include <initializer_list>
+#include <iosfwd>
 #include <memory>
+#include <new>
 #include <queue>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+#include "sim/bits.h"
+#include "sim/coverage.h"
+#include "sim/logic4.h"
+#include "sim/memory.h"
+#include "sim/random.h"
+#include "sim/svdpi.h"
+
 namespace sim {
 
+class DpiOut;
 class Kernel;
+class Memory;
+class Partition;
+class ProcessRandom;
 class Signal;
+struct DpiScope;
 
 enum class Edge {
     Any,
@@ -33,29 +53,75 @@ struct MonitorArg {
     static MonitorArg signalArg(Signal* sig) { return {MonitorArgKind::Signal, sig}; }
 };
 
+// Initial state of a signal before anything drives it. 4-state signals selected by codegen
+// start as X (uninitialized variables) or Z (undriven nets); everything else starts at 0.
+enum class Init {
+    Zero,
+    X,
+    Z
+};
+
 struct Process {
     std::function<void()> run;
     bool scheduled = false;
+    uint32_t site = 0;
+};
+
+// Where a process came from: the hierarchical instance path, the kind of SV block
+// (`always_ff`, `assign`, ...) and its source location. Site 0 is the kernel itself.
+struct SourceSite {
+    std::string scope;
+    std::string process;
+    std::string file;
+    uint32_t line = 0;
 };
 
 class Signal {
 public:
-    explicit Signal(uint32_t width = 1);
+    explicit Signal(uint32_t width = 1, Init init = Init::Zero);
 
     uint64_t value() const { return value_; }
+    uint64_t unknown() const { return unknown_; }
+    Logic4 logic() const { return {value_, unknown_}; }
     uint32_t width() const { return width_; }
 
+    // Multi-lane signals (see LaneSignal) expose every lane here; `value()` mirrors lane 0.
+    uint32_t laneCount() const { return laneCount_; }
+    uint64_t laneValue(uint32_t lane) const { return lanes_ ? lanes_[lane] : value_; }
+
     void set(uint64_t value);
+    void set(Logic4 value);
+
+    // The value word itself, passed in place as a DPI-C vector argument.
+    const uint64_t* data() const { return &value_; }
+
+protected:
+    void bindLanes(const uint64_t* lanes, uint32_t count) {
+        lanes_ = lanes;
+        laneCount_ = count;
+    }
+    // Called by derived storage after it changed: refreshes the lane-0 mirror and wakes
+    // dependent processes.
+    void notifyChange(uint64_t oldValue, uint64_t newValue);
 
 private:
+    friend class DpiOut;
     friend class Kernel;
 
     void attach(Kernel* kernel);
+    // Publishes a value a DPI-C call wrote straight into value_ (`bits` wide) through set().
+    void dpiCommit(uint64_t oldValue, uint64_t oldUnknown, uint32_t bits, bool isSigned);
 
     uint32_t width_ = 1;
+    uint32_t laneCount_ = 1;
     uint64_t value_ = 0;
+    uint64_t unknown_ = 0;
+    const uint64_t* lanes_ = nullptr;
     Kernel* kernel_ = nullptr;
 
+    // Set by the kernel for tracked signals when toggle coverage is enabled.
+    ToggleCounters* toggle_ = nullptr;
+
     std::vector<Process*> levelSensitive;
     std::vector<Process*> posedgeSensitive;
     std::vector<Process*> negedgeSensitive;
@@ -71,7 +137,7 @@ public:
         Edge edge = Edge::Any;
     };
 
-    Kernel() = default;
+    Kernel();
     Kernel(const Kernel&) = delete;
     Kernel& operator=(const Kernel&) = delete;
 
@@ -81,20 +147,134 @@ public:
 
     void schedule_at(uint64_t time, Callback cb);
 
+    // Checkpointable state. Events scheduled with schedule_at are opaque closures and cannot
+    // be saved; generated code schedules its initial-block steps as resumables instead.
+    // A resumable is registered once in construction order (so ids match between the run
+    // that saves a snapshot and the freshly constructed design that restores it) and is
+    // passed its own id so it can reschedule itself.
+    using Resumable = std::function<void(uint32_t self)>;
+    uint32_t add_resumable(Resumable fn);
+    void schedule_resumable(uint64_t time, uint32_t id);
+    // Signals whose values are part of a snapshot, in construction order. The scoped form
+    // also names them `<scope>.<name>` for toggle coverage.
+    void track(std::initializer_list<Signal*> signals);
+    void track(std::string_view scope,
+               std::initializer_list<std::pair<const char*, Signal*>> signals);
+    // Memories whose contents (allocated pages only, when sparse) are part of a snapshot.
+    void track_memory(std::initializer_list<Memory*> memories);
+    // Random streams whose position is part of a snapshot.
+    void track_random(std::initializer_list<ProcessRandom*> streams);
+    // `$monitor` split in two so a restored design can re-enable monitors that were active
+    // when the snapshot was taken; register_monitor does both.
+    uint32_t define_monitor(const std::string& format, const std::vector<MonitorArg>& args);
+    void enable_monitor(uint32_t id);
+
+    // Writes time, tracked signal values, memory contents and random streams, pending NBAs,
+    // enabled monitors and future events. Only valid between time steps, and fails if an opaque (schedule_at)
+    // event is pending.
+    bool save_snapshot(const std::string& path);
+    // Replaces the state of a freshly constructed design with a snapshot of the same design.
+    bool restore_snapshot(const std::string& path);
+    // Makes run() save a snapshot before advancing past `time` (and stop there if
+    // `exitAfter`), or restore one before its first event.
+    void set_checkpoint(uint64_t time, std::string path, bool exitAfter);
+    void set_restore(std::string path) { restorePath = std::move(path); }
+    bool snapshot_failed() const { return snapshotFailed; }
+
+    // Source attribution. Processes and events registered while a site is current are
+    // charged to it by the sampling profiler; events scheduled from a running event inherit
+    // that event's site. Generated constructors call `set_site(add_site(...))` per SV block.
+    uint32_t add_site(std::string scope, std::string process, std::string file, uint32_t line);
+    void set_site(uint32_t site) { currentSite.store(site, std::memory_order_relaxed); }
+    uint32_t site() const { return currentSite.load(std::memory_order_relaxed); }
+    const std::vector<SourceSite>& sites() const { return sourceSites; }
+    // Profiler samples per site collected during run(); empty unless profiling was active.
+    const std::vector<uint64_t>& site_samples() const { return siteSamples; }
+
     void nba_assign(Signal& signal, uint64_t value);
+    void nba_assign(Signal& signal, Logic4 value);
+    // `<=` to the bits of `signal` under `mask` (a part select or concatenation target); the
+    // other bits keep whatever the signal holds when the NBA applies.
+    void nba_assign(Signal& signal, uint64_t value, uint64_t mask);
+    // Queues `mem[addr] <= value`; applied with the scalar NBAs.
+    void nba_write(Memory& mem, uint64_t addr, uint64_t value);
+    // Runs `commit` in the NBA phase after the queued scalar assignments.
+    void nba_defer(Callback commit);
 
     void run();
+    // Runs every event up to and including `time`, then leaves the clock at `time` (when
+    // nothing finished the run). run_until(time()) settles the current time step after
+    // signals were set from outside, which is how an embedding model's eval() works.
+    void run_until(uint64_t time);
     void finish() { finished = true; }
+    bool is_finished() const { return finished; }
 
     uint64_t time() const { return currentTime; }
+    uint64_t event_count() const { return executedEvents; }
+
+    // Per-kernel environment. Everything an instance observes from the outside world goes
+    // through the kernel so several kernels can run side by side on different threads.
+    void set_output(std::ostream& out) { outputStream = &out; }
+    std::ostream& output();
+    void set_seed(uint64_t value) { seedValue = value; }
+    uint64_t seed() const { return seedValue; }
+    // The instance's index in its batch (0 outside runBatch), for per-instance file names.
+    void set_instance(uint32_t index) { instanceIndex = index; }
+    uint32_t instance() const { return instanceIndex; }
+    void set_plusargs(std::vector<std::string> args) { plusargs = std::move(args); }
+    bool test_plusargs(std::string_view name) const;
+    bool value_plusargs(std::string_view prefix, std::string& value) const;
+
+    // `$sim_fork(N)`: fans a warmed-up simulation out into N child processes that share the
+    // current state copy-on-write. Child i continues the run with seed `seed() + i + 1`, the
+    // plusargs plus `childPlusargs[i % size]` and `+fork_index=<i>`, writing its output to
+    // `<outPrefix><i>.log`; sim_fork returns i there. The parent waits for every child,
+    // appends their logs to its own output in child order, finishes, and returns -1.
+    static constexpr uint32_t kNotForked = ~0U;
+    int sim_fork(uint32_t count);
+    void set_fork_options(std::string outPrefix,
+                          std::vector<std::vector<std::string>> childPlusargs, bool enabled);
+    uint32_t fork_index() const { return forkIndex; }
+    bool fork_failed() const { return forkFailed; }
+
+    // Toggle coverage of the tracked signals. Enable before the design is constructed (so
+    // names are kept); run() attaches the counters, and collect_toggle_coverage adds this
+    // run to `db`.
+    void set_toggle_coverage(bool enabled) { toggleEnabled = enabled; }
+    bool collect_toggle_coverage(ToggleCoverage& db) const;
+    // Line/branch counters of a class generated with `--coverage`. Every instance of `module`
+    // in this kernel shares one kernel-owned array of `count` counters (so they stay valid
+    // after the design is destroyed); `points` is the class's static point table.
+    uint64_t* cover(const char* module, const CoverPoint* points, uint32_t count);
+    bool collect_line_coverage(LineCoverage& db) const;
+
+    // DPI-C scopes (svScope). Generated instances that call context imports or export
+    // functions register one under their hierarchical path; `type` identifies the class.
+    DpiScope* dpi_scope(std::string name, void* instance, const void* type);
+    DpiScope* find_dpi_scope(std::string_view name) const;
+
+    // The processes of a partitioned run (`--partition`); stand-ins for partitioned
+    // instances find their link through it. nullptr in an ordinary run.
+    void set_partition(Partition* partition) { partitionRun = partition; }
+    Partition* partition() const { return partitionRun; }
 
 private:
     friend class Signal;
+    friend void onProfileSample(int);
+
+    static constexpr uint32_t kNotResumable = ~0U;
 
     struct Event {
         uint64_t time = 0;
         uint64_t order = 0;
         Callback action;
+        uint32_t site = 0;
+        uint32_t resumable = kNotResumable;
+    };
+
+    struct ResumableEntry {
+        Resumable fn;
+        uint32_t site = 0;
     };
 
     struct EventCompare {
@@ -108,27 +288,560 @@ private:
     struct NbaAssign {
         Signal* signal = nullptr;
         uint64_t value = 0;
+        uint64_t unknown = 0;
+        uint64_t mask = ~0ULL;
+    };
+
+    struct MemoryNba {
+        Memory* memory = nullptr;
+        uint64_t addr = 0;
+        uint64_t value = 0;
     };
 
     struct Monitor {
         std::string format;
         std::vector<MonitorArg> args;
+        bool enabled = false;
     };
 
     uint64_t currentTime = 0;
     uint64_t nextOrder = 0;
+    uint64_t executedEvents = 0;
+    uint64_t seedValue = 0;
+    uint32_t instanceIndex = 0;
     bool finished = false;
+    bool started = false;
+    std::ostream* outputStream = nullptr;
+    std::vector<std::string> plusargs;
 
     std::priority_queue<Event, std::vector<Event>, EventCompare> eventQueue;
     std::deque<Event> activeQueue;
     std::vector<NbaAssign> nbaQueue;
+    std::vector<MemoryNba> memoryNbaQueue;
+    std::vector<Callback> nbaDeferred;
     std::vector<std::unique_ptr<Process>> processes;
     std::vector<std::unique_ptr<Monitor>> monitors;
 
-    void scheduleAt(uint64_t time, Callback action);
+    // Read from the SIGPROF handler on the thread running this kernel.
+    std::atomic<uint32_t> currentSite{0};
+    std::vector<SourceSite> sourceSites;
+    std::vector<uint64_t> siteSamples;
+
+    std::vector<ResumableEntry> resumables;
+    std::vector<Signal*> trackedSignals;
+    std::vector<Memory*> trackedMemories;
+    std::vector<ProcessRandom*> trackedRandoms;
+    std::vector<std::string> trackedNames;
+    bool toggleEnabled = false;
+    std::vector<ToggleCounters> toggleCounters;
+    std::vector<uint32_t> toggleWidths;
+    uint64_t toggleSignature = 0;
+    struct CoverRegion {
+        std::string module;
+        const CoverPoint* points;
+        uint32_t count;
+        std::unique_ptr<uint64_t[]> counters;
+    };
+    std::vector<CoverRegion> coverRegions;
+    std::string checkpointPath;
+    uint64_t checkpointTime = 0;
+    bool checkpointExit = false;
+    std::string restorePath;
+    bool snapshotFailed = false;
+
+    std::string forkPrefix = "sim.fork.";
+    std::vector<std::vector<std::string>> forkPlusargs;
+    bool forkEnabled = true;
+    bool forkFailed = false;
+    uint32_t forkIndex = kNotForked;
+    // A child's log; shared_ptr because <fstream> is not included here.
+    std::shared_ptr<std::ostream> forkLog;
+
+    std::vector<std::unique_ptr<DpiScope>> dpiScopes;
+    Partition* partitionRun = nullptr;
+
+    void scheduleAt(uint64_t time, Callback action, uint32_t site);
+    void scheduleResumable(uint64_t time, uint64_t order, uint32_t id);
+    void enableMonitor(uint32_t id, bool printNow);
+    uint64_t designSignature() const;
     void scheduleProcess(Process& proc, uint64_t at);
     void applyNba();
-    void onSignalChange(Signal& signal, uint64_t oldValue, uint64_t newValue);
+    // Once per kernel before its first event: attaches coverage counters and restores a
+    // snapshot when asked to.
+    void start();
+    void onSignalChange(Signal& signal, uint64_t oldValue, uint64_t newValue,
+                        uint64_t oldUnknown = 0, uint64_t newUnknown = 0);
+    std::string formatMonitor(const Monitor& mon, uint32_t lane, uint32_t laneCount) const;
 };
 
+// An unpacked array. Its Signal value is a write generation bumped whenever a word actually
+// changes, so a process lists the array once in its sensitivity instead of one signal per
+// element. Storage is dense or sparse depending on depth (see MemoryStorage).
+class Memory : public Signal {
+public:
+    // `lower` is the lowest SV index; read/write take offsets from it. `descending` records a
+    // `[hi:lo]` declaration, whose left bound is the highest index (see svLeft).
+    Memory(uint32_t width, uint64_t depth, int64_t lower = 0, bool descending = false)
+        : Signal(64), storage(width, depth), lower_(lower), descending_(descending) {}
+    Memory(const Memory&) = delete;
+    Memory& operator=(const Memory&) = delete;
+
+    uint64_t read(uint64_t addr) const { return storage.read(addr); }
+    void write(uint64_t addr, uint64_t data) {
+        if (storage.write(addr, data))
+            notifyChange(value(), value() + 1);
+    }
+    const MemoryStorage& words() const { return storage; }
+    int64_t lower() const { return lower_; }
+    int64_t upper() const { return lower_ + static_cast<int64_t>(storage.depth()) - 1; }
+    bool descending() const { return descending_; }
+    // In-place word access for DPI open arrays (see MemoryStorage::word_ptr).
+    uint64_t* word_ptr(uint64_t addr) { return storage.word_ptr(addr); }
+    uint64_t* dense_data() { return storage.dense_data(); }
+
+    // `$readmemh`/`$readmemb` and `$writememh`/`$writememb`; start/end are SV indices.
+    bool load(const std::string& path, MemFileFormat format, int64_t start = kNoAddress,
+              int64_t end = kNoAddress);
+    bool dump(const std::string& path, MemFileFormat format, int64_t start = kNoAddress,
+              int64_t end = kNoAddress) const;
+
+private:
+    friend class DpiArrayOut;
+    friend class Kernel;
+
+    MemoryStorage storage;
+    int64_t lower_ = 0;
+    bool descending_ = false;
+};
+
+// Non-blocking memory writes of a cycle-mode class (CodegenOptions::cycle): queued while its
+// flops evaluate and applied in order by commit(), with the Kernel::nba_write signature so
+// the statement emitter can target either.
+class CycleWrites {
+public:
+    void nba_write(Memory& mem, uint64_t addr, uint64_t value) {
+        writes.push_back({&mem, addr, value});
+    }
+    void commit() {
+        for (const auto& w : writes)
+            w.mem->write(w.addr, w.value);
+        writes.clear();
+    }
+
+private:
+    struct Write {
+        Memory* mem;
+        uint64_t addr;
+        uint64_t value;
+    };
+    std::vector<Write> writes;
+};
+
+// An argument or local variable of an SV function in generated code: plain storage with the
+// value()/set() interface the expression emitter uses for signals, but no kernel behind it.
+template<uint32_t W>
+struct Local {
+    uint64_t word = 0;
+
+    uint64_t value() const { return word; }
+    void set(uint64_t v) { word = W >= 64 ? v : v & ((1ULL << (W % 64)) - 1); }
+};
+
+// The random stream of one process in generated code, named `<scope>:<symbol index>`. It is
+// derived from the kernel's seed on first use and again whenever that seed changes, so each
+// `$sim_fork` child draws its own values from the fork on.
+class ProcessRandom {
+public:
+    ProcessRandom(const Kernel& kernel, std::string name) :
+        kernel_(kernel), name_(std::move(name)) {}
+
+    Random& get() {
+        if (!seeded_ || seed_ != kernel_.seed()) {
+            seed_ = kernel_.seed();
+            seeded_ = true;
+            random_.reseed(seed_, name_);
+        }
+        return random_;
+    }
+    // `$urandom(seed)`: restarts the stream from `seed`. It stays on that stream until the
+    // kernel's seed changes, as after a `$sim_fork`.
+    Random& reseed(uint64_t seed) {
+        seeded_ = true;
+        seed_ = kernel_.seed();
+        random_.reseed(seed, name_);
+        return random_;
+    }
+
+private:
+    friend class Kernel;
+
+    const Kernel& kernel_;
+    std::string name_;
+    uint64_t seed_ = 0;
+    bool seeded_ = false;
+    Random random_;
+};
+
+// `$random(seed)` on a signal or local: advances the seed in place.
+template<typename S>
+uint64_t random_seeded(S& seed) {
+    SeededRandom next = random_step(seed.value());
+    seed.set(next.seed);
+    return next.value;
+}
+
+// The replicas of one instance array or generate-for loop in generated code: N objects of
+// one class, contiguous and built in place by `make(i)` for replica i. They register `this`
+// with the kernel, so unlike a std::array or std::vector element they never move.
+template<typename T, size_t N>
+class Replicas {
+public:
+    template<typename Make>
+    explicit Replicas(Make make) {
+        for (size_t i = 0; i < N; ++i)
+            ::new (static_cast<void*>(slots_[i].bytes)) T(make(i));
+    }
+    ~Replicas() {
+        for (size_t i = N; i-- > 0;)
+            (*this)[i].~T();
+    }
+    Replicas(const Replicas&) = delete;
+    Replicas& operator=(const Replicas&) = delete;
+
+    T& operator[](size_t i) { return *std::launder(reinterpret_cast<T*>(slots_[i].bytes)); }
+    T* begin() { return &(*this)[0]; }
+    T* end() { return begin() + N; }
+    static constexpr size_t size() { return N; }
+
+private:
+    struct alignas(T) Slot {
+        std::byte bytes[sizeof(T)];
+    };
+    std::array<Slot, N> slots_;
+};
+
+// DPI-C glue for generated code; the C side is sim/svdpi.h. Imports are called directly
+// with C argument types: scalars by value, vectors and open arrays by pointer into signal
+// and memory storage wherever the actual argument is a whole signal or memory.
+struct DpiScope {
+    std::string name;
+    void* instance = nullptr;
+    const void* type = nullptr;
+    Kernel* kernel = nullptr;
+};
+
+// This thread's current scope (svGetScope) and the kernel running on it.
+inline thread_local DpiScope* dpiScope = nullptr;
+inline thread_local Kernel* dpiKernel = nullptr;
+
+// Makes `scope` current for a context import call, `(sim::DpiContext(dpi_scope_), f(...))`,
+// and restores the caller's scope at the end of the full-expression.
+class DpiContext {
+public:
+    explicit DpiContext(DpiScope* scope) : saved(dpiScope) { dpiScope = scope; }
+    ~DpiContext() { dpiScope = saved; }
+    DpiContext(const DpiContext&) = delete;
+    DpiContext& operator=(const DpiContext&) = delete;
+
+private:
+    DpiScope* saved;
+};
+
+[[noreturn]] void dpiScopeError(const char* function);
+
+// The instance an exported function runs on: the current scope, which must belong to `T`.
+template<typename T>
+T* dpi_instance(const char* function) {
+    DpiScope* scope = dpiScope;
+    if (!scope || scope->type != &T::dpi_type)
+        dpiScopeError(function);
+    return static_cast<T*>(scope->instance);
+}
+
+// svBitVecVal chunks are the little-endian halves of a 64-bit value word.
+static_assert(std::endian::native == std::endian::little, "DPI vectors alias signal storage");
+
+inline const svBitVecVal* dpi_bits(const Signal& signal) {
+    return reinterpret_cast<const svBitVecVal*>(signal.data());
+}
+
+// A vector argument of an exported function, as a value word.
+inline uint64_t dpi_read_bits(const svBitVecVal* v, uint32_t width) {
+    return width > 32 ? v[0] | (static_cast<uint64_t>(v[1]) << 32) : v[0];
+}
+
+inline uint64_t dpi_read_logic(const svLogicVecVal* v, uint32_t width) {
+    return width > 32 ? v[0].aval | (static_cast<uint64_t>(v[1].aval) << 32) : v[0].aval;
+}
+
+// Input vectors computed by an expression; the temporary lives until the call returns.
+struct DpiBits {
+    uint64_t word = 0;
+    const svBitVecVal* ptr() const { return reinterpret_cast<const svBitVecVal*>(&word); }
+};
+
+// 4-state vectors interleave aval/bval per chunk, which signal storage does not, so they
+// are converted (two chunks at most).
+struct DpiLogic {
+    svLogicVecVal chunks[2];
+
+    explicit DpiLogic(Logic4 v)
+        : chunks{{static_cast<uint32_t>(v.value), static_cast<uint32_t>(v.unknown)},
+                 {static_cast<uint32_t>(v.value >> 32), static_cast<uint32_t>(v.unknown >> 32)}} {}
+    const svLogicVecVal* ptr() const { return chunks; }
+};
+
+inline svLogic dpi_logic(Logic4 v) {
+    return static_cast<svLogic>((v.value & 1) | ((v.unknown & 1) << 1));
+}
+
+inline svOpenArrayHandle dpi_array(const Memory& mem) {
+    return const_cast<Memory*>(&mem);
+}
+
+// Output and inout arguments bound to a whole 2-state signal: the C side writes straight
+// into the value word, and the result (`bits` wide, sign- or zero-extended) is published
+// through Signal::set, waking readers, when the call's full-expression ends.
+class DpiOut {
+public:
+    DpiOut(Signal& signal, uint32_t bits, bool isSigned)
+        : signal(signal), oldValue(signal.value_), oldUnknown(signal.unknown_), bits(bits),
+          isSigned(isSigned) {}
+    ~DpiOut() { signal.dpiCommit(oldValue, oldUnknown, bits, isSigned); }
+    DpiOut(const DpiOut&) = delete;
+    DpiOut& operator=(const DpiOut&) = delete;
+
+    template<typename T>
+    T* ptr() {
+        return reinterpret_cast<T*>(&signal.value_);
+    }
+
+private:
+    Signal& signal;
+    uint64_t oldValue;
+    uint64_t oldUnknown;
+    uint32_t bits;
+    bool isSigned;
+};
+
+// Output and inout 4-state arguments go through canonical chunks and are set on return.
+class DpiLogicOut {
+public:
+    explicit DpiLogicOut(Signal& signal) : signal(signal), chunks(signal.logic()) {
+        scalar_ = dpi_logic(signal.logic());
+    }
+    ~DpiLogicOut() {
+        if (usedScalar) {
+            signal.set(Logic4{static_cast<uint64_t>(scalar_ & 1),
+                              static_cast<uint64_t>((scalar_ >> 1) & 1)});
+            return;
+        }
+        const svLogicVecVal* c = chunks.chunks;
+        signal.set(Logic4{c[0].aval | (static_cast<uint64_t>(c[1].aval) << 32),
+                          c[0].bval | (static_cast<uint64_t>(c[1].bval) << 32)});
+    }
+    DpiLogicOut(const DpiLogicOut&) = delete;
+    DpiLogicOut& operator=(const DpiLogicOut&) = delete;
+
+    svLogicVecVal* vec() { return chunks.chunks; }
+    svLogic* scalar() {
+        usedScalar = true;
+        return &scalar_;
+    }
+
+private:
+    Signal& signal;
+    DpiLogic chunks;
+    svLogic scalar_ = 0;
+    bool usedScalar = false;
+};
+
+// Output and inout open arrays: the C side may write elements in place, so readers of the
+// memory are woken once the call returns.
+class DpiArrayOut {
+public:
+    explicit DpiArrayOut(Memory& mem) : mem(mem) {}
+    ~DpiArrayOut() { mem.notifyChange(mem.value(), mem.value() + 1); }
+    DpiArrayOut(const DpiArrayOut&) = delete;
+    DpiArrayOut& operator=(const DpiArrayOut&) = delete;
+
+    svOpenArrayHandle handle() { return &mem; }
+
+private:
+    Memory& mem;
+};
+
+template<uint32_t N>
+using Lanes = std::array<uint64_t, N>;
+
+template<uint32_t N>
+inline bool any_lane(const Lanes<N>& mask) {
+    uint64_t acc = 0;
+    for (uint32_t l = 0; l < N; ++l)
+        acc |= mask[l];
+    return acc != 0;
+}
+
+// A signal carrying N independent stimulus lanes that share one schedule. Lane masks are
+// all-ones for active lanes and zero otherwise so updates are branch-free selects the
+// compiler can vectorize. Processes are woken when any lane changes.
+template<uint32_t N>
+class LaneSignal : public Signal {
+public:
+    explicit LaneSignal(uint32_t width = 1) : Signal(width) { bindLanes(lanes_.data(), N); }
+    LaneSignal(const LaneSignal&) = delete;
+    LaneSignal& operator=(const LaneSignal&) = delete;
+
+    uint64_t lane(uint32_t l) const { return lanes_[l]; }
+    const Lanes<N>& lanes() const { return lanes_; }
+
+    void set(uint64_t value) {
+        Lanes<N> values;
+        values.fill(value);
+        set(values);
+    }
+
+    void set(const Lanes<N>& values) {
+        Lanes<N> mask;
+        mask.fill(~0ULL);
+        set(values, mask);
+    }
+
+    void set(const Lanes<N>& values, const Lanes<N>& mask) {
+        uint64_t widthMask = width() >= 64 ? ~0ULL : ((1ULL << width()) - 1);
+        uint64_t old0 = lanes_[0];
+        uint64_t diff = 0;
+        for (uint32_t l = 0; l < N; ++l) {
+            uint64_t next = ((values[l] & mask[l]) | (lanes_[l] & ~mask[l])) & widthMask;
+            diff |= next ^ lanes_[l];
+            lanes_[l] = next;
+        }
+        if (diff)
+            notifyChange(old0, lanes_[0]);
+    }
+
+    // Sets one lane of `signal`, a LaneSignal<N>; the StimulusReplay lane setter.
+    static void set_lane(Signal& signal, uint32_t lane, uint64_t value) {
+        Lanes<N> values{};
+        Lanes<N> mask{};
+        values[lane] = value;
+        mask[lane] = ~0ULL;
+        static_cast<LaneSignal&>(signal).set(values, mask);
+    }
+
+    void nba(Kernel& kernel, uint64_t value) {
+        Lanes<N> values;
+        values.fill(value);
+        nba(kernel, values);
+    }
+
+    void nba(Kernel& kernel, const Lanes<N>& values) {
+        Lanes<N> mask;
+        mask.fill(~0ULL);
+        nba(kernel, values, mask);
+    }
+
+    void nba(Kernel& kernel, const Lanes<N>& values, const Lanes<N>& mask) {
+        for (uint32_t l = 0; l < N; ++l) {
+            pending_[l] = (values[l] & mask[l]) | (pending_[l] & ~mask[l]);
+            pendingMask_[l] |= mask[l];
+        }
+        if (nbaQueued_)
+            return;
+        nbaQueued_ = true;
+        kernel.nba_defer([this]() {
+            nbaQueued_ = false;
+            Lanes<N> mask = pendingMask_;
+            pendingMask_.fill(0);
+            set(pending_, mask);
+        });
+    }
+
+private:
+    Lanes<N> lanes_{};
+    Lanes<N> pending_{};
+    Lanes<N> pendingMask_{};
+    bool nbaQueued_ = false;
+};
+
+struct BatchOptions {
+    uint32_t instances = 1;
+    uint32_t threads = 1;
+    uint64_t seed = 0;
+    // Clock cycles per instance for designs generated in cycle mode (`--cycle`).
+    uint64_t cycles = 1000;
+    // Instance i writes its output to <outPrefix><i>.log when more than one instance runs.
+    std::string outPrefix = "sim.";
+    std::vector<std::string> plusargs;
+    // Extra plusargs per instance, one whitespace-separated line per instance (cycled).
+    std::vector<std::vector<std::string>> instancePlusargs;
+    // Extra plusargs per `$sim_fork` child, same format as instancePlusargs.
+    std::vector<std::vector<std::string>> forkPlusargs;
+    // Print a machine-readable `stats:` line (see reportStats) after the run.
+    bool stats = false;
+    // When set, sample with SIGPROF at `profileHz` and write per-site counts here (a forked
+    // child i writes <profilePath>.fork.<i>, including the samples taken before the fork).
+    std::string profilePath;
+    uint32_t profileHz = 1000;
+    // Snapshot the state before advancing past `checkpointTime` (instance i writes
+    // <checkpointPath>.<i> when several run), optionally stopping there; or start every
+    // instance from the snapshot at `restorePath`.
+    std::string checkpointPath;
+    uint64_t checkpointTime = 0;
+    bool checkpointExit = false;
+    std::string restorePath;
+    // Toggle coverage database for the whole batch (a forked child i writes
+    // <toggleCoveragePath>.fork.<i>).
+    std::string toggleCoveragePath;
+    // Line/branch coverage database of a design generated with `--coverage` (forked children
+    // likewise write <lineCoveragePath>.fork.<i>).
+    std::string lineCoveragePath;
+    // Input port values replayed from a stimulus file, and output ports recorded to one
+    // (instance i writes <recordPath>.<i> when several run), by generated drivers; see
+    // sim/stimulus.h. `recordMatrix` records one row per cycle instead of every change.
+    std::string stimulusPath;
+    std::string recordPath;
+    bool recordMatrix = false;
+    // Set by partition 0 of a partitioned run for the processes it starts: the shared region
+    // and their partition index. Their profile and coverage files get a `.part.<k>` suffix.
+    std::string partitionRegion;
+    uint32_t partitionIndex = 0;
+};
+
+// Prints `stats: events=<n> time=<t> wall_s=<s> peak_rss_kb=<k>` for benchmark scripts.
+void reportStats(std::ostream& out, uint64_t events, uint64_t time, double seconds);
+
+// Sampling profiler driven by ITIMER_PROF. Each SIGPROF is charged to the site of the event
+// executing on the interrupted thread (see Kernel::add_site); samples that land outside
+// Kernel::run are counted as dropped. Only one profiler can be active per process.
+// startProfiler accepts 1..1000000 Hz and returns false, with errno set, if it cannot start.
+bool startProfiler(uint32_t hz);
+void stopProfiler();
+uint64_t droppedProfileSamples();
+
+// Writes `# sim-profile hz=<hz> dropped=<n>` followed by one
+// `<samples>\t<scope>\t<process>\t<file>\t<line>` row per site with samples.
+bool writeProfile(const std::string& path, const std::vector<SourceSite>& sites,
+                  const std::vector<uint64_t>& samples, uint32_t hz);
+
+// Parses `--instances N --threads T --seed S --cycles N --out-prefix P --instance-args <file>
+// --stats --profile <file> --profile-hz N --checkpoint <file> --checkpoint-at T
+// --checkpoint-exit --restore <file> --fork-args <file> --toggle-cov <file> --line-cov <file>
+// --stimulus <file> --record <file> --record-matrix --partition-region <name>
+// --partition-index <k>` and `+plusarg` arguments of a generated driver.
+bool parseBatchArgs(int argc, char** argv, BatchOptions& options);
+
+// Runs `options.instances` independent simulations, each with its own Kernel, spread over
+// `options.threads` worker threads. `body` builds and runs one design instance and must
+// only share read-only state between calls.
+int runBatch(const BatchOptions& options, const std::function<void(Kernel&)>& body);
+
+// Runs one process of a partitioned design (see sim/partition.h) as a single-instance batch.
+// Partition 0 starts the executables in `parts` (instance path, executable name) first and
+// waits for them after `body`; the others attach to its region. `body` reaches the
+// Partition through Kernel::partition().
+int runPartitioned(const BatchOptions& options,
+                   const std::vector<std::pair<std::string, std::string>>& parts, int argc,
+                   char** argv, const std::function<void(Kernel&)>& body);
+
 } // namespace sim
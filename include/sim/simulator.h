@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <iosfwd>
 #include <memory>
 
 namespace slang::ast {
@@ -11,15 +13,24 @@ namespace sim {
 
 class Simulator {
 public:
-    Simulator(slang::ast::Compilation& compilation, const slang::ast::InstanceSymbol& top);
+    // `optimize` runs the IR passes over every child module before building its processes.
+    Simulator(slang::ast::Compilation& compilation, const slang::ast::InstanceSymbol& top,
+              bool optimize = true);
     ~Simulator();
 
     Simulator(const Simulator&) = delete;
     Simulator& operator=(const Simulator&) = delete;
 
     void build();
+    // Seeds the per-process random streams (`+seed=`); call before run().
+    void setSeed(uint64_t seed);
     void run();
 
+    uint64_t time() const;
+    uint64_t eventCount() const;
+    // Per child module, its IR size and what each pass removed (valid after build()).
+    void reportIr(std::ostream& out) const;
+
 private:
     struct Impl;
     std::unique_ptr<Impl> impl;
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sim {
+
+class Kernel;
+class Signal;
+
+// Binary stimulus for testbench-free runs of a generated top: input port values replayed
+// straight from a memory-mapped file, and output ports recorded in the same format so two
+// runs compare with `cmp`. All fields are host-endian; the file is
+//   StimulusHeader
+//   `signals` x (StimulusColumn, name padded with zeros to a multiple of 8 bytes)
+//   Records: `count` x StimulusRecord, ordered by time
+//   Matrix:  `count` rows of `signals` uint64_t values, one per column
+// A record's or row's time is the kernel time in event mode and the cycle in cycle mode,
+// where row k applies before the k-th step(). In event mode row k applies at k * period.
+// A column is one lane of a port: `--lanes` builds give each lane its own columns, and a
+// column drives or records only its lane.
+enum class StimulusLayout : uint32_t {
+    Records = 0,
+    Matrix = 1
+};
+
+struct StimulusHeader {
+    static constexpr char kMagic[8] = {'S', 'I', 'M', 'S', 'T', 'I', 'M', '1'};
+
+    char magic[8] = {};
+    StimulusLayout layout = StimulusLayout::Records;
+    uint32_t signals = 0;
+    uint64_t count = 0;
+    uint64_t period = 0;
+};
+
+struct StimulusColumn {
+    uint32_t width = 0;
+    uint32_t lane = 0;
+    uint32_t nameLength = 0;
+    uint32_t reserved = 0;
+};
+
+struct StimulusRecord {
+    uint64_t time = 0;
+    // Column index in the signal table.
+    uint32_t signal = 0;
+    uint32_t reserved = 0;
+    uint64_t value = 0;
+};
+
+static_assert(sizeof(StimulusHeader) == 32 && sizeof(StimulusColumn) == 16 &&
+                  sizeof(StimulusRecord) == 24,
+              "stimulus files have a fixed layout");
+
+// A stimulus file mapped read-only and matched against the top's input ports. Instances
+// of a batch share one StimulusFile; each replays it through its own StimulusReplay.
+// Defined in runtime.cpp.
+class StimulusFile {
+public:
+    StimulusFile();
+    StimulusFile(const StimulusFile&) = delete;
+    StimulusFile& operator=(const StimulusFile&) = delete;
+    ~StimulusFile();
+
+    // Maps `path` and binds each column to the port (name, width) of the same name and
+    // width; the file may leave ports out. `cycles` selects the driver's mode: event mode
+    // needs a period for the matrix layout. False, with a message on stderr, if the file is
+    // malformed or names a port or lane (of `lanes`) that does not exist.
+    bool open(const std::string& path, const std::vector<std::pair<std::string, uint32_t>>& ports,
+              bool cycles, uint32_t lanes = 1);
+    bool is_open() const { return mapping_ != nullptr; }
+
+private:
+    friend class StimulusReplay;
+    struct Mapping;
+
+    std::unique_ptr<Mapping> mapping_;
+    StimulusLayout layout_ = StimulusLayout::Records;
+    uint64_t count_ = 0;
+    uint64_t period_ = 0;
+    // Per column, the index of its port and its lane.
+    std::vector<uint32_t> columnPort_;
+    std::vector<uint32_t> columnLane_;
+    const StimulusRecord* records_ = nullptr;
+    const uint64_t* rows_ = nullptr;
+};
+
+// One instance's replay of a StimulusFile onto its port signals, given in the order of the
+// list passed to StimulusFile::open. Nothing is applied while the file is not open. The
+// position in the file is only a hint, so a restored snapshot replays from the right place.
+// Multi-lane ports are written through `setLane` (LaneSignal<N>::set_lane).
+class StimulusReplay {
+public:
+    using LaneSetter = void (*)(Signal& signal, uint32_t lane, uint64_t value);
+
+    StimulusReplay(const StimulusFile& file, std::vector<Signal*> ports,
+                   LaneSetter setLane = nullptr)
+        : file_(file), ports_(std::move(ports)), setLane_(setLane) {}
+
+    // Event mode: a resumable applies what is due at the current time and reschedules
+    // itself for the next record or row.
+    void schedule(Kernel& kernel);
+    // Cycle mode: applies what is due before `cycle`'s step(); true if anything was.
+    bool apply(uint64_t cycle);
+
+private:
+    bool applyRecords(uint64_t time);
+    void applyRow(uint64_t row);
+    void set(uint32_t column, uint64_t value);
+
+    const StimulusFile& file_;
+    std::vector<Signal*> ports_;
+    LaneSetter setLane_ = nullptr;
+    uint64_t cursor_ = 0;
+};
+
+// Writes output port values in the stimulus format, one column per port and lane. Records
+// holds every change (and the values when recording starts); Matrix, cycle mode only, one
+// row per cycle.
+class StimulusRecorder {
+public:
+    StimulusRecorder() = default;
+    StimulusRecorder(const StimulusRecorder&) = delete;
+    StimulusRecorder& operator=(const StimulusRecorder&) = delete;
+    ~StimulusRecorder() { close(); }
+
+    bool open(const std::string& path, StimulusLayout layout,
+              std::vector<std::pair<std::string, Signal*>> ports);
+    bool is_open() const { return out_.is_open(); }
+
+    // Event mode: records each port lane whenever it changes.
+    void watch(Kernel& kernel);
+    // Cycle mode: records the ports after `cycle`'s step().
+    void sample(uint64_t cycle);
+    // Writes the record or row count into the header. False if any write failed.
+    bool close();
+
+private:
+    // Writes the lanes of port `port` that changed since they were last recorded.
+    void record(uint64_t time, uint32_t port);
+    void write(uint64_t time, uint32_t signal, uint64_t value);
+
+    std::ofstream out_;
+    std::string path_;
+    StimulusLayout layout_ = StimulusLayout::Records;
+    std::vector<Signal*> ports_;
+    // Per port, its first column; per column, the last value recorded and whether one was.
+    std::vector<uint32_t> firstColumn_;
+    std::vector<uint64_t> last_;
+    std::vector<bool> recorded_;
+    uint64_t count_ = 0;
+    bool failed_ = false;
+};
+
+// The file instance `index` of a batch writes: `path` itself, or `<path>.<index>` when
+// several instances run (as for checkpoints).
+std::string batchFilePath(const std::string& path, uint32_t instances, uint32_t index);
+
+} // namespace sim
@@ -0,0 +1,67 @@
+/* C side of DPI-C (IEEE 1800 Annex H/I): the types and the subset of svdpi.h functions the
+ * runtime implements. C reference models include this (or the generated sim_dpi.h, which
+ * also declares the design's imports and exports). Kept C-compatible on purpose. */
+#ifndef SIM_SVDPI_H
+#define SIM_SVDPI_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint8_t svScalar;
+typedef svScalar svBit;
+typedef svScalar svLogic;
+
+#define sv_0 0
+#define sv_1 1
+#define sv_z 2
+#define sv_x 3
+
+/* Packed vectors in 32-bit chunks, least significant chunk first. */
+typedef uint32_t svBitVecVal;
+typedef struct t_vpi_vecval {
+    uint32_t aval;
+    uint32_t bval;
+} svLogicVecVal;
+
+#define SV_PACKED_DATA_NELEMS(WIDTH) (((WIDTH) + 31) >> 5)
+
+typedef void* svScope;
+typedef void* svOpenArrayHandle;
+
+/* Scopes. Context imports run with the calling instance as the current scope; exported
+ * functions are called on the current scope. */
+svScope svGetScope(void);
+svScope svSetScope(const svScope scope);
+const char* svGetNameFromScope(const svScope scope);
+svScope svGetScopeFromName(const char* scopeName);
+
+/* Bit selects on canonical vectors. */
+svBit svGetBitselBit(const svBitVecVal* s, int i);
+void svPutBitselBit(svBitVecVal* d, int i, svBit s);
+svLogic svGetBitselLogic(const svLogicVecVal* s, int i);
+void svPutBitselLogic(svLogicVecVal* d, int i, svLogic s);
+
+/* Open arrays (`input bit [31:0] a[]`). Elements are stored one per 64-bit word, so element
+ * pointers read correctly as svBitVecVal/int for elements up to 32 bits (and as 64-bit
+ * values up to 64). svGetArrayPtr is NULL for sparse arrays. */
+int svLeft(const svOpenArrayHandle h, int d);
+int svRight(const svOpenArrayHandle h, int d);
+int svLow(const svOpenArrayHandle h, int d);
+int svHigh(const svOpenArrayHandle h, int d);
+int svIncrement(const svOpenArrayHandle h, int d);
+int svSize(const svOpenArrayHandle h, int d);
+int svDimensions(const svOpenArrayHandle h);
+void* svGetArrayPtr(const svOpenArrayHandle h);
+int svSizeOfArray(const svOpenArrayHandle h);
+void* svGetArrElemPtr1(const svOpenArrayHandle h, int indx1);
+void svGetBitArrElem1VecVal(svBitVecVal* d, const svOpenArrayHandle s, int indx1);
+void svPutBitArrElem1VecVal(const svOpenArrayHandle d, const svBitVecVal* s, int indx1);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_SVDPI_H */
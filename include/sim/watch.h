@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "sim/codegen.h"
+
+namespace sim {
+
+struct WatchOptions {
+    std::vector<std::string> files;
+    std::string topName;
+    std::string cppOutDir;
+    CodegenOptions codegen;
+    // Shell command run after each regeneration that touched at least one file.
+    std::string onChange;
+    bool runSim = false;
+};
+
+// Regenerates C++ whenever one of the input files, or a file they include, changes on disk.
+// A write that leaves an input file's contents unchanged is ignored; any other change
+// reparses every input file (see doc/slang_integration.md). Runs until interrupted; returns
+// a nonzero exit code if watching cannot be set up or the first generation fails.
+int runWatch(const WatchOptions& options);
+
+} // namespace sim
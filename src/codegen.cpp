@@ -1,17 +1,25 @@
 #include "sim/codegen.h"
 
+#include <algorithm>
 #include <cctype>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <optional>
+#include <sstream>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "slang/ast/ASTVisitor.h"
+#include "slang/ast/Compilation.h"
 #include "slang/ast/Expression.h"
 #include "slang/ast/Statement.h"
 #include "slang/ast/Symbol.h"
@@ -22,6 +30,7 @@
 #include "slang/ast/expressions/LiteralExpressions.h"
 #include "slang/ast/expressions/MiscExpressions.h"
 #include "slang/ast/expressions/OperatorExpressions.h"
+#include "slang/ast/expressions/SelectExpressions.h"
 #include "slang/ast/statements/ConditionalStatements.h"
 #include "slang/ast/statements/MiscStatements.h"
 #include "slang/ast/statements/LoopStatements.h"
@@ -31,13 +40,22 @@
 #include "slang/ast/symbols/MemberSymbols.h"
 #include "slang/ast/symbols/ParameterSymbols.h"
 #include "slang/ast/symbols/PortSymbols.h"
+#include "slang/ast/symbols/SubroutineSymbols.h"
 #include "slang/ast/symbols/ValueSymbol.h"
+#include "slang/ast/types/AllTypes.h"
 #include "slang/ast/types/Type.h"
+#include "slang/numeric/SVInt.h"
+#include "slang/syntax/AllSyntax.h"
+#include "slang/text/SourceManager.h"
+
+#include "sim/frontend.h"
+#include "sim/ir_lower.h"
 
 namespace sim {
 
 using namespace slang;
 using namespace slang::ast;
+using namespace slang::syntax;
 
 namespace {
 
@@ -63,6 +81,29 @@ uint32_t bitWidth(const Type& type, uint32_t fallback = 1) {
     return widthOrDefault(w, fallback);
 }
 
+// Shape of an unpacked array of integral elements (`logic [W-1:0] m [N]`), which is emitted
+// as a sim::Memory. Element `i` lives at offset `i - lower`; `descending` is a `[hi:lo]` range.
+struct MemoryShape {
+    uint32_t width = 1;
+    uint64_t depth = 0;
+    int64_t lower = 0;
+    bool descending = false;
+};
+
+std::optional<MemoryShape> memoryShape(const Type& type) {
+    const Type& canonical = type.getCanonicalType();
+    if (canonical.kind != SymbolKind::FixedSizeUnpackedArrayType)
+        return std::nullopt;
+    auto& array = canonical.as<FixedSizeUnpackedArrayType>();
+    if (!array.elementType.isIntegral())
+        return std::nullopt;
+    uint32_t width = bitWidth(array.elementType, 0);
+    if (width == 0 || width > 64)
+        return std::nullopt;
+    return MemoryShape{width, array.range.width(), array.range.lower(),
+                       array.range.left > array.range.right};
+}
+
 const ValueSymbol* getValueSymbol(const Symbol* symbol) {
     if (!symbol)
         return nullptr;
@@ -142,12 +183,36 @@ void collectInstances(const InstanceSymbol& inst,
     if (defs.find(defName) == defs.end())
         defs.emplace(defName, &inst);
 
-    for (auto& child : inst.body.membersOfType<InstanceSymbol>())
-        collectInstances(child, defs);
+    for (const auto& child : childInstances(inst.body))
+        collectInstances(*child.symbol, defs);
 }
 
-std::string emitExpr(const Expression& expr,
-                     const std::unordered_map<const ValueSymbol*, std::string>& names);
+// SV functions and tasks of the module being emitted, by member name (see emitModule), and
+// the scope constant calls are evaluated in.
+struct FunctionTable {
+    const Scope* scope = nullptr;
+    std::unordered_map<const SubroutineSymbol*, std::string> members;
+};
+
+// The C++ names of the module's signals, and what else expressions need from the code
+// around them: the module's function table and the sim::ProcessRandom member of the
+// process or function being emitted (see emitModule). Copies made for loop variables and
+// function locals keep both.
+struct EmitNames : std::unordered_map<const ValueSymbol*, std::string> {
+    const FunctionTable* functions = nullptr;
+    const std::string* random = nullptr;
+};
+
+// `access` is appended to a signal name to read it: `.value()` for scalar signals, or a
+// lane accessor inside the per-lane loops of multi-lane mode.
+std::string emitExpr(const Expression& expr, const EmitNames& names,
+                     std::string_view access = ".value()");
+std::string emitNode(const LoweredModule& lowered, ir::NodeId id, const EmitNames& names);
+std::string cppStringLiteral(std::string_view text);
+
+// The left-hand side of the assignment being emitted. slang binds `a op= b` as
+// `a = <lvalue> op b`; the lvalue reference reads this.
+const Expression* compoundTarget = nullptr;
 
 const ValueSymbol* getValueSymbolFromExpr(const Expression& expr) {
     if (auto sym = expr.getSymbolReference()) {
@@ -157,8 +222,488 @@ const ValueSymbol* getValueSymbolFromExpr(const Expression& expr) {
     return nullptr;
 }
 
+std::string emitMemoryAddress(const ElementSelectExpression& sel, const MemoryShape& shape,
+                              const EmitNames& names, std::string_view access,
+                              const LoweredModule* ir = nullptr) {
+    ir::NodeId node = ir ? ir->node(sel.selector()) : ir::kNoNode;
+    std::string index = node != ir::kNoNode
+                            ? emitNode(*ir, node, names)
+                            : "static_cast<uint64_t>(" + emitExpr(sel.selector(), names, access) +
+                                  ")";
+    if (shape.lower == 0)
+        return index;
+    return "(" + index + " - " + std::to_string(shape.lower) + "ULL)";
+}
+
+// `mem[i] = v` / `mem[i] <= v` on an unpacked array. Returns false when the target is not a
+// memory, so callers fall back to whole-signal assignment.
+bool emitMemoryWrite(const AssignmentExpression& a,
+                     const EmitNames& names,
+                     std::ostream& out,
+                     const std::string& pad,
+                     const std::string& kernelRef,
+                     bool nonBlocking,
+                     const std::string& marker,
+                     const LoweredModule* ir = nullptr) {
+    if (a.left().kind != ExpressionKind::ElementSelect)
+        return false;
+    auto& sel = a.left().as<ElementSelectExpression>();
+    const ValueSymbol* sym = getValueSymbolFromExpr(sel.value());
+    auto shape = sym ? memoryShape(sym->getType()) : std::nullopt;
+    auto it = sym ? names.find(sym) : names.end();
+    if (!shape || it == names.end())
+        return false;
+    std::string addr = emitMemoryAddress(sel, *shape, names, ".value()", ir);
+    ir::NodeId value = ir ? ir->node(a.right()) : ir::kNoNode;
+    std::string rhs =
+        value != ir::kNoNode ? emitNode(*ir, value, names) : emitExpr(a.right(), names);
+    if (nonBlocking) {
+        out << pad << kernelRef << ".nba_write(" << it->second << ", " << addr << ", " << rhs
+            << ");" << marker << "\n";
+    } else {
+        out << pad << it->second << ".write(" << addr << ", " << rhs << ");" << marker << "\n";
+    }
+    return true;
+}
+
+// C representation of a DPI-C formal or return type (IEEE 1800 H.7.4). Integers pass as C
+// integers, 1-bit types as svBit/svLogic, other integral types up to 64 bits as canonical
+// vectors, unpacked open arrays as handles to a sim::Memory.
+enum class DpiKind {
+    Void,
+    Integer,
+    Bit,
+    Logic,
+    BitVector,
+    LogicVector,
+    String,
+    OpenArray,
+    Unsupported
+};
+
+struct DpiType {
+    DpiKind kind = DpiKind::Unsupported;
+    std::string cType;
+    uint32_t width = 0;
+    bool isSigned = false;
+};
+
+DpiType dpiType(const Type& type) {
+    const Type& canonical = type.getCanonicalType();
+    DpiType t;
+    t.isSigned = canonical.isSigned();
+    if (canonical.isVoid()) {
+        t.kind = DpiKind::Void;
+        t.cType = "void";
+        return t;
+    }
+    if (canonical.isString()) {
+        t.kind = DpiKind::String;
+        t.cType = "const char*";
+        return t;
+    }
+    if (canonical.kind == SymbolKind::DPIOpenArrayType) {
+        t.kind = DpiKind::OpenArray;
+        t.cType = "svOpenArrayHandle";
+        return t;
+    }
+    if (!canonical.isIntegral())
+        return t;
+    t.width = bitWidth(canonical, 0);
+    if (t.width == 0 || t.width > 64)
+        return t;
+    if (canonical.kind == SymbolKind::PredefinedIntegerType && !canonical.isFourState()) {
+        t.kind = DpiKind::Integer;
+        const char* base = t.width == 8 ? "char" : t.width == 16 ? "short" : t.width == 32 ? "int"
+                                                                                 : "long long";
+        t.cType = t.isSigned ? base : std::string("unsigned ") + base;
+        return t;
+    }
+    if (t.width == 1 && canonical.kind == SymbolKind::ScalarType) {
+        t.kind = canonical.isFourState() ? DpiKind::Logic : DpiKind::Bit;
+        t.cType = canonical.isFourState() ? "svLogic" : "svBit";
+        return t;
+    }
+    t.kind = canonical.isFourState() ? DpiKind::LogicVector : DpiKind::BitVector;
+    t.cType = canonical.isFourState() ? "svLogicVecVal" : "svBitVecVal";
+    return t;
+}
+
+bool isDpiImport(const SubroutineSymbol& sub) {
+    return sub.flags.has(MethodFlags::DPIImport);
+}
+
+const SubroutineSymbol* calledSubroutine(const CallExpression& call) {
+    if (call.isSystemCall())
+        return nullptr;
+    return std::get<const SubroutineSymbol*>(call.subroutine);
+}
+
+// A random call emitRandomCall has no C++ for: `$urandom_range` without a bound, or `$random`
+// seeds and `std::randomize` arguments that are not variables of at most 64 bits.
+const CallExpression* unsupportedRandomCall(const Symbol& symbol) {
+    auto isVariable = [](const Expression& arg) {
+        const Expression* target = &arg;
+        if (target->kind == ExpressionKind::Assignment)
+            target = &target->as<AssignmentExpression>().left();
+        uint32_t width = bitWidth(*target->type, 0);
+        return target->kind == ExpressionKind::NamedValue && width > 0 && width <= 64;
+    };
+    const CallExpression* found = nullptr;
+    symbol.visit(makeVisitor([&](auto& self, const CallExpression& call) {
+        auto args = call.arguments();
+        switch (randomCall(call)) {
+            case RandomCall::UrandomRange:
+                if (args.empty())
+                    found = &call;
+                break;
+            case RandomCall::Random:
+                if (!args.empty() && !isVariable(*args[0]))
+                    found = &call;
+                break;
+            case RandomCall::Randomize:
+                if (!constrainedRandomize(call) &&
+                    !std::all_of(args.begin(), args.end(),
+                                 [&](const Expression* arg) { return isVariable(*arg); }))
+                    found = &call;
+                break;
+            default:
+                break;
+        }
+        self.visitDefault(call);
+    }));
+    return found;
+}
+
+// A random call used as a statement, typically `void'(std::randomize(x))`.
+const CallExpression* discardedRandomCall(const Expression& expr) {
+    const Expression* inner = &expr;
+    while (inner->kind == ExpressionKind::Conversion)
+        inner = &inner->as<ConversionExpression>().operand();
+    if (inner->kind != ExpressionKind::Call)
+        return nullptr;
+    auto& call = inner->as<CallExpression>();
+    return randomCall(call) != RandomCall::None ? &call : nullptr;
+}
+
+// The C symbol of an import: the SV name unless the declaration gave `c_name = sv_name`.
+std::string dpiImportName(const SubroutineSymbol& sub) {
+    if (auto* syntax = sub.getSyntax(); syntax && syntax->kind == SyntaxKind::DPIImport) {
+        auto cName = syntax->as<DPIImportSyntax>().c_identifier.valueText();
+        if (!cName.empty())
+            return std::string(cName);
+    }
+    return std::string(sub.name);
+}
+
+// Signals and memories of the module itself (not function arguments or locals); only these
+// can be passed in place.
+bool isModuleSignal(const ValueSymbol& sym) {
+    const Scope* scope = sym.getParentScope();
+    return scope && scope->asSymbol().kind == SymbolKind::InstanceBody;
+}
+
+const Expression& dpiActual(const Expression& actual, const FormalArgumentSymbol& formal) {
+    // Output and inout actuals are wrapped as assignments to the actual lvalue.
+    if (formal.direction != ArgumentDirection::In && actual.kind == ExpressionKind::Assignment)
+        return actual.as<AssignmentExpression>().left();
+    return actual;
+}
+
+const StringLiteral* stringLiteral(const Expression& expr) {
+    if (expr.kind == ExpressionKind::Conversion)
+        return stringLiteral(expr.as<ConversionExpression>().operand());
+    if (expr.kind == ExpressionKind::StringLiteral)
+        return &expr.as<StringLiteral>();
+    return nullptr;
+}
+
+std::string dpiParamDecl(const FormalArgumentSymbol& formal) {
+    DpiType t = dpiType(formal.getType());
+    bool input = formal.direction == ArgumentDirection::In;
+    std::string type = t.cType;
+    switch (t.kind) {
+        case DpiKind::BitVector:
+        case DpiKind::LogicVector:
+            type = (input ? "const " : "") + type + "*";
+            break;
+        case DpiKind::OpenArray:
+            type = input ? "const svOpenArrayHandle" : "svOpenArrayHandle";
+            break;
+        default:
+            if (!input)
+                type += "*";
+            break;
+    }
+    return type + " " + cppIdent(formal.name);
+}
+
+std::string dpiPrototype(const SubroutineSymbol& sub, const std::string& cName) {
+    // Tasks return int in C (nonzero when disabled), which generated code ignores.
+    std::string ret = sub.subroutineKind == SubroutineKind::Task
+                          ? "int"
+                          : dpiType(sub.getReturnType()).cType;
+    std::string text = ret + " " + cName + "(";
+    auto args = sub.getArguments();
+    for (size_t i = 0; i < args.size(); ++i)
+        text += (i ? ", " : "") + dpiParamDecl(*args[i]);
+    if (args.empty())
+        text += "void";
+    return text + ")";
+}
+
+// Why an import or export cannot be generated, or empty when it can.
+std::string dpiSignatureError(const SubroutineSymbol& sub, bool isExport) {
+    if (sub.subroutineKind != SubroutineKind::Task) {
+        auto ret = dpiType(sub.getReturnType()).kind;
+        if (ret != DpiKind::Void && ret != DpiKind::Integer && ret != DpiKind::Bit &&
+            ret != DpiKind::Logic)
+            return "unsupported return type";
+    }
+    for (auto* formal : sub.getArguments()) {
+        auto kind = dpiType(formal->getType()).kind;
+        if (kind == DpiKind::Unsupported || kind == DpiKind::Void)
+            return "unsupported type of argument '" + std::string(formal->name) + "'";
+        if (isExport && (formal->direction != ArgumentDirection::In ||
+                         kind == DpiKind::String || kind == DpiKind::OpenArray))
+            return "exported functions take input integral arguments only";
+    }
+    return {};
+}
+
+// Why a call of an import cannot pass its actuals, or empty when it can.
+std::string dpiCallError(const CallExpression& call, const SubroutineSymbol& sub) {
+    auto formals = sub.getArguments();
+    auto actuals = call.arguments();
+    for (size_t i = 0; i < formals.size() && i < actuals.size(); ++i) {
+        const FormalArgumentSymbol& formal = *formals[i];
+        const Expression& actual = dpiActual(*actuals[i], formal);
+        DpiType t = dpiType(formal.getType());
+        const ValueSymbol* sym = getValueSymbolFromExpr(actual);
+        bool moduleSignal = sym && isModuleSignal(*sym);
+        bool memory = moduleSignal && memoryShape(sym->getType()).has_value();
+        std::string arg = "argument '" + std::string(formal.name) + "'";
+        if (t.kind == DpiKind::OpenArray && !memory)
+            return arg + " must be a whole unpacked array of this module";
+        if (t.kind == DpiKind::String && !stringLiteral(actual))
+            return arg + " must be a string literal";
+        if (formal.direction != ArgumentDirection::In && t.kind != DpiKind::OpenArray &&
+            (!moduleSignal || memory))
+            return "output " + arg + " must be a whole signal of this module";
+    }
+    return {};
+}
+
+// One argument of a direct call to an import. Whole signals and memories are passed in
+// place; everything else through a temporary that lives until the call returns.
+std::string emitDpiArg(const FormalArgumentSymbol& formal, const Expression& actualArg,
+                       const EmitNames& names, std::string_view access) {
+    const Expression& actual = dpiActual(actualArg, formal);
+    DpiType t = dpiType(formal.getType());
+    const ValueSymbol* sym = getValueSymbolFromExpr(actual);
+    auto it = sym && isModuleSignal(*sym) ? names.find(sym) : names.end();
+    bool inPlace = it != names.end();
+    std::string bits = std::to_string(t.width);
+    std::string sign = t.isSigned ? "true" : "false";
+
+    if (formal.direction != ArgumentDirection::In) {
+        if (!inPlace)
+            return "nullptr";
+        const std::string& name = it->second;
+        switch (t.kind) {
+            case DpiKind::Integer:
+            case DpiKind::Bit:
+                return "sim::DpiOut(" + name + ", " + bits + ", " + sign + ").ptr<" + t.cType +
+                       ">()";
+            case DpiKind::BitVector:
+                return "sim::DpiOut(" + name + ", " + bits + ", " + sign + ").ptr<svBitVecVal>()";
+            case DpiKind::Logic:
+                return "sim::DpiLogicOut(" + name + ").scalar()";
+            case DpiKind::LogicVector:
+                return "sim::DpiLogicOut(" + name + ").vec()";
+            case DpiKind::OpenArray:
+                return "sim::DpiArrayOut(" + name + ").handle()";
+            default:
+                return "nullptr";
+        }
+    }
+
+    if (t.kind == DpiKind::String) {
+        auto* lit = stringLiteral(actual);
+        return lit ? cppStringLiteral(lit->getValue()) : "\"\"";
+    }
+    if (t.kind == DpiKind::OpenArray)
+        return inPlace ? "sim::dpi_array(" + it->second + ")" : "nullptr";
+    std::string value = "static_cast<uint64_t>(" + emitExpr(actual, names, access) + ")";
+    switch (t.kind) {
+        case DpiKind::Integer:
+            return "static_cast<" + t.cType + ">(" + value + ")";
+        case DpiKind::Bit:
+            return "static_cast<svBit>(" + value + " & 1)";
+        case DpiKind::Logic:
+            if (inPlace)
+                return "sim::dpi_logic(" + it->second + ".logic())";
+            return "static_cast<svLogic>(" + value + " & 1)";
+        case DpiKind::BitVector:
+            if (inPlace)
+                return "sim::dpi_bits(" + it->second + ")";
+            return "sim::DpiBits{" + value + "}.ptr()";
+        case DpiKind::LogicVector:
+            if (inPlace)
+                return "sim::DpiLogic(" + it->second + ".logic()).ptr()";
+            return "sim::DpiLogic(sim::Logic4{" + value + ", 0}).ptr()";
+        default:
+            return "0";
+    }
+}
+
+// A direct C call of an import as a 64-bit value (or a void expression). Context imports
+// make the calling instance the current svScope for the duration of the call.
+std::string emitDpiCall(const CallExpression& call, const SubroutineSymbol& sub,
+                        const EmitNames& names, std::string_view access) {
+    std::string text = dpiImportName(sub) + "(";
+    auto formals = sub.getArguments();
+    auto actuals = call.arguments();
+    for (size_t i = 0; i < formals.size() && i < actuals.size(); ++i)
+        text += (i ? ", " : "") + emitDpiArg(*formals[i], *actuals[i], names, access);
+    text += ")";
+    if (sub.flags.has(MethodFlags::DPIContext))
+        text = "(sim::DpiContext(dpi_scope_), " + text + ")";
+    if (sub.subroutineKind == SubroutineKind::Task)
+        return text;
+    switch (dpiType(sub.getReturnType()).kind) {
+        case DpiKind::Integer:
+            return "static_cast<uint64_t>(" + text + ")";
+        case DpiKind::Bit:
+        case DpiKind::Logic:
+            return "static_cast<uint64_t>(" + text + " & 1)";
+        default:
+            return text;
+    }
+}
+
+// emitExpr's text masked to the expression's width, for operators that look at every bit
+// (comparisons, reductions, right shifts, concatenation). emitExpr leaves arithmetic
+// unmasked since assignments mask anyway.
+std::string emitCanonical(const Expression& expr,
+                          const EmitNames& names,
+                          std::string_view access) {
+    std::string text = emitExpr(expr, names, access);
+    switch (expr.kind) {
+        case ExpressionKind::IntegerLiteral:
+        case ExpressionKind::UnbasedUnsizedIntegerLiteral:
+        case ExpressionKind::NamedValue:
+        case ExpressionKind::ElementSelect:
+        case ExpressionKind::RangeSelect:
+        case ExpressionKind::Concatenation:
+        case ExpressionKind::Replication:
+            return text;
+        default:
+            break;
+    }
+    uint32_t width = expr.type->isIntegral() ? expr.type->getBitWidth() : 64;
+    if (width == 0 || width >= 64)
+        return text;
+    return "(" + text + " & " + std::to_string(widthMask(width)) + "ULL)";
+}
+
+// A part select of `count` packed elements of `value` starting at element index `lsb`
+// (plus `adjust`), as a shift and mask. Constant offsets are folded here.
+std::string emitSelect(const Expression& value, const Expression& lsb, int64_t adjust,
+                       uint32_t width,
+                       const EmitNames& names,
+                       std::string_view access) {
+    const Type& type = *value.type;
+    uint32_t from = type.isIntegral() ? type.getBitWidth() : 0;
+    if (from == 0 || from > 64)
+        return "0";
+    ConstantRange range = type.getFixedRange();
+    if (from % range.width() != 0)
+        return "0";
+    uint32_t elementWidth = from / range.width();
+    std::string source = emitExpr(value, names, access);
+    std::string mask = std::to_string(widthMask(width)) + "ULL";
+    if (auto index = constantInt(lsb)) {
+        int64_t element = range.isLittleEndian() ? *index + adjust - range.lower()
+                                                 : range.upper() - (*index + adjust);
+        int64_t offset = element * elementWidth;
+        if (offset < 0 || offset >= 64)
+            return "0";
+        if (offset == 0)
+            return "(" + source + " & " + mask + ")";
+        return "((" + source + " >> " + std::to_string(offset) + ") & " + mask + ")";
+    }
+    std::string index = emitCanonical(lsb, names, access);
+    if (lsb.type->isSigned() && lsb.type->getBitWidth() < 64)
+        index = "sim::sext(" + index + ", " + std::to_string(lsb.type->getBitWidth()) + ")";
+    std::string element =
+        range.isLittleEndian()
+            ? "(" + index + " - " + std::to_string(range.lower() - adjust) + "ULL)"
+            : "(" + std::to_string(range.upper() - adjust) + "ULL - " + index + ")";
+    if (elementWidth != 1)
+        element = "(" + element + " * " + std::to_string(elementWidth) + ")";
+    return "sim::bits(" + source + ", " + element + ", " + std::to_string(width) + ")";
+}
+
+// `$urandom`, `$urandom_range`, `$random` and `std::randomize` on the process's stream.
+// Variables written by `$random(seed)` and `std::randomize` are set in place (a blocking
+// write), which the comma expression orders before the call's value. emitModule gives every
+// process and function that draws a stream and rejects what unsupportedRandomCall finds.
+std::string emitRandomCall(const CallExpression& call, RandomCall kind, const EmitNames& names,
+                           std::string_view access) {
+    if (!names.random)
+        return "0";
+    const std::string& rng = *names.random;
+    auto args = call.arguments();
+    auto variable = [&](const Expression& arg) -> const std::string* {
+        const Expression* target = &arg;
+        if (target->kind == ExpressionKind::Assignment)
+            target = &target->as<AssignmentExpression>().left();
+        if (target->kind != ExpressionKind::NamedValue)
+            return nullptr;
+        auto it = names.find(getValueSymbolFromExpr(*target));
+        return it != names.end() ? &it->second : nullptr;
+    };
+    switch (kind) {
+        case RandomCall::Urandom:
+            if (!args.empty())
+                return "static_cast<uint64_t>(" + rng + ".reseed(" +
+                       emitExpr(*args[0], names, access) + ").urandom())";
+            return "static_cast<uint64_t>(" + rng + ".get().urandom())";
+        case RandomCall::UrandomRange:
+            if (args.empty())
+                return "0";
+            return "static_cast<uint64_t>(" + rng + ".get().urandom_range(" +
+                   emitExpr(*args[0], names, access) + ", " +
+                   (args.size() > 1 ? emitExpr(*args[1], names, access) : "0ULL") + "))";
+        case RandomCall::Random:
+            if (args.empty())
+                return "static_cast<uint64_t>(" + rng + ".get().urandom())";
+            if (auto* seed = variable(*args[0]))
+                return "sim::random_seeded(" + *seed + ")";
+            return "0";
+        case RandomCall::Randomize: {
+            if (constrainedRandomize(call))
+                return "0ULL";
+            std::string text = "(";
+            for (auto* arg : args) {
+                auto* target = variable(*arg);
+                uint32_t width = bitWidth(*arg->type, 0);
+                if (!target || width == 0 || width > 64)
+                    continue;
+                text += *target + ".set(" + rng + ".get().bits(" + std::to_string(width) +
+                        ")), ";
+            }
+            return text + "1ULL)";
+        }
+        default:
+            return "0";
+    }
+}
+
 std::string emitExpr(const Expression& expr,
-                     const std::unordered_map<const ValueSymbol*, std::string>& names) {
+                     const EmitNames& names,
+                     std::string_view access) {
     switch (expr.kind) {
         case ExpressionKind::IntegerLiteral: {
             auto& lit = expr.as<IntegerLiteral>();
@@ -196,30 +741,177 @@ std::string emitExpr(const Expression& expr,
             }
             auto it = names.find(&sym.as<ValueSymbol>());
             if (it != names.end())
-                return it->second + ".value()";
+                return it->second + std::string(access);
             return "0";
         }
         case ExpressionKind::Conversion: {
             auto& conv = expr.as<ConversionExpression>();
-            return emitExpr(conv.operand(), names);
+            const Type& from = *conv.operand().type;
+            uint32_t fromWidth = from.isIntegral() ? from.getBitWidth() : 0;
+            // Signed operands widen by sign extension (high bits masked by the consumer).
+            if (from.isSigned() && fromWidth > 0 && fromWidth < 64 &&
+                fromWidth < bitWidth(*expr.type, 64))
+                return "sim::sext(" + emitCanonical(conv.operand(), names, access) + ", " +
+                       std::to_string(fromWidth) + ")";
+            return emitExpr(conv.operand(), names, access);
+        }
+        case ExpressionKind::ElementSelect: {
+            auto& sel = expr.as<ElementSelectExpression>();
+            const ValueSymbol* sym = getValueSymbolFromExpr(sel.value());
+            auto shape = sym ? memoryShape(sym->getType()) : std::nullopt;
+            if (!shape) {
+                return emitSelect(sel.value(), sel.selector(), 0, bitWidth(*expr.type), names,
+                                  access);
+            }
+            auto it = names.find(sym);
+            if (it == names.end())
+                return "0";
+            return it->second + ".read(" + emitMemoryAddress(sel, *shape, names, access) + ")";
+        }
+        case ExpressionKind::RangeSelect: {
+            auto& sel = expr.as<RangeSelectExpression>();
+            const Type& type = *sel.value().type;
+            uint32_t width = bitWidth(*expr.type);
+            if (!type.isIntegral())
+                return "0";
+            ConstantRange range = type.getFixedRange();
+            if (range.width() == 0 || type.getBitWidth() % range.width() != 0)
+                return "0";
+            int64_t last = width / (type.getBitWidth() / range.width()) - 1;
+            switch (sel.getSelectionKind()) {
+                case RangeSelectionKind::IndexedUp:
+                    return emitSelect(sel.value(), sel.left(),
+                                      range.isLittleEndian() ? 0 : last, width, names, access);
+                case RangeSelectionKind::IndexedDown:
+                    return emitSelect(sel.value(), sel.left(),
+                                      range.isLittleEndian() ? -last : 0, width, names, access);
+                default:
+                    return emitSelect(sel.value(), sel.right(), 0, width, names, access);
+            }
+        }
+        case ExpressionKind::Concatenation: {
+            // Operands are shifted into place at codegen time, least significant first.
+            auto& cat = expr.as<ConcatenationExpression>();
+            std::string text;
+            uint32_t shift = 0;
+            for (size_t i = cat.operands().size(); i-- > 0;) {
+                const Expression& operand = *cat.operands()[i];
+                uint32_t w = operand.type->getBitWidth();
+                if (w == 0)
+                    continue;
+                std::string part = emitCanonical(operand, names, access);
+                if (shift != 0)
+                    part = "(" + part + " << " + std::to_string(shift) + ")";
+                text = text.empty() ? part : text + " | " + part;
+                shift += w;
+            }
+            return text.empty() ? "0" : "(" + text + ")";
+        }
+        case ExpressionKind::Replication: {
+            // Copies never overlap, so one multiply makes all of them.
+            const Expression& inner = expr.as<ReplicationExpression>().concat();
+            uint32_t width = bitWidth(*expr.type);
+            uint32_t w = inner.type->getBitWidth();
+            if (w == 0 || width % w != 0 || width > 64)
+                return "0";
+            uint64_t pattern = 0;
+            for (uint32_t bit = 0; bit < width; bit += w)
+                pattern |= 1ULL << bit;
+            return "(" + emitCanonical(inner, names, access) + " * " + std::to_string(pattern) +
+                   "ULL)";
         }
         case ExpressionKind::UnaryOp: {
             auto& un = expr.as<UnaryExpression>();
-            std::string rhs = emitExpr(un.operand(), names);
+            std::string rhs = emitExpr(un.operand(), names, access);
+            uint32_t from = un.operand().type->getBitWidth();
             switch (un.op) {
                 case UnaryOperator::LogicalNot:
                     return "(!" + rhs + ")";
                 case UnaryOperator::BitwiseNot:
                     return "(~" + rhs + ")";
+                case UnaryOperator::Minus:
+                    return "(0ULL - " + rhs + ")";
+                case UnaryOperator::BitwiseAnd:
+                case UnaryOperator::BitwiseNand:
+                    return std::string(un.op == UnaryOperator::BitwiseAnd ? "(" : "(!(") +
+                           emitCanonical(un.operand(), names, access) + " == " +
+                           std::to_string(widthMask(from)) + "ULL" +
+                           (un.op == UnaryOperator::BitwiseAnd ? ")" : "))");
+                case UnaryOperator::BitwiseOr:
+                    return "(" + emitCanonical(un.operand(), names, access) + " != 0)";
+                case UnaryOperator::BitwiseNor:
+                    return "(" + emitCanonical(un.operand(), names, access) + " == 0)";
+                case UnaryOperator::BitwiseXor:
+                    return "sim::parity(" + emitCanonical(un.operand(), names, access) + ")";
+                case UnaryOperator::BitwiseXnor:
+                    return "(sim::parity(" + emitCanonical(un.operand(), names, access) +
+                           ") ^ 1)";
                 default:
                     return "(" + rhs + ")";
             }
         }
         case ExpressionKind::BinaryOp: {
             auto& bin = expr.as<BinaryExpression>();
-            std::string lhs = emitExpr(bin.left(), names);
-            std::string rhs = emitExpr(bin.right(), names);
+            std::string lhs = emitExpr(bin.left(), names, access);
+            std::string rhs = emitExpr(bin.right(), names, access);
+            uint32_t from = bin.left().type->getBitWidth();
+            bool isSigned = bin.left().type->isSigned() && bin.right().type->isSigned();
+            // Comparisons and right shifts look at every bit of their operands.
+            auto compare = [&](const char* op, const char* signedFn, bool swap) {
+                std::string a = emitCanonical(bin.left(), names, access);
+                std::string b = emitCanonical(bin.right(), names, access);
+                if (swap)
+                    std::swap(a, b);
+                if (isSigned && signedFn && from < 64)
+                    return std::string(signedFn) + "(" + a + ", " + b + ", " +
+                           std::to_string(from) + ")";
+                if (isSigned && signedFn)
+                    return "(static_cast<int64_t>(" + a + ") " + op + " static_cast<int64_t>(" +
+                           b + "))";
+                return "(" + a + " " + op + " " + b + ")";
+            };
+            auto amount = [&]() { return constantInt(bin.right()); };
             switch (bin.op) {
+                case BinaryOperator::BinaryAnd:
+                    return "(" + lhs + " & " + rhs + ")";
+                case BinaryOperator::BinaryOr:
+                    return "(" + lhs + " | " + rhs + ")";
+                case BinaryOperator::BinaryXor:
+                    return "(" + lhs + " ^ " + rhs + ")";
+                case BinaryOperator::BinaryXnor:
+                    return "(~(" + lhs + " ^ " + rhs + "))";
+                case BinaryOperator::Equality:
+                case BinaryOperator::CaseEquality:
+                    return compare("==", nullptr, false);
+                case BinaryOperator::Inequality:
+                case BinaryOperator::CaseInequality:
+                    return compare("!=", nullptr, false);
+                case BinaryOperator::LessThan:
+                    return compare("<", "sim::slt", false);
+                case BinaryOperator::LessThanEqual:
+                    return compare("<=", "sim::sle", false);
+                case BinaryOperator::GreaterThan:
+                    return compare("<", "sim::slt", true);
+                case BinaryOperator::GreaterThanEqual:
+                    return compare("<=", "sim::sle", true);
+                case BinaryOperator::LogicalShiftLeft:
+                case BinaryOperator::ArithmeticShiftLeft:
+                    if (auto k = amount(); k && *k >= 0 && *k < 64)
+                        return "(" + lhs + " << " + std::to_string(*k) + ")";
+                    return "sim::shl(" + lhs + ", " + emitCanonical(bin.right(), names, access) +
+                           ")";
+                case BinaryOperator::LogicalShiftRight:
+                case BinaryOperator::ArithmeticShiftRight: {
+                    std::string value = emitCanonical(bin.left(), names, access);
+                    std::string shift = emitCanonical(bin.right(), names, access);
+                    if (bin.op == BinaryOperator::ArithmeticShiftRight &&
+                        bin.left().type->isSigned())
+                        return "sim::sar(" + value + ", " + shift + ", " + std::to_string(from) +
+                               ")";
+                    if (auto k = amount(); k && *k >= 0 && *k < 64)
+                        return "(" + value + " >> " + std::to_string(*k) + ")";
+                    return "sim::shr(" + value + ", " + shift + ")";
+                }
                 case BinaryOperator::Add:
                     return "(" + lhs + " + " + rhs + ")";
                 case BinaryOperator::Subtract:
@@ -240,121 +932,154 @@ std::string emitExpr(const Expression& expr,
             auto& call = expr.as<CallExpression>();
             if (call.isSystemCall() && call.getSubroutineName() == "$time")
                 return "kernel.time()";
-            return "0";
+            if (auto kind = randomCall(call); kind != RandomCall::None)
+                return emitRandomCall(call, kind, names, access);
+            auto* sub = calledSubroutine(call);
+            if (sub && isDpiImport(*sub))
+                return emitDpiCall(call, *sub, names, access);
+            if (!names.functions)
+                return "0";
+            if (auto value = evalConstant(call, *names.functions->scope))
+                return std::to_string(*value) + "ULL";
+            auto it = sub ? names.functions->members.find(sub) : names.functions->members.end();
+            if (it == names.functions->members.end())
+                return "0";
+            std::string text = it->second + "(";
+            auto args = call.arguments();
+            for (size_t i = 0; i < args.size(); ++i)
+                text += (i ? ", " : "") + emitExpr(*args[i], names, access);
+            return text + ")";
         }
+        case ExpressionKind::LValueReference:
+            return compoundTarget ? emitExpr(*compoundTarget, names, access) : "0";
         default:
             return "0";
     }
 }
 
-std::string emitMonitorArg(const Expression& expr,
-                           const std::unordered_map<const ValueSymbol*, std::string>& names) {
-    if (expr.kind == ExpressionKind::Call) {
-        auto& call = expr.as<CallExpression>();
-        if (call.isSystemCall() && call.getSubroutineName() == "$time")
-            return "sim::MonitorArg::time()";
-    }
-    const ValueSymbol* sym = getValueSymbolFromExpr(expr);
-    if (sym) {
-        auto it = names.find(sym);
-        if (it != names.end())
-            return "sim::MonitorArg::signalArg(&" + it->second + ")";
-    }
-    return "sim::MonitorArg::time()";
-}
-
-bool emitInitialStatement(const Statement& stmt,
-                          const std::unordered_map<const ValueSymbol*, std::string>& names,
-                          std::ostream& out,
-                          int indent,
-                          const std::string& timeVar) {
-    auto pad = std::string(static_cast<size_t>(indent), ' ');
-    switch (stmt.kind) {
-        case StatementKind::Block: {
-            auto& block = stmt.as<BlockStatement>();
-            return emitInitialStatement(block.body, names, out, indent, timeVar);
-        }
-        case StatementKind::List: {
-            auto& list = stmt.as<StatementList>();
-            for (auto* s : list.list) {
-                if (!emitInitialStatement(*s, names, out, indent, timeVar))
-                    return false;
-            }
-            return true;
+// The C++ for node `id`, with the nodes in `temps` read from their locals instead.
+std::string emitNodeText(const LoweredModule& lowered, ir::NodeId id, const EmitNames& names,
+                         const std::unordered_map<ir::NodeId, std::string>& temps) {
+    if (auto temp = temps.find(id); temp != temps.end())
+        return temp->second;
+    const ir::Node& node = lowered.ir.nodes[id];
+    auto operand = [&](ir::NodeId n) { return emitNodeText(lowered, n, names, temps); };
+    auto binary = [&](const char* op) {
+        return "(" + operand(node.a) + " " + op + " " + operand(node.b) + ")";
+    };
+    switch (node.op) {
+        case ir::Op::Const:
+            return std::to_string(node.value) + "ULL";
+        case ir::Op::Signal: {
+            auto it = names.find(lowered.symbols[node.value]);
+            return it != names.end() ? it->second + ".value()" : "0";
         }
-        case StatementKind::Timed: {
-            auto& ts = stmt.as<TimedStatement>();
-            if (ts.timing.kind == TimingControlKind::Delay) {
-                auto& delay = ts.timing.as<DelayControl>();
-                std::string expr = emitExpr(delay.expr, names);
-                out << pad << timeVar << " += static_cast<uint64_t>(" << expr << ");\n";
-                if (ts.stmt.kind == StatementKind::Empty)
-                    return true;
-                return emitInitialStatement(ts.stmt, names, out, indent, timeVar);
-            }
-            return false;
+        case ir::Op::MemRead: {
+            auto it = names.find(lowered.symbols[node.value]);
+            return it != names.end() ? it->second + ".read(" + operand(node.a) + ")" : "0";
         }
-        case StatementKind::Empty:
-            return true;
-        case StatementKind::ExpressionStatement: {
-            auto& es = stmt.as<ExpressionStatement>();
-            if (es.expr.kind == ExpressionKind::Call) {
-                auto& call = es.expr.as<CallExpression>();
-                if (!call.isSystemCall())
-                    return false;
-                auto name = call.getSubroutineName();
-                if (name == "$finish") {
-                    out << pad << "kernel.schedule_at(" << timeVar
-                        << ", [this]() { this->kernel.finish(); });\n";
-                    return true;
-                }
-                if (name == "$monitor") {
-                    if (call.arguments().empty())
-                        return false;
-                    if (call.arguments()[0]->kind != ExpressionKind::StringLiteral)
-                        return false;
-                    auto& fmt = call.arguments()[0]->as<StringLiteral>();
-                    out << pad << "kernel.schedule_at(" << timeVar << ", [this]() {\n";
-                    out << pad << "    this->kernel.register_monitor(\"" << fmt.getValue()
-                        << "\", {";
-                    bool first = true;
-                    for (size_t i = 1; i < call.arguments().size(); ++i) {
-                        const Expression* arg = call.arguments()[i];
-                        if (!first)
-                            out << ", ";
-                        first = false;
-                        out << emitMonitorArg(*arg, names);
-                    }
-                    out << "});\n";
-                    out << pad << "});\n";
-                    return true;
-                }
-                return false;
-            }
-            if (es.expr.kind == ExpressionKind::Assignment) {
-                auto& a = es.expr.as<AssignmentExpression>();
-                const ValueSymbol* lhsSym = getValueSymbolFromExpr(a.left());
-                if (!lhsSym)
-                    return false;
-                auto it = names.find(lhsSym);
-                if (it == names.end())
-                    return false;
-                std::string rhs = emitExpr(a.right(), names);
-                out << pad << "kernel.schedule_at(" << timeVar << ", [this]() {\n";
-                if (a.isNonBlocking()) {
-                    out << pad << "    this->kernel.nba_assign(" << it->second << ", " << rhs
-                        << ");\n";
-                } else {
-                    out << pad << "    " << it->second << ".set(" << rhs << ");\n";
-                }
-                out << pad << "});\n";
-                return true;
-            }
-            return false;
+        case ir::Op::Opaque:
+            return emitExpr(*lowered.opaque[node.value], names);
+        case ir::Op::Trunc:
+            return "(" + operand(node.a) + " & " + std::to_string(widthMask(node.width)) + "ULL)";
+        case ir::Op::Sext:
+            return "sim::sext(" + operand(node.a) + ", " + std::to_string(node.value) + ")";
+        case ir::Op::Not:
+            return "(~" + operand(node.a) + ")";
+        case ir::Op::LogicNot:
+            return "(!" + operand(node.a) + ")";
+        case ir::Op::Add:
+            return binary("+");
+        case ir::Op::Sub:
+            return binary("-");
+        case ir::Op::Mul:
+            return binary("*");
+        case ir::Op::Div:
+            return "sim::div2(" + operand(node.a) + ", " + operand(node.b) + ")";
+        case ir::Op::And:
+            return binary("&");
+        case ir::Op::Or:
+            return binary("|");
+        case ir::Op::Xor:
+            return binary("^");
+        case ir::Op::LogicAnd:
+            return binary("&&");
+        case ir::Op::LogicOr:
+            return binary("||");
+        case ir::Op::Shl:
+        case ir::Op::Shr: {
+            // Constant amounts (every select offset) are plain shifts.
+            const ir::Node& amount = lowered.ir.nodes[node.b];
+            if (amount.op != ir::Op::Const)
+                return std::string(node.op == ir::Op::Shl ? "sim::shl(" : "sim::shr(") +
+                       operand(node.a) + ", " + operand(node.b) + ")";
+            if (amount.value >= 64)
+                return "0ULL";
+            return binary(node.op == ir::Op::Shl ? "<<" : ">>");
         }
-        default:
-            return false;
+        case ir::Op::Sar:
+            return "sim::sar(" + operand(node.a) + ", " + operand(node.b) + ", " +
+                   std::to_string(node.value) + ")";
+        case ir::Op::Eq:
+            return binary("==");
+        case ir::Op::Ne:
+            return binary("!=");
+        case ir::Op::Lt:
+            return binary("<");
+        case ir::Op::Le:
+            return binary("<=");
+        case ir::Op::Slt:
+        case ir::Op::Sle:
+            return std::string(node.op == ir::Op::Slt ? "sim::slt(" : "sim::sle(") +
+                   operand(node.a) + ", " + operand(node.b) + ", " + std::to_string(node.value) +
+                   ")";
+        case ir::Op::RedAnd:
+            return "(" + operand(node.a) + " == " +
+                   std::to_string(widthMask(static_cast<uint32_t>(node.value))) + "ULL)";
+        case ir::Op::RedOr:
+            return "(" + operand(node.a) + " != 0)";
+        case ir::Op::RedXor:
+            return "sim::parity(" + operand(node.a) + ")";
+        case ir::Op::Gather:
+            return "sim::gather(" + operand(node.a) + ", " + std::to_string(node.value) + "ULL)";
+    }
+    return "0";
+}
+
+// The C++ for an optimized IR node. Nodes the IR does not model go back to emitExpr. Shared
+// nodes (LoweredModule::shared) the expression uses more than once are computed once, into
+// `const uint64_t` locals of an immediately invoked lambda the C++ compiler inlines.
+std::string emitNode(const LoweredModule& lowered, ir::NodeId id, const EmitNames& names) {
+    std::unordered_map<ir::NodeId, uint32_t> uses;
+    std::vector<ir::NodeId> stack{id};
+    while (!stack.empty()) {
+        ir::NodeId n = stack.back();
+        stack.pop_back();
+        if (uses[n]++ != 0)
+            continue;
+        const ir::Node& node = lowered.ir.nodes[n];
+        if (node.a != ir::kNoNode)
+            stack.push_back(node.a);
+        if (node.b != ir::kNoNode)
+            stack.push_back(node.b);
+    }
+    // Operands come before their users, so ascending ids define each local before its use.
+    std::vector<ir::NodeId> shared;
+    for (const auto& [n, count] : uses) {
+        if (count > 1 && n < lowered.shared.size() && lowered.shared[n])
+            shared.push_back(n);
     }
+    std::unordered_map<ir::NodeId, std::string> temps;
+    if (shared.empty())
+        return emitNodeText(lowered, id, names, temps);
+    std::sort(shared.begin(), shared.end());
+    std::string text = "[&] {";
+    for (ir::NodeId n : shared) {
+        std::string temp = "cse" + std::to_string(temps.size()) + "_";
+        text += " const uint64_t " + temp + " = " + emitNodeText(lowered, n, names, temps) + ";";
+        temps.emplace(n, temp);
+    }
+    return text + " return " + emitNodeText(lowered, id, names, temps) + "; }()";
 }
 
 void collectExprSignals(const Expression& expr,
@@ -368,150 +1093,2486 @@ void collectExprSignals(const Expression& expr,
     });
 }
 
-void collectStatementSignals(const Statement& stmt,
-                             std::unordered_set<const ValueSymbol*>& deps) {
-    switch (stmt.kind) {
-        case StatementKind::Block: {
-            auto& block = stmt.as<BlockStatement>();
-            collectStatementSignals(block.body, deps);
-            break;
+// The signals an assignment target writes and those its selectors read: `x`, `x[i]`,
+// `x[i +: 4]`, `mem[i]` and concatenations of them.
+void collectTargetSignals(const Expression& target,
+                          std::unordered_set<const ValueSymbol*>& writes,
+                          std::unordered_set<const ValueSymbol*>& reads) {
+    switch (target.kind) {
+        case ExpressionKind::Concatenation:
+            for (auto* operand : target.as<ConcatenationExpression>().operands())
+                collectTargetSignals(*operand, writes, reads);
+            return;
+        case ExpressionKind::ElementSelect: {
+            auto& sel = target.as<ElementSelectExpression>();
+            collectExprSignals(sel.selector(), reads);
+            collectTargetSignals(sel.value(), writes, reads);
+            return;
         }
-        case StatementKind::List: {
-            auto& list = stmt.as<StatementList>();
-            for (auto* s : list.list)
-                collectStatementSignals(*s, deps);
-            break;
+        case ExpressionKind::RangeSelect: {
+            auto& sel = target.as<RangeSelectExpression>();
+            collectExprSignals(sel.left(), reads);
+            collectExprSignals(sel.right(), reads);
+            collectTargetSignals(sel.value(), writes, reads);
+            return;
         }
-        case StatementKind::Conditional: {
-            auto& cond = stmt.as<ConditionalStatement>();
-            collectExprSignals(*cond.conditions[0].expr, deps);
-            collectStatementSignals(cond.ifTrue, deps);
-            if (cond.ifFalse)
-                collectStatementSignals(*cond.ifFalse, deps);
-            break;
+        default:
+            if (auto* sym = getValueSymbolFromExpr(target))
+                writes.insert(sym);
+            return;
+    }
+}
+
+// Converts a literal to the runtime's aval/bval encoding. slang marks X and Z through the
+// per-bit logic_t state, so this stays independent of SVInt's internal word layout.
+std::string emitLiteral4(const SVInt& value) {
+    uint64_t aval = 0;
+    uint64_t bval = 0;
+    uint32_t width = std::min<uint32_t>(value.getBitWidth(), 64);
+    for (uint32_t i = 0; i < width; ++i) {
+        logic_t bit = value[static_cast<int32_t>(i)];
+        if (bit.isUnknown()) {
+            bval |= 1ULL << i;
+            if (bit.value != logic_t::Z_VALUE)
+                aval |= 1ULL << i;
+        } else if (bit.value) {
+            aval |= 1ULL << i;
         }
-        case StatementKind::Timed: {
-            auto& ts = stmt.as<TimedStatement>();
-            if (ts.timing.kind == TimingControlKind::Delay) {
-                auto& delay = ts.timing.as<DelayControl>();
-                collectExprSignals(delay.expr, deps);
-            }
-            collectStatementSignals(ts.stmt, deps);
-            break;
+    }
+    return "sim::Logic4{" + std::to_string(aval) + "ULL, " + std::to_string(bval) + "ULL}";
+}
+
+bool hasUnknownLiteral(const Expression& expr) {
+    switch (expr.kind) {
+        case ExpressionKind::IntegerLiteral:
+            return expr.as<IntegerLiteral>().getValue().hasUnknown();
+        case ExpressionKind::UnbasedUnsizedIntegerLiteral:
+            return expr.as<UnbasedUnsizedIntegerLiteral>().getValue().hasUnknown();
+        case ExpressionKind::Conversion:
+            return hasUnknownLiteral(expr.as<ConversionExpression>().operand());
+        case ExpressionKind::UnaryOp:
+            return hasUnknownLiteral(expr.as<UnaryExpression>().operand());
+        case ExpressionKind::BinaryOp: {
+            auto& bin = expr.as<BinaryExpression>();
+            return hasUnknownLiteral(bin.left()) || hasUnknownLiteral(bin.right());
         }
-        case StatementKind::ExpressionStatement: {
-            auto& es = stmt.as<ExpressionStatement>();
-            if (es.expr.kind == ExpressionKind::Assignment) {
-                auto& a = es.expr.as<AssignmentExpression>();
-                collectExprSignals(a.right(), deps);
-            } else {
-                collectExprSignals(es.expr, deps);
-            }
-            break;
+        case ExpressionKind::ConditionalOp: {
+            auto& cond = expr.as<ConditionalExpression>();
+            return hasUnknownLiteral(cond.left()) || hasUnknownLiteral(cond.right());
         }
         default:
-            break;
+            return false;
     }
 }
 
-void emitStatement(const Statement& stmt,
-                   const std::unordered_map<const ValueSymbol*, std::string>& names,
-                   std::ostream& out,
-                   int indent,
-                   bool allowNba) {
+// True when evaluating `expr` can observe X/Z: it reads a 4-state signal or contains an
+// X/Z literal. Everything else keeps the plain 2-state expression.
+bool needsFourState(const Expression& expr,
+                    const std::unordered_set<const ValueSymbol*>& fourState) {
+    if (fourState.empty())
+        return false;
+    if (hasUnknownLiteral(expr))
+        return true;
+    bool found = false;
+    expr.visitSymbolReferences([&](const Expression&, const Symbol& sym) {
+        if (ValueSymbol::isKind(sym.kind) && fourState.count(&sym.as<ValueSymbol>()))
+            found = true;
+    });
+    return found;
+}
+
+// Emits an expression of type `sim::Logic4`. Operands that cannot carry X/Z are emitted
+// with the 2-state emitter and wrapped as known values.
+std::string emitExpr4(const Expression& expr,
+                      const EmitNames& names,
+                      const std::unordered_set<const ValueSymbol*>& fourState) {
+    std::string width = std::to_string(bitWidth(*expr.type, 64));
+    auto known = [&]() { return "sim::Logic4{" + emitExpr(expr, names) + ", 0}"; };
+    switch (expr.kind) {
+        case ExpressionKind::IntegerLiteral:
+            return emitLiteral4(expr.as<IntegerLiteral>().getValue());
+        case ExpressionKind::UnbasedUnsizedIntegerLiteral:
+            return emitLiteral4(expr.as<UnbasedUnsizedIntegerLiteral>().getValue());
+        case ExpressionKind::NamedValue: {
+            auto& sym = expr.as<NamedValueExpression>().symbol;
+            if (!ValueSymbol::isKind(sym.kind) || !fourState.count(&sym.as<ValueSymbol>()))
+                return known();
+            auto it = names.find(&sym.as<ValueSymbol>());
+            if (it == names.end())
+                return known();
+            return it->second + ".logic()";
+        }
+        case ExpressionKind::Conversion:
+            return emitExpr4(expr.as<ConversionExpression>().operand(), names, fourState);
+        case ExpressionKind::UnaryOp: {
+            auto& un = expr.as<UnaryExpression>();
+            std::string rhs = emitExpr4(un.operand(), names, fourState);
+            switch (un.op) {
+                case UnaryOperator::BitwiseNot:
+                    return "sim::l4_not(" + rhs + ", " + width + ")";
+                case UnaryOperator::LogicalNot:
+                    return "sim::l4_lnot(" + rhs + ")";
+                default:
+                    return known();
+            }
+        }
+        case ExpressionKind::BinaryOp: {
+            auto& bin = expr.as<BinaryExpression>();
+            std::string lhs = emitExpr4(bin.left(), names, fourState);
+            std::string rhs = emitExpr4(bin.right(), names, fourState);
+            auto sized = [&](const char* fn) {
+                return std::string("sim::") + fn + "(" + lhs + ", " + rhs + ", " + width + ")";
+            };
+            auto unsized = [&](const char* fn) {
+                return std::string("sim::") + fn + "(" + lhs + ", " + rhs + ")";
+            };
+            switch (bin.op) {
+                case BinaryOperator::Add:
+                    return sized("l4_add");
+                case BinaryOperator::Subtract:
+                    return sized("l4_sub");
+                case BinaryOperator::Multiply:
+                    return sized("l4_mul");
+                case BinaryOperator::Divide:
+                    return sized("l4_div");
+                case BinaryOperator::BinaryAnd:
+                    return sized("l4_and");
+                case BinaryOperator::BinaryOr:
+                    return sized("l4_or");
+                case BinaryOperator::BinaryXor:
+                    return sized("l4_xor");
+                case BinaryOperator::LogicalAnd:
+                    return unsized("l4_land");
+                case BinaryOperator::LogicalOr:
+                    return unsized("l4_lor");
+                case BinaryOperator::Equality:
+                    return unsized("l4_eq");
+                case BinaryOperator::Inequality:
+                    return unsized("l4_ne");
+                case BinaryOperator::CaseEquality:
+                    return unsized("l4_case_eq");
+                case BinaryOperator::CaseInequality:
+                    return "sim::l4_not(" + unsized("l4_case_eq") + ", 1)";
+                default:
+                    return known();
+            }
+        }
+        default:
+            return known();
+    }
+}
+
+// Picks the 4-state emitter only for right-hand sides that can actually produce X/Z; 2-state
+// ones come from the optimized IR when `ir` has lowered them.
+std::string emitRhs(const Expression& expr,
+                    const EmitNames& names,
+                    const std::unordered_set<const ValueSymbol*>& fourState,
+                    const LoweredModule* ir = nullptr) {
+    if (needsFourState(expr, fourState))
+        return emitExpr4(expr, names, fourState);
+    if (ir && ir->node(expr) != ir::kNoNode)
+        return emitNode(*ir, ir->node(expr), names);
+    return emitExpr(expr, names);
+}
+
+std::string emitCondition(const Expression& expr,
+                          const EmitNames& names,
+                          const std::unordered_set<const ValueSymbol*>& fourState,
+                          const LoweredModule* ir = nullptr) {
+    if (needsFourState(expr, fourState))
+        return "sim::l4_true(" + emitExpr4(expr, names, fourState) + ")";
+    if (ir && ir->node(expr) != ir::kNoNode)
+        return emitNode(*ir, ir->node(expr), names);
+    return emitExpr(expr, names);
+}
+
+void forEachAssignment(const Statement& stmt,
+                       const std::function<void(const AssignmentExpression&)>& fn) {
+    switch (stmt.kind) {
+        case StatementKind::Block:
+            forEachAssignment(stmt.as<BlockStatement>().body, fn);
+            break;
+        case StatementKind::List:
+            for (auto* s : stmt.as<StatementList>().list)
+                forEachAssignment(*s, fn);
+            break;
+        case StatementKind::Conditional: {
+            auto& cond = stmt.as<ConditionalStatement>();
+            forEachAssignment(cond.ifTrue, fn);
+            if (cond.ifFalse)
+                forEachAssignment(*cond.ifFalse, fn);
+            break;
+        }
+        case StatementKind::Case: {
+            auto& cs = stmt.as<CaseStatement>();
+            for (auto& group : cs.items)
+                forEachAssignment(*group.stmt, fn);
+            if (cs.defaultCase)
+                forEachAssignment(*cs.defaultCase, fn);
+            break;
+        }
+        case StatementKind::ForLoop:
+            forEachAssignment(stmt.as<ForLoopStatement>().body, fn);
+            break;
+        case StatementKind::Timed:
+            forEachAssignment(stmt.as<TimedStatement>().stmt, fn);
+            break;
+        case StatementKind::ForeverLoop:
+            forEachAssignment(stmt.as<ForeverLoopStatement>().body, fn);
+            break;
+        case StatementKind::ExpressionStatement: {
+            auto& es = stmt.as<ExpressionStatement>();
+            if (es.expr.kind == ExpressionKind::Assignment)
+                fn(es.expr.as<AssignmentExpression>());
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Result of the X/Z propagation analysis. Signals are keyed by "<definition>.<name>"
+// because each definition is emitted once for all of its instances.
+struct FourStateInfo {
+    std::unordered_set<std::string> signals;
+    // Emitted `sim::Init` value for signals that do not start at zero.
+    std::unordered_map<std::string, std::string> initial;
+};
+
+struct FourStateGraph {
+    std::unordered_map<std::string, std::vector<std::string>> edges;
+    std::unordered_set<std::string> seeds;
+    std::unordered_map<std::string, std::string> initial;
+};
+
+std::string signalKey(std::string_view defName, const ValueSymbol& sym) {
+    return std::string(defName) + "." + std::string(sym.name);
+}
+
+void collectFourStateGraph(const InstanceSymbol& inst, FourStateGraph& graph) {
+    std::string defName(inst.getDefinition().name);
+    const InstanceBodySymbol& body = inst.body;
+
+    std::unordered_set<const ValueSymbol*> portInternals;
+    for (const auto& port : collectPorts(body)) {
+        if (port.internal)
+            portInternals.insert(port.internal);
+    }
+
+    std::unordered_set<const ValueSymbol*> driven;
+    std::unordered_set<const ValueSymbol*> combDriven;
+    auto addAssignment = [&](const AssignmentExpression& a, bool comb) {
+        std::unordered_set<const ValueSymbol*> targets;
+        std::unordered_set<const ValueSymbol*> deps;
+        collectTargetSignals(a.left(), targets, deps);
+        collectExprSignals(a.right(), deps);
+        for (const auto* lhs : targets) {
+            driven.insert(lhs);
+            if (comb)
+                combDriven.insert(lhs);
+            std::string lhsKey = signalKey(defName, *lhs);
+            if (hasUnknownLiteral(a.right()))
+                graph.seeds.insert(lhsKey);
+            for (const auto* dep : deps)
+                graph.edges[signalKey(defName, *dep)].push_back(lhsKey);
+        }
+    };
+
+    for (auto& assign : body.membersOfType<ContinuousAssignSymbol>()) {
+        const Expression& expr = assign.getAssignment();
+        if (expr.kind == ExpressionKind::Assignment)
+            addAssignment(expr.as<AssignmentExpression>(), true);
+    }
+    for (auto& block : body.membersOfType<ProceduralBlockSymbol>()) {
+        bool comb = block.procedureKind == ProceduralBlockKind::AlwaysComb;
+        forEachAssignment(block.getBody(),
+                          [&](const AssignmentExpression& a) { addAssignment(a, comb); });
+    }
+
+    // Port internals alias the connected signal in the parent, so X/Z flows both ways.
+    for (const auto& instance : childInstances(body)) {
+        const InstanceSymbol& child = *instance.symbol;
+        std::string childDef(child.getDefinition().name);
+        for (auto* conn : child.getPortConnections()) {
+            const auto& port = conn->port.as<PortSymbol>();
+            const ValueSymbol* internal = getValueSymbol(port.internalSymbol);
+            const Expression* actualExpr = conn->getExpression();
+            if (!internal || !actualExpr)
+                continue;
+            const ValueSymbol* actual = getValueSymbolFromExpr(*actualExpr);
+            if (!actual)
+                continue;
+            std::string innerKey = signalKey(childDef, *internal);
+            std::string outerKey = signalKey(defName, *actual);
+            graph.edges[innerKey].push_back(outerKey);
+            graph.edges[outerKey].push_back(innerKey);
+            if (actual->kind == SymbolKind::Variable)
+                driven.insert(actual);
+        }
+        collectFourStateGraph(child, graph);
+    }
+
+    // Uninitialized 4-state variables start as X unless combinational logic computes them
+    // at time zero; undriven nets float at Z.
+    for (auto& member : body.membersOfType<ValueSymbol>()) {
+        if (portInternals.count(&member))
+            continue;
+        if (member.getInitializer())
+            continue;
+        if (!member.getType().isFourState())
+            continue;
+        std::string key = signalKey(defName, member);
+        if (member.kind == SymbolKind::Variable && !combDriven.count(&member)) {
+            graph.seeds.insert(key);
+            graph.initial[key] = "sim::Init::X";
+        } else if (member.kind == SymbolKind::Net && !driven.count(&member)) {
+            graph.seeds.insert(key);
+            graph.initial[key] = "sim::Init::Z";
+        }
+    }
+}
+
+FourStateInfo analyzeFourState(const InstanceSymbol& top) {
+    FourStateGraph graph;
+    collectFourStateGraph(top, graph);
+
+    FourStateInfo info;
+    info.initial = std::move(graph.initial);
+    std::deque<std::string> work(graph.seeds.begin(), graph.seeds.end());
+    while (!work.empty()) {
+        std::string key = std::move(work.front());
+        work.pop_front();
+        if (!info.signals.insert(key).second)
+            continue;
+        auto it = graph.edges.find(key);
+        if (it == graph.edges.end())
+            continue;
+        for (const auto& next : it->second) {
+            if (!info.signals.count(next))
+                work.push_back(next);
+        }
+    }
+    return info;
+}
+
+std::string emitMonitorArg(const Expression& expr, const EmitNames& names) {
+    if (expr.kind == ExpressionKind::Call) {
+        auto& call = expr.as<CallExpression>();
+        if (call.isSystemCall() && call.getSubroutineName() == "$time")
+            return "sim::MonitorArg::time()";
+    }
+    const ValueSymbol* sym = getValueSymbolFromExpr(expr);
+    if (sym) {
+        auto it = names.find(sym);
+        if (it != names.end())
+            return "sim::MonitorArg::signalArg(&" + it->second + ")";
+    }
+    return "sim::MonitorArg::time()";
+}
+
+std::string signalType(const CodegenOptions& options) {
+    if (options.lanes > 1)
+        return "sim::LaneSignal<" + std::to_string(options.lanes) + ">";
+    return "sim::Signal";
+}
+
+// Assignment of one value to a whole signal (every lane in multi-lane mode).
+std::string emitAssign(const std::string& kernelRef, const std::string& target,
+                       const std::string& rhs, bool nonBlocking, const CodegenOptions& options) {
+    if (!nonBlocking)
+        return target + ".set(" + rhs + ");";
+    if (options.lanes > 1)
+        return target + ".nba(" + kernelRef + ", " + rhs + ");";
+    return kernelRef + ".nba_assign(" + target + ", " + rhs + ");";
+}
+
+// File and line of a source location; the file is empty when it has none.
+std::pair<std::string, size_t> svFileLine(const SourceManager* sm, SourceLocation loc) {
+    if (!sm || !loc.valid())
+        return {};
+    loc = sm->getFullyOriginalLoc(loc);
+    return {std::string(sm->getFileName(loc)), sm->getLineNumber(loc)};
+}
+
+// `file:line` of a source location, or empty when it has none.
+std::string svLocation(const SourceManager* sm, SourceLocation loc) {
+    auto [file, line] = svFileLine(sm, loc);
+    return file.empty() ? std::string() : file + ":" + std::to_string(line);
+}
+
+// Trailing `// sv: file:line` marker on generated statements. writeCppOutput collects the
+// markers into srcmap.tsv, so every marked line is mapped back to its SV source.
+std::string svMarker(const SourceManager* sm, SourceLocation loc) {
+    std::string where = svLocation(sm, loc);
+    return where.empty() ? std::string() : " // sv: " + where;
+}
+
+std::string cppStringLiteral(std::string_view text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '\\' || c == '"')
+            out.push_back('\\');
+        out.push_back(c);
+    }
+    out.push_back('"');
+    return out;
+}
+
+// Line/branch coverage points of one generated class (`--coverage`). Each point is one slot
+// of the class's counter array `cov_`, bumped by the statement hit() returns; emitModule
+// writes the matching `cov_points_` table at the end of the class.
+struct CoverPoints {
+    struct Point {
+        std::string kind;
+        std::string file;
+        size_t line;
+    };
+    std::vector<Point> points;
+
+    std::string hit(std::string_view kind, const SourceManager* sm, SourceLocation loc) {
+        auto [file, line] = svFileLine(sm, loc);
+        points.push_back({std::string(kind), std::move(file), line});
+        return "++cov_[" + std::to_string(points.size() - 1) + "];";
+    }
+};
+
+// One piece of a part-select, bit-select or concatenation target: `width` bits of `target`
+// at bit `offset` (a C++ expression, or `constantOffset` when known), taken from bit
+// `rhsOffset` of the right-hand side.
+struct TargetPiece {
+    const ValueSymbol* symbol = nullptr;
+    std::string target;
+    std::optional<uint64_t> constantOffset;
+    std::string offset;
+    uint32_t width = 0;
+    uint32_t rhsOffset = 0;
+};
+
+// Splits an assignment target into pieces, least significant right-hand-side bits first.
+// Returns false when a piece is not a whole or packed select of a 2-state signal of up to 64
+// bits, or a constant select lies outside the signal.
+bool targetPieces(const Expression& target, uint32_t rhsOffset, const EmitNames& names,
+                  const std::unordered_set<const ValueSymbol*>& fourState,
+                  std::vector<TargetPiece>& pieces) {
+    if (target.kind == ExpressionKind::Concatenation) {
+        auto& cat = target.as<ConcatenationExpression>();
+        for (size_t i = cat.operands().size(); i-- > 0;) {
+            const Expression& operand = *cat.operands()[i];
+            if (!targetPieces(operand, rhsOffset, names, fourState, pieces))
+                return false;
+            rhsOffset += operand.type->getBitWidth();
+        }
+        return true;
+    }
+    const Expression* value = &target;
+    if (target.kind == ExpressionKind::ElementSelect)
+        value = &target.as<ElementSelectExpression>().value();
+    else if (target.kind == ExpressionKind::RangeSelect)
+        value = &target.as<RangeSelectExpression>().value();
+    if (value->kind != ExpressionKind::NamedValue || !value->type->isIntegral() ||
+        !target.type->isIntegral())
+        return false;
+    const ValueSymbol* sym = getValueSymbolFromExpr(*value);
+    auto it = sym ? names.find(sym) : names.end();
+    if (it == names.end() || fourState.count(sym) || memoryShape(sym->getType()))
+        return false;
+    uint32_t from = value->type->getBitWidth();
+    uint32_t width = target.type->getBitWidth();
+    if (from == 0 || from > 64 || width == 0 || rhsOffset + width > 64)
+        return false;
+    TargetPiece piece{sym, it->second, 0, "0", width, rhsOffset};
+    if (value == &target) {
+        pieces.push_back(std::move(piece));
+        return true;
+    }
+
+    // The element index of the select's lsb, as in emitExpr's selects.
+    ConstantRange range = value->type->getFixedRange();
+    if (range.width() == 0 || from % range.width() != 0)
+        return false;
+    uint32_t elementWidth = from / range.width();
+    int64_t last = width / elementWidth - 1;
+    const Expression* lsb = nullptr;
+    int64_t adjust = 0;
+    if (target.kind == ExpressionKind::ElementSelect) {
+        lsb = &target.as<ElementSelectExpression>().selector();
+    } else {
+        auto& sel = target.as<RangeSelectExpression>();
+        switch (sel.getSelectionKind()) {
+            case RangeSelectionKind::IndexedUp:
+                lsb = &sel.left();
+                adjust = range.isLittleEndian() ? 0 : last;
+                break;
+            case RangeSelectionKind::IndexedDown:
+                lsb = &sel.left();
+                adjust = range.isLittleEndian() ? -last : 0;
+                break;
+            default:
+                lsb = &sel.right();
+                break;
+        }
+    }
+    if (auto index = constantInt(*lsb)) {
+        int64_t element = range.isLittleEndian() ? *index + adjust - range.lower()
+                                                 : range.upper() - (*index + adjust);
+        int64_t offset = element * elementWidth;
+        if (offset < 0 || offset + width > from)
+            return false;
+        piece.constantOffset = static_cast<uint64_t>(offset);
+        piece.offset = std::to_string(offset);
+    } else {
+        std::string index = emitCanonical(*lsb, names, ".value()");
+        if (lsb->type->isSigned() && lsb->type->getBitWidth() < 64)
+            index = "sim::sext(" + index + ", " + std::to_string(lsb->type->getBitWidth()) + ")";
+        std::string element =
+            range.isLittleEndian()
+                ? "(" + index + " - " + std::to_string(range.lower() - adjust) + "ULL)"
+                : "(" + std::to_string(range.upper() - adjust) + "ULL - " + index + ")";
+        if (elementWidth != 1)
+            element = "(" + element + " * " + std::to_string(elementWidth) + ")";
+        piece.constantOffset.reset();
+        piece.offset = element;
+    }
+    pieces.push_back(std::move(piece));
+    return true;
+}
+
+// `a` when its target is a part select, bit select or concatenation; returns false for a
+// whole-signal target, which the caller writes itself. Each signal's bits are merged into its
+// value under a mask, and `<=` passes the mask to nba_assign so several partial NBAs to one
+// signal combine. The pieces of one signal at constant offsets, in the same order as in the
+// right-hand side, move as one gather/scatter (pext/pdep) pair. Targets with a piece codegen
+// cannot write are reported and dropped.
+bool emitPartialWrite(std::ostream& out, const std::string& pad, const std::string& kernelRef,
+                      const AssignmentExpression& a, const EmitNames& names,
+                      const std::unordered_set<const ValueSymbol*>& fourState, bool nonBlocking,
+                      bool nextState, const SourceManager* sm, const std::string& marker,
+                      const LoweredModule* ir = nullptr) {
+    const Expression& target = a.left();
+    if (target.kind != ExpressionKind::Concatenation &&
+        target.kind != ExpressionKind::ElementSelect &&
+        target.kind != ExpressionKind::RangeSelect)
+        return false;
+    std::vector<TargetPiece> pieces;
+    if (!targetPieces(target, 0, names, fourState, pieces)) {
+        std::string where = svLocation(sm, a.sourceRange.start());
+        std::cerr << "warning: " << (where.empty() ? "" : where + ": ")
+                  << "assignment not emitted: only selects and concatenations of 2-state "
+                  << "signals of up to 64 bits are supported as targets\n";
+        out << pad << "// unsupported assignment target" << marker << "\n";
+        return true;
+    }
+
+    std::string rhs = ir && ir->node(a.right()) != ir::kNoNode
+                          ? emitNode(*ir, ir->node(a.right()), names)
+                          : emitExpr(a.right(), names);
+    out << pad << "{\n";
+    out << pad << "    const uint64_t write_rhs_ = " << rhs << ";" << marker << "\n";
+    auto write = [&](const std::string& targetName, const std::string& field,
+                     const std::string& mask) {
+        out << pad << "    ";
+        if (nonBlocking && nextState)
+            out << targetName << "_next = sim::deposit(" << targetName << "_next, " << field
+                << ", " << mask << ");\n";
+        else if (nonBlocking)
+            out << kernelRef << ".nba_assign(" << targetName << ", " << field << ", " << mask
+                << ");\n";
+        else
+            out << targetName << ".set(sim::deposit(" << targetName << ".value(), " << field
+                << ", " << mask << "));\n";
+    };
+
+    std::vector<bool> done(pieces.size(), false);
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        if (done[i])
+            continue;
+        std::vector<size_t> group;
+        for (size_t j = i; j < pieces.size(); ++j) {
+            if (pieces[j].symbol == pieces[i].symbol)
+                group.push_back(j);
+        }
+        bool merge = group.size() > 1;
+        for (size_t k = 0; merge && k < group.size(); ++k) {
+            const TargetPiece& piece = pieces[group[k]];
+            merge = piece.constantOffset &&
+                    (k == 0 || *piece.constantOffset >= *pieces[group[k - 1]].constantOffset +
+                                                            pieces[group[k - 1]].width);
+        }
+        if (merge) {
+            uint64_t rhsMask = 0;
+            uint64_t mask = 0;
+            for (size_t k : group) {
+                rhsMask |= widthMask(pieces[k].width) << pieces[k].rhsOffset;
+                mask |= widthMask(pieces[k].width) << *pieces[k].constantOffset;
+                done[k] = true;
+            }
+            std::string maskText = std::to_string(mask) + "ULL";
+            write(pieces[i].target,
+                  "sim::scatter(sim::gather(write_rhs_, " + std::to_string(rhsMask) + "ULL), " +
+                      maskText + ")",
+                  maskText);
+            continue;
+        }
+        // Variable, overlapping or reordered pieces are written one by one.
+        for (size_t k : group) {
+            const TargetPiece& piece = pieces[k];
+            done[k] = true;
+            std::string field = "sim::bits(write_rhs_, " + std::to_string(piece.rhsOffset) +
+                                ", " + std::to_string(piece.width) + ")";
+            std::string ones = std::to_string(widthMask(piece.width)) + "ULL";
+            if (piece.constantOffset) {
+                uint64_t offset = *piece.constantOffset;
+                std::string mask = std::to_string(widthMask(piece.width) << offset) + "ULL";
+                write(piece.target,
+                      offset ? "(" + field + " << " + std::to_string(offset) + ")" : field,
+                      mask);
+            } else {
+                write(piece.target, "sim::shl(" + field + ", " + piece.offset + ")",
+                      "sim::shl(" + ones + ", " + piece.offset + ")");
+            }
+        }
+    }
+    out << pad << "}\n";
+    return true;
+}
+
+// Makes `kind` at `loc` the kernel's current site so the processes and events registered
+// next are attributed to it by the profiler.
+void emitSite(std::ostream& out, int indent, std::string_view kind, const SourceManager* sm,
+              SourceLocation loc) {
+    auto [file, line] = svFileLine(sm, loc);
+    out << std::string(static_cast<size_t>(indent), ' ')
+        << "kernel.set_site(kernel.add_site(scope, " << cppStringLiteral(kind) << ", "
+        << cppStringLiteral(file) << ", " << line << "));" << svMarker(sm, loc) << "\n";
+}
+
+bool hasTimingControl(const Statement& stmt) {
+    bool found = false;
+    auto visitor = makeVisitor([&](auto&, const TimedStatement&) { found = true; },
+                               [&](auto&, const WaitStatement&) { found = true; });
+    stmt.visit(visitor);
+    return found;
+}
+
+bool emitInitialStatement(const Statement& stmt,
+                          const EmitNames& names,
+                          std::ostream& out,
+                          int indent,
+                          const std::string& timeVar,
+                          const CodegenOptions& options,
+                          const std::unordered_set<const ValueSymbol*>& fourState,
+                          const SourceManager* sm);
+
+// A task with delays, called from an initial block: its body joins the block's schedule,
+// so each delayed step becomes one more resumable at its time. Arguments must be constant;
+// they are bound to static constants the scheduled steps read without capturing them.
+// Otherwise the block stops at the call, which is reported.
+bool emitInitialTask(const CallExpression& call, const SubroutineSymbol& task,
+                     const EmitNames& names, std::ostream& out, int indent,
+                     const std::string& timeVar, const CodegenOptions& options,
+                     const std::unordered_set<const ValueSymbol*>& fourState,
+                     const SourceManager* sm) {
+    auto reject = [&](std::string_view reason) {
+        std::string where = svLocation(sm, call.sourceRange.start());
+        std::cerr << "warning: " << (where.empty() ? "" : where + ": ") << "call of task "
+                  << task.name << " not emitted: " << reason
+                  << "; the rest of its initial block is dropped\n";
+        return false;
+    };
+    auto pad = std::string(static_cast<size_t>(indent), ' ');
+    auto formals = task.getArguments();
+    auto actuals = call.arguments();
+    if (!names.functions || formals.size() != actuals.size())
+        return reject("its arguments must all be given");
+    auto taskNames = names;
+    std::ostringstream body;
+    body << pad << "{" << svMarker(sm, call.sourceRange.start()) << "\n";
+    for (size_t i = 0; i < formals.size(); ++i) {
+        auto value = evalConstant(*actuals[i], *names.functions->scope);
+        uint32_t width = bitWidth(formals[i]->getType(), 0);
+        if (formals[i]->direction != ArgumentDirection::In || !value || width == 0 ||
+            width > 64)
+            return reject("argument " + std::string(formals[i]->name) +
+                          " is not a constant input of at most 64 bits");
+        std::string name = "task_" + cppIdent(formals[i]->name) + "_";
+        taskNames[formals[i]] = name;
+        body << pad << "    static constexpr sim::Local<" << width << "> " << name << "{"
+             << (*value & widthMask(width)) << "ULL};\n";
+    }
+    if (!emitInitialStatement(task.getBody(), taskNames, body, indent + 4, timeVar, options,
+                              fourState, sm))
+        return reject("its body has a statement initial blocks do not support");
+    out << body.str() << pad << "}\n";
+    return true;
+}
+
+bool emitInitialStatement(const Statement& stmt,
+                          const EmitNames& names,
+                          std::ostream& out,
+                          int indent,
+                          const std::string& timeVar,
+                          const CodegenOptions& options,
+                          const std::unordered_set<const ValueSymbol*>& fourState,
+                          const SourceManager* sm) {
+    auto pad = std::string(static_cast<size_t>(indent), ' ');
+    switch (stmt.kind) {
+        case StatementKind::Block: {
+            auto& block = stmt.as<BlockStatement>();
+            return emitInitialStatement(block.body, names, out, indent, timeVar, options,
+                                        fourState, sm);
+        }
+        case StatementKind::List: {
+            auto& list = stmt.as<StatementList>();
+            for (auto* s : list.list) {
+                if (!emitInitialStatement(*s, names, out, indent, timeVar, options, fourState,
+                                          sm))
+                    return false;
+            }
+            return true;
+        }
+        case StatementKind::Timed: {
+            auto& ts = stmt.as<TimedStatement>();
+            if (ts.timing.kind == TimingControlKind::Delay) {
+                auto& delay = ts.timing.as<DelayControl>();
+                std::string expr = emitExpr(delay.expr, names);
+                out << pad << timeVar << " += static_cast<uint64_t>(" << expr << ");"
+                    << svMarker(sm, stmt.sourceRange.start()) << "\n";
+                if (ts.stmt.kind == StatementKind::Empty)
+                    return true;
+                return emitInitialStatement(ts.stmt, names, out, indent, timeVar, options,
+                                            fourState, sm);
+            }
+            return false;
+        }
+        case StatementKind::Empty:
+            return true;
+        case StatementKind::ExpressionStatement: {
+            auto& es = stmt.as<ExpressionStatement>();
+            std::string marker = svMarker(sm, stmt.sourceRange.start());
+            if (auto* call = discardedRandomCall(es.expr)) {
+                out << pad << "kernel.schedule_resumable(" << timeVar
+                    << ", kernel.add_resumable([this](uint32_t) {\n";
+                out << pad << "    static_cast<void>(" << emitExpr(*call, names) << ");" << marker
+                    << "\n";
+                out << pad << "}));\n";
+                return true;
+            }
+            if (es.expr.kind == ExpressionKind::Call) {
+                auto& call = es.expr.as<CallExpression>();
+                if (!call.isSystemCall()) {
+                    auto* sub = calledSubroutine(call);
+                    if (sub && sub->subroutineKind == SubroutineKind::Task && !isDpiImport(*sub) &&
+                        hasTimingControl(sub->getBody()))
+                        return emitInitialTask(call, *sub, names, out, indent, timeVar, options,
+                                               fourState, sm);
+                    bool member = sub && names.functions && names.functions->members.count(sub);
+                    if (!sub || (!isDpiImport(*sub) && !member))
+                        return false;
+                    out << pad << "kernel.schedule_resumable(" << timeVar
+                        << ", kernel.add_resumable([this](uint32_t) {\n";
+                    out << pad << "    " << emitExpr(call, names) << ";" << marker << "\n";
+                    out << pad << "}));\n";
+                    return true;
+                }
+                auto name = call.getSubroutineName();
+                if (name == "$finish") {
+                    out << pad << "kernel.schedule_resumable(" << timeVar
+                        << ", kernel.add_resumable([this](uint32_t) { this->kernel.finish(); }));"
+                        << marker << "\n";
+                    return true;
+                }
+                if (name == "$sim_fork") {
+                    if (call.arguments().size() != 1)
+                        return false;
+                    std::string count = emitExpr(*call.arguments()[0], names);
+                    out << pad << "kernel.schedule_resumable(" << timeVar
+                        << ", kernel.add_resumable([this](uint32_t) {\n";
+                    out << pad << "    this->kernel.sim_fork(static_cast<uint32_t>(" << count
+                        << "));" << marker << "\n";
+                    out << pad << "}));\n";
+                    return true;
+                }
+                if (name == "$readmemh" || name == "$readmemb" || name == "$writememh" ||
+                    name == "$writememb") {
+                    // $readmemh("file", mem[, start[, end]]): the file name must be a literal
+                    // and `mem` a whole sim::Memory; addresses stay SV indices.
+                    auto args = call.arguments();
+                    if (args.size() < 2 || args.size() > 4 ||
+                        args[0]->kind != ExpressionKind::StringLiteral)
+                        return false;
+                    const ValueSymbol* memSym = getValueSymbolFromExpr(*args[1]);
+                    if (!memSym || !memoryShape(memSym->getType()))
+                        return false;
+                    auto it = names.find(memSym);
+                    if (it == names.end())
+                        return false;
+                    bool load = name.starts_with("$readmem");
+                    std::string format = name.ends_with("h") ? "sim::MemFileFormat::Hex"
+                                                             : "sim::MemFileFormat::Binary";
+                    out << pad << "kernel.schedule_resumable(" << timeVar
+                        << ", kernel.add_resumable([this](uint32_t) {\n";
+                    out << pad << "    " << it->second << (load ? ".load(" : ".dump(")
+                        << cppStringLiteral(args[0]->as<StringLiteral>().getValue()) << ", "
+                        << format;
+                    for (size_t i = 2; i < args.size(); ++i)
+                        out << ", static_cast<int64_t>(" << emitExpr(*args[i], names) << ")";
+                    out << ");" << marker << "\n";
+                    out << pad << "}));\n";
+                    return true;
+                }
+                if (name == "$monitor") {
+                    if (call.arguments().empty())
+                        return false;
+                    if (call.arguments()[0]->kind != ExpressionKind::StringLiteral)
+                        return false;
+                    auto& fmt = call.arguments()[0]->as<StringLiteral>();
+                    // Defined at construction, enabled by a resumable event, so a restored
+                    // snapshot can re-enable it by id.
+                    out << pad << "{\n";
+                    out << pad << "    uint32_t monitor = kernel.define_monitor(\""
+                        << fmt.getValue() << "\", {";
+                    bool first = true;
+                    for (size_t i = 1; i < call.arguments().size(); ++i) {
+                        const Expression* arg = call.arguments()[i];
+                        if (!first)
+                            out << ", ";
+                        first = false;
+                        out << emitMonitorArg(*arg, names);
+                    }
+                    out << "});" << marker << "\n";
+                    out << pad << "    kernel.schedule_resumable(" << timeVar
+                        << ", kernel.add_resumable([this, monitor](uint32_t) {\n";
+                    out << pad << "        this->kernel.enable_monitor(monitor);\n";
+                    out << pad << "    }));\n";
+                    out << pad << "}\n";
+                    return true;
+                }
+                return false;
+            }
+            if (es.expr.kind == ExpressionKind::Assignment) {
+                auto& a = es.expr.as<AssignmentExpression>();
+                std::ostringstream write;
+                if (emitMemoryWrite(a, names, write, pad + "    ", "this->kernel",
+                                    a.isNonBlocking(), marker)) {
+                    out << pad << "kernel.schedule_resumable(" << timeVar
+                        << ", kernel.add_resumable([this](uint32_t) {\n";
+                    out << write.str();
+                    out << pad << "}));\n";
+                    return true;
+                }
+                if (options.lanes == 1 &&
+                    emitPartialWrite(write, pad + "    ", "this->kernel", a, names, fourState,
+                                     a.isNonBlocking(), false, sm, marker)) {
+                    out << pad << "kernel.schedule_resumable(" << timeVar
+                        << ", kernel.add_resumable([this](uint32_t) {\n";
+                    out << write.str();
+                    out << pad << "}));\n";
+                    return true;
+                }
+                const ValueSymbol* lhsSym = getValueSymbolFromExpr(a.left());
+                if (!lhsSym)
+                    return false;
+                auto it = names.find(lhsSym);
+                if (it == names.end())
+                    return false;
+                std::string rhs = emitRhs(a.right(), names, fourState);
+                out << pad << "kernel.schedule_resumable(" << timeVar
+                    << ", kernel.add_resumable([this](uint32_t) {\n";
+                out << pad << "    "
+                    << emitAssign("this->kernel", it->second, rhs, a.isNonBlocking(), options)
+                    << marker << "\n";
+                out << pad << "}));\n";
+                return true;
+            }
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
+void collectStatementSignals(const Statement& stmt,
+                             std::unordered_set<const ValueSymbol*>& deps) {
+    switch (stmt.kind) {
+        case StatementKind::Block: {
+            auto& block = stmt.as<BlockStatement>();
+            collectStatementSignals(block.body, deps);
+            break;
+        }
+        case StatementKind::List: {
+            auto& list = stmt.as<StatementList>();
+            for (auto* s : list.list)
+                collectStatementSignals(*s, deps);
+            break;
+        }
+        case StatementKind::Conditional: {
+            auto& cond = stmt.as<ConditionalStatement>();
+            collectExprSignals(*cond.conditions[0].expr, deps);
+            collectStatementSignals(cond.ifTrue, deps);
+            if (cond.ifFalse)
+                collectStatementSignals(*cond.ifFalse, deps);
+            break;
+        }
+        case StatementKind::Case: {
+            auto& cs = stmt.as<CaseStatement>();
+            collectExprSignals(cs.expr, deps);
+            for (auto& group : cs.items) {
+                for (auto* item : group.expressions)
+                    collectExprSignals(*item, deps);
+                collectStatementSignals(*group.stmt, deps);
+            }
+            if (cs.defaultCase)
+                collectStatementSignals(*cs.defaultCase, deps);
+            break;
+        }
+        case StatementKind::ForLoop: {
+            // The loop variable is a local of the emitted loop, not a dependency.
+            auto& loop = stmt.as<ForLoopStatement>();
+            std::unordered_set<const ValueSymbol*> body;
+            collectStatementSignals(loop.body, body);
+            if (auto bounds = constantLoop(loop))
+                body.erase(bounds->var);
+            deps.insert(body.begin(), body.end());
+            break;
+        }
+        case StatementKind::Timed: {
+            auto& ts = stmt.as<TimedStatement>();
+            if (ts.timing.kind == TimingControlKind::Delay) {
+                auto& delay = ts.timing.as<DelayControl>();
+                collectExprSignals(delay.expr, deps);
+            }
+            collectStatementSignals(ts.stmt, deps);
+            break;
+        }
+        case StatementKind::ExpressionStatement: {
+            auto& es = stmt.as<ExpressionStatement>();
+            if (es.expr.kind == ExpressionKind::Assignment) {
+                auto& a = es.expr.as<AssignmentExpression>();
+                std::unordered_set<const ValueSymbol*> targets;
+                collectExprSignals(a.right(), deps);
+                collectTargetSignals(a.left(), targets, deps);
+            } else {
+                collectExprSignals(es.expr, deps);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// A write of `rhs` to a whole signal: `<=` goes to the kernel's NBA queue, or to the
+// `_next` member in cycle mode (`nextState`).
+void emitSignalWrite(std::ostream& out, const std::string& pad, const std::string& target,
+                     const std::string& rhs, bool nonBlocking, bool nextState,
+                     const std::string& marker) {
+    if (nonBlocking && nextState)
+        out << pad << target << "_next = " << rhs << ";" << marker << "\n";
+    else if (nonBlocking)
+        out << pad << "kernel.nba_assign(" << target << ", " << rhs << ");" << marker << "\n";
+    else
+        out << pad << target << ".set(" << rhs << ");" << marker << "\n";
+}
+
+// One write of a case arm that only assigns constants to whole 2-state signals.
+struct ConstantWrite {
+    const ValueSymbol* target = nullptr;
+    uint64_t value = 0;
+    bool nonBlocking = false;
+};
+
+bool constantWrites(const Statement& stmt,
+                    const EmitNames& names,
+                    const std::unordered_set<const ValueSymbol*>& fourState,
+                    std::vector<ConstantWrite>& writes) {
+    switch (stmt.kind) {
+        case StatementKind::Block:
+            return constantWrites(stmt.as<BlockStatement>().body, names, fourState, writes);
+        case StatementKind::List:
+            for (auto* s : stmt.as<StatementList>().list) {
+                if (!constantWrites(*s, names, fourState, writes))
+                    return false;
+            }
+            return true;
+        case StatementKind::Empty:
+            return true;
+        case StatementKind::ExpressionStatement: {
+            auto& es = stmt.as<ExpressionStatement>();
+            if (es.expr.kind != ExpressionKind::Assignment)
+                return false;
+            auto& a = es.expr.as<AssignmentExpression>();
+            if (a.isCompound() || a.left().kind != ExpressionKind::NamedValue)
+                return false;
+            const ValueSymbol* sym = getValueSymbolFromExpr(a.left());
+            auto value = constantInt(a.right());
+            if (!sym || !value || !names.count(sym) || fourState.count(sym) ||
+                memoryShape(sym->getType()) || bitWidth(sym->getType()) > 64)
+                return false;
+            uint64_t word = static_cast<uint64_t>(*value) & widthMask(bitWidth(sym->getType()));
+            for (auto& w : writes) {
+                if (w.target == sym) {
+                    w = {sym, word, a.isNonBlocking()};
+                    return true;
+                }
+            }
+            writes.push_back({sym, word, a.isNonBlocking()});
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Emits a `case` whose labels are all exact constants as a table lookup when every arm
+// only assigns constants to the same signals, and as a dense switch otherwise. Returns
+// false when the arms do not fit a table and the caller should emit the switch.
+bool emitCaseTable(const CaseStatement& cs,
+                   const std::vector<std::pair<uint64_t, const Statement*>>& labels,
+                   const std::string& selector, uint32_t width,
+                   const EmitNames& names,
+                   std::ostream& out, const std::string& pad, bool allowNba,
+                   const std::unordered_set<const ValueSymbol*>& fourState,
+                   const SourceManager* sm, bool nextState) {
+    constexpr uint32_t kMaxTableBits = 10;
+    uint64_t entries = 1ULL << width;
+    if (width > kMaxTableBits || labels.size() < 3 ||
+        (!cs.defaultCase && labels.size() != entries))
+        return false;
+
+    std::vector<ConstantWrite> fallback;
+    if (cs.defaultCase && !constantWrites(*cs.defaultCase, names, fourState, fallback))
+        return false;
+    std::vector<std::vector<ConstantWrite>> arms;
+    for (auto& [value, body] : labels) {
+        arms.emplace_back();
+        if (!constantWrites(*body, names, fourState, arms.back()))
+            return false;
+    }
+    // Every arm must write the same signals the same way, or a table entry would have to
+    // mean "leave this one alone".
+    const auto& first = arms.front();
+    if (first.empty())
+        return false;
+    auto sameTargets = [&](const std::vector<ConstantWrite>& writes) {
+        if (writes.size() != first.size())
+            return false;
+        for (auto& w : writes) {
+            auto it = std::find_if(first.begin(), first.end(),
+                                   [&](const ConstantWrite& f) { return f.target == w.target; });
+            if (it == first.end() || it->nonBlocking != w.nonBlocking)
+                return false;
+        }
+        return true;
+    };
+    if (!std::all_of(arms.begin(), arms.end(), sameTargets) ||
+        (cs.defaultCase && !sameTargets(fallback)))
+        return false;
+
+    std::string marker = svMarker(sm, cs.sourceRange.start());
+    out << pad << "{" << marker << "\n";
+    std::string inner = pad + "    ";
+    for (auto& target : first) {
+        uint32_t bits = bitWidth(target.target->getType());
+        std::string elem = bits <= 8 ? "uint8_t" : bits <= 16 ? "uint16_t"
+                                                              : bits <= 32 ? "uint32_t"
+                                                                           : "uint64_t";
+        auto lookup = [&](const std::vector<ConstantWrite>& writes) {
+            for (auto& w : writes) {
+                if (w.target == target.target)
+                    return w.value;
+            }
+            return uint64_t(0);
+        };
+        std::vector<uint64_t> table(entries, cs.defaultCase ? lookup(fallback) : 0);
+        for (size_t i = 0; i < labels.size(); ++i)
+            table[labels[i].first] = lookup(arms[i]);
+        out << inner << "static constexpr " << elem << " case_lut_"
+            << cppIdent(names.at(target.target)) << "_[" << entries << "] = {";
+        for (uint64_t i = 0; i < entries; ++i)
+            out << (i ? ", " : "") << (i % 16 == 0 ? "\n" + inner + "    " : "") << table[i]
+                << (bits > 32 ? "ULL" : "");
+        out << "};\n";
+    }
+    out << inner << "const uint64_t case_sel_ = " << selector << ";\n";
+    for (auto& target : first) {
+        const std::string& name = names.at(target.target);
+        emitSignalWrite(out, inner, name, "case_lut_" + cppIdent(name) + "_[case_sel_]",
+                        target.nonBlocking && allowNba, nextState, "");
+    }
+    out << pad << "}\n";
+    return true;
+}
+
+void emitStatement(const Statement& stmt,
+                   const EmitNames& names,
+                   std::ostream& out,
+                   int indent,
+                   bool allowNba,
+                   const std::unordered_set<const ValueSymbol*>& fourState,
+                   const SourceManager* sm,
+                   CoverPoints* cover = nullptr,
+                   bool nextState = false,
+                   const LoweredModule* ir = nullptr) {
+    auto pad = std::string(static_cast<size_t>(indent), ' ');
+    switch (stmt.kind) {
+        case StatementKind::Block: {
+            auto& block = stmt.as<BlockStatement>();
+            emitStatement(block.body, names, out, indent, allowNba, fourState, sm, cover,
+                          nextState, ir);
+            break;
+        }
+        case StatementKind::List: {
+            auto& list = stmt.as<StatementList>();
+            for (auto* s : list.list)
+                emitStatement(*s, names, out, indent, allowNba, fourState, sm, cover, nextState,
+                              ir);
+            break;
+        }
+        case StatementKind::Conditional: {
+            auto& cond = stmt.as<ConditionalStatement>();
+            std::string expr = emitCondition(*cond.conditions[0].expr, names, fourState, ir);
+            std::string inner(static_cast<size_t>(indent + 4), ' ');
+            out << pad << "if (" << expr << ") {" << svMarker(sm, stmt.sourceRange.start())
+                << "\n";
+            if (cover)
+                out << inner << cover->hit("if", sm, cond.ifTrue.sourceRange.start()) << "\n";
+            emitStatement(cond.ifTrue, names, out, indent + 4, allowNba, fourState, sm, cover,
+                          nextState, ir);
+            out << pad << "}";
+            if (cond.ifFalse) {
+                out << " else {\n";
+                if (cover) {
+                    out << inner << cover->hit("else", sm, cond.ifFalse->sourceRange.start())
+                        << "\n";
+                }
+                emitStatement(*cond.ifFalse, names, out, indent + 4, allowNba, fourState, sm,
+                              cover, nextState, ir);
+                out << pad << "}";
+            } else if (cover) {
+                // The implicit else arm, so branch coverage sees an `if` that is never false.
+                out << " else {\n";
+                out << inner << cover->hit("else", sm, stmt.sourceRange.start()) << "\n";
+                out << pad << "}";
+            }
+            out << "\n";
+            break;
+        }
+        case StatementKind::Case: {
+            auto& cs = stmt.as<CaseStatement>();
+            uint32_t width = bitWidth(*cs.expr.type);
+            std::string marker = svMarker(sm, stmt.sourceRange.start());
+            if (cs.condition == CaseStatementCondition::Inside || width > 64) {
+                out << pad << "// unsupported statement" << marker << "\n";
+                break;
+            }
+            std::string inner(static_cast<size_t>(indent + 4), ' ');
+            bool fourSel = needsFourState(cs.expr, fourState);
+            std::string selector;
+            if (fourSel)
+                selector = emitExpr4(cs.expr, names, fourState);
+            else if (ir && ir->node(cs.expr) != ir::kNoNode)
+                selector = emitNode(*ir, ir->node(cs.expr), names);
+            else
+                selector = emitCanonical(cs.expr, names, ".value()");
+            auto emitDefault = [&](int at) {
+                std::string armPad(static_cast<size_t>(at), ' ');
+                if (cs.defaultCase) {
+                    if (cover) {
+                        out << armPad
+                            << cover->hit("default", sm, cs.defaultCase->sourceRange.start())
+                            << "\n";
+                    }
+                    emitStatement(*cs.defaultCase, names, out, at, allowNba, fourState, sm, cover,
+                                  nextState, ir);
+                } else if (cover) {
+                    // The implicit default, like the implicit else of an `if`.
+                    out << armPad << cover->hit("default", sm, stmt.sourceRange.start()) << "\n";
+                }
+            };
+
+            // Labels that are exact constants make a switch (or a table); each value goes to
+            // the first item that names it, and items no 2-state value matches are dropped.
+            bool exact = !fourSel;
+            std::vector<std::vector<std::optional<CasePattern>>> patterns;
+            for (auto& group : cs.items) {
+                auto& items = patterns.emplace_back();
+                for (auto* item : group.expressions) {
+                    items.push_back(casePattern(cs, *item));
+                    auto& p = items.back();
+                    if (!p || (!p->never && p->mask != widthMask(width)))
+                        exact = false;
+                }
+            }
+            if (exact) {
+                std::vector<std::pair<uint64_t, const Statement*>> labels;
+                std::vector<std::vector<uint64_t>> groupLabels(cs.items.size());
+                std::unordered_set<uint64_t> seen;
+                for (size_t g = 0; g < cs.items.size(); ++g) {
+                    for (auto& p : patterns[g]) {
+                        if (p->never || !seen.insert(p->value).second)
+                            continue;
+                        labels.push_back({p->value, cs.items[g].stmt});
+                        groupLabels[g].push_back(p->value);
+                    }
+                }
+                if (!cover && emitCaseTable(cs, labels, selector, width, names, out, pad,
+                                            allowNba, fourState, sm, nextState))
+                    break;
+                out << pad << "switch (" << selector << ") {" << marker << "\n";
+                for (size_t g = 0; g < cs.items.size(); ++g) {
+                    auto& values = groupLabels[g];
+                    for (size_t i = 0; i < values.size(); ++i) {
+                        out << inner << "case " << values[i] << "ULL:"
+                            << (i + 1 == values.size() ? " {" : "") << "\n";
+                    }
+                    if (values.empty())
+                        continue;
+                    auto& body = *cs.items[g].stmt;
+                    if (cover)
+                        out << inner << "    " << cover->hit("case", sm, body.sourceRange.start())
+                            << "\n";
+                    emitStatement(body, names, out, indent + 8, allowNba, fourState, sm, cover,
+                                  nextState, ir);
+                    out << inner << "    break;\n";
+                    out << inner << "}\n";
+                }
+                out << inner << "default: {\n";
+                emitDefault(indent + 8);
+                out << inner << "    break;\n";
+                out << inner << "}\n";
+                out << pad << "}\n";
+                break;
+            }
+
+            // casez/casex masks and labels computed at run time: a priority chain over the
+            // items in source order, evaluating the selector once.
+            std::string sel = fourSel ? "case_sel_.value" : "case_sel_";
+            out << pad << "{" << marker << "\n";
+            out << inner << (fourSel ? "const sim::Logic4" : "const uint64_t") << " case_sel_ = "
+                << selector << ";\n";
+            bool any = false;
+            for (size_t g = 0; g < cs.items.size(); ++g) {
+                std::vector<std::string> tests;
+                for (size_t i = 0; i < patterns[g].size(); ++i) {
+                    auto& p = patterns[g][i];
+                    auto& item = *cs.items[g].expressions[i];
+                    if (p && p->never)
+                        continue;
+                    if (p && p->mask == widthMask(width)) {
+                        tests.push_back(sel + " == " + std::to_string(p->value) + "ULL");
+                    } else if (p) {
+                        tests.push_back("(" + sel + " & " + std::to_string(p->mask) + "ULL) == " +
+                                        std::to_string(p->value) + "ULL");
+                    } else if (needsFourState(item, fourState)) {
+                        tests.push_back(sel + " == (" + emitExpr4(item, names, fourState) +
+                                        ").value");
+                    } else if (ir && ir->node(item) != ir::kNoNode) {
+                        tests.push_back(sel + " == " + emitNode(*ir, ir->node(item), names));
+                    } else {
+                        tests.push_back(sel + " == " + emitCanonical(item, names, ".value()"));
+                    }
+                }
+                if (tests.empty())
+                    continue;
+                std::string test;
+                for (auto& t : tests)
+                    test += (test.empty() ? "" : " || ") + t;
+                if (fourSel)
+                    test = "case_sel_.unknown == 0 && (" + test + ")";
+                out << (any ? " else if (" : inner + "if (") << test << ") {\n";
+                auto& body = *cs.items[g].stmt;
+                if (cover)
+                    out << inner << "    " << cover->hit("case", sm, body.sourceRange.start())
+                        << "\n";
+                emitStatement(body, names, out, indent + 8, allowNba, fourState, sm, cover,
+                              nextState, ir);
+                out << inner << "}";
+                any = true;
+            }
+            if (any) {
+                out << " else {\n";
+                emitDefault(indent + 8);
+                out << inner << "}\n";
+            } else {
+                emitDefault(indent + 4);
+            }
+            out << pad << "}\n";
+            break;
+        }
+        case StatementKind::ForLoop: {
+            auto& loop = stmt.as<ForLoopStatement>();
+            std::string marker = svMarker(sm, stmt.sourceRange.start());
+            auto bounds = constantLoop(loop);
+            auto varIt = bounds ? names.find(bounds->var) : names.end();
+            if (!bounds || (!bounds->declared && varIt == names.end())) {
+                out << pad << "// unsupported statement" << marker << "\n";
+                break;
+            }
+            // The variable's final value, for loops over a variable declared outside.
+            std::string exitWrite = bounds->declared
+                                        ? std::string()
+                                        : varIt->second + ".set(" +
+                                              std::to_string(bounds->exit) + "ULL);";
+
+            if (auto& red = bounds->reduction;
+                red && names.count(red->acc) && !fourState.count(red->acc) &&
+                !needsFourState(*red->source, fourState)) {
+                // The whole loop is one word operation on the bits it visits.
+                std::string acc = names.at(red->acc) + ".value()";
+                std::string part = "sim::bits(" + emitExpr(*red->source, names) + ", " +
+                                   std::to_string(red->offset) + ", " +
+                                   std::to_string(red->count) + ")";
+                std::string value;
+                switch (red->op) {
+                    case ir::Op::Xor:
+                        value = acc + " ^ sim::parity(" + part + ")";
+                        break;
+                    case ir::Op::Or:
+                        value = acc + " | static_cast<uint64_t>(" + part + " != 0)";
+                        break;
+                    case ir::Op::And:
+                        value = acc + " & sim::red_and(" + part + ", " +
+                                std::to_string(red->count) + ")";
+                        break;
+                    default:
+                        value = acc + " + sim::popcount(" + part + ")";
+                        break;
+                }
+                emitSignalWrite(out, pad, names.at(red->acc), value, false, nextState, marker);
+                if (!exitWrite.empty())
+                    out << pad << exitWrite << "\n";
+                break;
+            }
+
+            // The body reads the variable from a local, so a module-level loop variable is
+            // written once, after the loop, instead of on every iteration.
+            constexpr size_t kMaxUnrolledTrips = 16;
+            auto loopNames = names;
+            std::string var = "loop_" + cppIdent(bounds->var->name) + "_";
+            loopNames[bounds->var] = var;
+            std::string local = "sim::Local<" + std::to_string(bounds->width) + "> " + var;
+            if (bounds->values.size() <= kMaxUnrolledTrips && !cover) {
+                for (uint64_t v : bounds->values) {
+                    out << pad << "{" << marker << "\n";
+                    out << pad << "    const " << local << "{" << v << "ULL};\n";
+                    emitStatement(loop.body, loopNames, out, indent + 4, allowNba, fourState, sm,
+                                  cover, nextState, ir);
+                    out << pad << "}\n";
+                }
+            } else if (!bounds->values.empty()) {
+                // Values step by a constant modulo 2^width, which Local::set wraps to.
+                uint64_t step = bounds->values.size() > 1
+                                    ? bounds->values[1] - bounds->values[0]
+                                    : 0;
+                std::string trip = var + "n_";
+                out << pad << "for (uint64_t " << trip << " = 0; " << trip << " < "
+                    << bounds->values.size() << "; ++" << trip << ") {" << marker << "\n";
+                out << pad << "    " << local << ";\n";
+                out << pad << "    " << var << ".set(" << bounds->values[0] << "ULL + " << trip
+                    << " * " << step << "ULL);\n";
+                emitStatement(loop.body, loopNames, out, indent + 4, allowNba, fourState, sm,
+                              cover, nextState, ir);
+                out << pad << "}\n";
+            }
+            if (!exitWrite.empty())
+                out << pad << exitWrite << "\n";
+            break;
+        }
+        case StatementKind::ExpressionStatement: {
+            auto& es = stmt.as<ExpressionStatement>();
+            if (es.expr.kind == ExpressionKind::Assignment) {
+                auto& a = es.expr.as<AssignmentExpression>();
+                std::string marker = svMarker(sm, stmt.sourceRange.start());
+                compoundTarget = &a.left();
+                // Cycle mode (`nextState`) keeps `<=` writes in the class until step() commits.
+                if (emitMemoryWrite(a, names, out, pad, nextState ? "nba_writes_" : "kernel",
+                                    a.isNonBlocking() && allowNba, marker, ir))
+                    break;
+                if (emitPartialWrite(out, pad, "kernel", a, names, fourState,
+                                     a.isNonBlocking() && allowNba, nextState, sm, marker, ir))
+                    break;
+                const ValueSymbol* lhsSym = getValueSymbolFromExpr(a.left());
+                if (!lhsSym)
+                    break;
+                auto it = names.find(lhsSym);
+                if (it == names.end())
+                    break;
+                emitSignalWrite(out, pad, it->second, emitRhs(a.right(), names, fourState, ir),
+                                a.isNonBlocking() && allowNba, nextState, marker);
+            } else if (es.expr.kind == ExpressionKind::Call &&
+                       !es.expr.as<CallExpression>().isSystemCall()) {
+                // Tasks with delays only run inline in initial blocks (emitInitialTask).
+                auto* sub = calledSubroutine(es.expr.as<CallExpression>());
+                if (sub && !isDpiImport(*sub) && hasTimingControl(sub->getBody())) {
+                    std::string where = svLocation(sm, stmt.sourceRange.start());
+                    std::cerr << "warning: " << (where.empty() ? "" : where + ": ")
+                              << "call of task " << sub->name << " not emitted: tasks with "
+                              << "delays are only supported when called from initial blocks\n";
+                    out << pad << "// unsupported call of task " << sub->name
+                        << svMarker(sm, stmt.sourceRange.start()) << "\n";
+                    break;
+                }
+                out << pad << emitExpr(es.expr, names) << ";"
+                    << svMarker(sm, stmt.sourceRange.start()) << "\n";
+            } else if (auto* call = discardedRandomCall(es.expr)) {
+                out << pad << "static_cast<void>(" << emitExpr(*call, names) << ");"
+                    << svMarker(sm, stmt.sourceRange.start()) << "\n";
+            }
+            break;
+        }
+        case StatementKind::VariableDeclaration: {
+            // Function locals (see emitFunction, which names them up front).
+            auto& var = stmt.as<VariableDeclStatement>().symbol;
+            auto it = names.find(&var);
+            if (it == names.end())
+                break;
+            out << pad << "sim::Local<" << bitWidth(var.getType(), 64) << "> " << it->second
+                << ";\n";
+            if (auto* init = var.getInitializer())
+                out << pad << it->second << ".set(" << emitExpr(*init, names) << ");\n";
+            break;
+        }
+        case StatementKind::Return: {
+            auto& ret = stmt.as<ReturnStatement>();
+            out << pad << "return";
+            if (ret.expr)
+                out << " " << emitCanonical(*ret.expr, names, ".value()");
+            out << ";" << svMarker(sm, stmt.sourceRange.start()) << "\n";
+            break;
+        }
+        default:
+            out << pad << "// unsupported statement\n";
+            break;
+    }
+}
+
+// Multi-lane counterpart of emitStatement. Control flow becomes per-lane masks: `mask`
+// names a `sim::Lanes<N>` holding all-ones for lanes that execute the statement, and
+// assignments merge the new value into the active lanes only. Branches are skipped when no
+// lane takes them so divergence costs nothing for uniform stimulus.
+void emitLaneStatement(const Statement& stmt,
+                       const EmitNames& names,
+                       std::ostream& out,
+                       int indent,
+                       bool allowNba,
+                       const std::string& mask,
+                       const CodegenOptions& options,
+                       int& tempIndex,
+                       const SourceManager* sm) {
+    auto pad = std::string(static_cast<size_t>(indent), ' ');
+    std::string lanes = std::to_string(options.lanes);
+    std::string laneType = "sim::Lanes<" + lanes + ">";
+    std::string laneLoop = "for (uint32_t l = 0; l < " + lanes + "; ++l)";
+    switch (stmt.kind) {
+        case StatementKind::Block: {
+            auto& block = stmt.as<BlockStatement>();
+            emitLaneStatement(block.body, names, out, indent, allowNba, mask, options, tempIndex,
+                              sm);
+            break;
+        }
+        case StatementKind::List: {
+            auto& list = stmt.as<StatementList>();
+            for (auto* s : list.list)
+                emitLaneStatement(*s, names, out, indent, allowNba, mask, options, tempIndex,
+                                  sm);
+            break;
+        }
+        case StatementKind::Conditional: {
+            auto& cond = stmt.as<ConditionalStatement>();
+            std::string expr = emitExpr(*cond.conditions[0].expr, names, ".lane(l)");
+            std::string taken = "m" + std::to_string(tempIndex++);
+            out << pad << laneType << " " << taken << ";" << svMarker(sm, stmt.sourceRange.start())
+                << "\n";
+            out << pad << laneLoop << "\n";
+            out << pad << "    " << taken << "[l] = " << mask
+                << "[l] & (0 - static_cast<uint64_t>((" << expr << ") != 0));\n";
+            out << pad << "if (sim::any_lane<" << lanes << ">(" << taken << ")) {\n";
+            emitLaneStatement(cond.ifTrue, names, out, indent + 4, allowNba, taken, options,
+                              tempIndex, sm);
+            out << pad << "}\n";
+            if (cond.ifFalse) {
+                std::string other = "m" + std::to_string(tempIndex++);
+                out << pad << laneType << " " << other << ";\n";
+                out << pad << laneLoop << "\n";
+                out << pad << "    " << other << "[l] = " << mask << "[l] & ~" << taken
+                    << "[l];\n";
+                out << pad << "if (sim::any_lane<" << lanes << ">(" << other << ")) {\n";
+                emitLaneStatement(*cond.ifFalse, names, out, indent + 4, allowNba, other,
+                                  options, tempIndex, sm);
+                out << pad << "}\n";
+            }
+            break;
+        }
+        case StatementKind::ExpressionStatement: {
+            auto& es = stmt.as<ExpressionStatement>();
+            if (es.expr.kind == ExpressionKind::Assignment) {
+                auto& a = es.expr.as<AssignmentExpression>();
+                const ValueSymbol* lhsSym = getValueSymbolFromExpr(a.left());
+                if (!lhsSym)
+                    break;
+                auto it = names.find(lhsSym);
+                if (it == names.end())
+                    break;
+                compoundTarget = &a.left();
+                std::string rhs = emitExpr(a.right(), names, ".lane(l)");
+                out << pad << "{" << svMarker(sm, stmt.sourceRange.start()) << "\n";
+                out << pad << "    " << laneType << " v;\n";
+                out << pad << "    " << laneLoop << "\n";
+                out << pad << "        v[l] = " << rhs << ";\n";
+                if (a.isNonBlocking() && allowNba) {
+                    out << pad << "    " << it->second << ".nba(kernel, v, " << mask << ");\n";
+                } else {
+                    out << pad << "    " << it->second << ".set(v, " << mask << ");\n";
+                }
+                out << pad << "}\n";
+            }
+            break;
+        }
+        case StatementKind::Empty:
+            break;
+        default:
+            // emitModule rejects these up front (unsupportedLaneConstruct).
+            out << pad << "// unsupported statement\n";
+            break;
+    }
+}
+
+struct EdgeEventInfo {
+    std::string signal;
+    EdgeKind edge = EdgeKind::None;
+};
+
+void collectEdgeEvents(const TimingControl& timing,
+                       const EmitNames& names,
+                       std::vector<EdgeEventInfo>& events) {
+    if (timing.kind == TimingControlKind::EventList) {
+        for (auto* ev : timing.as<EventListControl>().events)
+            collectEdgeEvents(*ev, names, events);
+    } else if (timing.kind == TimingControlKind::SignalEvent) {
+        auto& ev = timing.as<SignalEventControl>();
+        const ValueSymbol* sig = getValueSymbolFromExpr(ev.expr);
+        if (!sig)
+            return;
+        auto it = names.find(sig);
+        if (it == names.end())
+            return;
+        events.push_back({it->second, ev.edge});
+    }
+}
+
+// With `anyEdge` every event is registered as level-sensitive; multi-lane processes
+// compute their own per-lane edge masks.
+void emitSensitivity(const TimingControl& timing,
+                     const EmitNames& names,
+                     std::ostream& out,
+                     int indent,
+                     bool anyEdge = false) {
     auto pad = std::string(static_cast<size_t>(indent), ' ');
+    if (timing.kind == TimingControlKind::EventList) {
+        auto& list = timing.as<EventListControl>();
+        bool first = true;
+        out << pad << "{";
+        for (auto* ev : list.events) {
+            if (!first)
+                out << ", ";
+            first = false;
+            emitSensitivity(*ev, names, out, 0, anyEdge);
+        }
+        out << "}";
+    } else if (timing.kind == TimingControlKind::SignalEvent) {
+        auto& ev = timing.as<SignalEventControl>();
+        const ValueSymbol* sig = getValueSymbolFromExpr(ev.expr);
+        if (!sig)
+            return;
+        auto it = names.find(sig);
+        if (it == names.end())
+            return;
+        const char* edge = "Any";
+        if (!anyEdge && ev.edge == EdgeKind::PosEdge)
+            edge = "Pos";
+        else if (!anyEdge && ev.edge == EdgeKind::NegEdge)
+            edge = "Neg";
+        out << "{&" << it->second << ", sim::Edge::" << edge << "}";
+    }
+}
+
+// Emits the `active` lane mask of a multi-lane edge-triggered process: a lane is active
+// when any of its sensitivity signals saw the requested edge in that lane since the
+// process last ran. The per-event snapshots live in `ff_<index>_prev_<n>` members.
+void emitLaneEdgeMask(const TimingControl* timing,
+                      const EmitNames& names,
+                      std::ostream& out,
+                      int index,
+                      const CodegenOptions& options) {
+    std::vector<EdgeEventInfo> events;
+    if (timing)
+        collectEdgeEvents(*timing, names, events);
+
+    out << "        sim::Lanes<" << options.lanes << "> active;\n";
+    out << "        for (uint32_t l = 0; l < " << options.lanes << "; ++l) {\n";
+    out << "            uint64_t edge = 0;\n";
+    for (size_t i = 0; i < events.size(); ++i) {
+        std::string prev = "ff_" + std::to_string(index) + "_prev_" + std::to_string(i) + "[l]";
+        std::string now = events[i].signal + ".lane(l)";
+        switch (events[i].edge) {
+            case EdgeKind::PosEdge:
+                out << "            edge |= (" << prev << " == 0 && " << now << " != 0);\n";
+                break;
+            case EdgeKind::NegEdge:
+                out << "            edge |= (" << prev << " != 0 && " << now << " == 0);\n";
+                break;
+            default:
+                out << "            edge |= (" << prev << " != " << now << ");\n";
+                break;
+        }
+        out << "            " << prev << " = " << now << ";\n";
+    }
+    out << "            active[l] = 0 - edge;\n";
+    out << "        }\n";
+    out << "        if (!sim::any_lane<" << options.lanes << ">(active))\n";
+    out << "            return;\n";
+}
+
+bool writeIfChanged(const std::filesystem::path& outPath, const std::string& text,
+                    CodegenResult* result) {
+    {
+        std::ifstream in(outPath, std::ios::binary);
+        if (in) {
+            std::ostringstream existing;
+            existing << in.rdbuf();
+            if (existing.str() == text) {
+                if (result)
+                    result->unchanged.push_back(outPath.string());
+                return true;
+            }
+        }
+    }
+
+    std::ofstream out(outPath, std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to open output file: " << outPath << "\n";
+        return false;
+    }
+    out << text;
+    if (result)
+        result->written.push_back(outPath.string());
+    return true;
+}
+
+// Scans a generated module for `// sv: file:line` markers and appends one srcmap row per
+// marked line: `code <cpp file> <cpp line> <function> <sv file> <sv line>`.
+void collectSourceRows(const std::string& cppFile, const std::string& className,
+                       const std::string& text, std::vector<std::string>& rows) {
+    std::istringstream in(text);
+    std::string line;
+    std::string function;
+    size_t lineNo = 0;
+    while (std::getline(in, line)) {
+        lineNo++;
+        if (line.rfind("    void ", 0) == 0) {
+            auto open = line.find('(');
+            if (open != std::string::npos)
+                function = line.substr(9, open - 9);
+        } else if (line.rfind("    " + className + "(", 0) == 0) {
+            function = className;
+        }
+        auto marker = line.find("// sv: ");
+        if (marker == std::string::npos)
+            continue;
+        std::string where = line.substr(marker + 7);
+        auto colon = where.rfind(':');
+        if (colon == std::string::npos)
+            continue;
+        rows.push_back("code\t" + cppFile + "\t" + std::to_string(lineNo) + "\t" + function +
+                       "\t" + where.substr(0, colon) + "\t" + where.substr(colon + 1));
+    }
+}
+
+void collectInstanceRows(const InstanceSymbol& inst, const std::string& path,
+                         std::vector<std::string>& rows) {
+    rows.push_back("instance\t" + path + "\t" + cppIdent(inst.getDefinition().name));
+    for (const auto& child : childInstances(inst.body))
+        collectInstanceRows(*child.symbol, path + "." + child.path(), rows);
+}
+
+// Signals a statement assigns (whole signals and memories), optionally only through `<=`.
+void collectAssignedSignals(const Statement& stmt, bool nonBlockingOnly,
+                            std::unordered_set<const ValueSymbol*>& targets) {
+    switch (stmt.kind) {
+        case StatementKind::Block:
+            collectAssignedSignals(stmt.as<BlockStatement>().body, nonBlockingOnly, targets);
+            break;
+        case StatementKind::List:
+            for (auto* s : stmt.as<StatementList>().list)
+                collectAssignedSignals(*s, nonBlockingOnly, targets);
+            break;
+        case StatementKind::Conditional: {
+            auto& cond = stmt.as<ConditionalStatement>();
+            collectAssignedSignals(cond.ifTrue, nonBlockingOnly, targets);
+            if (cond.ifFalse)
+                collectAssignedSignals(*cond.ifFalse, nonBlockingOnly, targets);
+            break;
+        }
+        case StatementKind::Case: {
+            auto& cs = stmt.as<CaseStatement>();
+            for (auto& group : cs.items)
+                collectAssignedSignals(*group.stmt, nonBlockingOnly, targets);
+            if (cs.defaultCase)
+                collectAssignedSignals(*cs.defaultCase, nonBlockingOnly, targets);
+            break;
+        }
+        case StatementKind::ForLoop: {
+            auto& loop = stmt.as<ForLoopStatement>();
+            collectAssignedSignals(loop.body, nonBlockingOnly, targets);
+            if (auto bounds = constantLoop(loop); bounds && !bounds->declared && !nonBlockingOnly)
+                targets.insert(bounds->var);
+            break;
+        }
+        case StatementKind::Timed:
+            collectAssignedSignals(stmt.as<TimedStatement>().stmt, nonBlockingOnly, targets);
+            break;
+        case StatementKind::ExpressionStatement: {
+            auto& es = stmt.as<ExpressionStatement>();
+            if (es.expr.kind != ExpressionKind::Assignment)
+                break;
+            auto& a = es.expr.as<AssignmentExpression>();
+            if (nonBlockingOnly && !a.isNonBlocking())
+                break;
+            std::unordered_set<const ValueSymbol*> selectors;
+            collectTargetSignals(a.left(), targets, selectors);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// The signal a port connection refers to; output connections come wrapped in an assignment.
+const ValueSymbol* portActual(const Expression* expr) {
+    if (!expr)
+        return nullptr;
+    if (expr->kind == ExpressionKind::Assignment)
+        return getValueSymbolFromExpr(expr->as<AssignmentExpression>().left());
+    return getValueSymbolFromExpr(*expr);
+}
+
+// Cycle mode (`--cycle`): a design whose flops all sample one clock on its rising edge and
+// whose remaining logic is combinational is simulated by step() calls instead of events.
+// Per definition, `combOrder` is the levelized order of its combinational nodes (continuous
+// assigns, always_comb blocks and child instances, by symbol). A child whose registered
+// outputs feed logic that drives its inputs is listed twice: once up front for those outputs
+// and once after its inputs settle.
+struct CycleSchedule {
+    using PortPaths = std::unordered_map<std::string, std::unordered_set<std::string>>;
+
+    std::unordered_map<std::string, std::vector<const Symbol*>> combOrder;
+    // Per definition, the clock port (empty when the definition has no flops below it) and,
+    // per output port, the input ports it depends on combinationally.
+    std::unordered_map<std::string, std::string> clockPort;
+    std::unordered_map<std::string, PortPaths> through;
+};
+
+// Checks one definition (children first) and records its schedule; on failure `reason` says
+// why the design needs the event kernel.
+bool analyzeCycleInstance(const InstanceSymbol& inst, CycleSchedule& schedule,
+                          std::string& reason) {
+    std::string defName(inst.getDefinition().name);
+    if (schedule.combOrder.count(defName))
+        return true;
+    const InstanceBodySymbol& body = inst.body;
+    const SourceManager* sm = body.getCompilation().getSourceManager();
+    auto where = [&](SourceLocation loc) {
+        std::string at = svLocation(sm, loc);
+        return defName + (at.empty() ? "" : " (" + at + ")");
+    };
+
+    std::vector<PortInfo> ports = collectPorts(body);
+    std::unordered_map<const ValueSymbol*, const PortInfo*> portOf;
+    for (const auto& port : ports) {
+        if (port.internal)
+            portOf[port.internal] = &port;
+    }
+
+    // Every always_ff samples the same signal on its rising edge.
+    const ValueSymbol* clock = nullptr;
+    std::unordered_set<const ValueSymbol*> dataReads;
+    for (auto& block : body.membersOfType<ProceduralBlockSymbol>()) {
+        switch (block.procedureKind) {
+            case ProceduralBlockKind::AlwaysComb:
+                continue;
+            case ProceduralBlockKind::AlwaysFF:
+                break;
+            case ProceduralBlockKind::Initial:
+                reason = "initial block in " + where(block.location) +
+                         "; generate the design under test as --top";
+                return false;
+            default:
+                reason = "always/always_latch/final block in " + where(block.location);
+                return false;
+        }
+        const Statement& stmt = block.getBody();
+        const ValueSymbol* edgeSym = nullptr;
+        if (stmt.kind == StatementKind::Timed) {
+            auto& ts = stmt.as<TimedStatement>();
+            if (ts.timing.kind == TimingControlKind::SignalEvent) {
+                auto& ev = ts.timing.as<SignalEventControl>();
+                if (ev.edge == EdgeKind::PosEdge && !ev.iffCondition)
+                    edgeSym = getValueSymbolFromExpr(ev.expr);
+            }
+            collectStatementSignals(ts.stmt, dataReads);
+        }
+        if (!edgeSym) {
+            reason = "always_ff in " + where(block.location) +
+                     " is not clocked by a single posedge (asynchronous reset?)";
+            return false;
+        }
+        if (clock && clock != edgeSym) {
+            reason = "always_ff in " + where(block.location) + " uses clock " +
+                     std::string(edgeSym->name) + " besides " + std::string(clock->name);
+            return false;
+        }
+        clock = edgeSym;
+    }
+
+    // Combinational nodes: what each reads and writes. Children also map their clocks.
+    struct Node {
+        const Symbol* symbol;
+        std::unordered_set<const ValueSymbol*> reads;
+        std::unordered_set<const ValueSymbol*> writes;
+        // Child instances: per written signal, the read signals it depends on combinationally.
+        std::unordered_map<const ValueSymbol*, std::unordered_set<const ValueSymbol*>> paths;
+        bool child = false;
+    };
+    std::vector<Node> nodes;
+    for (auto& assign : body.membersOfType<ContinuousAssignSymbol>()) {
+        const Expression& expr = assign.getAssignment();
+        if (expr.kind != ExpressionKind::Assignment)
+            continue;
+        auto& a = expr.as<AssignmentExpression>();
+        Node node{&assign, {}, {}, {}, false};
+        collectExprSignals(a.right(), node.reads);
+        collectTargetSignals(a.left(), node.writes, node.reads);
+        nodes.push_back(std::move(node));
+    }
+    for (auto& block : body.membersOfType<ProceduralBlockSymbol>()) {
+        if (block.procedureKind != ProceduralBlockKind::AlwaysComb)
+            continue;
+        Node node{&block, {}, {}, {}, false};
+        collectStatementSignals(block.getBody(), node.reads);
+        collectAssignedSignals(block.getBody(), false, node.writes);
+        nodes.push_back(std::move(node));
+    }
+    for (const auto& instance : childInstances(body)) {
+        const InstanceSymbol& child = *instance.symbol;
+        if (!analyzeCycleInstance(child, schedule, reason))
+            return false;
+        std::string childDef(child.getDefinition().name);
+        std::unordered_map<std::string, const ValueSymbol*> actuals;
+        for (auto* conn : child.getPortConnections()) {
+            const Expression* expr = conn->getExpression();
+            if (expr && expr->kind == ExpressionKind::Assignment)
+                expr = &expr->as<AssignmentExpression>().left();
+            auto slice = expr ? signalSlice(*expr) : std::nullopt;
+            if (slice && !slice->whole) {
+                reason = "port " + std::string(conn->port.name) + " of " + instance.path() +
+                         " in " + where(child.location) + " is connected to a part select";
+                return false;
+            }
+            actuals[std::string(conn->port.name)] = portActual(conn->getExpression());
+        }
+
+        const std::string& childClock = schedule.clockPort[childDef];
+        if (!childClock.empty()) {
+            const ValueSymbol* actual = actuals[childClock];
+            if (!actual || (clock && actual != clock)) {
+                reason = "clock port " + childClock + " of " + instance.path() +
+                         " in " + where(child.location) + " is not driven by the clock of " +
+                         defName;
+                return false;
+            }
+            clock = actual;
+        }
+
+        Node node{&child, {}, {}, {}, true};
+        const auto& through = schedule.through[childDef];
+        for (const auto& port : collectPorts(child.body)) {
+            const ValueSymbol* actual = actuals[port.name];
+            if (!actual || port.name == childClock)
+                continue;
+            if (port.direction == ArgumentDirection::In) {
+                node.reads.insert(actual);
+            } else if (port.direction == ArgumentDirection::Out) {
+                node.writes.insert(actual);
+                auto& deps = node.paths[actual];
+                auto it = through.find(port.name);
+                if (it == through.end())
+                    continue;
+                for (const auto& input : it->second) {
+                    if (auto* in = actuals[input])
+                        deps.insert(in);
+                }
+            }
+        }
+        nodes.push_back(std::move(node));
+    }
+
+    if (clock) {
+        bool readAsData = dataReads.count(clock) != 0;
+        for (const auto& node : nodes)
+            readAsData = readAsData || node.reads.count(clock);
+        if (readAsData) {
+            reason = "clock " + std::string(clock->name) + " of " + defName +
+                     " is also read as data";
+            return false;
+        }
+        auto port = portOf.find(clock);
+        if (port == portOf.end()) {
+            reason = "clock " + std::string(clock->name) + " of " + defName + " is not a port";
+            return false;
+        }
+        schedule.clockPort[defName] = port->second->name;
+    } else {
+        schedule.clockPort[defName];
+    }
+
+    // Levelize. A child's registered outputs (no combinational path from its inputs) only
+    // add an ordering edge if that keeps the graph acyclic; otherwise children whose
+    // registered outputs are read are also evaluated up front, where those are already final.
+    std::unordered_map<const ValueSymbol*, std::vector<size_t>> writers;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        for (auto* sym : nodes[i].writes)
+            writers[sym].push_back(i);
+    }
+    auto levelize = [&](bool registeredEdges, std::vector<size_t>& order) {
+        std::vector<std::vector<size_t>> succ(nodes.size());
+        std::vector<size_t> indegree(nodes.size(), 0);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            for (auto* sym : nodes[i].reads) {
+                auto it = writers.find(sym);
+                if (it == writers.end())
+                    continue;
+                for (size_t w : it->second) {
+                    if (w == i)
+                        continue;
+                    if (nodes[w].child && !registeredEdges && nodes[w].paths[sym].empty())
+                        continue;
+                    succ[w].push_back(i);
+                    indegree[i]++;
+                }
+            }
+        }
+        order.clear();
+        std::vector<size_t> ready;
+        for (size_t i = nodes.size(); i-- > 0;) {
+            if (indegree[i] == 0)
+                ready.push_back(i);
+        }
+        while (!ready.empty()) {
+            size_t n = ready.back();
+            ready.pop_back();
+            order.push_back(n);
+            for (size_t s : succ[n]) {
+                if (--indegree[s] == 0)
+                    ready.push_back(s);
+            }
+        }
+        return order.size() == nodes.size();
+    };
+
+    std::vector<size_t> order;
+    auto& combOrder = schedule.combOrder[defName];
+    if (!levelize(true, order)) {
+        if (!levelize(false, order)) {
+            std::string loop;
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                if (std::find(order.begin(), order.end(), i) != order.end())
+                    continue;
+                for (auto* sym : nodes[i].writes)
+                    loop += (loop.empty() ? "" : ", ") + std::string(sym->name);
+            }
+            schedule.combOrder.erase(defName);
+            reason = "combinational loop in " + defName + " through " + loop;
+            return false;
+        }
+        for (auto& node : nodes) {
+            bool early = false;
+            for (auto* sym : node.writes) {
+                if (!node.child || !node.paths[sym].empty())
+                    continue;
+                for (const auto& reader : nodes)
+                    early = early || reader.reads.count(sym);
+            }
+            if (early)
+                combOrder.push_back(node.symbol);
+        }
+    }
+    for (size_t n : order)
+        combOrder.push_back(nodes[n].symbol);
+
+    // Combinational paths from input to output ports, for the parent's levelization.
+    std::unordered_map<const ValueSymbol*, std::unordered_set<const ValueSymbol*>> sources;
+    std::function<const std::unordered_set<const ValueSymbol*>&(const ValueSymbol*)> inputsOf;
+    inputsOf = [&](const ValueSymbol* sym) -> const std::unordered_set<const ValueSymbol*>& {
+        auto cached = sources.find(sym);
+        if (cached != sources.end())
+            return cached->second;
+        auto& result = sources[sym];
+        auto port = portOf.find(sym);
+        if (port != portOf.end() && port->second->direction == ArgumentDirection::In) {
+            result.insert(sym);
+            return result;
+        }
+        std::unordered_set<const ValueSymbol*> found;
+        auto it = writers.find(sym);
+        if (it != writers.end()) {
+            for (size_t w : it->second) {
+                const auto& deps = nodes[w].child ? nodes[w].paths[sym] : nodes[w].reads;
+                for (auto* dep : deps) {
+                    if (dep == sym)
+                        continue;
+                    const auto& inputs = inputsOf(dep);
+                    found.insert(inputs.begin(), inputs.end());
+                }
+            }
+        }
+        sources[sym] = std::move(found);
+        return sources[sym];
+    };
+    auto& through = schedule.through[defName];
+    for (const auto& port : ports) {
+        if (port.direction != ArgumentDirection::Out || !port.internal)
+            continue;
+        auto& inputs = through[port.name];
+        for (auto* in : inputsOf(port.internal))
+            inputs.insert(portOf[in]->name);
+    }
+    return true;
+}
+
+bool analyzeCycle(const InstanceSymbol& top, const CodegenOptions& options,
+                  CycleSchedule& schedule, std::string& reason) {
+    if (options.lanes > 1) {
+        reason = "--lanes needs the event kernel";
+        return false;
+    }
+    if (options.fourState) {
+        reason = "--four-state needs the event kernel";
+        return false;
+    }
+    return analyzeCycleInstance(top, schedule, reason);
+}
+
+// An `export "DPI-C" function` of a module, under its C name.
+struct DpiExport {
+    std::string cName;
+    const SubroutineSymbol* function = nullptr;
+};
+
+// DPI-C use of one module definition.
+struct DpiUsage {
+    std::vector<const SubroutineSymbol*> imports;
+    std::vector<DpiExport> exports;
+    // Calls a context import, so instances register an svScope.
+    bool context = false;
+
+    bool any() const { return !imports.empty() || !exports.empty(); }
+    bool needsScope() const { return context || !exports.empty(); }
+};
+
+bool collectDpi(const InstanceBodySymbol& body, DpiUsage& usage) {
+    std::string defName(body.getDefinition().name);
+    bool ok = true;
+    std::unordered_set<const SubroutineSymbol*> seen;
+    auto visitor = makeVisitor(
+        // Child instances are collected with their own definitions.
+        [&](auto&, const InstanceSymbol&) {},
+        [&](auto& self, const CallExpression& call) {
+            if (auto* sub = calledSubroutine(call); sub && isDpiImport(*sub)) {
+                std::string error = dpiSignatureError(*sub, false);
+                if (error.empty())
+                    error = dpiCallError(call, *sub);
+                if (!error.empty()) {
+                    std::cerr << "DPI-C import " << sub->name << " called in " << defName
+                              << ": " << error << "\n";
+                    ok = false;
+                }
+                if (seen.insert(sub).second)
+                    usage.imports.push_back(sub);
+                if (sub->flags.has(MethodFlags::DPIContext))
+                    usage.context = true;
+            }
+            self.visitDefault(call);
+        });
+    body.visit(visitor);
+
+    // Export directives do not produce symbols of their own, so read them off the syntax.
+    auto* syntax = body.getDefinition().getSyntax();
+    if (!syntax || !ModuleDeclarationSyntax::isKind(syntax->kind))
+        return ok;
+    for (auto* member : syntax->as<ModuleDeclarationSyntax>().members) {
+        if (member->kind != SyntaxKind::DPIExport)
+            continue;
+        auto& directive = member->as<DPIExportSyntax>();
+        auto name = directive.name.valueText();
+        auto* sym = body.find(name);
+        if (!sym || sym->kind != SymbolKind::Subroutine)
+            continue;
+        auto& sub = sym->as<SubroutineSymbol>();
+        std::string error = sub.subroutineKind == SubroutineKind::Task
+                                ? "exported tasks are not supported"
+                                : dpiSignatureError(sub, true);
+        if (!error.empty()) {
+            std::cerr << "DPI-C export " << name << " in " << defName << ": " << error << "\n";
+            ok = false;
+            continue;
+        }
+        auto cName = directive.c_identifier.valueText();
+        usage.exports.push_back({std::string(cName.empty() ? name : cName), &sub});
+    }
+    return ok;
+}
+
+void collectLocals(const Statement& stmt, std::vector<const VariableSymbol*>& locals) {
     switch (stmt.kind) {
-        case StatementKind::Block: {
-            auto& block = stmt.as<BlockStatement>();
-            emitStatement(block.body, names, out, indent, allowNba);
+        case StatementKind::Block:
+            collectLocals(stmt.as<BlockStatement>().body, locals);
             break;
-        }
-        case StatementKind::List: {
-            auto& list = stmt.as<StatementList>();
-            for (auto* s : list.list)
-                emitStatement(*s, names, out, indent, allowNba);
+        case StatementKind::List:
+            for (auto* s : stmt.as<StatementList>().list)
+                collectLocals(*s, locals);
             break;
-        }
         case StatementKind::Conditional: {
             auto& cond = stmt.as<ConditionalStatement>();
-            std::string expr = emitExpr(*cond.conditions[0].expr, names);
-            out << pad << "if (" << expr << ") {\n";
-            emitStatement(cond.ifTrue, names, out, indent + 4, allowNba);
-            out << pad << "}";
-            if (cond.ifFalse) {
-                out << " else {\n";
-                emitStatement(*cond.ifFalse, names, out, indent + 4, allowNba);
-                out << pad << "}";
-            }
-            out << "\n";
+            collectLocals(cond.ifTrue, locals);
+            if (cond.ifFalse)
+                collectLocals(*cond.ifFalse, locals);
             break;
         }
-        case StatementKind::ExpressionStatement: {
-            auto& es = stmt.as<ExpressionStatement>();
-            if (es.expr.kind == ExpressionKind::Assignment) {
-                auto& a = es.expr.as<AssignmentExpression>();
-                const ValueSymbol* lhsSym = getValueSymbolFromExpr(a.left());
-                if (!lhsSym)
-                    break;
-                auto it = names.find(lhsSym);
-                if (it == names.end())
-                    break;
-                std::string rhs = emitExpr(a.right(), names);
-                if (a.isNonBlocking() && allowNba) {
-                    out << pad << "kernel.nba_assign(" << it->second << ", " << rhs << ");\n";
-                } else {
-                    out << pad << it->second << ".set(" << rhs << ");\n";
-                }
-            }
+        case StatementKind::Case: {
+            auto& cs = stmt.as<CaseStatement>();
+            for (auto& group : cs.items)
+                collectLocals(*group.stmt, locals);
+            if (cs.defaultCase)
+                collectLocals(*cs.defaultCase, locals);
             break;
         }
+        case StatementKind::ForLoop:
+            collectLocals(stmt.as<ForLoopStatement>().body, locals);
+            break;
+        case StatementKind::VariableDeclaration:
+            locals.push_back(&stmt.as<VariableDeclStatement>().symbol);
+            break;
         default:
-            out << pad << "// unsupported statement\n";
             break;
     }
 }
 
-void emitSensitivity(const TimingControl& timing,
-                     const std::unordered_map<const ValueSymbol*, std::string>& names,
-                     std::ostream& out,
-                     int indent) {
-    auto pad = std::string(static_cast<size_t>(indent), ' ');
-    if (timing.kind == TimingControlKind::EventList) {
-        auto& list = timing.as<EventListControl>();
-        bool first = true;
-        out << pad << "{";
-        for (auto* ev : list.events) {
-            if (!first)
-                out << ", ";
-            first = false;
-            emitSensitivity(*ev, names, out, 0);
+// A function or task as a member taking and returning value words; arguments and locals
+// are sim::Local so the statement emitter treats them like signals. `head` is everything
+// before the parameter list.
+void emitSubroutineMember(const SubroutineSymbol& sub, const std::string& head,
+                          const EmitNames& nameMap, std::ostream& out, const SourceManager* sm,
+                          CoverPoints* cover) {
+    auto names = nameMap;
+    bool isVoid = sub.getReturnType().isVoid();
+    out << "    " << head << "(";
+    auto args = sub.getArguments();
+    for (size_t i = 0; i < args.size(); ++i)
+        out << (i ? ", " : "") << "uint64_t " << cppIdent(args[i]->name) << "_in";
+    out << ") {" << svMarker(sm, sub.location) << "\n";
+    if (cover)
+        out << "        " << cover->hit("function", sm, sub.location) << "\n";
+    if (!isVoid && sub.returnValVar) {
+        names[sub.returnValVar] = cppIdent(sub.name);
+        out << "        sim::Local<" << bitWidth(sub.getReturnType(), 64) << "> "
+            << cppIdent(sub.name) << ";\n";
+    }
+    for (auto* arg : args) {
+        std::string name = cppIdent(arg->name);
+        names[arg] = name;
+        out << "        sim::Local<" << bitWidth(arg->getType(), 64) << "> " << name << ";\n";
+        out << "        " << name << ".set(" << name << "_in);\n";
+    }
+    std::vector<const VariableSymbol*> locals;
+    collectLocals(sub.getBody(), locals);
+    for (auto* local : locals)
+        names[local] = cppIdent(local->name);
+    emitStatement(sub.getBody(), names, out, 8, false, {}, sm, cover);
+    if (!isVoid && sub.returnValVar)
+        out << "        return " << cppIdent(sub.name) << ".value();\n";
+    out << "    }\n";
+}
+
+void emitExportMember(const DpiExport& exp, const EmitNames& nameMap,
+                      std::ostream& out, const SourceManager* sm, CoverPoints* cover) {
+    const SubroutineSymbol& sub = *exp.function;
+    out << "\n    // export \"DPI-C\" " << exp.cName << "\n";
+    emitSubroutineMember(sub,
+                         std::string(sub.getReturnType().isVoid() ? "void" : "uint64_t") +
+                             " dpi_export_" + exp.cName,
+                         nameMap, out, sm, cover);
+}
+
+// Functions and tasks without timing controls whose arguments are all inputs and whose
+// arguments and result fit a word; calls to anything else still emit 0.
+bool emittableSubroutine(const SubroutineSymbol& sub) {
+    if (isDpiImport(sub) || sub.thisVar || hasTimingControl(sub.getBody()))
+        return false;
+    auto fits = [](const Type& type) {
+        return type.isIntegral() && type.getBitWidth() <= 64;
+    };
+    for (auto* arg : sub.getArguments()) {
+        if (arg->direction != ArgumentDirection::In || !fits(arg->getType()))
+            return false;
+    }
+    return sub.getReturnType().isVoid() || fits(sub.getReturnType());
+}
+
+bool declaredIn(const Symbol& sym, const SubroutineSymbol& sub) {
+    for (auto* scope = sym.getParentScope(); scope; scope = scope->asSymbol().getParentScope()) {
+        if (&scope->asSymbol() == &sub)
+            return true;
+    }
+    return false;
+}
+
+// Pure functions touch only their arguments and locals and call only pure functions, so
+// they become static members and lane mode can call them.
+bool pureSubroutine(const SubroutineSymbol& sub,
+                    std::unordered_map<const SubroutineSymbol*, bool>& memo) {
+    if (auto it = memo.find(&sub); it != memo.end())
+        return it->second;
+    memo[&sub] = true;
+    bool pure = true;
+    auto visitor = makeVisitor(
+        [&](auto& self, const NamedValueExpression& named) {
+            if (named.symbol.kind != SymbolKind::Parameter && !declaredIn(named.symbol, sub))
+                pure = false;
+            self.visitDefault(named);
+        },
+        [&](auto& self, const CallExpression& call) {
+            auto* callee = calledSubroutine(call);
+            if (call.isSystemCall() || !callee || !emittableSubroutine(*callee) ||
+                !pureSubroutine(*callee, memo))
+                pure = false;
+            self.visitDefault(call);
+        });
+    sub.getBody().visit(visitor);
+    memo[&sub] = pure;
+    return pure;
+}
+
+// What emitLaneStatement cannot emit per lane in an always block body: statements other
+// than blocks, `if`/`else` and assignments. Empty when it can emit all of them.
+std::string unsupportedLaneStatement(const Statement& stmt) {
+    switch (stmt.kind) {
+        case StatementKind::Block:
+            return unsupportedLaneStatement(stmt.as<BlockStatement>().body);
+        case StatementKind::List:
+            for (auto* s : stmt.as<StatementList>().list) {
+                if (auto what = unsupportedLaneStatement(*s); !what.empty())
+                    return what;
+            }
+            return {};
+        case StatementKind::Empty:
+            return {};
+        case StatementKind::Conditional: {
+            auto& cond = stmt.as<ConditionalStatement>();
+            if (cond.conditions.size() != 1 || cond.conditions[0].pattern)
+                return "Conditions with patterns or &&&";
+            if (auto what = unsupportedLaneStatement(cond.ifTrue); !what.empty())
+                return what;
+            return cond.ifFalse ? unsupportedLaneStatement(*cond.ifFalse) : std::string();
         }
-        out << "}";
-    } else if (timing.kind == TimingControlKind::SignalEvent) {
-        auto& ev = timing.as<SignalEventControl>();
-        const ValueSymbol* sig = getValueSymbolFromExpr(ev.expr);
-        if (!sig)
-            return;
-        auto it = names.find(sig);
-        if (it == names.end())
-            return;
-        const char* edge = "Any";
-        if (ev.edge == EdgeKind::PosEdge)
-            edge = "Pos";
-        else if (ev.edge == EdgeKind::NegEdge)
-            edge = "Neg";
-        out << "{&" << it->second << ", sim::Edge::" << edge << "}";
+        case StatementKind::ExpressionStatement:
+            if (stmt.as<ExpressionStatement>().expr.kind == ExpressionKind::Assignment)
+                return {};
+            return "Task and system calls in always blocks";
+        case StatementKind::Case:
+        case StatementKind::PatternCase:
+            return "Case statements";
+        case StatementKind::ForLoop:
+        case StatementKind::RepeatLoop:
+        case StatementKind::ForeachLoop:
+        case StatementKind::WhileLoop:
+        case StatementKind::DoWhileLoop:
+        case StatementKind::ForeverLoop:
+            return "Loops";
+        default:
+            return std::string(toString(stmt.kind)) + " statements";
+    }
+}
+
+// The first construct of a module member that --lanes codegen cannot emit per lane, or empty:
+// unsupported statements in always blocks, select and concatenation assignment targets, and
+// calls of impure functions, which read signals through the scalar accessors and so are not
+// emitted in lane mode.
+std::string unsupportedLaneConstruct(const Symbol& member,
+                                     std::unordered_map<const SubroutineSymbol*, bool>& pure) {
+    std::string what;
+    if (member.kind == SymbolKind::ProceduralBlock) {
+        auto& block = member.as<ProceduralBlockSymbol>();
+        if (block.procedureKind != ProceduralBlockKind::Initial) {
+            const Statement* body = &block.getBody();
+            if (body->kind == StatementKind::Timed)
+                body = &body->as<TimedStatement>().stmt;
+            what = unsupportedLaneStatement(*body);
+        }
+    }
+    member.visit(makeVisitor(
+        // Child instances are checked with their own definitions.
+        [&](auto&, const InstanceSymbol&) {},
+        [&](auto& self, const AssignmentExpression& a) {
+            // Memories are rejected before, so any select here is of a packed signal.
+            if (what.empty() && a.left().kind != ExpressionKind::NamedValue)
+                what = "Select and concatenation assignment targets";
+            self.visitDefault(a);
+        },
+        [&](auto& self, const CallExpression& call) {
+            auto* sub = calledSubroutine(call);
+            if (what.empty() && sub && emittableSubroutine(*sub) && !pureSubroutine(*sub, pure))
+                what = "Calls of impure function " + std::string(sub->name);
+            self.visitDefault(call);
+        }));
+    return what;
+}
+
+// Few enough statements that every call site should get its own copy.
+bool smallSubroutine(const SubroutineSymbol& sub) {
+    constexpr int kMaxInlineStatements = 4;
+    int statements = 0;
+    bool loops = false;
+    auto visitor = makeVisitor(
+        [&](auto& self, const ExpressionStatement& stmt) {
+            statements++;
+            self.visitDefault(stmt);
+        },
+        [&](auto& self, const ReturnStatement& stmt) {
+            statements++;
+            self.visitDefault(stmt);
+        },
+        [&](auto&, const ForLoopStatement&) { loops = true; });
+    sub.getBody().visit(visitor);
+    return !loops && statements <= kMaxInlineStatements;
+}
+
+// The functions and tasks the module calls, directly or through each other, in first-call
+// order.
+std::vector<const SubroutineSymbol*> collectSubroutines(const InstanceBodySymbol& body) {
+    std::vector<const SubroutineSymbol*> subs;
+    std::unordered_set<const SubroutineSymbol*> seen;
+    auto visitor = makeVisitor(
+        // Child instances are emitted with their own definitions.
+        [&](auto&, const InstanceSymbol&) {},
+        [&](auto& self, const CallExpression& call) {
+            auto* sub = calledSubroutine(call);
+            if (!call.isSystemCall() && sub && emittableSubroutine(*sub) &&
+                seen.insert(sub).second) {
+                subs.push_back(sub);
+                sub->getBody().visit(self);
+            }
+            self.visitDefault(call);
+        });
+    body.visit(visitor);
+    return subs;
+}
+
+// The C entry point of an export: runs the member on the instance of the current scope.
+void emitExportWrapper(const DpiExport& exp, const std::string& className, std::ostream& out) {
+    const SubroutineSymbol& sub = *exp.function;
+    out << "extern \"C\" " << dpiPrototype(sub, exp.cName) << " {\n";
+    std::string callText = "sim::dpi_instance<gen::" + className + ">(" +
+                           cppStringLiteral(exp.cName) + ")->dpi_export_" + exp.cName + "(";
+    auto args = sub.getArguments();
+    for (size_t i = 0; i < args.size(); ++i) {
+        DpiType t = dpiType(args[i]->getType());
+        std::string name = cppIdent(args[i]->name);
+        std::string value;
+        switch (t.kind) {
+            case DpiKind::Bit:
+            case DpiKind::Logic:
+                value = "static_cast<uint64_t>(" + name + " & 1)";
+                break;
+            case DpiKind::BitVector:
+                value = "sim::dpi_read_bits(" + name + ", " + std::to_string(t.width) + ")";
+                break;
+            case DpiKind::LogicVector:
+                value = "sim::dpi_read_logic(" + name + ", " + std::to_string(t.width) + ")";
+                break;
+            default:
+                value = "static_cast<uint64_t>(" + name + ")";
+                break;
+        }
+        callText += (i ? ", " : "") + value;
+    }
+    callText += ")";
+    DpiType ret = dpiType(sub.getReturnType());
+    switch (ret.kind) {
+        case DpiKind::Void:
+            out << "    " << callText << ";\n";
+            break;
+        case DpiKind::Bit:
+        case DpiKind::Logic:
+            out << "    return static_cast<" << ret.cType << ">(" << callText << " & 1);\n";
+            break;
+        default:
+            out << "    return static_cast<" << ret.cType << ">(" << callText << ");\n";
+            break;
+    }
+    out << "}\n";
+}
+
+// sim_dpi.h: C prototypes of every import the design calls and every function it exports.
+// C models include it so their definitions get C linkage and are checked against the SV
+// declarations.
+bool emitDpiHeader(const std::vector<const DpiUsage*>& usages, const std::string& outDir,
+                   CodegenResult* result) {
+    std::map<std::string, std::string> imports;
+    std::map<std::string, std::string> exports;
+    for (const auto* usage : usages) {
+        for (const auto* sub : usage->imports)
+            imports.emplace(dpiImportName(*sub), dpiPrototype(*sub, dpiImportName(*sub)));
+        for (const auto& exp : usage->exports)
+            exports.emplace(exp.cName, dpiPrototype(*exp.function, exp.cName));
     }
+    std::ostringstream out;
+    out << "/* DPI-C functions of the design; generated, do not edit. */\n";
+    out << "#ifndef SIM_DPI_H\n#define SIM_DPI_H\n\n";
+    out << "#include \"sim/svdpi.h\"\n\n";
+    out << "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n";
+    out << "/* Imported: implemented in C. */\n";
+    for (const auto& [name, proto] : imports)
+        out << proto << ";\n";
+    out << "\n/* Exported: implemented by the design, callable from C. */\n";
+    for (const auto& [name, proto] : exports)
+        out << proto << ";\n";
+    out << "\n#ifdef __cplusplus\n}\n#endif\n\n#endif /* SIM_DPI_H */\n";
+    return writeIfChanged(std::filesystem::path(outDir) / "sim_dpi.h", out.str(), result);
 }
 
-bool emitModule(const InstanceSymbol& inst, const std::string& outDir) {
+// A cycle-mode step of a child member: a loop over the replicas when it holds several.
+void emitChildCall(std::ostream& out, const std::string& name, size_t count,
+                   std::string_view method) {
+    if (count > 1) {
+        out << "        for (auto& replica : " << name << ")\n";
+        out << "            replica." << method << "();\n";
+    } else {
+        out << "        " << name << "." << method << "();\n";
+    }
+}
+
+bool emitModule(const InstanceSymbol& inst, const std::string& outDir,
+                const CodegenOptions& options, const FourStateInfo& fourStateInfo,
+                const DpiUsage& dpi, const CycleSchedule* cycle, CodegenResult* result,
+                std::vector<std::string>& srcRows) {
     std::string defName(inst.getDefinition().name);
+    const SourceManager* sm = inst.body.getCompilation().getSourceManager();
+    std::string sigType = signalType(options);
+    bool laneMode = options.lanes > 1;
     std::filesystem::path outPath = std::filesystem::path(outDir) / (defName + ".cpp");
-    std::ofstream out(outPath);
-    if (!out) {
-        std::cerr << "Failed to open output file: " << outPath << "\n";
-        return false;
-    }
+    CoverPoints coverPoints;
+    CoverPoints* cover = options.coverage && !laneMode ? &coverPoints : nullptr;
+    std::ostringstream out;
 
     const InstanceBodySymbol& body = inst.body;
     std::vector<PortInfo> ports = collectPorts(body);
@@ -521,6 +3582,11 @@ bool emitModule(const InstanceSymbol& inst, const std::string& outDir) {
             portInternals.insert(port.internal);
     }
 
+    // Instrumented builds measure the design as written, so coverage turns the passes off.
+    LoweredModule lowered = lowerModule(body, options.optimize && !options.coverage);
+    if (options.irStats)
+        ir::printStats(std::cerr, lowered.ir, lowered.stats);
+
     std::vector<const ParameterSymbol*> params;
     for (auto* paramBase : body.getParameters()) {
         if (paramBase->symbol.kind == SymbolKind::Parameter)
@@ -533,18 +3599,22 @@ bool emitModule(const InstanceSymbol& inst, const std::string& outDir) {
             continue;
         if (portInternals.find(&member) != portInternals.end())
             continue;
+        if (!lowered.liveSignal(member))
+            continue;
         internals.push_back(&member);
     }
 
     std::vector<std::pair<std::string, uint32_t>> extraSignals;
     struct CombProc {
+        const Symbol* symbol = nullptr;
         std::vector<const ValueSymbol*> deps;
         const AssignmentExpression* assign = nullptr;
         const Statement* stmt = nullptr;
+        SourceLocation location;
     };
     std::vector<CombProc> combProcs;
 
-    std::unordered_map<const ValueSymbol*, std::string> nameMap;
+    EmitNames nameMap;
     for (const auto& port : ports) {
         if (port.internal)
             nameMap[port.internal] = port.name;
@@ -554,69 +3624,305 @@ bool emitModule(const InstanceSymbol& inst, const std::string& outDir) {
         nameMap[sig] = name;
     }
 
-    struct ChildInst {
-        std::string name;
-        std::string className;
-        std::vector<std::string> args;
+    // Unpacked arrays are 2-state sim::Memory members with one copy per instance.
+    std::unordered_map<const ValueSymbol*, MemoryShape> memories;
+    for (const auto* sig : internals) {
+        if (auto shape = memoryShape(sig->getType()))
+            memories.emplace(sig, *shape);
+    }
+    if (laneMode && !memories.empty()) {
+        std::cerr << "Unpacked arrays in " << defName << " are not supported with --lanes\n";
+        return false;
+    }
+    if (laneMode && dpi.any()) {
+        std::cerr << "DPI-C functions in " << defName << " are not supported with --lanes\n";
+        return false;
+    }
+
+    // Called functions and tasks become members: pure ones static, small pure ones forced
+    // inline. Lane mode reads signals per lane, so it only calls pure ones.
+    FunctionTable functions;
+    functions.scope = &body;
+    std::unordered_map<const SubroutineSymbol*, bool> pure;
+    std::vector<std::pair<const SubroutineSymbol*, std::string>> functionMembers;
+    for (auto* sub : collectSubroutines(body)) {
+        bool isPure = pureSubroutine(*sub, pure);
+        if (laneMode && !isPure)
+            continue;
+        std::string name = "fn_" + cppIdent(sub->name);
+        functions.members.emplace(sub, name);
+        std::string head = std::string(sub->getReturnType().isVoid() ? "void " : "uint64_t ") +
+                           name;
+        // Coverage counters are members, so instrumented functions cannot be static.
+        if (isPure && !cover)
+            head = (smallSubroutine(*sub) ? "[[gnu::always_inline]] static " : "static ") + head;
+        functionMembers.push_back({sub, head});
+    }
+    nameMap.functions = &functions;
+    if (laneMode) {
+        for (auto& member : body.members()) {
+            if (member.kind != SymbolKind::ProceduralBlock &&
+                member.kind != SymbolKind::ContinuousAssign)
+                continue;
+            if (auto what = unsupportedLaneConstruct(member, pure); !what.empty()) {
+                std::cerr << what << " in " << defName << " are not supported with --lanes\n";
+                return false;
+            }
+        }
+    }
+
+    // A random stream per process and function that draws random numbers, named after the
+    // symbol's index in the module like the interpreter's.
+    // Lane bodies have no stream, so they reject random calls like memories and DPI.
+    std::vector<std::pair<const Symbol*, std::string>> randomStreams;
+    for (auto& member : body.members()) {
+        if ((member.kind != SymbolKind::ProceduralBlock &&
+             member.kind != SymbolKind::ContinuousAssign &&
+             member.kind != SymbolKind::Subroutine) ||
+            !usesRandom(member))
+            continue;
+        if (laneMode) {
+            std::cerr << "Random number calls in " << defName
+                      << " are not supported with --lanes\n";
+            return false;
+        }
+        if (auto* call = unsupportedRandomCall(member)) {
+            std::cerr << "Unsupported " << call->getSubroutineName() << " call in " << defName
+                      << ": $urandom_range needs a bound, and $random seeds and randomized "
+                      << "values must be variables of at most 64 bits\n";
+            return false;
+        }
+        randomStreams.emplace_back(&member, "rng_" + std::to_string(static_cast<uint32_t>(
+                                                         member.getIndex())) + "_");
+    }
+    auto useRandomStream = [&](const Symbol* process) {
+        nameMap.random = nullptr;
+        for (const auto& [symbol, name] : randomStreams) {
+            if (symbol == process)
+                nameMap.random = &name;
+        }
+    };
+
+    std::unordered_set<const ValueSymbol*> fourState;
+    for (const auto& [sym, name] : nameMap) {
+        if (fourStateInfo.signals.count(signalKey(defName, *sym)) && !memories.count(sym))
+            fourState.insert(sym);
+    }
+
+    // A child is one member, or for replicas of one instantiation in a generate-for loop or
+    // instance array, one sim::Replicas member built and stepped in a loop, so the class does
+    // not grow with the replica count. Replicas share a member when their connections only
+    // differ in the replica index: the same parent signals, constants and unconnected ports,
+    // and constant selects (`.a(data[i])`) whose offset steps by the same amount per replica.
+    struct ChildInst {
+        // Every replica, in index order.
+        std::vector<const InstanceSymbol*> symbols;
+        std::string name;
+        std::string className;
+        // Constructor arguments; for replicas, `i` is the replica in the expressions.
+        std::vector<std::string> args;
+        size_t count = 1;
+    };
+    // Per-replica signals for unconnected ports: name, width and replica count.
+    struct ReplicaSignal {
+        std::string name;
+        uint32_t width = 1;
+        size_t count = 1;
+    };
+    std::vector<ReplicaSignal> replicaSignals;
+
+    // How a child port is connected: to a parent signal (`signal`), to `width` bits of one
+    // from `offset` (`slice`), to a constant, or not at all (everything empty). Slices and
+    // constants get a signal of their own, kept in step with the parent by PortGlue.
+    struct PortActual {
+        std::string signal;
+        uint32_t width = 1;
+        bool output = false;
+        bool slice = false;
+        uint32_t offset = 0;
+        std::optional<uint64_t> constant;
+
+        bool sameShape(const PortActual& other) const {
+            return signal == other.signal && width == other.width && output == other.output &&
+                   slice == other.slice && constant == other.constant;
+        }
+    };
+    std::vector<std::string> connectionErrors;
+    std::vector<ChildInstance> childList = childInstances(body);
+    std::vector<std::vector<PortActual>> actuals;
+    for (const auto& child : childList) {
+        std::unordered_map<const PortSymbol*, const Expression*> portExprs;
+        for (auto* conn : child.symbol->getPortConnections()) {
+            const auto& port = conn->port.as<PortSymbol>();
+            portExprs[&port] = conn->getExpression();
+        }
+        auto& row = actuals.emplace_back();
+        for (const auto& port : collectPorts(child.symbol->body)) {
+            PortActual& actual = row.emplace_back();
+            actual.width = port.width;
+            actual.output = port.direction != ArgumentDirection::In;
+            auto it = port.portSymbol ? portExprs.find(port.portSymbol) : portExprs.end();
+            if (it == portExprs.end() || !it->second)
+                continue;
+            const Expression& expr = it->second->kind == ExpressionKind::Assignment
+                                         ? it->second->as<AssignmentExpression>().left()
+                                         : *it->second;
+            // Selects of signals this class does not keep stay unconnected, like those signals.
+            auto slice = signalSlice(expr);
+            auto nameIt = slice ? nameMap.find(slice->signal) : nameMap.end();
+            if (nameIt != nameMap.end() && !memories.count(slice->signal)) {
+                actual.signal = nameIt->second;
+                actual.slice = !slice->whole;
+                actual.offset = slice->offset;
+            } else if (!slice && !actual.output) {
+                actual.constant = evalConstant(expr, body);
+            }
+            if (!slice && !actual.constant) {
+                connectionErrors.push_back("port " + port.name + " of " + child.path());
+                continue;
+            }
+            if (actual.slice && port.direction == ArgumentDirection::InOut)
+                connectionErrors.push_back("inout port " + port.name + " of " + child.path());
+        }
+    }
+    if (!connectionErrors.empty()) {
+        for (const auto& error : connectionErrors)
+            std::cerr << "Unsupported connection of " << error << " in " << defName
+                      << ": only signals, constant selects of them and constants\n";
+        return false;
+    }
+
+    // Replicas by instantiation, then checked for a constant index step and uniform ports.
+    std::map<std::tuple<const void*, std::string, std::string>, std::vector<size_t>> replicas;
+    for (size_t i = 0; i < childList.size(); ++i) {
+        const auto& child = childList[i];
+        if (child.index)
+            replicas[{child.symbol->getSyntax(), child.prefix, child.suffix}].push_back(i);
+    }
+    auto connectionsStep = [&](const std::vector<size_t>& members) {
+        const auto& first = actuals[members[0]];
+        for (size_t p = 0; p < first.size(); ++p) {
+            int64_t stride = static_cast<int64_t>(actuals[members[1]][p].offset) -
+                             static_cast<int64_t>(first[p].offset);
+            for (size_t k = 1; k < members.size(); ++k) {
+                const PortActual& actual = actuals[members[k]][p];
+                if (!actual.sameShape(first[p]) ||
+                    static_cast<int64_t>(actual.offset) !=
+                        static_cast<int64_t>(first[p].offset) +
+                            stride * static_cast<int64_t>(k))
+                    return false;
+            }
+        }
+        return true;
+    };
+    std::vector<const std::vector<size_t>*> groupOf(childList.size());
+    for (const auto& [key, members] : replicas) {
+        if (members.size() < 2)
+            continue;
+        const auto& first = childList[members[0]];
+        int64_t step = *childList[members[1]].index - *first.index;
+        bool uniform = step != 0;
+        for (size_t k = 1; k < members.size() && uniform; ++k) {
+            const auto& child = childList[members[k]];
+            uniform = *child.index == *first.index + step * static_cast<int64_t>(k) &&
+                      &child.symbol->getDefinition() == &first.symbol->getDefinition() &&
+                      actuals[members[k]].size() == actuals[members[0]].size();
+        }
+        if (uniform && connectionsStep(members)) {
+            for (size_t i : members)
+                groupOf[i] = &members;
+        }
+    }
+
+    // Copies between a slice or constant connection's own signal and the parent: `offset`
+    // (plus `stride` per replica) locates the slice.
+    struct PortGlue {
+        std::string port;
+        PortActual actual;
+        int64_t stride = 0;
+        size_t count = 1;
     };
+    std::vector<PortGlue> portGlue;
 
     std::vector<ChildInst> children;
     int childIndex = 0;
-    for (auto& child : body.membersOfType<InstanceSymbol>()) {
+    for (size_t c = 0; c < childList.size(); ++c) {
+        const auto& child = childList[c];
+        const std::vector<size_t>* group = groupOf[c];
+        if (group && group->front() != c)
+            continue;
         ChildInst ci;
-        ci.name = cppIdent(child.name);
+        ci.name = cppIdent(group ? child.prefix + child.suffix : child.path());
         if (ci.name.empty())
             ci.name = "inst_" + std::to_string(childIndex);
-        ci.className = cppIdent(child.getDefinition().name);
+        ci.className = cppIdent(child.symbol->getDefinition().name);
         if (ci.name == ci.className)
             ci.name += "_inst";
         ci.args.push_back("kernel");
-
-        std::unordered_map<const PortSymbol*, const Expression*> portExprs;
-        for (auto* conn : child.getPortConnections()) {
-            const auto& port = conn->port.as<PortSymbol>();
-            portExprs[&port] = conn->getExpression();
+        if (group) {
+            int64_t step = *childList[(*group)[1]].index - *child.index;
+            ci.count = group->size();
+            for (size_t i : *group)
+                ci.symbols.push_back(childList[i].symbol);
+            ci.args.push_back("scope + " + cppStringLiteral("." + child.prefix + "[") +
+                              " + std::to_string(" + std::to_string(*child.index) + " + " +
+                              std::to_string(step) + " * static_cast<int64_t>(i)) + " +
+                              cppStringLiteral("]" + child.suffix));
+        } else {
+            ci.symbols.push_back(child.symbol);
+            ci.args.push_back("scope + " + cppStringLiteral("." + child.path()));
         }
 
-        auto childPorts = collectPorts(child.body);
         int dummyIndex = 0;
-        for (const auto& port : childPorts) {
-            std::string arg;
-            if (port.portSymbol) {
-                auto it = portExprs.find(port.portSymbol);
-                if (it != portExprs.end() && it->second) {
-                    const ValueSymbol* actual = getValueSymbolFromExpr(*it->second);
-                    if (actual) {
-                        auto nameIt = nameMap.find(actual);
-                        if (nameIt != nameMap.end())
-                            arg = nameIt->second;
-                    }
-                }
+        for (size_t p = 0; p < actuals[c].size(); ++p) {
+            const PortActual& actual = actuals[c][p];
+            if (!actual.signal.empty() && !actual.slice) {
+                ci.args.push_back(actual.signal);
+                continue;
+            }
+            std::string dummy = ci.name + "_unconn_" + std::to_string(dummyIndex++);
+            if (group) {
+                replicaSignals.push_back({dummy, actual.width, ci.count});
+                ci.args.push_back(dummy + "[i]");
+            } else {
+                extraSignals.emplace_back(dummy, actual.width);
+                ci.args.push_back(dummy);
             }
-            if (arg.empty()) {
-                std::string dummy = ci.name + "_unconn_" + std::to_string(dummyIndex++);
-                extraSignals.emplace_back(dummy, port.width);
-                arg = dummy;
+            if (actual.slice || actual.constant) {
+                int64_t stride = group ? static_cast<int64_t>(actuals[(*group)[1]][p].offset) -
+                                             static_cast<int64_t>(actual.offset)
+                                       : 0;
+                portGlue.push_back({dummy, actual, stride, group ? ci.count : 1});
             }
-            ci.args.push_back(arg);
         }
 
         children.push_back(std::move(ci));
         childIndex++;
     }
+    if (laneMode && std::any_of(portGlue.begin(), portGlue.end(),
+                                [](const PortGlue& glue) { return glue.actual.slice; })) {
+        std::cerr << "Part-select port connections in " << defName
+                  << " are not supported with --lanes\n";
+        return false;
+    }
 
     out << "#include <cstdint>\n";
     out << "#include <functional>\n";
     out << "#include <memory>\n";
+    out << "#include <string>\n";
     out << "#include <vector>\n";
-    out << "#include \"sim/runtime.h\"\n\n";
+    out << "#include \"sim/runtime.h\"\n";
+    if (dpi.any())
+        out << "#include \"sim_dpi.h\"\n";
+    out << "\n";
     out << "namespace gen {\n\n";
     out << "class " << cppIdent(defName) << " {\n";
     out << "public:\n";
 
-    out << "    " << cppIdent(defName) << "(sim::Kernel& kernel";
+    // `scope` is the hierarchical path of this instance, used to attribute profile samples.
+    out << "    " << cppIdent(defName) << "(sim::Kernel& kernel, const std::string& scope";
     for (const auto& port : ports)
-        out << ", sim::Signal& " << port.name;
+        out << ", " << sigType << "& " << port.name;
     for (const auto* param : params) {
         auto opt = param->getValue().integer().as<uint64_t>();
         uint64_t value = opt.value_or(0);
@@ -624,42 +3930,155 @@ bool emitModule(const InstanceSymbol& inst, const std::string& outDir) {
     }
     out << ")\n";
     out << "        : kernel(kernel)";
+    if (dpi.needsScope())
+        out << ", dpi_scope_(kernel.dpi_scope(scope, this, &dpi_type))";
     for (const auto& port : ports)
         out << ", " << port.name << "(" << port.name << ")";
     for (const auto* sig : internals) {
         std::string name = nameMap[sig];
+        auto memory = memories.find(sig);
+        if (memory != memories.end()) {
+            out << ", " << name << "(" << memory->second.width << ", " << memory->second.depth
+                << "ULL";
+            if (memory->second.lower != 0 || memory->second.descending)
+                out << ", " << memory->second.lower << "LL";
+            if (memory->second.descending)
+                out << ", true";
+            out << ")";
+            continue;
+        }
         uint32_t width = bitWidth(sig->getType(), 1);
-        out << ", " << name << "(" << width << ")";
+        out << ", " << name << "(" << width;
+        auto init = fourStateInfo.initial.find(signalKey(defName, *sig));
+        if (init != fourStateInfo.initial.end())
+            out << ", " << init->second;
+        out << ")";
     }
     for (const auto& extra : extraSignals)
         out << ", " << extra.first << "(" << extra.second << ")";
+    for (const auto& extra : replicaSignals) {
+        out << ", " << extra.name << "([](size_t) { return " << sigType << "(" << extra.width
+            << "); })";
+    }
+    for (const auto& [symbol, name] : randomStreams) {
+        out << ", " << name << "(kernel, scope + \":"
+            << static_cast<uint32_t>(symbol->getIndex()) << "\")";
+    }
     for (const auto& child : children) {
         out << ", " << child.name << "(";
+        if (child.count > 1)
+            out << "[&](size_t i) {\n            return " << child.className << "(";
         for (size_t i = 0; i < child.args.size(); ++i) {
             if (i != 0)
                 out << ", ";
             out << child.args[i];
         }
-        out << ")";
+        out << (child.count > 1 ? ");\n        })" : ")");
     }
     out << " {\n";
 
+    // Ports are tracked by the module that owns them (or by the top driver).
+    if (internals.size() > memories.size() || !extraSignals.empty()) {
+        // Named by SV identifier for toggle coverage.
+        out << "        kernel.track(scope, {";
+        bool firstTracked = true;
+        for (const auto* sig : internals) {
+            if (memories.count(sig))
+                continue;
+            out << (firstTracked ? "" : ", ") << "{" << cppStringLiteral(sig->name) << ", &"
+                << nameMap[sig] << "}";
+            firstTracked = false;
+        }
+        for (const auto& extra : extraSignals) {
+            out << (firstTracked ? "" : ", ") << "{" << cppStringLiteral(extra.first) << ", &"
+                << extra.first << "}";
+            firstTracked = false;
+        }
+        out << "});\n";
+    }
+    if (!memories.empty()) {
+        out << "        kernel.track_memory({";
+        bool firstTracked = true;
+        for (const auto* sig : internals) {
+            if (!memories.count(sig))
+                continue;
+            out << (firstTracked ? "" : ", ") << "&" << nameMap[sig];
+            firstTracked = false;
+        }
+        out << "});\n";
+    }
+    for (const auto& extra : replicaSignals)
+        out << "        for (auto& signal : " << extra.name << ")\n"
+            << "            kernel.track({&signal});\n";
+    if (!randomStreams.empty()) {
+        out << "        kernel.track_random({";
+        for (size_t i = 0; i < randomStreams.size(); ++i)
+            out << (i ? ", " : "") << "&" << randomStreams[i].second;
+        out << "});\n";
+    }
+
+    // Slice and constant port connections (see PortActual).
+    for (const auto& glue : portGlue) {
+        const PortActual& actual = glue.actual;
+        std::string pad = "        ";
+        std::string port = glue.port;
+        std::string offset = std::to_string(actual.offset);
+        if (glue.count > 1) {
+            out << pad << "for (size_t i = 0; i < " << glue.count << "; ++i) {\n";
+            pad += "    ";
+            port += "[i]";
+            if (actual.slice) {
+                out << pad << "const uint64_t offset = " << actual.offset << " + "
+                    << glue.stride << " * static_cast<int64_t>(i);\n";
+                offset = "offset";
+            }
+        }
+        std::string capture = glue.count > 1 ? "[this, i, offset]" : "[this]";
+        if (actual.constant) {
+            out << pad << port << ".set(" << *actual.constant << "ULL);\n";
+        } else if (!actual.output) {
+            out << pad << "kernel.register_continuous(" << capture << " {\n"
+                << pad << "    " << port << ".set(sim::Logic4{sim::bits(" << actual.signal
+                << ".value(), " << offset << ", " << actual.width << "), sim::bits("
+                << actual.signal << ".unknown(), " << offset << ", " << actual.width
+                << ")});\n"
+                << pad << "}, {&" << actual.signal << "});\n";
+        } else {
+            std::string mask =
+                "(" + std::to_string(widthMask(actual.width)) + "ULL << " + offset + ")";
+            out << pad << "kernel.register_continuous(" << capture << " {\n"
+                << pad << "    const uint64_t mask = " << mask << ";\n"
+                << pad << "    " << actual.signal << ".set(sim::Logic4{(" << actual.signal
+                << ".value() & ~mask) | (" << port << ".value() << " << offset << "), ("
+                << actual.signal << ".unknown() & ~mask) | (" << port << ".unknown() << "
+                << offset << ")});\n"
+                << pad << "}, {&" << port << "});\n";
+        }
+        if (glue.count > 1)
+            out << "        }\n";
+    }
+
     for (auto& assign : body.membersOfType<ContinuousAssignSymbol>()) {
         const Expression& expr = assign.getAssignment();
-        if (expr.kind != ExpressionKind::Assignment)
+        if (expr.kind != ExpressionKind::Assignment || !lowered.live(assign))
             continue;
         auto& a = expr.as<AssignmentExpression>();
         CombProc proc;
+        proc.symbol = &assign;
         proc.assign = &a;
+        proc.location = assign.location;
+        std::unordered_set<const ValueSymbol*> targets;
         std::unordered_set<const ValueSymbol*> deps;
         collectExprSignals(a.right(), deps);
+        collectTargetSignals(a.left(), targets, deps);
         proc.deps.assign(deps.begin(), deps.end());
         combProcs.push_back(std::move(proc));
     }
 
+    std::unordered_set<const ValueSymbol*> nbaTargets;
     int ffIndex = 0;
     for (auto& block : body.membersOfType<ProceduralBlockSymbol>()) {
-        if (block.procedureKind != ProceduralBlockKind::AlwaysFF)
+        if (block.procedureKind != ProceduralBlockKind::AlwaysFF || !lowered.live(block))
             continue;
 
         const Statement& bodyStmt = block.getBody();
@@ -671,9 +4090,16 @@ bool emitModule(const InstanceSymbol& inst, const std::string& outDir) {
             stmtBody = &ts.stmt;
         }
 
+        if (cycle) {
+            // Cycle mode: step() runs the flops; `<=` targets get next-state members.
+            collectAssignedSignals(*stmtBody, true, nbaTargets);
+            ffIndex++;
+            continue;
+        }
+        emitSite(out, 8, "always_ff", sm, block.location);
         out << "        kernel.register_edge([this]() { eval_ff_" << ffIndex << "(); }, ";
         if (timing) {
-            emitSensitivity(*timing, nameMap, out, 8);
+            emitSensitivity(*timing, nameMap, out, 8, laneMode);
         } else {
             out << "{}";
         }
@@ -682,7 +4108,7 @@ bool emitModule(const InstanceSymbol& inst, const std::string& outDir) {
     }
 
     for (auto& block : body.membersOfType<ProceduralBlockSymbol>()) {
-        if (block.procedureKind != ProceduralBlockKind::AlwaysComb)
+        if (block.procedureKind != ProceduralBlockKind::AlwaysComb || !lowered.live(block))
             continue;
 
         const Statement& bodyStmt = block.getBody();
@@ -690,13 +4116,18 @@ bool emitModule(const InstanceSymbol& inst, const std::string& outDir) {
         collectStatementSignals(bodyStmt, deps);
 
         CombProc proc;
+        proc.symbol = &block;
         proc.stmt = &bodyStmt;
+        proc.location = block.location;
         proc.deps.assign(deps.begin(), deps.end());
         combProcs.push_back(std::move(proc));
     }
 
     int combProcIndex = 0;
     for (const auto& comb : combProcs) {
+        if (cycle)
+            break;
+        emitSite(out, 8, comb.assign ? "assign" : "always_comb", sm, comb.location);
         out << "        kernel.register_continuous([this]() { eval_comb_proc_"
             << combProcIndex << "(); }, {";
         bool first = true;
@@ -718,6 +4149,8 @@ bool emitModule(const InstanceSymbol& inst, const std::string& outDir) {
         if (block.procedureKind != ProceduralBlockKind::Initial)
             continue;
         const Statement& bodyStmt = block.getBody();
+        emitSite(out, 8, "initial", sm, block.location);
+        useRandomStream(&block);
 
         if (bodyStmt.kind == StatementKind::ForeverLoop) {
             auto& loop = bodyStmt.as<ForeverLoopStatement>();
@@ -727,146 +4160,937 @@ bool emitModule(const InstanceSymbol& inst, const std::string& outDir) {
                 if (ts.timing.kind == TimingControlKind::Delay) {
                     auto& delay = ts.timing.as<DelayControl>();
                     std::string delayExpr = emitExpr(delay.expr, nameMap);
-                    out << "        {\n";
-                    out << "            auto tick = std::make_shared<std::function<void()>>();\n";
-                    out << "            *tick = [this, tick]() {\n";
+                    // The resumable reschedules itself by id, so a snapshot can store it.
+                    out << "        kernel.schedule_resumable(static_cast<uint64_t>(" << delayExpr
+                        << "), kernel.add_resumable([this](uint32_t self) {\n";
                     if (ts.stmt.kind == StatementKind::ExpressionStatement) {
                         auto& es = ts.stmt.as<ExpressionStatement>();
                         if (es.expr.kind == ExpressionKind::Assignment) {
                             auto& a = es.expr.as<AssignmentExpression>();
                             const ValueSymbol* lhs = getValueSymbolFromExpr(a.left());
-                            if (lhs) {
+                            if (!laneMode &&
+                                emitPartialWrite(out, "            ", "this->kernel", a, nameMap,
+                                                 fourState, a.isNonBlocking(), false, sm,
+                                                 svMarker(sm, ts.stmt.sourceRange.start()))) {
+                                // Part-select or concatenation target.
+                            } else if (lhs) {
                                 auto it = nameMap.find(lhs);
                                 if (it != nameMap.end()) {
-                                    std::string rhs = emitExpr(a.right(), nameMap);
-                                    if (a.isNonBlocking()) {
-                                        out << "                this->kernel.nba_assign("
-                                            << it->second
-                                            << ", " << rhs << ");\n";
-                                    } else {
-                                        out << "                " << it->second << ".set(" << rhs
-                                            << ");\n";
-                                    }
+                                    std::string rhs = emitRhs(a.right(), nameMap, fourState);
+                                    out << "            "
+                                        << emitAssign("this->kernel", it->second, rhs,
+                                                      a.isNonBlocking(), options)
+                                        << svMarker(sm, ts.stmt.sourceRange.start()) << "\n";
                                 }
                             }
                         }
                     }
-                    out << "                this->kernel.schedule_at(this->kernel.time() + "
+                    out << "            this->kernel.schedule_resumable(this->kernel.time() + "
                            "static_cast<uint64_t>("
-                        << delayExpr << "), *tick);\n";
-                    out << "            };\n";
-                    out << "            kernel.schedule_at(static_cast<uint64_t>(" << delayExpr
-                        << "), *tick);\n";
-                    out << "        }\n";
+                        << delayExpr << "), self);\n";
+                    out << "        }));\n";
                 }
             }
         } else {
             std::string timeVar = "t" + std::to_string(initIndex);
             out << "        {\n";
             out << "            uint64_t " << timeVar << " = 0;\n";
-            emitInitialStatement(bodyStmt, nameMap, out, 12, timeVar);
+            emitInitialStatement(bodyStmt, nameMap, out, 12, timeVar, options, fourState, sm);
             out << "        }\n";
         }
         initIndex++;
     }
 
-    out << "    }\n\n";
+    useRandomStream(nullptr);
+    out << "        kernel.set_site(0);\n";
+    out << "    }\n";
+    if (dpi.needsScope()) {
+        // Identifies this class in svScopes, so exports reject a scope of another module.
+        out << "\n    static inline const char dpi_type = 0;\n";
+    }
+    for (const auto& exp : dpi.exports) {
+        useRandomStream(exp.function);
+        emitExportMember(exp, nameMap, out, sm, cover);
+    }
+    for (const auto& [sub, head] : functionMembers) {
+        out << "\n    // " << (sub->subroutineKind == SubroutineKind::Task ? "task " : "function ")
+            << sub->name << "\n";
+        useRandomStream(sub);
+        emitSubroutineMember(*sub, head, nameMap, out, sm, cover);
+    }
+
+    // Cycle mode: `<=` targets in declaration order (memories queue their writes instead).
+    std::vector<std::string> nextSignals;
+    bool nbaMemories = false;
+    for (const auto& port : ports) {
+        if (port.internal && nbaTargets.count(port.internal))
+            nextSignals.push_back(port.name);
+    }
+    for (const auto* sig : internals) {
+        if (!nbaTargets.count(sig))
+            continue;
+        if (memories.count(sig))
+            nbaMemories = true;
+        else
+            nextSignals.push_back(nameMap[sig]);
+    }
+    if (cycle) {
+        // One rising clock edge for this instance and everything below it: every flop
+        // computes its next state from the settled values, then all commit at once.
+        out << "\n    void step() {\n";
+        out << "        cycle_ff();\n";
+        out << "        cycle_commit();\n";
+        out << "        cycle_comb();\n";
+        out << "    }\n";
+        out << "\n    void cycle_ff() {\n";
+        for (const auto& name : nextSignals)
+            out << "        " << name << "_next = " << name << ".value();\n";
+        for (int i = 0; i < ffIndex; ++i)
+            out << "        eval_ff_" << i << "();\n";
+        for (const auto& child : children)
+            emitChildCall(out, child.name, child.count, "cycle_ff");
+        out << "    }\n";
+        out << "\n    void cycle_commit() {\n";
+        for (const auto& name : nextSignals)
+            out << "        " << name << ".set(" << name << "_next);\n";
+        if (nbaMemories)
+            out << "        nba_writes_.commit();\n";
+        for (const auto& child : children)
+            emitChildCall(out, child.name, child.count, "cycle_commit");
+        out << "    }\n";
+        // Levelized, so every combinational node runs once after its inputs.
+        out << "\n    void cycle_comb() {\n";
+        auto order = cycle->combOrder.find(defName);
+        if (order != cycle->combOrder.end()) {
+            for (const Symbol* node : order->second) {
+                for (size_t i = 0; i < combProcs.size(); ++i) {
+                    if (combProcs[i].symbol == node)
+                        out << "        eval_comb_proc_" << i << "();\n";
+                }
+                // Replicas have the same inputs; they all run where the first one does.
+                for (const auto& child : children) {
+                    if (child.symbols.front() == node)
+                        emitChildCall(out, child.name, child.count, "cycle_comb");
+                }
+            }
+        }
+        out << "    }\n";
+    }
+    out << "\n";
     out << "private:\n";
     out << "    sim::Kernel& kernel;\n";
+    if (dpi.needsScope())
+        out << "    sim::DpiScope* dpi_scope_;\n";
     for (const auto& port : ports) {
-        out << "    sim::Signal& " << port.name << "; // "
+        out << "    " << sigType << "& " << port.name << "; // "
             << directionString(port.direction) << "\n";
     }
     for (const auto* sig : internals) {
         std::string name = nameMap[sig];
-        out << "    sim::Signal " << name << ";\n";
+        out << "    " << (memories.count(sig) ? "sim::Memory" : sigType) << " " << name << ";\n";
     }
     for (const auto& extra : extraSignals)
-        out << "    sim::Signal " << extra.first << ";\n";
-    for (const auto& child : children)
-        out << "    " << child.className << " " << child.name << ";\n";
+        out << "    " << sigType << " " << extra.first << ";\n";
+    for (const auto& extra : replicaSignals) {
+        out << "    sim::Replicas<" << sigType << ", " << extra.count << "> " << extra.name
+            << ";\n";
+    }
+    for (const auto& stream : randomStreams)
+        out << "    sim::ProcessRandom " << stream.second << ";\n";
+    for (const auto& child : children) {
+        if (child.count > 1) {
+            out << "    sim::Replicas<" << child.className << ", " << child.count << "> "
+                << child.name << ";\n";
+        } else {
+            out << "    " << child.className << " " << child.name << ";\n";
+        }
+    }
+    for (const auto& name : nextSignals)
+        out << "    uint64_t " << name << "_next = 0;\n";
+    if (nbaMemories)
+        out << "    sim::CycleWrites nba_writes_;\n";
 
     ffIndex = 0;
     for (auto& block : body.membersOfType<ProceduralBlockSymbol>()) {
-        if (block.procedureKind != ProceduralBlockKind::AlwaysFF)
+        if (block.procedureKind != ProceduralBlockKind::AlwaysFF || !lowered.live(block))
             continue;
 
         const Statement& bodyStmt = block.getBody();
         const Statement* stmtBody = &bodyStmt;
+        const TimingControl* timing = nullptr;
         if (bodyStmt.kind == StatementKind::Timed) {
             auto& ts = bodyStmt.as<TimedStatement>();
+            timing = &ts.timing;
             stmtBody = &ts.stmt;
         }
 
-        out << "\n    void eval_ff_" << ffIndex++ << "() {\n";
-        emitStatement(*stmtBody, nameMap, out, 8, true);
+        int index = ffIndex++;
+        useRandomStream(&block);
+        out << "\n    void eval_ff_" << index << "() {" << svMarker(sm, block.location) << "\n";
+        if (cover)
+            out << "        " << cover->hit("always_ff", sm, block.location) << "\n";
+        if (laneMode) {
+            emitLaneEdgeMask(timing, nameMap, out, index, options);
+            int tempIndex = 0;
+            emitLaneStatement(*stmtBody, nameMap, out, 8, true, "active", options, tempIndex, sm);
+        } else {
+            emitStatement(*stmtBody, nameMap, out, 8, true, fourState, sm, cover,
+                          cycle != nullptr, &lowered);
+        }
         out << "    }\n";
+        if (laneMode) {
+            std::vector<EdgeEventInfo> events;
+            if (timing)
+                collectEdgeEvents(*timing, nameMap, events);
+            for (size_t i = 0; i < events.size(); ++i) {
+                out << "    sim::Lanes<" << options.lanes << "> ff_" << index << "_prev_" << i
+                    << "{};\n";
+            }
+        }
     }
 
     combProcIndex = 0;
     for (const auto& comb : combProcs) {
-        out << "\n    void eval_comb_proc_" << combProcIndex++ << "() {\n";
-        if (comb.assign) {
+        useRandomStream(comb.symbol);
+        out << "\n    void eval_comb_proc_" << combProcIndex++ << "() {"
+            << svMarker(sm, comb.location) << "\n";
+        if (cover) {
+            out << "        "
+                << cover->hit(comb.assign ? "assign" : "always_comb", sm, comb.location) << "\n";
+        }
+        if (comb.assign && !laneMode &&
+            emitMemoryWrite(*comb.assign, nameMap, out, "        ", "kernel", false, "",
+                            &lowered)) {
+            // `assign mem[i] = ...` drives one word.
+        } else if (comb.assign && !laneMode &&
+                   emitPartialWrite(out, "        ", "kernel", *comb.assign, nameMap, fourState,
+                                    false, false, sm, "", &lowered)) {
+            // `assign x[7:4] = ...` and `assign {a, b} = ...` merge into the signals.
+        } else if (comb.assign) {
             const ValueSymbol* lhs = getValueSymbolFromExpr(comb.assign->left());
             if (lhs) {
                 auto it = nameMap.find(lhs);
-                if (it != nameMap.end()) {
-                    std::string rhs = emitExpr(comb.assign->right(), nameMap);
+                if (it != nameMap.end() && laneMode) {
+                    std::string rhs = emitExpr(comb.assign->right(), nameMap, ".lane(l)");
+                    out << "        sim::Lanes<" << options.lanes << "> v;\n";
+                    out << "        for (uint32_t l = 0; l < " << options.lanes << "; ++l)\n";
+                    out << "            v[l] = " << rhs << ";\n";
+                    out << "        " << it->second << ".set(v);\n";
+                } else if (it != nameMap.end()) {
+                    std::string rhs =
+                        emitRhs(comb.assign->right(), nameMap, fourState, &lowered);
                     out << "        " << it->second << ".set(" << rhs << ");\n";
                 }
             }
+        } else if (comb.stmt && laneMode) {
+            out << "        sim::Lanes<" << options.lanes << "> active;\n";
+            out << "        active.fill(~0ULL);\n";
+            int tempIndex = 0;
+            emitLaneStatement(*comb.stmt, nameMap, out, 8, false, "active", options, tempIndex,
+                              sm);
         } else if (comb.stmt) {
-            emitStatement(*comb.stmt, nameMap, out, 8, false);
+            emitStatement(*comb.stmt, nameMap, out, 8, false, fourState, sm, cover, false,
+                          &lowered);
         } else {
             out << "        // unsupported combinational block\n";
         }
         out << "    }\n";
     }
 
+    if (cover && !coverPoints.points.empty()) {
+        // Declared last: processes only run once the design is constructed.
+        out << "\n    static constexpr sim::CoverPoint cov_points_[] = {\n";
+        for (const auto& point : coverPoints.points) {
+            out << "        {" << cppStringLiteral(point.kind) << ", "
+                << cppStringLiteral(point.file) << ", " << point.line << "},\n";
+        }
+        out << "    };\n";
+        out << "    uint64_t* cov_ = kernel.cover(" << cppStringLiteral(defName)
+            << ", cov_points_, " << coverPoints.points.size() << ");\n";
+    }
+
     out << "};\n\n";
     out << "} // namespace gen\n";
+    if (!dpi.exports.empty())
+        out << "\n";
+    for (const auto& exp : dpi.exports)
+        emitExportWrapper(exp, cppIdent(defName), out);
 
-    return true;
+    std::string text = out.str();
+    collectSourceRows(defName + ".cpp", cppIdent(defName), text, srcRows);
+    return writeIfChanged(outPath, text, result);
 }
 
 bool emitTopDriver(const InstanceSymbol& top,
                    const std::unordered_map<std::string, const InstanceSymbol*>& defs,
-                   const std::string& outDir) {
+                   const std::string& outDir,
+                   const CodegenOptions& options,
+                   const CycleSchedule* cycle,
+                   CodegenResult* result) {
     std::filesystem::path outPath = std::filesystem::path(outDir) / "sim_main.cpp";
-    std::ofstream out(outPath);
-    if (!out) {
-        std::cerr << "Failed to open output file: " << outPath << "\n";
-        return false;
-    }
+    std::ostringstream out;
 
     out << "#include \"sim/runtime.h\"\n";
+    out << "#include \"sim/stimulus.h\"\n";
     for (const auto& [name, inst] : defs) {
         out << "#include \"" << name << ".cpp\"\n";
     }
     out << "\n";
-    out << "int main() {\n";
-    out << "    sim::Kernel kernel;\n";
 
+    // Stimulus replay drives the inputs other than the cycle-mode clock, which step()
+    // toggles itself; the recorder captures the outputs.
     const auto ports = collectPorts(top.body);
+    std::string clock;
+    if (cycle) {
+        auto it = cycle->clockPort.find(std::string(top.getDefinition().name));
+        if (it != cycle->clockPort.end())
+            clock = it->second;
+    }
+    std::vector<const PortInfo*> inputs;
+    std::vector<const PortInfo*> outputs;
+    for (const auto& port : ports) {
+        if (port.direction == ArgumentDirection::Out)
+            outputs.push_back(&port);
+        else if (port.name != clock)
+            inputs.push_back(&port);
+    }
+
+    out << "int main(int argc, char** argv) {\n";
+    out << "    sim::BatchOptions options;\n";
+    out << "    if (!sim::parseBatchArgs(argc, argv, options))\n";
+    out << "        return 1;\n";
+    out << "    sim::StimulusFile stimulus;\n";
+    out << "    if (!options.stimulusPath.empty() &&\n";
+    out << "        !stimulus.open(options.stimulusPath, {";
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        out << (i ? ", " : "") << "{" << cppStringLiteral(inputs[i]->name) << ", "
+            << inputs[i]->width << "}";
+    }
+    out << "}, " << (cycle ? "true" : "false");
+    if (options.lanes > 1)
+        out << ", " << options.lanes;
+    out << "))\n";
+    out << "        return 1;\n";
+    out << "    std::atomic<bool> recordFailed{false};\n";
+    out << "    int status = sim::runBatch(options, [&](sim::Kernel& kernel) {\n";
+
     for (const auto& port : ports) {
-        out << "    sim::Signal " << port.name << "(" << port.width << ");\n";
+        out << "        " << signalType(options) << " " << port.name << "(" << port.width
+            << ");\n";
+    }
+    if (!ports.empty()) {
+        out << "        kernel.track(" << cppStringLiteral(top.name) << ", {";
+        for (size_t i = 0; i < ports.size(); ++i) {
+            out << (i ? ", " : "") << "{" << cppStringLiteral(ports[i].name) << ", &"
+                << ports[i].name << "}";
+        }
+        out << "});\n";
     }
 
-    out << "    gen::" << cppIdent(top.getDefinition().name) << " top(kernel";
+    out << "        gen::" << cppIdent(top.getDefinition().name) << " top(kernel, "
+        << cppStringLiteral(top.name);
     for (const auto& port : ports) {
         out << ", " << port.name;
     }
     out << ");\n";
-    out << "    kernel.run();\n";
-    out << "    return 0;\n";
+
+    // Multi-lane files have one column per port and lane.
+    out << "        sim::StimulusReplay replay(stimulus, {";
+    for (size_t i = 0; i < inputs.size(); ++i)
+        out << (i ? ", " : "") << "&" << inputs[i]->name;
+    out << "}";
+    if (options.lanes > 1)
+        out << ", &" << signalType(options) << "::set_lane";
+    out << ");\n";
+    out << "        sim::StimulusRecorder recorder;\n";
+    out << "        if (!options.recordPath.empty() &&\n";
+    out << "            !recorder.open(sim::batchFilePath(options.recordPath, options.instances, "
+        << "kernel.instance()),\n";
+    out << "                           "
+        << (cycle ? "options.recordMatrix ? sim::StimulusLayout::Matrix : " : "")
+        << "sim::StimulusLayout::Records, {";
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        out << (i ? ", " : "") << "{" << cppStringLiteral(outputs[i]->name) << ", &"
+            << outputs[i]->name << "}";
+    }
+    out << "}))\n";
+    out << "            recordFailed = true;\n";
+    if (cycle) {
+        // Cycle mode: one step() per rising clock edge, no event queue. Inputs replayed for
+        // a cycle settle through cycle_comb() before its step() samples them.
+        out << "        top.cycle_comb();\n";
+        out << "        for (uint64_t cycle = 0; cycle < options.cycles; ++cycle) {\n";
+        out << "            if (replay.apply(cycle))\n";
+        out << "                top.cycle_comb();\n";
+        out << "            top.step();\n";
+        out << "            recorder.sample(cycle);\n";
+        out << "        }\n";
+    } else {
+        out << "        replay.schedule(kernel);\n";
+        out << "        recorder.watch(kernel);\n";
+        out << "        kernel.run();\n";
+    }
+    out << "        if (!recorder.close())\n";
+    out << "            recordFailed = true;\n";
+    out << "    });\n";
+    out << "    return status ? status : recordFailed ? 1 : 0;\n";
     out << "}\n";
 
+    return writeIfChanged(outPath, out.str(), result);
+}
+
+// C++ type of a model port field: the narrowest unsigned integer holding `width` bits.
+std::string modelFieldType(uint32_t width) {
+    if (width <= 8)
+        return "uint8_t";
+    if (width <= 16)
+        return "uint16_t";
+    if (width <= 32)
+        return "uint32_t";
+    return "uint64_t";
+}
+
+// The top-level input tick() toggles: the cycle-mode clock, else a 1-bit input named like a
+// clock. Empty when there is none (and the model has no tick()).
+std::string modelClockPort(const InstanceSymbol& top, const std::vector<PortInfo>& ports,
+                           const CycleSchedule* cycle) {
+    if (cycle) {
+        auto it = cycle->clockPort.find(std::string(top.getDefinition().name));
+        return it != cycle->clockPort.end() ? it->second : std::string();
+    }
+    for (const char* name : {"clk", "clock", "clk_i", "i_clk"}) {
+        for (const auto& port : ports) {
+            if (port.name == name && port.width == 1 && port.direction == ArgumentDirection::In)
+                return port.name;
+        }
+    }
+    return {};
+}
+
+// `<top>_model.h`/`<top>_model.cpp`: the design behind a Verilator-style class for C++
+// harnesses. Ports are plain integer fields; eval()/tick()/advance() copy the inputs into
+// the design, run it and copy the outputs back. The header only needs the standard library,
+// so harnesses link the static library built by `make model` without runtime headers.
+bool emitModel(const InstanceSymbol& top,
+               const std::unordered_map<std::string, const InstanceSymbol*>& defs,
+               const std::string& outDir, const CodegenOptions& options,
+               const CycleSchedule* cycle, CodegenResult* result) {
+    std::string topClass = cppIdent(top.getDefinition().name);
+    std::string model = topClass + "_model";
+    const auto ports = collectPorts(top.body);
+    std::string clock = modelClockPort(top, ports, cycle);
+    auto isInput = [](const PortInfo& port) { return port.direction != ArgumentDirection::Out; };
+    // With --lanes every port but the clock is an array with one element per lane.
+    bool laneMode = options.lanes > 1;
+    auto isLaneField = [&](const PortInfo& port) { return laneMode && port.name != clock; };
+
+    std::ostringstream header;
+    header << "// Embeddable model of " << top.name
+           << ": set the input fields, call eval()/tick()/advance(), read the\n"
+           << "// output fields. Link lib" << model << ".a (`make model`) with -pthread.\n";
+    header << "#pragma once\n\n";
+    if (laneMode)
+        header << "#include <array>\n";
+    header << "#include <cstdint>\n";
+    header << "#include <memory>\n";
+    header << "#include <string>\n\n";
+    header << "namespace gen {\n\n";
+    header << "class " << model << " {\n";
+    header << "public:\n";
+    header << "    explicit " << model << "(const std::string& name = "
+           << cppStringLiteral(top.name) << ");\n";
+    header << "    ~" << model << "();\n";
+    header << "    " << model << "(const " << model << "&) = delete;\n";
+    header << "    " << model << "& operator=(const " << model << "&) = delete;\n\n";
+    if (laneMode && !ports.empty()) {
+        header << "    // Element l of a port is lane l; the clock drives every lane.\n";
+    }
+    for (const auto& port : ports) {
+        if (isLaneField(port)) {
+            header << "    std::array<" << modelFieldType(port.width) << ", " << options.lanes
+                   << "> " << port.name << "{}; // ";
+        } else {
+            header << "    " << modelFieldType(port.width) << " " << port.name << " = 0; // ";
+        }
+        header << directionString(port.direction) << " [" << port.width - 1 << ":0]\n";
+    }
+    if (!ports.empty())
+        header << "\n";
+    header << "    // Applies the inputs and settles the current time step. Other inputs settle "
+           << "before the\n    // clock is applied, so flops sample logic driven by this call's "
+           << "inputs.\n";
+    header << "    void eval();\n";
+    if (!clock.empty()) {
+        if (cycle) {
+            header << "    // One rising edge of " << clock
+                   << " (one time unit): step() of the cycle-mode design.\n";
+        } else {
+            header << "    // One period of " << clock << ": rising edge, eval(), falling edge, "
+                   << "eval().\n";
+        }
+        header << "    void tick();\n";
+    }
+    if (cycle)
+        header << "    // Runs `time` clock cycles with the inputs held.\n";
+    else
+        header << "    // Applies the inputs and runs every event of the next `time` units.\n";
+    header << "    void advance(uint64_t time);\n";
+    header << "    // Ends the simulation and flushes its output; later calls do nothing.\n";
+    header << "    void final();\n\n";
+    header << "    uint64_t time() const;\n";
+    header << "    // True once the design called $finish (or final() ran).\n";
+    header << "    bool got_finish() const;\n\n";
+    header << "private:\n";
+    header << "    struct Impl;\n";
+    header << "    std::unique_ptr<Impl> impl;\n\n";
+    header << "    void putInputs();\n";
+    header << "    void getOutputs();\n";
+    header << "};\n\n";
+    header << "} // namespace gen\n";
+
+    std::ostringstream out;
+    out << "#include \"" << model << ".h\"\n\n";
+    out << "#include \"sim/runtime.h\"\n";
+    for (const auto& [name, inst] : defs)
+        out << "#include \"" << name << ".cpp\"\n";
+    out << "\n";
+    out << "namespace gen {\n\n";
+    out << "struct " << model << "::Impl {\n";
+    out << "    explicit Impl(const std::string& name)\n";
+    out << "        : ";
+    for (const auto& port : ports)
+        out << port.name << "(" << port.width << "), ";
+    out << "top(kernel, name";
+    for (const auto& port : ports)
+        out << ", " << port.name;
+    out << ") {\n";
+    if (cycle)
+        out << "        top.cycle_comb();\n";
+    out << "    }\n\n";
+    out << "    sim::Kernel kernel;\n";
+    for (const auto& port : ports)
+        out << "    " << signalType(options) << " " << port.name << ";\n";
+    out << "    " << topClass << " top;\n";
+    if (cycle)
+        out << "    uint64_t cycles = 0;\n";
+    out << "};\n\n";
+
+    out << model << "::" << model << "(const std::string& name)\n";
+    out << "    : impl(std::make_unique<Impl>(name)) {}\n\n";
+    out << model << "::~" << model << "() = default;\n\n";
+
+    // The clock goes in separately (see eval()).
+    out << "void " << model << "::putInputs() {\n";
+    for (const auto& port : ports) {
+        if (!isInput(port) || port.name == clock)
+            continue;
+        if (isLaneField(port)) {
+            out << "    {\n";
+            out << "        sim::Lanes<" << options.lanes << "> values;\n";
+            out << "        for (uint32_t l = 0; l < " << options.lanes << "; ++l)\n";
+            out << "            values[l] = " << port.name << "[l];\n";
+            out << "        impl->" << port.name << ".set(values);\n";
+            out << "    }\n";
+        } else {
+            out << "    impl->" << port.name << ".set(" << port.name << ");\n";
+        }
+    }
+    out << "}\n\n";
+    out << "void " << model << "::getOutputs() {\n";
+    for (const auto& port : ports) {
+        if (isInput(port))
+            continue;
+        if (isLaneField(port)) {
+            out << "    for (uint32_t l = 0; l < " << options.lanes << "; ++l)\n";
+            out << "        " << port.name << "[l] = static_cast<" << modelFieldType(port.width)
+                << ">(impl->" << port.name << ".lane(l));\n";
+        } else {
+            out << "    " << port.name << " = static_cast<" << modelFieldType(port.width)
+                << ">(impl->" << port.name << ".value());\n";
+        }
+    }
+    out << "}\n\n";
+
+    out << "void " << model << "::eval() {\n";
+    out << "    putInputs();\n";
+    if (cycle) {
+        out << "    impl->top.cycle_comb();\n";
+    } else {
+        out << "    impl->kernel.run_until(impl->kernel.time());\n";
+        if (!clock.empty()) {
+            out << "    impl->" << clock << ".set(" << clock << ");\n";
+            out << "    impl->kernel.run_until(impl->kernel.time());\n";
+        }
+    }
+    out << "    getOutputs();\n";
+    out << "}\n\n";
+    if (!clock.empty()) {
+        out << "void " << model << "::tick() {\n";
+        if (cycle) {
+            out << "    putInputs();\n";
+            out << "    impl->top.step();\n";
+            out << "    impl->cycles++;\n";
+            out << "    getOutputs();\n";
+        } else {
+            out << "    " << clock << " = 1;\n";
+            out << "    eval();\n";
+            out << "    " << clock << " = 0;\n";
+            out << "    eval();\n";
+        }
+        out << "}\n\n";
+    }
+    out << "void " << model << "::advance(uint64_t time) {\n";
+    out << "    putInputs();\n";
+    if (cycle) {
+        out << "    for (uint64_t cycle = 0; cycle < time; ++cycle)\n";
+        out << "        impl->top.step();\n";
+        out << "    impl->cycles += time;\n";
+    } else {
+        if (!clock.empty())
+            out << "    impl->" << clock << ".set(" << clock << ");\n";
+        out << "    impl->kernel.run_until(impl->kernel.time() + time);\n";
+    }
+    out << "    getOutputs();\n";
+    out << "}\n\n";
+    out << "void " << model << "::final() {\n";
+    out << "    impl->kernel.finish();\n";
+    out << "    impl->kernel.output().flush();\n";
+    out << "}\n\n";
+    out << "uint64_t " << model << "::time() const {\n";
+    out << "    return " << (cycle ? "impl->cycles" : "impl->kernel.time()") << ";\n";
+    out << "}\n\n";
+    out << "bool " << model << "::got_finish() const {\n";
+    out << "    return impl->kernel.is_finished();\n";
+    out << "}\n\n";
+    out << "} // namespace gen\n";
+
+    auto dir = std::filesystem::path(outDir);
+    return writeIfChanged(dir / (model + ".h"), header.str(), result) &&
+           writeIfChanged(dir / (model + ".cpp"), out.str(), result);
+}
+
+// `--partition`: the instances that run as separate processes (partition k is instances[k-1]
+// at paths[k-1]) and the definitions each process includes, children first.
+struct PartitionPlan {
+    std::vector<const InstanceSymbol*> instances;
+    std::vector<std::string> paths;
+    std::vector<std::string> rootDefs;
+    std::vector<std::vector<std::string>> partDefs;
+    std::unordered_set<std::string> remoteDefs;
+};
+
+// Appends `inst`'s definition and those below it in include order. With `found`, instances
+// of a definition in `remote` are collected there instead of descended into.
+void collectPartitionDefs(const InstanceSymbol& inst, const std::string& path,
+                          const std::unordered_set<std::string>& remote,
+                          std::unordered_set<std::string>& seen, std::vector<std::string>& order,
+                          std::vector<std::pair<const InstanceSymbol*, std::string>>* found) {
+    for (const auto& instance : childInstances(inst.body)) {
+        const InstanceSymbol& child = *instance.symbol;
+        std::string childDef(child.getDefinition().name);
+        std::string childPath = path + "." + instance.path();
+        if (found && remote.count(childDef)) {
+            found->emplace_back(&child, childPath);
+            if (seen.insert(childDef).second)
+                order.push_back(childDef);
+            continue;
+        }
+        collectPartitionDefs(child, childPath, remote, seen, order, found);
+    }
+    std::string defName(inst.getDefinition().name);
+    if (seen.insert(defName).second)
+        order.push_back(defName);
+}
+
+bool planPartitions(const InstanceSymbol& top, const CodegenOptions& options,
+                    const CycleSchedule& cycle, PartitionPlan& plan) {
+    std::unordered_set<std::string> remote(options.partitions.begin(), options.partitions.end());
+    if (remote.count(std::string(top.getDefinition().name))) {
+        std::cerr << "--partition: the top module " << top.getDefinition().name
+                  << " runs in partition 0 and cannot be partitioned\n";
+        return false;
+    }
+
+    std::vector<std::pair<const InstanceSymbol*, std::string>> found;
+    std::unordered_set<std::string> seen;
+    collectPartitionDefs(top, std::string(top.name), remote, seen, plan.rootDefs, &found);
+    for (const auto& [inst, path] : found) {
+        std::string defName(inst->getDefinition().name);
+        plan.remoteDefs.insert(defName);
+        plan.instances.push_back(inst);
+        plan.paths.push_back(path);
+        std::unordered_set<std::string> partSeen;
+        plan.partDefs.emplace_back();
+        collectPartitionDefs(*inst, path, remote, partSeen, plan.partDefs.back(), nullptr);
+    }
+    for (const auto& name : options.partitions) {
+        if (!plan.remoteDefs.count(name)) {
+            std::cerr << "--partition: no instance of " << name << " below "
+                      << top.getDefinition().name << " (or only inside another partition)\n";
+            return false;
+        }
+    }
+
+    // A process computes cycle n from its peers' frames of cycle n-1, which only holds when
+    // no output of a partition depends combinationally on its inputs.
+    for (const auto& defName : plan.remoteDefs) {
+        const InstanceSymbol* inst = nullptr;
+        for (auto* candidate : plan.instances) {
+            if (candidate->getDefinition().name == defName)
+                inst = candidate;
+        }
+        const auto& through = cycle.through.at(defName);
+        for (const auto& port : collectPorts(inst->body)) {
+            if (port.direction != ArgumentDirection::In &&
+                port.direction != ArgumentDirection::Out) {
+                std::cerr << "--partition: port " << port.name << " of " << defName
+                          << " is neither an input nor an output\n";
+                return false;
+            }
+            auto it = through.find(port.name);
+            if (port.direction != ArgumentDirection::Out || it == through.end() ||
+                it->second.empty())
+                continue;
+            std::string inputs;
+            for (const auto& input : it->second)
+                inputs += (inputs.empty() ? "" : ", ") + input;
+            std::cerr << "--partition: output " << port.name << " of " << defName
+                      << " depends combinationally on " << inputs
+                      << "; partition boundaries must be registered\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Emits `switch (port)` cases that set the ports of one direction from a received frame.
+void emitPartitionCases(const std::vector<PortInfo>& ports, ArgumentDirection direction,
+                        const std::string& clock, const std::string& indent, std::ostream& out) {
+    out << indent << "switch (port) {\n";
+    for (size_t i = 0; i < ports.size(); ++i) {
+        if (ports[i].direction != direction || ports[i].name == clock)
+            continue;
+        out << indent << "case " << i << ":\n";
+        out << indent << "    " << ports[i].name << ".set(value);\n";
+        out << indent << "    break;\n";
+    }
+    out << indent << "}\n";
+}
+
+// Emits the sends of one direction's ports that changed since the previous frame.
+void emitPartitionSends(const std::vector<PortInfo>& ports, ArgumentDirection direction,
+                        const std::string& clock, const std::string& link,
+                        const std::string& suffix, const std::string& indent,
+                        std::ostream& out) {
+    for (size_t i = 0; i < ports.size(); ++i) {
+        if (ports[i].direction != direction || ports[i].name == clock)
+            continue;
+        std::string sent = ports[i].name + suffix;
+        out << indent << "if (" << ports[i].name << ".value() != " << sent << ") {\n";
+        out << indent << "    " << sent << " = " << ports[i].name << ".value();\n";
+        out << indent << "    " << link << "send(" << i << ", " << sent << ");\n";
+        out << indent << "}\n";
+    }
+}
+
+// `<def>_remote.cpp`: partition 0's stand-in for the instances of a partitioned definition.
+// It has the real class's name and constructor, so parents are emitted unchanged, and each
+// cycle trades frames with the process running the instance instead of simulating it.
+bool emitPartitionRemote(const InstanceSymbol& inst, const std::string& outDir,
+                         const CycleSchedule& cycle, CodegenResult* result) {
+    std::string defName(inst.getDefinition().name);
+    std::string className = cppIdent(defName);
+    const auto ports = collectPorts(inst.body);
+    const std::string& clock = cycle.clockPort.at(defName);
+
+    std::ostringstream out;
+    out << "#include <cstdint>\n";
+    out << "#include <string>\n";
+    out << "#include \"sim/partition.h\"\n";
+    out << "#include \"sim/runtime.h\"\n\n";
+    out << "namespace gen {\n\n";
+    out << "// Stands in for an instance of " << defName
+        << " that runs in its own process (--partition).\n";
+    out << "class " << className << " {\n";
+    out << "public:\n";
+    out << "    " << className << "(sim::Kernel& kernel, const std::string& scope";
+    for (const auto& port : ports)
+        out << ", sim::Signal& " << port.name;
+    out << ")\n";
+    out << "        : link_(*kernel.partition()->link(scope))";
+    for (const auto& port : ports)
+        out << ", " << port.name << "(" << port.name << ")";
+    out << " {}\n";
+
+    // Inputs settled in the previous cycle are what the instance's flops sample next.
+    out << "\n    void cycle_ff() {\n";
+    emitPartitionSends(ports, ArgumentDirection::In, clock, "link_.", "_sent_", "        ", out);
+    out << "        link_.end_frame(cycle_);\n";
+    out << "    }\n";
+    out << "\n    void cycle_commit() { cycle_++; }\n";
+    // The instance's registered outputs for this cycle. A stand-in can be listed twice in
+    // its parent's combinational order; the frame is only read once.
+    out << "\n    void cycle_comb() {\n";
+    out << "        if (received_ == cycle_)\n";
+    out << "            return;\n";
+    out << "        received_ = cycle_;\n";
+    out << "        link_.receive(cycle_, [this](uint32_t port, uint64_t value) {\n";
+    emitPartitionCases(ports, ArgumentDirection::Out, clock, "            ", out);
+    out << "        });\n";
+    out << "    }\n";
+    out << "\nprivate:\n";
+    out << "    sim::PartitionLink& link_;\n";
+    for (const auto& port : ports) {
+        out << "    sim::Signal& " << port.name << "; // " << directionString(port.direction)
+            << "\n";
+    }
+    for (const auto& port : ports) {
+        if (port.direction == ArgumentDirection::In && port.name != clock)
+            out << "    uint64_t " << port.name << "_sent_ = 0;\n";
+    }
+    out << "    uint64_t cycle_ = 0;\n";
+    out << "    uint64_t received_ = ~0ULL;\n";
+    out << "};\n\n";
+    out << "} // namespace gen\n";
+
+    auto outPath = std::filesystem::path(outDir) / (defName + "_remote.cpp");
+    return writeIfChanged(outPath, out.str(), result);
+}
+
+// `sim_part0.cpp` runs the top with stand-ins and starts `sim_part<k>` for partition k, the
+// driver of plan.instances[k-1]. Each runs options.cycles cycles in step with the others.
+bool emitPartitionDrivers(const InstanceSymbol& top, const PartitionPlan& plan,
+                          const std::string& outDir, const CycleSchedule& cycle,
+                          CodegenResult* result) {
+    auto emitPrologue = [&](std::ostream& out, const std::vector<std::string>& defs,
+                            bool records) {
+        out << "#include \"sim/partition.h\"\n";
+        out << "#include \"sim/runtime.h\"\n";
+        if (records)
+            out << "#include \"sim/stimulus.h\"\n";
+        for (const auto& name : defs) {
+            out << "#include \"" << name << (plan.remoteDefs.count(name) ? "_remote" : "")
+                << ".cpp\"\n";
+        }
+        out << "\n";
+        out << "int main(int argc, char** argv) {\n";
+        out << "    sim::BatchOptions options;\n";
+        out << "    if (!sim::parseBatchArgs(argc, argv, options))\n";
+        out << "        return 1;\n";
+    };
+    auto emitInstance = [&](std::ostream& out, const InstanceSymbol& inst,
+                            const std::string& path, const std::vector<PortInfo>& ports) {
+        for (const auto& port : ports)
+            out << "        sim::Signal " << port.name << "(" << port.width << ");\n";
+        if (!ports.empty()) {
+            out << "        kernel.track(" << cppStringLiteral(path) << ", {";
+            for (size_t i = 0; i < ports.size(); ++i) {
+                out << (i ? ", " : "") << "{" << cppStringLiteral(ports[i].name) << ", &"
+                    << ports[i].name << "}";
+            }
+            out << "});\n";
+        }
+        out << "        gen::" << cppIdent(inst.getDefinition().name) << " top(kernel, "
+            << cppStringLiteral(path);
+        for (const auto& port : ports)
+            out << ", " << port.name;
+        out << ");\n";
+    };
+
+    // Partition 0 holds the top's ports, so it records the outputs like sim_main's cycle
+    // loop; the other partitions ignore --record.
+    std::ostringstream root;
+    emitPrologue(root, plan.rootDefs, true);
+    const auto topPorts = collectPorts(top.body);
+    root << "    std::atomic<bool> recordFailed{false};\n";
+    root << "    int status = sim::runPartitioned(options, {";
+    for (size_t k = 0; k < plan.instances.size(); ++k) {
+        root << (k ? ", " : "") << "{" << cppStringLiteral(plan.paths[k]) << ", \"sim_part"
+             << k + 1 << "\"}";
+    }
+    root << "}, argc, argv, [&](sim::Kernel& kernel) {\n";
+    emitInstance(root, top, std::string(top.name), topPorts);
+    root << "        sim::StimulusRecorder recorder;\n";
+    root << "        if (!options.recordPath.empty() &&\n";
+    root << "            !recorder.open(options.recordPath,\n";
+    root << "                           options.recordMatrix ? sim::StimulusLayout::Matrix\n";
+    root << "                                                : sim::StimulusLayout::Records,\n";
+    root << "                           {";
+    bool firstOutput = true;
+    for (const auto& port : topPorts) {
+        if (port.direction != ArgumentDirection::Out)
+            continue;
+        root << (firstOutput ? "" : ", ") << "{" << cppStringLiteral(port.name) << ", &"
+             << port.name << "}";
+        firstOutput = false;
+    }
+    root << "}))\n";
+    root << "            recordFailed = true;\n";
+    root << "        top.cycle_comb();\n";
+    root << "        for (uint64_t cycle = 0;\n";
+    root << "             cycle < options.cycles && !kernel.partition()->failed(); ++cycle) {\n";
+    root << "            top.step();\n";
+    root << "            recorder.sample(cycle);\n";
+    root << "        }\n";
+    root << "        if (!recorder.close())\n";
+    root << "            recordFailed = true;\n";
+    root << "    });\n";
+    root << "    return status ? status : recordFailed ? 1 : 0;\n";
+    root << "}\n";
+    if (!writeIfChanged(std::filesystem::path(outDir) / "sim_part0.cpp", root.str(), result))
+        return false;
+
+    for (size_t k = 0; k < plan.instances.size(); ++k) {
+        const InstanceSymbol& inst = *plan.instances[k];
+        const auto ports = collectPorts(inst.body);
+        const std::string& clock = cycle.clockPort.at(std::string(inst.getDefinition().name));
+        std::ostringstream out;
+        emitPrologue(out, plan.partDefs[k], false);
+        out << "    // Partition " << k + 1 << ": " << plan.paths[k]
+            << ", started by sim_part0.\n";
+        out << "    return sim::runPartitioned(options, {}, argc, argv, "
+               "[&options](sim::Kernel& kernel) {\n";
+        emitInstance(out, inst, plan.paths[k], ports);
+        out << "        sim::PartitionLink& link = *kernel.partition()->link(\"\");\n";
+        for (const auto& port : ports) {
+            if (port.direction == ArgumentDirection::Out)
+                out << "        uint64_t " << port.name << "_sent = 0;\n";
+        }
+        out << "        auto sendFrame = [&](uint64_t cycle) {\n";
+        emitPartitionSends(ports, ArgumentDirection::Out, clock, "link.", "_sent",
+                           "            ", out);
+        out << "            link.end_frame(cycle);\n";
+        out << "        };\n";
+        out << "        top.cycle_comb();\n";
+        out << "        sendFrame(0);\n";
+        out << "        for (uint64_t cycle = 1; cycle <= options.cycles; ++cycle) {\n";
+        out << "            bool changed = false;\n";
+        out << "            bool ok = link.receive(cycle - 1, [&](uint32_t port, uint64_t value) "
+               "{\n";
+        emitPartitionCases(ports, ArgumentDirection::In, clock, "                ", out);
+        out << "                changed = true;\n";
+        out << "            });\n";
+        out << "            if (!ok)\n";
+        out << "                break;\n";
+        // The step's flops sample logic fed by the inputs partition 0 settled last cycle.
+        out << "            if (changed)\n";
+        out << "                top.cycle_comb();\n";
+        out << "            top.step();\n";
+        out << "            sendFrame(cycle);\n";
+        out << "        }\n";
+        out << "    });\n";
+        out << "}\n";
+        auto path = std::filesystem::path(outDir) / ("sim_part" + std::to_string(k + 1) + ".cpp");
+        if (!writeIfChanged(path, out.str(), result))
+            return false;
+    }
     return true;
 }
 
 } // namespace
 
-bool writeCppOutput(const InstanceSymbol& top, const std::string& outputDir) {
+bool writeCppOutput(const InstanceSymbol& top, const std::string& outputDir,
+                    const CodegenOptions& options, CodegenResult* result) {
     std::error_code ec;
     std::filesystem::create_directories(outputDir, ec);
     if (ec) {
@@ -877,14 +5101,87 @@ bool writeCppOutput(const InstanceSymbol& top, const std::string& outputDir) {
     std::unordered_map<std::string, const InstanceSymbol*> defs;
     collectInstances(top, defs);
 
+    // Multi-lane storage is 2-state only.
+    FourStateInfo fourState;
+    if (options.fourState && options.lanes <= 1)
+        fourState = analyzeFourState(top);
+    else if (options.fourState)
+        std::cerr << "warning: 4-state signals are not supported with --lanes; using 2-state\n";
+    if (options.coverage && options.lanes > 1)
+        std::cerr << "warning: --coverage is not supported with --lanes; not instrumenting\n";
+
+    CycleSchedule cycleSchedule;
+    const CycleSchedule* cycle = nullptr;
+    if (options.cycle || !options.partitions.empty()) {
+        std::string reason;
+        if (analyzeCycle(top, options, cycleSchedule, reason)) {
+            cycle = &cycleSchedule;
+        } else if (!options.partitions.empty()) {
+            // Partitions synchronize once per clock cycle.
+            std::cerr << "--partition needs a design that qualifies for --cycle: " << reason
+                      << "\n";
+            return false;
+        } else {
+            std::cerr << "note: --cycle: using the event kernel: " << reason << "\n";
+        }
+    }
+    PartitionPlan partitionPlan;
+    if (!options.partitions.empty() && !planPartitions(top, options, *cycle, partitionPlan))
+        return false;
+
+    // srcmap.tsv maps instance paths to classes and every marked generated line back to its
+    // SV source; rows are ordered by file so the output is stable across runs.
+    std::unordered_map<std::string, DpiUsage> dpi;
+    std::vector<const DpiUsage*> dpiUsages;
+    for (const auto& [name, inst] : defs) {
+        if (!collectDpi(inst->body, dpi[name]))
+            return false;
+        if (dpi[name].any())
+            dpiUsages.push_back(&dpi[name]);
+    }
+    if (!dpiUsages.empty() && !emitDpiHeader(dpiUsages, outputDir, result))
+        return false;
+
+    std::vector<std::string> srcRows;
     for (const auto& [name, inst] : defs) {
-        if (!emitModule(*inst, outputDir))
+        if (!emitModule(*inst, outputDir, options, fourState, dpi[name], cycle, result,
+                        srcRows))
             return false;
     }
+    auto cppFileOf = [](const std::string& row) {
+        auto start = row.find('\t') + 1;
+        return row.substr(start, row.find('\t', start) - start);
+    };
+    std::stable_sort(srcRows.begin(), srcRows.end(),
+                     [&](const std::string& a, const std::string& b) {
+                         return cppFileOf(a) < cppFileOf(b);
+                     });
+    std::vector<std::string> instanceRows;
+    collectInstanceRows(top, std::string(top.name), instanceRows);
 
-    if (!emitTopDriver(top, defs, outputDir))
+    std::string srcmap = "# instance\t<path>\t<class>\n"
+                         "# code\t<cpp file>\t<cpp line>\t<function>\t<sv file>\t<sv line>\n";
+    for (const auto& row : instanceRows)
+        srcmap += row + "\n";
+    for (const auto& row : srcRows)
+        srcmap += row + "\n";
+    if (!writeIfChanged(std::filesystem::path(outputDir) / "srcmap.tsv", srcmap, result))
         return false;
 
+    if (!emitTopDriver(top, defs, outputDir, options, cycle, result))
+        return false;
+    if (!emitModel(top, defs, outputDir, options, cycle, result))
+        return false;
+
+    if (!options.partitions.empty()) {
+        for (const auto& name : partitionPlan.remoteDefs) {
+            if (!emitPartitionRemote(*defs.at(name), outputDir, *cycle, result))
+                return false;
+        }
+        if (!emitPartitionDrivers(top, partitionPlan, outputDir, *cycle, result))
+            return false;
+    }
+
     return true;
 }
 
@@ -4,17 +4,31 @@
 #include <iostream>
 
 #include "slang/ast/Compilation.h"
+#include "slang/ast/SystemSubroutine.h"
+#include "slang/ast/symbols/BlockSymbols.h"
 #include "slang/ast/symbols/CompilationUnitSymbols.h"
 #include "slang/ast/symbols/InstanceSymbols.h"
+#include "slang/diagnostics/DiagnosticEngine.h"
 #include "slang/syntax/CSTSerializer.h"
 #include "slang/syntax/SyntaxTree.h"
 #include "slang/text/Json.h"
 
 namespace sim {
 
+using slang::DiagnosticEngine;
 using slang::JsonWriter;
 using slang::ast::Compilation;
+using slang::ast::GenerateBlockArraySymbol;
+using slang::ast::GenerateBlockSymbol;
+using slang::ast::InstanceArraySymbol;
+using slang::ast::InstanceBodySymbol;
 using slang::ast::InstanceSymbol;
+using slang::ast::Scope;
+using slang::ast::Symbol;
+using slang::ast::SymbolKind;
+using slang::ast::SimpleSystemSubroutine;
+using slang::ast::SubroutineKind;
+using slang::ast::Type;
 using slang::syntax::CSTJsonMode;
 using slang::syntax::CSTSerializer;
 using slang::syntax::SyntaxTree;
@@ -32,6 +46,17 @@ std::optional<std::shared_ptr<SyntaxTree>> loadFile(const std::string& path) {
     return *result;
 }
 
+std::optional<std::shared_ptr<SyntaxTree>> loadText(const std::string& path,
+                                                    std::string_view text,
+                                                    slang::SourceManager& sourceManager) {
+    auto tree = SyntaxTree::fromText(text, sourceManager, path, path);
+    if (!tree) {
+        std::cerr << "Failed to parse " << path << "\n";
+        return std::nullopt;
+    }
+    return tree;
+}
+
 const InstanceSymbol* findTop(Compilation& compilation, std::string_view name) {
     for (auto* inst : compilation.getRoot().topInstances) {
         if (inst->getDefinition().name == name)
@@ -40,6 +65,116 @@ const InstanceSymbol* findTop(Compilation& compilation, std::string_view name) {
     return nullptr;
 }
 
+std::string ChildInstance::path() const {
+    if (!index)
+        return prefix;
+    return prefix + "[" + std::to_string(*index) + "]" + suffix;
+}
+
+namespace {
+
+// Appends `name` to the hierarchical name being built: to the suffix once inside a replica.
+void appendName(ChildInstance& at, std::string_view name) {
+    (at.index ? at.suffix : at.prefix) += name;
+}
+
+void collectChildren(const Scope& scope, const ChildInstance& at,
+                     std::vector<ChildInstance>& out) {
+    for (auto& member : scope.members()) {
+        switch (member.kind) {
+            case SymbolKind::Instance: {
+                ChildInstance child = at;
+                child.symbol = &member.as<InstanceSymbol>();
+                appendName(child, member.name);
+                out.push_back(std::move(child));
+                break;
+            }
+            case SymbolKind::InstanceArray: {
+                // Elements (and those of nested arrays) carry their full index path.
+                auto& array = member.as<InstanceArraySymbol>();
+                std::vector<const Symbol*> work(array.elements.rbegin(), array.elements.rend());
+                while (!work.empty()) {
+                    const Symbol* element = work.back();
+                    work.pop_back();
+                    if (element->kind == SymbolKind::InstanceArray) {
+                        auto& inner = element->as<InstanceArraySymbol>().elements;
+                        work.insert(work.end(), inner.rbegin(), inner.rend());
+                        continue;
+                    }
+                    if (element->kind != SymbolKind::Instance)
+                        continue;
+                    auto& inst = element->as<InstanceSymbol>();
+                    if (inst.arrayPath.empty())
+                        continue;
+                    ChildInstance child = at;
+                    child.symbol = &inst;
+                    appendName(child, array.name);
+                    std::string outer = child.index ? child.path() : child.prefix;
+                    for (size_t i = 0; i + 1 < inst.arrayPath.size(); ++i)
+                        outer += "[" + std::to_string(inst.arrayPath[i]) + "]";
+                    child.prefix = std::move(outer);
+                    child.index = inst.arrayPath.back();
+                    child.suffix.clear();
+                    out.push_back(std::move(child));
+                }
+                break;
+            }
+            case SymbolKind::GenerateBlock: {
+                auto& block = member.as<GenerateBlockSymbol>();
+                if (block.isUninstantiated)
+                    break;
+                ChildInstance inner = at;
+                appendName(inner, block.getExternalName() + ".");
+                collectChildren(block, inner, out);
+                break;
+            }
+            case SymbolKind::GenerateBlockArray: {
+                auto& array = member.as<GenerateBlockArraySymbol>();
+                for (auto* entry : array.entries) {
+                    if (entry->isUninstantiated || !entry->arrayIndex)
+                        continue;
+                    ChildInstance inner = at;
+                    appendName(inner, array.getExternalName());
+                    inner.prefix = inner.index ? inner.path() : inner.prefix;
+                    inner.index = entry->arrayIndex->as<int64_t>().value_or(0);
+                    inner.suffix = ".";
+                    collectChildren(*entry, inner, out);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+} // namespace
+
+std::vector<ChildInstance> childInstances(const InstanceBodySymbol& body) {
+    std::vector<ChildInstance> out;
+    collectChildren(body, ChildInstance{}, out);
+    return out;
+}
+
+void registerSystemTasks(Compilation& compilation) {
+    compilation.addSystemSubroutine(std::make_shared<SimpleSystemSubroutine>(
+        "$sim_fork", SubroutineKind::Task, 1,
+        std::vector<const Type*>{&compilation.getIntType()}, compilation.getVoidType(), false));
+}
+
+bool reportDiagnostics(Compilation& compilation) {
+    const auto& diags = compilation.getAllDiagnostics();
+    if (!diags.empty()) {
+        const auto* sourceManager = compilation.getSourceManager();
+        if (sourceManager) {
+            std::string report = DiagnosticEngine::reportAll(*sourceManager, diags);
+            if (!report.empty())
+                std::cerr << report;
+        }
+    }
+    return !compilation.hasIssuedErrors();
+}
+
 bool writeAstJson(const std::vector<std::shared_ptr<SyntaxTree>>& trees,
                   const std::string& outputPath) {
     std::ofstream out(outputPath);
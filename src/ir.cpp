@@ -0,0 +1,679 @@
+#include "sim/ir.h"
+
+#include <algorithm>
+#include <bit>
+#include <iomanip>
+#include <ostream>
+#include <unordered_map>
+
+namespace sim::ir {
+
+NodeId Module::add(const Node& node) {
+    nodes.push_back(node);
+    return static_cast<NodeId>(nodes.size() - 1);
+}
+
+NodeId Module::constant(uint64_t value, uint32_t width) {
+    Node node;
+    node.op = Op::Const;
+    node.width = width;
+    node.value = value;
+    return add(node);
+}
+
+uint32_t Module::addRoot(NodeId node, uint32_t demand, uint32_t target) {
+    roots.push_back({node, demand, target});
+    return static_cast<uint32_t>(roots.size() - 1);
+}
+
+size_t Module::liveProcesses() const {
+    return static_cast<size_t>(
+        std::count_if(processes.begin(), processes.end(), [](const Process& p) { return p.live; }));
+}
+
+size_t Module::liveSignals() const {
+    return static_cast<size_t>(
+        std::count_if(signals.begin(), signals.end(), [](const Signal& s) { return s.live; }));
+}
+
+namespace {
+
+bool isOperator(Op op) {
+    return op != Op::Const && op != Op::Signal && op != Op::MemRead && op != Op::Opaque;
+}
+
+bool isCommutative(Op op) {
+    return op == Op::Add || op == Op::Mul || op == Op::And || op == Op::Or || op == Op::Xor ||
+           op == Op::Eq || op == Op::Ne;
+}
+
+// A value that is always 0 or 1.
+bool isBoolean(const Node& node) {
+    switch (node.op) {
+        case Op::LogicNot:
+        case Op::LogicAnd:
+        case Op::LogicOr:
+        case Op::Eq:
+        case Op::Ne:
+        case Op::Lt:
+        case Op::Le:
+        case Op::Slt:
+        case Op::Sle:
+        case Op::RedAnd:
+        case Op::RedOr:
+        case Op::RedXor:
+            return true;
+        case Op::Signal:
+        case Op::MemRead:
+        case Op::Trunc:
+            return node.width == 1;
+        default:
+            return false;
+    }
+}
+
+bool isConst(const Module& module, NodeId id, uint64_t value) {
+    const Node& node = module.nodes[id];
+    return node.op == Op::Const && node.value == value;
+}
+
+// Drops the nodes no live process's roots reach and renumbers the rest, keeping operands
+// before their users. Returns how many nodes were dropped.
+uint32_t compact(Module& module) {
+    std::vector<char> reached(module.nodes.size(), 0);
+    for (const auto& proc : module.processes) {
+        if (!proc.live)
+            continue;
+        for (uint32_t root : proc.roots) {
+            if (module.roots[root].node != kNoNode)
+                reached[module.roots[root].node] = 1;
+        }
+    }
+    for (size_t i = module.nodes.size(); i-- > 0;) {
+        if (!reached[i])
+            continue;
+        const Node& node = module.nodes[i];
+        if (node.a != kNoNode)
+            reached[node.a] = 1;
+        if (node.b != kNoNode)
+            reached[node.b] = 1;
+    }
+
+    std::vector<NodeId> remap(module.nodes.size(), kNoNode);
+    std::vector<Node> kept;
+    for (size_t i = 0; i < module.nodes.size(); ++i) {
+        if (!reached[i])
+            continue;
+        Node node = module.nodes[i];
+        if (node.a != kNoNode)
+            node.a = remap[node.a];
+        if (node.b != kNoNode)
+            node.b = remap[node.b];
+        remap[i] = static_cast<NodeId>(kept.size());
+        kept.push_back(node);
+    }
+    for (auto& root : module.roots) {
+        if (root.node != kNoNode)
+            root.node = remap[root.node];
+    }
+    uint32_t removed = static_cast<uint32_t>(module.nodes.size() - kept.size());
+    module.nodes = std::move(kept);
+    return removed;
+}
+
+// Points every operand and root through `forward` (old id -> replacement).
+void applyForward(Module& module, const std::vector<NodeId>& forward) {
+    for (auto& node : module.nodes) {
+        if (node.a != kNoNode)
+            node.a = forward[node.a];
+        if (node.b != kNoNode)
+            node.b = forward[node.b];
+    }
+    for (auto& root : module.roots) {
+        if (root.node != kNoNode)
+            root.node = forward[root.node];
+    }
+}
+
+std::vector<uint32_t> rootProcesses(const Module& module) {
+    std::vector<uint32_t> owner(module.roots.size(), ~0U);
+    for (size_t p = 0; p < module.processes.size(); ++p) {
+        for (uint32_t root : module.processes[p].roots)
+            owner[root] = static_cast<uint32_t>(p);
+    }
+    return owner;
+}
+
+// One front-to-back folding sweep; true if anything changed.
+bool foldOnce(Module& module) {
+    bool changed = false;
+    std::vector<NodeId> forward(module.nodes.size());
+    // Subtrees without Opaque nodes, which may be dropped without losing a side effect.
+    std::vector<char> pure(module.nodes.size(), 1);
+    for (size_t i = 0; i < module.nodes.size(); ++i) {
+        forward[i] = static_cast<NodeId>(i);
+        Node& node = module.nodes[i];
+        if (node.a != kNoNode)
+            node.a = forward[node.a];
+        if (node.b != kNoNode)
+            node.b = forward[node.b];
+        pure[i] = node.op != Op::Opaque && (node.a == kNoNode || pure[node.a]) &&
+                  (node.b == kNoNode || pure[node.b]);
+        if (!isOperator(node.op))
+            continue;
+
+        const Node& a = module.nodes[node.a];
+        const Node* b = node.b != kNoNode ? &module.nodes[node.b] : nullptr;
+        auto toConst = [&](uint64_t value) {
+            node = Node{Op::Const, node.width, kNoNode, kNoNode, value};
+            changed = true;
+        };
+        auto toOperand = [&](NodeId operand) {
+            forward[i] = operand;
+            changed = true;
+        };
+
+        if (a.op == Op::Const && (!b || b->op == Op::Const)) {
+            toConst(apply(node, a.value, b ? b->value : 0));
+            continue;
+        }
+        switch (node.op) {
+            case Op::Add:
+            case Op::Or:
+            case Op::Xor:
+                if (isConst(module, node.b, 0))
+                    toOperand(node.a);
+                else if (isConst(module, node.a, 0))
+                    toOperand(node.b);
+                break;
+            case Op::Sub:
+            case Op::Shl:
+            case Op::Shr:
+                if (isConst(module, node.b, 0))
+                    toOperand(node.a);
+                break;
+            case Op::Mul:
+                if (isConst(module, node.b, 1))
+                    toOperand(node.a);
+                else if (isConst(module, node.a, 1))
+                    toOperand(node.b);
+                else if ((isConst(module, node.a, 0) && pure[node.b]) ||
+                         (isConst(module, node.b, 0) && pure[node.a]))
+                    toConst(0);
+                break;
+            case Op::And:
+                if ((isConst(module, node.a, 0) && pure[node.b]) ||
+                    (isConst(module, node.b, 0) && pure[node.a]))
+                    toConst(0);
+                break;
+            case Op::Div:
+                if (isConst(module, node.b, 1))
+                    toOperand(node.a);
+                break;
+            case Op::LogicAnd:
+                // The right operand only runs when the left one is true.
+                if (isConst(module, node.a, 0))
+                    toConst(0);
+                else if (a.op == Op::Const && isBoolean(*b))
+                    toOperand(node.b);
+                break;
+            case Op::LogicOr:
+                if (a.op == Op::Const && a.value != 0)
+                    toConst(1);
+                else if (isConst(module, node.a, 0) && isBoolean(*b))
+                    toOperand(node.b);
+                break;
+            case Op::Trunc:
+                if (a.op == Op::Trunc && a.width <= node.width)
+                    toOperand(node.a);
+                break;
+            default:
+                break;
+        }
+    }
+    applyForward(module, forward);
+    return changed;
+}
+
+// Replaces reads of signals whose only writer is a continuous assignment of a constant.
+bool propagateConstantSignals(Module& module) {
+    std::vector<uint32_t> owner = rootProcesses(module);
+    std::vector<uint32_t> writers(module.signals.size(), 0);
+    std::vector<const Root*> writer(module.signals.size(), nullptr);
+    for (const auto& proc : module.processes) {
+        if (!proc.live)
+            continue;
+        for (uint32_t s : proc.writes)
+            writers[s] += proc.sideEffects ? 2 : 0;
+        for (uint32_t r : proc.roots) {
+            const Root& root = module.roots[r];
+            if (root.target == kNoSignal)
+                continue;
+            writers[root.target]++;
+            writer[root.target] = &root;
+        }
+    }
+
+    bool changed = false;
+    for (auto& node : module.nodes) {
+        if (node.op != Op::Signal)
+            continue;
+        uint32_t s = static_cast<uint32_t>(node.value);
+        const Signal& sig = module.signals[s];
+        if (sig.driven || sig.memory || writers[s] != 1)
+            continue;
+        const Root& root = *writer[s];
+        uint32_t proc = owner[static_cast<size_t>(&root - module.roots.data())];
+        const Node& value = module.nodes[root.node];
+        if (module.processes[proc].kind != ProcessKind::Assign || value.op != Op::Const)
+            continue;
+        node = Node{Op::Const, node.width, kNoNode, kNoNode, value.value & widthMask(sig.width)};
+        changed = true;
+    }
+    return changed;
+}
+
+struct NodeKey {
+    Op op;
+    uint32_t width;
+    NodeId a;
+    NodeId b;
+    uint64_t value;
+
+    bool operator==(const NodeKey&) const = default;
+};
+
+struct NodeKeyHash {
+    size_t operator()(const NodeKey& key) const {
+        uint64_t h = static_cast<uint64_t>(key.op) * 0x9e3779b97f4a7c15ULL;
+        for (uint64_t part : {uint64_t(key.width), uint64_t(key.a), uint64_t(key.b), key.value})
+            h = (h ^ part) * 0x100000001b3ULL + (h >> 29);
+        return static_cast<size_t>(h);
+    }
+};
+
+// Upper bound on the significant bits of each node's value (see Node on canonical values).
+std::vector<uint32_t> nodeBounds(const Module& module) {
+    std::vector<uint32_t> bits(module.nodes.size(), 64);
+    for (size_t i = 0; i < module.nodes.size(); ++i) {
+        const Node& node = module.nodes[i];
+        uint32_t a = node.a != kNoNode ? bits[node.a] : 0;
+        uint32_t b = node.b != kNoNode ? bits[node.b] : 0;
+        uint32_t bound = 64;
+        switch (node.op) {
+            case Op::Const:
+                bound = static_cast<uint32_t>(std::bit_width(node.value));
+                break;
+            case Op::Signal:
+                bound = module.signals[node.value].bits;
+                break;
+            case Op::MemRead:
+                bound = node.width;
+                break;
+            case Op::Trunc:
+                bound = std::min(node.width, a);
+                break;
+            case Op::Sext:
+                bound = a < node.value ? a : 64;
+                break;
+            case Op::LogicNot:
+            case Op::LogicAnd:
+            case Op::LogicOr:
+            case Op::Eq:
+            case Op::Ne:
+            case Op::Lt:
+            case Op::Le:
+            case Op::Slt:
+            case Op::Sle:
+            case Op::RedAnd:
+            case Op::RedOr:
+            case Op::RedXor:
+                bound = 1;
+                break;
+            case Op::Shl:
+                if (module.nodes[node.b].op == Op::Const)
+                    bound = module.nodes[node.b].value < 64
+                                ? a + static_cast<uint32_t>(module.nodes[node.b].value)
+                                : 0;
+                break;
+            case Op::Shr:
+                if (module.nodes[node.b].op == Op::Const)
+                    bound = module.nodes[node.b].value < a
+                                ? a - static_cast<uint32_t>(module.nodes[node.b].value)
+                                : 0;
+                else
+                    bound = a;
+                break;
+            case Op::Gather:
+                bound = static_cast<uint32_t>(std::popcount(node.value));
+                break;
+            case Op::Add:
+                bound = std::max(a, b) + 1;
+                break;
+            case Op::Mul:
+                bound = a + b;
+                break;
+            case Op::Div:
+                bound = a;
+                break;
+            case Op::And:
+                bound = std::min(a, b);
+                break;
+            case Op::Or:
+            case Op::Xor:
+                bound = std::max(a, b);
+                break;
+            default:
+                // Opaque values may be sign-extended (DPI integers); Not and Sub wrap.
+                break;
+        }
+        bits[i] = std::min<uint32_t>(bound, 64);
+    }
+    return bits;
+}
+
+} // namespace
+
+PassStats propagateConstants(Module& module) {
+    PassStats stats;
+    stats.pass = "const-prop";
+    // Each sweep bypasses nodes, which compacting drops before the next one.
+    do {
+        while (foldOnce(module))
+            stats.nodes += compact(module);
+    } while (propagateConstantSignals(module));
+    stats.nodes += compact(module);
+    return stats;
+}
+
+PassStats eliminateCommonSubexpressions(Module& module) {
+    PassStats stats;
+    stats.pass = "cse";
+    std::unordered_map<NodeKey, NodeId, NodeKeyHash> seen;
+    std::vector<NodeId> forward(module.nodes.size());
+    std::vector<char> pure(module.nodes.size(), 1);
+    for (size_t i = 0; i < module.nodes.size(); ++i) {
+        forward[i] = static_cast<NodeId>(i);
+        Node& node = module.nodes[i];
+        if (node.a != kNoNode)
+            node.a = forward[node.a];
+        if (node.b != kNoNode)
+            node.b = forward[node.b];
+        pure[i] = node.op != Op::Opaque && (node.a == kNoNode || pure[node.a]) &&
+                  (node.b == kNoNode || pure[node.b]);
+        if (node.op == Op::Opaque)
+            continue;
+        // Operand order only matters when an operand has side effects.
+        if (isCommutative(node.op) && node.a > node.b && pure[i])
+            std::swap(node.a, node.b);
+        auto [it, inserted] = seen.emplace(
+            NodeKey{node.op, node.width, node.a, node.b, node.value}, static_cast<NodeId>(i));
+        if (!inserted)
+            forward[i] = it->second;
+    }
+    applyForward(module, forward);
+    stats.nodes = compact(module);
+    return stats;
+}
+
+PassStats eliminateDeadCode(Module& module) {
+    PassStats stats;
+    stats.pass = "dce";
+    size_t signalCount = module.signals.size();
+    std::vector<std::vector<uint32_t>> reads(module.processes.size());
+    std::vector<std::vector<uint32_t>> writersOf(signalCount);
+    std::vector<uint32_t> stamp(module.nodes.size(), ~0U);
+    for (uint32_t p = 0; p < module.processes.size(); ++p) {
+        const Process& proc = module.processes[p];
+        if (!proc.live)
+            continue;
+        reads[p] = proc.reads;
+        std::vector<NodeId> stack;
+        for (uint32_t root : proc.roots) {
+            if (module.roots[root].node != kNoNode)
+                stack.push_back(module.roots[root].node);
+        }
+        while (!stack.empty()) {
+            NodeId id = stack.back();
+            stack.pop_back();
+            if (stamp[id] == p)
+                continue;
+            stamp[id] = p;
+            const Node& node = module.nodes[id];
+            if (node.op == Op::Signal || node.op == Op::MemRead)
+                reads[p].push_back(static_cast<uint32_t>(node.value));
+            if (node.a != kNoNode)
+                stack.push_back(node.a);
+            if (node.b != kNoNode)
+                stack.push_back(node.b);
+        }
+        for (uint32_t s : proc.writes)
+            writersOf[s].push_back(p);
+    }
+
+    std::vector<char> live(module.processes.size(), 0);
+    std::vector<char> needed(signalCount, 0);
+    std::vector<uint32_t> work;
+    auto need = [&](uint32_t s) {
+        if (needed[s])
+            return;
+        needed[s] = 1;
+        for (uint32_t p : writersOf[s]) {
+            if (!live[p]) {
+                live[p] = 1;
+                work.push_back(p);
+            }
+        }
+    };
+    for (uint32_t p = 0; p < module.processes.size(); ++p) {
+        if (module.processes[p].live && module.processes[p].sideEffects) {
+            live[p] = 1;
+            work.push_back(p);
+        }
+    }
+    for (uint32_t s = 0; s < signalCount; ++s) {
+        if (module.signals[s].observed)
+            need(s);
+    }
+    while (!work.empty()) {
+        uint32_t p = work.back();
+        work.pop_back();
+        for (uint32_t s : reads[p])
+            need(s);
+    }
+
+    std::vector<char> written(signalCount, 0);
+    for (uint32_t p = 0; p < module.processes.size(); ++p) {
+        Process& proc = module.processes[p];
+        if (proc.live && !live[p]) {
+            proc.live = false;
+            for (uint32_t root : proc.roots)
+                module.roots[root].node = kNoNode;
+            stats.processes++;
+        }
+        if (proc.live) {
+            for (uint32_t s : proc.writes)
+                written[s] = 1;
+        }
+    }
+    for (uint32_t s = 0; s < signalCount; ++s) {
+        Signal& sig = module.signals[s];
+        if (sig.live && !sig.observed && !needed[s] && !written[s]) {
+            sig.live = false;
+            stats.signals++;
+        }
+    }
+    stats.nodes = compact(module);
+    return stats;
+}
+
+PassStats narrowWidths(Module& module) {
+    PassStats stats;
+    stats.pass = "narrow";
+
+    // Signal bounds only come down from the declared width, and each step is computed from
+    // sound bounds, so every intermediate result is sound too (feedback loops included).
+    std::vector<std::vector<NodeId>> drivers(module.signals.size());
+    std::vector<char> candidate(module.signals.size(), 0);
+    for (size_t s = 0; s < module.signals.size(); ++s) {
+        Signal& sig = module.signals[s];
+        sig.bits = sig.width;
+        candidate[s] = !sig.driven && !sig.memory;
+    }
+    for (const auto& proc : module.processes) {
+        if (!proc.live)
+            continue;
+        for (uint32_t s : proc.writes)
+            candidate[s] = candidate[s] && !proc.sideEffects;
+        for (uint32_t r : proc.roots) {
+            const Root& root = module.roots[r];
+            if (root.target != kNoSignal && root.node != kNoNode)
+                drivers[root.target].push_back(root.node);
+        }
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        std::vector<uint32_t> bits = nodeBounds(module);
+        for (size_t s = 0; s < module.signals.size(); ++s) {
+            if (!candidate[s] || drivers[s].empty())
+                continue;
+            uint32_t bound = 0;
+            for (NodeId driver : drivers[s])
+                bound = std::max(bound, bits[driver]);
+            Signal& sig = module.signals[s];
+            if (bound < sig.bits) {
+                sig.bits = bound;
+                changed = true;
+            }
+        }
+    }
+    for (const auto& sig : module.signals) {
+        if (sig.live && !sig.memory)
+            stats.bits += sig.width - std::min(sig.width, sig.bits);
+    }
+
+    // Masks of values that already fit.
+    std::vector<uint32_t> bits = nodeBounds(module);
+    std::vector<NodeId> forward(module.nodes.size());
+    for (size_t i = 0; i < module.nodes.size(); ++i) {
+        Node& node = module.nodes[i];
+        if (node.a != kNoNode)
+            node.a = forward[node.a];
+        if (node.b != kNoNode)
+            node.b = forward[node.b];
+        forward[i] = static_cast<NodeId>(i);
+        if (node.op == Op::Trunc && bits[node.a] <= node.width)
+            forward[i] = node.a;
+    }
+    applyForward(module, forward);
+
+    // Masks whose high bits nobody looks at: Add, Sub, Mul, Not, the bitwise operators and
+    // the shifted operand of Shl compute their low bits from their operands' low bits only.
+    std::vector<uint32_t> demand(module.nodes.size(), 0);
+    for (const auto& proc : module.processes) {
+        if (!proc.live)
+            continue;
+        for (uint32_t r : proc.roots) {
+            const Root& root = module.roots[r];
+            if (root.node != kNoNode)
+                demand[root.node] = std::max(demand[root.node], root.demand);
+        }
+    }
+    for (size_t i = module.nodes.size(); i-- > 0;) {
+        const Node& node = module.nodes[i];
+        uint32_t d = demand[i];
+        if (d == 0)
+            continue;
+        uint32_t operands = 64;
+        switch (node.op) {
+            case Op::Trunc:
+                operands = std::min(d, node.width);
+                break;
+            case Op::Not:
+            case Op::Add:
+            case Op::Sub:
+            case Op::Mul:
+            case Op::And:
+            case Op::Or:
+            case Op::Xor:
+            case Op::Shl:
+                operands = d;
+                break;
+            default:
+                break;
+        }
+        if (node.a != kNoNode)
+            demand[node.a] = std::max(demand[node.a], operands);
+        if (node.b != kNoNode)
+            demand[node.b] = std::max(demand[node.b], node.op == Op::Shl ? 64 : operands);
+    }
+    for (size_t i = 0; i < module.nodes.size(); ++i) {
+        Node& node = module.nodes[i];
+        if (node.a != kNoNode)
+            node.a = forward[node.a];
+        if (node.b != kNoNode)
+            node.b = forward[node.b];
+        forward[i] = static_cast<NodeId>(i);
+        if (node.op == Op::Trunc && demand[i] <= node.width)
+            forward[i] = node.a;
+    }
+    applyForward(module, forward);
+    stats.nodes = compact(module);
+    return stats;
+}
+
+std::vector<PassStats> optimize(Module& module) {
+    compact(module);
+    std::vector<PassStats> stats;
+    stats.push_back(propagateConstants(module));
+    stats.push_back(eliminateCommonSubexpressions(module));
+    stats.push_back(eliminateDeadCode(module));
+    stats.push_back(narrowWidths(module));
+    return stats;
+}
+
+std::vector<char> sharedNodes(const Module& module) {
+    std::vector<uint32_t> users(module.nodes.size(), 0);
+    std::vector<char> pure(module.nodes.size(), 1);
+    for (size_t i = 0; i < module.nodes.size(); ++i) {
+        const Node& node = module.nodes[i];
+        pure[i] = node.op != Op::Opaque && (node.a == kNoNode || pure[node.a]) &&
+                  (node.b == kNoNode || pure[node.b]);
+        if (node.a != kNoNode)
+            users[node.a]++;
+        if (node.b != kNoNode)
+            users[node.b]++;
+    }
+    std::vector<char> shared(module.nodes.size(), 0);
+    for (size_t i = 0; i < module.nodes.size(); ++i) {
+        Op op = module.nodes[i].op;
+        shared[i] = users[i] > 1 && pure[i] && (isOperator(op) || op == Op::MemRead);
+    }
+    return shared;
+}
+
+void printStats(std::ostream& out, const Module& module, const std::vector<PassStats>& stats) {
+    size_t nodes = module.nodes.size();
+    size_t processes = module.liveProcesses();
+    size_t signals = module.liveSignals();
+    for (const auto& pass : stats) {
+        nodes += pass.nodes;
+        processes += pass.processes;
+        signals += pass.signals;
+    }
+    out << "ir " << module.name << ": " << nodes << " nodes, " << processes << " processes, "
+        << signals << " signals\n";
+    for (const auto& pass : stats) {
+        out << "  " << std::left << std::setw(12) << pass.pass << std::right << "-"
+            << pass.nodes << " nodes";
+        if (pass.processes)
+            out << ", -" << pass.processes << " processes";
+        if (pass.signals)
+            out << ", -" << pass.signals << " signals";
+        if (pass.bits)
+            out << ", " << pass.bits << " signal bits always zero";
+        out << "\n";
+    }
+}
+
+} // namespace sim::ir
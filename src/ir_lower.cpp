@@ -0,0 +1,1218 @@
+#include "sim/ir_lower.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "slang/ast/ASTVisitor.h"
+#include "slang/ast/Compilation.h"
+#include "slang/ast/EvalContext.h"
+#include "slang/ast/TimingControl.h"
+#include "slang/ast/types/AllTypes.h"
+
+namespace sim {
+
+using namespace slang;
+using namespace slang::ast;
+
+ir::NodeId LoweredModule::node(const Expression& expr) const {
+    auto it = roots.find(&expr);
+    return it == roots.end() ? ir::kNoNode : ir.roots[it->second].node;
+}
+
+bool LoweredModule::live(const Symbol& process) const {
+    auto it = processes.find(&process);
+    return it == processes.end() || ir.processes[it->second].live;
+}
+
+bool LoweredModule::liveSignal(const ValueSymbol& signal) const {
+    auto it = signals.find(&signal);
+    return it == signals.end() || ir.signals[it->second].live;
+}
+
+namespace {
+
+// Width of an integral expression, 0 for anything the IR cannot hold.
+uint32_t exprWidth(const Expression& expr) {
+    if (!expr.type->isIntegral())
+        return 0;
+    uint32_t width = expr.type->getBitWidth();
+    return width <= 64 ? width : 0;
+}
+
+std::optional<uint64_t> literalValue(const SVInt& value) {
+    if (value.hasUnknown())
+        return std::nullopt;
+    if (auto opt = value.as<uint64_t>())
+        return *opt;
+    if (auto opt = value.as<int64_t>())
+        return static_cast<uint64_t>(*opt);
+    return std::nullopt;
+}
+
+struct Lowering {
+    const InstanceBodySymbol& body;
+    LoweredModule& out;
+    // Per IR signal: the lower bound of a memory's index range.
+    std::vector<int64_t> lower;
+    std::unordered_set<const Symbol*> modeled;
+
+    void run() {
+        out.ir.name = std::string(body.getDefinition().name);
+        collectSignals();
+        for (auto& member : body.members()) {
+            if (member.kind == SymbolKind::ContinuousAssign)
+                lowerAssign(member.as<ContinuousAssignSymbol>());
+            else if (member.kind == SymbolKind::ProceduralBlock)
+                lowerBlock(member.as<ProceduralBlockSymbol>());
+        }
+        markUnmodeled();
+    }
+
+    void collectSignals() {
+        for (auto& member : body.members()) {
+            if (!ValueSymbol::isKind(member.kind) || member.kind == SymbolKind::Parameter)
+                continue;
+            auto& val = member.as<ValueSymbol>();
+            ir::Signal sig;
+            sig.name = std::string(val.name);
+            int64_t low = 0;
+            const Type& type = val.getType().getCanonicalType();
+            bool supported = false;
+            if (type.kind == SymbolKind::FixedSizeUnpackedArrayType) {
+                auto& array = type.as<FixedSizeUnpackedArrayType>();
+                uint32_t width = array.elementType.getBitWidth();
+                supported = array.elementType.isIntegral() && width > 0 && width <= 64;
+                sig.memory = true;
+                sig.width = width;
+                low = array.range.lower();
+            } else {
+                sig.width = type.getBitWidth();
+                supported = type.isIntegral() && sig.width > 0 && sig.width <= 64;
+            }
+            // Initializers run outside any process.
+            if (!supported || val.getInitializer()) {
+                sig.observed = true;
+                sig.driven = true;
+            }
+            out.signals[&val] = static_cast<uint32_t>(out.ir.signals.size());
+            out.symbols.push_back(&val);
+            out.ir.signals.push_back(std::move(sig));
+            lower.push_back(low);
+        }
+
+        // The parent reads outputs and drives inputs.
+        auto markPort = [&](const Symbol* internal) {
+            if (internal && ValueSymbol::isKind(internal->kind))
+                mark(internal->as<ValueSymbol>());
+        };
+        for (auto* sym : body.getPortList()) {
+            if (sym->kind == SymbolKind::Port) {
+                markPort(sym->as<PortSymbol>().internalSymbol);
+            } else if (sym->kind == SymbolKind::MultiPort) {
+                for (auto* port : sym->as<MultiPortSymbol>().ports)
+                    markPort(port->internalSymbol);
+            }
+        }
+    }
+
+    // `sym` is read or written by code outside the IR.
+    void mark(const ValueSymbol& sym) {
+        auto it = out.signals.find(&sym);
+        if (it == out.signals.end())
+            return;
+        out.ir.signals[it->second].observed = true;
+        out.ir.signals[it->second].driven = true;
+    }
+
+    std::optional<uint32_t> signalOf(const Expression& expr) const {
+        auto* sym = expr.getSymbolReference();
+        if (!sym || !ValueSymbol::isKind(sym->kind))
+            return std::nullopt;
+        auto it = out.signals.find(&sym->as<ValueSymbol>());
+        if (it == out.signals.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    // Whole supported signals and words of memories.
+    bool lowerableTarget(const Expression& lhs) const {
+        if (lhs.kind == ExpressionKind::ElementSelect) {
+            auto s = signalOf(lhs.as<ElementSelectExpression>().value());
+            return s && out.ir.signals[*s].memory;
+        }
+        if (lhs.kind != ExpressionKind::NamedValue)
+            return false;
+        auto s = signalOf(lhs);
+        return s && !out.ir.signals[*s].memory && exprWidth(lhs) != 0;
+    }
+
+    bool lowerable(const Statement& stmt) const {
+        switch (stmt.kind) {
+            case StatementKind::Block:
+                return lowerable(stmt.as<BlockStatement>().body);
+            case StatementKind::List:
+                for (auto* s : stmt.as<StatementList>().list) {
+                    if (!lowerable(*s))
+                        return false;
+                }
+                return true;
+            case StatementKind::Empty:
+                return true;
+            case StatementKind::Conditional: {
+                auto& cond = stmt.as<ConditionalStatement>();
+                if (cond.conditions.size() != 1 || cond.conditions[0].pattern)
+                    return false;
+                return lowerable(cond.ifTrue) && (!cond.ifFalse || lowerable(*cond.ifFalse));
+            }
+            case StatementKind::Case: {
+                auto& cs = stmt.as<CaseStatement>();
+                if (cs.condition == CaseStatementCondition::Inside || exprWidth(cs.expr) == 0)
+                    return false;
+                for (auto& group : cs.items) {
+                    if (!lowerable(*group.stmt))
+                        return false;
+                }
+                return !cs.defaultCase || lowerable(*cs.defaultCase);
+            }
+            case StatementKind::ExpressionStatement: {
+                auto& es = stmt.as<ExpressionStatement>();
+                if (es.expr.kind != ExpressionKind::Assignment)
+                    return false;
+                auto& a = es.expr.as<AssignmentExpression>();
+                return !a.isCompound() && lowerableTarget(a.left());
+            }
+            default:
+                return false;
+        }
+    }
+
+    uint32_t beginProcess(const Symbol& symbol, ir::ProcessKind kind) {
+        modeled.insert(&symbol);
+        uint32_t index = static_cast<uint32_t>(out.ir.processes.size());
+        out.processes[&symbol] = index;
+        out.ir.processes.push_back({});
+        out.ir.processes.back().kind = kind;
+        return index;
+    }
+
+    void lowerAssign(const ContinuousAssignSymbol& assign) {
+        const Expression& expr = assign.getAssignment();
+        if (expr.kind != ExpressionKind::Assignment)
+            return;
+        auto& a = expr.as<AssignmentExpression>();
+        if (!lowerableTarget(a.left()))
+            return;
+        uint32_t proc = beginProcess(assign, ir::ProcessKind::Assign);
+        lowerAssignment(a, proc);
+    }
+
+    void lowerBlock(const ProceduralBlockSymbol& block) {
+        const Statement* stmt = &block.getBody();
+        std::vector<uint32_t> events;
+        if (block.procedureKind == ProceduralBlockKind::AlwaysFF) {
+            if (stmt->kind != StatementKind::Timed)
+                return;
+            auto& ts = stmt->as<TimedStatement>();
+            if (!collectEvents(ts.timing, events))
+                return;
+            stmt = &ts.stmt;
+        } else if (block.procedureKind != ProceduralBlockKind::AlwaysComb) {
+            return;
+        }
+        if (!lowerable(*stmt))
+            return;
+        uint32_t proc = beginProcess(block, block.procedureKind == ProceduralBlockKind::AlwaysFF
+                                                ? ir::ProcessKind::Seq
+                                                : ir::ProcessKind::Comb);
+        out.ir.processes[proc].reads = events;
+        lowerStatement(*stmt, proc);
+    }
+
+    bool collectEvents(const TimingControl& timing, std::vector<uint32_t>& events) const {
+        if (timing.kind == TimingControlKind::EventList) {
+            for (auto* ev : timing.as<EventListControl>().events) {
+                if (!collectEvents(*ev, events))
+                    return false;
+            }
+            return true;
+        }
+        if (timing.kind != TimingControlKind::SignalEvent)
+            return false;
+        auto& ev = timing.as<SignalEventControl>();
+        auto s = signalOf(ev.expr);
+        if (ev.iffCondition || !s)
+            return false;
+        events.push_back(*s);
+        return true;
+    }
+
+    void lowerStatement(const Statement& stmt, uint32_t proc) {
+        switch (stmt.kind) {
+            case StatementKind::Block:
+                lowerStatement(stmt.as<BlockStatement>().body, proc);
+                break;
+            case StatementKind::List:
+                for (auto* s : stmt.as<StatementList>().list)
+                    lowerStatement(*s, proc);
+                break;
+            case StatementKind::Conditional: {
+                auto& cond = stmt.as<ConditionalStatement>();
+                lowerRoot(*cond.conditions[0].expr, 64, ir::kNoSignal, proc);
+                lowerStatement(cond.ifTrue, proc);
+                if (cond.ifFalse)
+                    lowerStatement(*cond.ifFalse, proc);
+                break;
+            }
+            case StatementKind::Case: {
+                // Constant items become labels and masks in the backends; only the selector
+                // and the items computed at run time are roots.
+                auto& cs = stmt.as<CaseStatement>();
+                lowerRoot(cs.expr, 64, ir::kNoSignal, proc);
+                for (auto& group : cs.items) {
+                    for (auto* item : group.expressions) {
+                        if (!casePattern(cs, *item))
+                            lowerRoot(*item, 64, ir::kNoSignal, proc);
+                    }
+                    lowerStatement(*group.stmt, proc);
+                }
+                if (cs.defaultCase)
+                    lowerStatement(*cs.defaultCase, proc);
+                break;
+            }
+            case StatementKind::ExpressionStatement:
+                lowerAssignment(stmt.as<ExpressionStatement>().expr.as<AssignmentExpression>(),
+                                proc);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void lowerAssignment(const AssignmentExpression& a, uint32_t proc) {
+        const Expression& lhs = a.left();
+        uint32_t target = 0;
+        if (lhs.kind == ExpressionKind::ElementSelect) {
+            auto& sel = lhs.as<ElementSelectExpression>();
+            target = *signalOf(sel.value());
+            lowerRoot(sel.selector(), 64, ir::kNoSignal, proc);
+        } else {
+            target = *signalOf(lhs);
+        }
+        out.ir.processes[proc].writes.push_back(target);
+        lowerRoot(a.right(), out.ir.signals[target].width, target, proc);
+    }
+
+    void lowerRoot(const Expression& expr, uint32_t demand, uint32_t target, uint32_t proc) {
+        ir::NodeId node = lowerExpr(expr, proc);
+        uint32_t root = out.ir.addRoot(node, demand, target);
+        out.ir.processes[proc].roots.push_back(root);
+        out.roots[&expr] = root;
+    }
+
+    // Operators on constants fold right away, so select offsets are known to concat().
+    ir::NodeId add(ir::Op op, uint32_t width, ir::NodeId a, ir::NodeId b = ir::kNoNode,
+                   uint64_t value = 0) {
+        ir::Node node{op, width, a, b, value};
+        bool operands = op != ir::Op::MemRead && a != ir::kNoNode;
+        auto isConst = [&](ir::NodeId n) {
+            return n == ir::kNoNode || out.ir.nodes[n].op == ir::Op::Const;
+        };
+        if (operands && isConst(a) && isConst(b)) {
+            uint64_t bv = b != ir::kNoNode ? out.ir.nodes[b].value : 0;
+            return out.ir.constant(ir::apply(node, out.ir.nodes[a].value, bv), width);
+        }
+        return out.ir.add(node);
+    }
+
+    // Add, Sub, Mul, Not, Shl and Sar leave bits above `width`; a mask makes the value
+    // canonical.
+    ir::NodeId masked(ir::NodeId node, uint32_t width) {
+        return width < 64 ? add(ir::Op::Trunc, width, node) : node;
+    }
+
+    ir::NodeId constant(std::optional<uint64_t> value, uint32_t width, const Expression& expr,
+                        uint32_t proc) {
+        if (!value)
+            return opaque(expr, proc);
+        return out.ir.constant(*value & widthMask(width), width);
+    }
+
+    ir::NodeId lowerExpr(const Expression& expr, uint32_t proc) {
+        uint32_t width = exprWidth(expr);
+        if (width == 0)
+            return opaque(expr, proc);
+        switch (expr.kind) {
+            case ExpressionKind::IntegerLiteral:
+                return constant(literalValue(expr.as<IntegerLiteral>().getValue()), width, expr,
+                                proc);
+            case ExpressionKind::UnbasedUnsizedIntegerLiteral:
+                return constant(literalValue(expr.as<UnbasedUnsizedIntegerLiteral>().getValue()),
+                                width, expr, proc);
+            case ExpressionKind::NamedValue: {
+                auto& sym = expr.as<NamedValueExpression>().symbol;
+                if (sym.kind == SymbolKind::Parameter) {
+                    auto cv = sym.as<ParameterSymbol>().getValue();
+                    if (!cv.isInteger())
+                        return opaque(expr, proc);
+                    return constant(literalValue(cv.integer()), width, expr, proc);
+                }
+                auto s = signalOf(expr);
+                if (!s || out.ir.signals[*s].memory || out.ir.signals[*s].width != width)
+                    return opaque(expr, proc);
+                return add(ir::Op::Signal, width, ir::kNoNode, ir::kNoNode, *s);
+            }
+            case ExpressionKind::Call:
+                // Functions of literals and parameters fold at elaboration time.
+                return constant(evalConstant(expr, body), width, expr, proc);
+            case ExpressionKind::Conversion: {
+                const Expression& operand = expr.as<ConversionExpression>().operand();
+                uint32_t from = exprWidth(operand);
+                if (from == 0)
+                    return opaque(expr, proc);
+                ir::NodeId node = lowerExpr(operand, proc);
+                if (width < from)
+                    return add(ir::Op::Trunc, width, node);
+                if (width > from && operand.type->isSigned())
+                    return masked(add(ir::Op::Sext, width, node, ir::kNoNode, from), width);
+                return node;
+            }
+            case ExpressionKind::ElementSelect: {
+                auto& sel = expr.as<ElementSelectExpression>();
+                auto s = signalOf(sel.value());
+                if (!s || !out.ir.signals[*s].memory) {
+                    // A bit (or packed element) select.
+                    uint32_t from = exprWidth(sel.value());
+                    if (from == 0)
+                        return opaque(expr, proc);
+                    ir::NodeId offset = elementOffset(*sel.value().type,
+                                                      index(sel.selector(), proc), width);
+                    return add(ir::Op::Trunc, width,
+                               add(ir::Op::Shr, from, lowerExpr(sel.value(), proc), offset));
+                }
+                ir::NodeId addr = lowerExpr(sel.selector(), proc);
+                if (lower[*s] != 0) {
+                    addr = add(ir::Op::Sub, 64, addr,
+                               out.ir.constant(static_cast<uint64_t>(lower[*s]), 64));
+                }
+                return add(ir::Op::MemRead, width, addr, ir::kNoNode, *s);
+            }
+            case ExpressionKind::RangeSelect:
+                return rangeSelect(expr.as<RangeSelectExpression>(), width, proc);
+            case ExpressionKind::Concatenation:
+                return concat(expr.as<ConcatenationExpression>(), width, proc);
+            case ExpressionKind::Replication: {
+                // Copies of a w-bit value never overlap, so one multiply makes all of them.
+                const Expression& inner = expr.as<ReplicationExpression>().concat();
+                uint32_t w = exprWidth(inner);
+                if (w == 0 || width % w != 0)
+                    return opaque(expr, proc);
+                uint64_t pattern = 0;
+                for (uint32_t bit = 0; bit < width; bit += w)
+                    pattern |= 1ULL << bit;
+                return add(ir::Op::Mul, width, lowerExpr(inner, proc),
+                           out.ir.constant(pattern, width));
+            }
+            case ExpressionKind::UnaryOp: {
+                auto& un = expr.as<UnaryExpression>();
+                switch (un.op) {
+                    case UnaryOperator::Plus:
+                        return lowerExpr(un.operand(), proc);
+                    case UnaryOperator::Minus:
+                        return masked(add(ir::Op::Sub, width, out.ir.constant(0, width),
+                                          lowerExpr(un.operand(), proc)),
+                                      width);
+                    case UnaryOperator::BitwiseNot:
+                        return masked(add(ir::Op::Not, width, lowerExpr(un.operand(), proc)),
+                                      width);
+                    case UnaryOperator::LogicalNot:
+                    case UnaryOperator::BitwiseNor:
+                        return add(ir::Op::LogicNot, 1, lowerExpr(un.operand(), proc));
+                    case UnaryOperator::BitwiseAnd:
+                    case UnaryOperator::BitwiseNand:
+                    case UnaryOperator::BitwiseOr:
+                    case UnaryOperator::BitwiseXor:
+                    case UnaryOperator::BitwiseXnor:
+                        return reduce(un, proc);
+                    default:
+                        return opaque(expr, proc);
+                }
+            }
+            case ExpressionKind::BinaryOp: {
+                auto& bin = expr.as<BinaryExpression>();
+                if (auto node = compareOrShift(bin, width, proc))
+                    return *node;
+                ir::Op op;
+                switch (bin.op) {
+                    case BinaryOperator::Add:
+                        op = ir::Op::Add;
+                        break;
+                    case BinaryOperator::Subtract:
+                        op = ir::Op::Sub;
+                        break;
+                    case BinaryOperator::Multiply:
+                        op = ir::Op::Mul;
+                        break;
+                    case BinaryOperator::Divide:
+                        // Signed division would need the operands sign-extended first.
+                        if (bin.left().type->isSigned() || bin.right().type->isSigned())
+                            return opaque(expr, proc);
+                        op = ir::Op::Div;
+                        break;
+                    case BinaryOperator::BinaryAnd:
+                        op = ir::Op::And;
+                        break;
+                    case BinaryOperator::BinaryOr:
+                        op = ir::Op::Or;
+                        break;
+                    case BinaryOperator::BinaryXor:
+                    case BinaryOperator::BinaryXnor:
+                        op = ir::Op::Xor;
+                        break;
+                    case BinaryOperator::LogicalAnd:
+                        op = ir::Op::LogicAnd;
+                        break;
+                    case BinaryOperator::LogicalOr:
+                        op = ir::Op::LogicOr;
+                        break;
+                    default:
+                        return opaque(expr, proc);
+                }
+                ir::NodeId lhs = lowerExpr(bin.left(), proc);
+                ir::NodeId rhs = lowerExpr(bin.right(), proc);
+                ir::NodeId node = add(op, width, lhs, rhs);
+                if (bin.op == BinaryOperator::BinaryXnor)
+                    return masked(add(ir::Op::Not, width, node), width);
+                if (op == ir::Op::Add || op == ir::Op::Sub || op == ir::Op::Mul)
+                    return masked(node, width);
+                return node;
+            }
+            default:
+                return opaque(expr, proc);
+        }
+    }
+
+    // An index as a 64-bit value, sign-extended if the index is signed.
+    ir::NodeId index(const Expression& expr, uint32_t proc) {
+        ir::NodeId node = lowerExpr(expr, proc);
+        uint32_t width = exprWidth(expr);
+        if (width != 0 && width < 64 && expr.type->isSigned())
+            return add(ir::Op::Sext, 64, node, ir::kNoNode, width);
+        return node;
+    }
+
+    // The bit offset of the packed element at `index` (a 64-bit node) of `type`, whose
+    // elements are `elementWidth` bits wide.
+    ir::NodeId elementOffset(const Type& type, ir::NodeId index, uint32_t elementWidth) {
+        ConstantRange range = type.getFixedRange();
+        auto bound = [&](int32_t value) {
+            return out.ir.constant(static_cast<uint64_t>(static_cast<int64_t>(value)), 64);
+        };
+        ir::NodeId offset = range.isLittleEndian()
+                                ? add(ir::Op::Sub, 64, index, bound(range.lower()))
+                                : add(ir::Op::Sub, 64, bound(range.upper()), index);
+        if (elementWidth != 1)
+            offset = add(ir::Op::Mul, 64, offset, out.ir.constant(elementWidth, 64));
+        return offset;
+    }
+
+    // `x[msb:lsb]`, `x[base +: w]` and `x[base -: w]` as one shift and mask.
+    ir::NodeId rangeSelect(const RangeSelectExpression& sel, uint32_t width, uint32_t proc) {
+        const Type& type = *sel.value().type;
+        uint32_t from = exprWidth(sel.value());
+        if (from == 0)
+            return opaque(sel, proc);
+        ConstantRange range = type.getFixedRange();
+        if (range.width() == 0 || from % range.width() != 0)
+            return opaque(sel, proc);
+        uint32_t elementWidth = from / range.width();
+        uint64_t last = width / elementWidth - 1;
+        ir::NodeId lsb = ir::kNoNode;
+        switch (sel.getSelectionKind()) {
+            case RangeSelectionKind::Simple:
+                lsb = index(sel.right(), proc);
+                break;
+            case RangeSelectionKind::IndexedUp:
+                lsb = index(sel.left(), proc);
+                if (!range.isLittleEndian())
+                    lsb = add(ir::Op::Add, 64, lsb, out.ir.constant(last, 64));
+                break;
+            case RangeSelectionKind::IndexedDown:
+                lsb = index(sel.left(), proc);
+                if (range.isLittleEndian())
+                    lsb = add(ir::Op::Sub, 64, lsb, out.ir.constant(last, 64));
+                break;
+        }
+        ir::NodeId offset = elementOffset(type, lsb, elementWidth);
+        return add(ir::Op::Trunc, width,
+                   add(ir::Op::Shr, from, lowerExpr(sel.value(), proc), offset));
+    }
+
+    // A constant select of a node: `node` is Trunc(Shr(source, offset)) or Trunc(source).
+    struct Field {
+        ir::NodeId source = ir::kNoNode;
+        uint64_t offset = 0;
+        uint32_t width = 0;
+    };
+
+    std::optional<Field> field(ir::NodeId id) const {
+        const ir::Node& node = out.ir.nodes[id];
+        if (node.op != ir::Op::Trunc)
+            return std::nullopt;
+        const ir::Node& inner = out.ir.nodes[node.a];
+        if (inner.op == ir::Op::Shr && out.ir.nodes[inner.b].op == ir::Op::Const &&
+            out.ir.nodes[inner.b].value < 64)
+            return Field{inner.a, out.ir.nodes[inner.b].value, node.width};
+        return Field{node.a, 0, node.width};
+    }
+
+    // `{a, b, ...}`: operands shifted into place and ORed. Selects of one source in
+    // ascending bit order become a single Gather (pext) instead.
+    ir::NodeId concat(const ConcatenationExpression& cat, uint32_t width, uint32_t proc) {
+        std::vector<ir::NodeId> parts;
+        std::vector<uint32_t> widths;
+        for (size_t i = cat.operands().size(); i-- > 0;) {
+            const Expression& operand = *cat.operands()[i];
+            if (!operand.type->isIntegral())
+                return opaque(cat, proc);
+            uint32_t w = operand.type->getBitWidth();
+            if (w == 0)
+                continue;
+            if (w > 64)
+                return opaque(cat, proc);
+            parts.push_back(lowerExpr(operand, proc));
+            widths.push_back(w);
+        }
+        if (parts.empty())
+            return out.ir.constant(0, width);
+
+        uint64_t mask = 0;
+        uint64_t next = 0;
+        ir::NodeId source = ir::kNoNode;
+        bool gather = parts.size() > 1;
+        for (size_t i = 0; i < parts.size() && gather; ++i) {
+            auto f = field(parts[i]);
+            gather = f && (source == ir::kNoNode || f->source == source) && f->offset >= next &&
+                     f->offset + f->width <= 64;
+            if (!gather)
+                break;
+            source = f->source;
+            mask |= widthMask(f->width) << f->offset;
+            next = f->offset + f->width;
+        }
+        if (gather)
+            return add(ir::Op::Gather, width, source, ir::kNoNode, mask);
+
+        ir::NodeId node = parts[0];
+        uint32_t shift = widths[0];
+        for (size_t i = 1; i < parts.size(); ++i) {
+            node = add(ir::Op::Or, width, node,
+                       add(ir::Op::Shl, width, parts[i], out.ir.constant(shift, 64)));
+            shift += widths[i];
+        }
+        return node;
+    }
+
+    // Reduction operators on one word: compare, popcount parity, or test for zero.
+    ir::NodeId reduce(const UnaryExpression& un, uint32_t proc) {
+        uint32_t from = exprWidth(un.operand());
+        if (from == 0)
+            return opaque(un, proc);
+        ir::NodeId operand = lowerExpr(un.operand(), proc);
+        switch (un.op) {
+            case UnaryOperator::BitwiseAnd:
+                return add(ir::Op::RedAnd, 1, operand, ir::kNoNode, from);
+            case UnaryOperator::BitwiseNand:
+                return add(ir::Op::LogicNot, 1,
+                           add(ir::Op::RedAnd, 1, operand, ir::kNoNode, from));
+            case UnaryOperator::BitwiseOr:
+                return add(ir::Op::RedOr, 1, operand);
+            case UnaryOperator::BitwiseXor:
+                return add(ir::Op::RedXor, 1, operand);
+            default:
+                return add(ir::Op::Xor, 1, add(ir::Op::RedXor, 1, operand),
+                           out.ir.constant(1, 1));
+        }
+    }
+
+    // Shifts and relational operators, or nullopt for any other operator.
+    std::optional<ir::NodeId> compareOrShift(const BinaryExpression& bin, uint32_t width,
+                                             uint32_t proc) {
+        uint32_t from = exprWidth(bin.left());
+        bool isSigned = bin.left().type->isSigned() && bin.right().type->isSigned();
+        auto compare = [&](ir::Op op, ir::Op signedOp, bool swap) -> std::optional<ir::NodeId> {
+            if (from == 0 || exprWidth(bin.right()) != from)
+                return opaque(bin, proc);
+            ir::NodeId lhs = lowerExpr(bin.left(), proc);
+            ir::NodeId rhs = lowerExpr(bin.right(), proc);
+            if (swap)
+                std::swap(lhs, rhs);
+            if (isSigned && (signedOp == ir::Op::Slt || signedOp == ir::Op::Sle))
+                return add(signedOp, 1, lhs, rhs, from);
+            return add(op, 1, lhs, rhs);
+        };
+        auto shift = [&](ir::Op op) -> ir::NodeId {
+            ir::NodeId lhs = lowerExpr(bin.left(), proc);
+            ir::NodeId rhs = lowerExpr(bin.right(), proc);
+            if (op == ir::Op::Shr)
+                return add(op, width, lhs, rhs);
+            return masked(add(op, width, lhs, rhs, op == ir::Op::Sar ? width : 0), width);
+        };
+        switch (bin.op) {
+            case BinaryOperator::Equality:
+            case BinaryOperator::CaseEquality:
+                return compare(ir::Op::Eq, ir::Op::Eq, false);
+            case BinaryOperator::Inequality:
+            case BinaryOperator::CaseInequality:
+                return compare(ir::Op::Ne, ir::Op::Ne, false);
+            case BinaryOperator::LessThan:
+                return compare(ir::Op::Lt, ir::Op::Slt, false);
+            case BinaryOperator::LessThanEqual:
+                return compare(ir::Op::Le, ir::Op::Sle, false);
+            case BinaryOperator::GreaterThan:
+                return compare(ir::Op::Lt, ir::Op::Slt, true);
+            case BinaryOperator::GreaterThanEqual:
+                return compare(ir::Op::Le, ir::Op::Sle, true);
+            case BinaryOperator::LogicalShiftLeft:
+            case BinaryOperator::ArithmeticShiftLeft:
+                return shift(ir::Op::Shl);
+            case BinaryOperator::LogicalShiftRight:
+                return shift(ir::Op::Shr);
+            case BinaryOperator::ArithmeticShiftRight:
+                return shift(bin.left().type->isSigned() ? ir::Op::Sar : ir::Op::Shr);
+            default:
+                return std::nullopt;
+        }
+    }
+
+    // Backends emit `expr` from the AST. Its reads still count for dead-code elimination;
+    // a call may write anything, so it pins the process and everything it touches.
+    ir::NodeId opaque(const Expression& expr, uint32_t proc) {
+        ir::Process& process = out.ir.processes[proc];
+        bool calls = false;
+        std::vector<uint32_t> reads;
+        auto visitor = makeVisitor(
+            [&](auto& self, const CallExpression& call) {
+                calls = true;
+                self.visitDefault(call);
+            },
+            [&](auto& self, const NamedValueExpression& named) {
+                if (auto s = signalOf(named))
+                    reads.push_back(*s);
+                self.visitDefault(named);
+            });
+        expr.visit(visitor);
+        if (calls) {
+            process.sideEffects = true;
+            for (uint32_t s : reads)
+                mark(*out.symbols[s]);
+        } else {
+            process.reads.insert(process.reads.end(), reads.begin(), reads.end());
+        }
+        uint32_t width = exprWidth(expr);
+        uint64_t handle = out.opaque.size();
+        out.opaque.push_back(&expr);
+        return add(ir::Op::Opaque, width ? width : 64, ir::kNoNode, ir::kNoNode, handle);
+    }
+
+    // Initial blocks, other processes, functions, child port connections and initializers
+    // stay with the AST; whatever they touch is observed and driven.
+    void markUnmodeled() {
+        auto markRefs = [&](const Expression&, const Symbol& sym) {
+            if (ValueSymbol::isKind(sym.kind))
+                mark(sym.as<ValueSymbol>());
+        };
+        auto visitor = makeVisitor(
+            [&](auto&, const InstanceSymbol& child) {
+                for (auto* conn : child.getPortConnections()) {
+                    if (auto* expr = conn->getExpression())
+                        expr->visitSymbolReferences(markRefs);
+                }
+            },
+            [&](auto& self, const ContinuousAssignSymbol& assign) {
+                if (!modeled.count(&assign))
+                    self.visitDefault(assign);
+            },
+            [&](auto& self, const ProceduralBlockSymbol& block) {
+                if (!modeled.count(&block))
+                    self.visitDefault(block);
+            },
+            [&](auto& self, const NamedValueExpression& named) {
+                if (ValueSymbol::isKind(named.symbol.kind))
+                    mark(named.symbol.as<ValueSymbol>());
+                self.visitDefault(named);
+            });
+        body.visit(visitor);
+    }
+};
+
+} // namespace
+
+std::optional<int64_t> constantInt(const Expression& expr) {
+    switch (expr.kind) {
+        case ExpressionKind::IntegerLiteral:
+            return expr.as<IntegerLiteral>().getValue().as<int64_t>();
+        case ExpressionKind::UnbasedUnsizedIntegerLiteral:
+            return expr.as<UnbasedUnsizedIntegerLiteral>().getValue().as<int64_t>();
+        case ExpressionKind::NamedValue: {
+            auto& sym = expr.as<NamedValueExpression>().symbol;
+            if (sym.kind != SymbolKind::Parameter)
+                return std::nullopt;
+            auto cv = sym.as<ParameterSymbol>().getValue();
+            if (!cv.isInteger())
+                return std::nullopt;
+            return cv.integer().as<int64_t>();
+        }
+        case ExpressionKind::Conversion:
+            return constantInt(expr.as<ConversionExpression>().operand());
+        case ExpressionKind::UnaryOp: {
+            auto& un = expr.as<UnaryExpression>();
+            auto v = constantInt(un.operand());
+            if (!v || (un.op != UnaryOperator::Minus && un.op != UnaryOperator::Plus))
+                return std::nullopt;
+            return un.op == UnaryOperator::Minus ? -*v : *v;
+        }
+        case ExpressionKind::BinaryOp: {
+            auto& bin = expr.as<BinaryExpression>();
+            auto l = constantInt(bin.left());
+            auto r = constantInt(bin.right());
+            if (!l || !r)
+                return std::nullopt;
+            switch (bin.op) {
+                case BinaryOperator::Add:
+                    return *l + *r;
+                case BinaryOperator::Subtract:
+                    return *l - *r;
+                case BinaryOperator::Multiply:
+                    return *l * *r;
+                default:
+                    return std::nullopt;
+            }
+        }
+        default:
+            return std::nullopt;
+    }
+}
+
+std::optional<SignalSlice> signalSlice(const Expression& expr) {
+    const Expression* value = &expr;
+    if (expr.kind == ExpressionKind::ElementSelect)
+        value = &expr.as<ElementSelectExpression>().value();
+    else if (expr.kind == ExpressionKind::RangeSelect)
+        value = &expr.as<RangeSelectExpression>().value();
+    if (value->kind != ExpressionKind::NamedValue || !value->type->isIntegral())
+        return std::nullopt;
+    const auto& sym = value->as<NamedValueExpression>().symbol;
+    if (sym.kind == SymbolKind::Parameter)
+        return std::nullopt;
+    uint32_t from = value->type->getBitWidth();
+    uint32_t width = expr.type->isIntegral() ? expr.type->getBitWidth() : 0;
+    if (from == 0 || from > 64 || width == 0)
+        return std::nullopt;
+    if (value == &expr)
+        return SignalSlice{&sym, 0, from, true};
+
+    // The element index of the select's lsb, as in Lowering::rangeSelect.
+    ConstantRange range = value->type->getFixedRange();
+    if (range.width() == 0 || from % range.width() != 0)
+        return std::nullopt;
+    uint32_t elementWidth = from / range.width();
+    std::optional<int64_t> lsb;
+    if (expr.kind == ExpressionKind::ElementSelect) {
+        lsb = constantInt(expr.as<ElementSelectExpression>().selector());
+    } else {
+        auto& sel = expr.as<RangeSelectExpression>();
+        int64_t last = width / elementWidth - 1;
+        switch (sel.getSelectionKind()) {
+            case RangeSelectionKind::Simple:
+                lsb = constantInt(sel.right());
+                break;
+            case RangeSelectionKind::IndexedUp:
+                lsb = constantInt(sel.left());
+                if (lsb && !range.isLittleEndian())
+                    *lsb += last;
+                break;
+            case RangeSelectionKind::IndexedDown:
+                lsb = constantInt(sel.left());
+                if (lsb && range.isLittleEndian())
+                    *lsb -= last;
+                break;
+        }
+    }
+    if (!lsb)
+        return std::nullopt;
+    int64_t element = range.isLittleEndian() ? *lsb - range.lower() : range.upper() - *lsb;
+    int64_t offset = element * elementWidth;
+    if (offset < 0 || offset + width > from)
+        return std::nullopt;
+    return SignalSlice{&sym, static_cast<uint32_t>(offset), width, false};
+}
+
+std::optional<uint64_t> evalConstant(const Expression& expr, const Scope& scope) {
+    if (!expr.type->isIntegral() || expr.type->getBitWidth() > 64)
+        return std::nullopt;
+    // Anything else the evaluator would reject anyway; checking first keeps it from
+    // reporting diagnostics for every call on a signal.
+    bool constant = true;
+    expr.visitSymbolReferences([&](const Expression&, const Symbol& sym) {
+        if (sym.kind != SymbolKind::Parameter)
+            constant = false;
+    });
+    expr.visit(makeVisitor([&](auto& self, const CallExpression& call) {
+        if (randomCall(call) != RandomCall::None)
+            constant = false;
+        self.visitDefault(call);
+    }));
+    if (!constant)
+        return std::nullopt;
+    ASTContext context(scope, LookupLocation::max);
+    EvalContext eval(context);
+    ConstantValue value = expr.eval(eval);
+    if (!value.isInteger())
+        return std::nullopt;
+    auto word = literalValue(value.integer());
+    if (!word)
+        return std::nullopt;
+    return *word & widthMask(expr.type->getBitWidth());
+}
+
+RandomCall randomCall(const CallExpression& call) {
+    if (!call.isSystemCall())
+        return RandomCall::None;
+    auto name = call.getSubroutineName();
+    if (name == "$urandom")
+        return RandomCall::Urandom;
+    if (name == "$urandom_range")
+        return RandomCall::UrandomRange;
+    if (name == "$random")
+        return RandomCall::Random;
+    if (name == "randomize" || name == "std::randomize")
+        return RandomCall::Randomize;
+    return RandomCall::None;
+}
+
+bool constrainedRandomize(const CallExpression& call) {
+    if (randomCall(call) != RandomCall::Randomize)
+        return false;
+    auto& info = std::get<CallExpression::SystemCallInfo>(call.subroutine);
+    auto* randomize = std::get_if<CallExpression::RandomizeCallInfo>(&info.extraInfo);
+    return randomize && randomize->inlineConstraints;
+}
+
+bool usesRandom(const Symbol& symbol) {
+    bool found = false;
+    symbol.visit(makeVisitor([&](auto& self, const CallExpression& call) {
+        if (randomCall(call) != RandomCall::None)
+            found = true;
+        self.visitDefault(call);
+    }));
+    return found;
+}
+
+std::optional<CasePattern> casePattern(const CaseStatement& stmt, const Expression& item) {
+    uint32_t width = exprWidth(stmt.expr);
+    if (width == 0)
+        return std::nullopt;
+    const Expression* expr = &item;
+    while (expr->kind == ExpressionKind::Conversion)
+        expr = &expr->as<ConversionExpression>().operand();
+    CasePattern pattern;
+    pattern.mask = widthMask(width);
+    SVInt literal;
+    if (expr->kind == ExpressionKind::IntegerLiteral) {
+        literal = expr->as<IntegerLiteral>().getValue();
+    } else if (expr->kind == ExpressionKind::UnbasedUnsizedIntegerLiteral) {
+        literal = expr->as<UnbasedUnsizedIntegerLiteral>().getValue();
+    } else {
+        auto value = constantInt(item);
+        if (!value)
+            return std::nullopt;
+        pattern.value = static_cast<uint64_t>(*value) & pattern.mask;
+        return pattern;
+    }
+
+    uint32_t bits = literal.getBitWidth();
+    if (bits == 0)
+        return std::nullopt;
+    // Past its MSB a literal extends with its sign bit, or with x/z.
+    bool extend = literal.isSigned() || literal[static_cast<int32_t>(bits - 1)].isUnknown();
+    for (uint32_t i = 0; i < width; ++i) {
+        if (i >= bits && !extend)
+            break;
+        logic_t bit = literal[static_cast<int32_t>(std::min(i, bits - 1))];
+        if (bit.isUnknown()) {
+            bool wildcard = stmt.condition == CaseStatementCondition::WildcardXOrZ ||
+                            (stmt.condition == CaseStatementCondition::WildcardJustZ &&
+                             bit.value == logic_t::Z_VALUE);
+            if (wildcard)
+                pattern.mask &= ~(1ULL << i);
+            else
+                pattern.never = true;
+        } else if (bit.value) {
+            pattern.value |= 1ULL << i;
+        }
+    }
+    return pattern;
+}
+
+namespace {
+
+// Loops with more iterations than this are left to the AST fallback.
+constexpr size_t kMaxLoopTrips = 1 << 16;
+
+bool refersTo(const Expression& expr, const ValueSymbol& var) {
+    const Expression* e = &expr;
+    while (e->kind == ExpressionKind::Conversion)
+        e = &e->as<ConversionExpression>().operand();
+    return e->kind == ExpressionKind::NamedValue &&
+           &e->as<NamedValueExpression>().symbol == &var;
+}
+
+// The constant a step expression adds to `var`: `i++`, `i--`, `i += k`, `i = i - k`.
+std::optional<int64_t> loopStep(const Expression& step, const ValueSymbol& var) {
+    if (step.kind == ExpressionKind::UnaryOp) {
+        auto& un = step.as<UnaryExpression>();
+        if (!refersTo(un.operand(), var))
+            return std::nullopt;
+        switch (un.op) {
+            case UnaryOperator::Preincrement:
+            case UnaryOperator::Postincrement:
+                return 1;
+            case UnaryOperator::Predecrement:
+            case UnaryOperator::Postdecrement:
+                return -1;
+            default:
+                return std::nullopt;
+        }
+    }
+    if (step.kind != ExpressionKind::Assignment)
+        return std::nullopt;
+    auto& a = step.as<AssignmentExpression>();
+    if (!refersTo(a.left(), var) || a.right().kind != ExpressionKind::BinaryOp)
+        return std::nullopt;
+    // A compound assignment's right-hand side is `<lvalue> op rhs`.
+    auto& bin = a.right().as<BinaryExpression>();
+    if (!a.isCompound() && !refersTo(bin.left(), var))
+        return std::nullopt;
+    auto amount = constantInt(bin.right());
+    if (!amount)
+        return std::nullopt;
+    if (bin.op == BinaryOperator::Add)
+        return *amount;
+    if (bin.op == BinaryOperator::Subtract)
+        return -*amount;
+    return std::nullopt;
+}
+
+bool writes(const Statement& body, const ValueSymbol& var) {
+    bool found = false;
+    auto visitor = makeVisitor(
+        [&](auto& self, const AssignmentExpression& a) {
+            if (a.left().getSymbolReference() == &var)
+                found = true;
+            self.visitDefault(a);
+        },
+        [&](auto& self, const UnaryExpression& un) {
+            bool step = un.op == UnaryOperator::Preincrement ||
+                        un.op == UnaryOperator::Postincrement ||
+                        un.op == UnaryOperator::Predecrement ||
+                        un.op == UnaryOperator::Postdecrement;
+            if (step && un.operand().getSymbolReference() == &var)
+                found = true;
+            self.visitDefault(un);
+        });
+    body.visit(visitor);
+    return found;
+}
+
+const Statement& singleStatement(const Statement& stmt) {
+    if (stmt.kind == StatementKind::Block)
+        return singleStatement(stmt.as<BlockStatement>().body);
+    if (stmt.kind == StatementKind::List && stmt.as<StatementList>().list.size() == 1)
+        return singleStatement(*stmt.as<StatementList>().list[0]);
+    return stmt;
+}
+
+std::optional<LoopReduction> loopReduction(const ForLoopStatement& loop,
+                                           const ConstantLoop& bounds) {
+    auto& stmt = singleStatement(loop.body);
+    if (stmt.kind != StatementKind::ExpressionStatement)
+        return std::nullopt;
+    auto& es = stmt.as<ExpressionStatement>();
+    if (es.expr.kind != ExpressionKind::Assignment)
+        return std::nullopt;
+    auto& a = es.expr.as<AssignmentExpression>();
+    if (a.isNonBlocking() || a.left().kind != ExpressionKind::NamedValue ||
+        a.right().kind != ExpressionKind::BinaryOp || exprWidth(a.left()) == 0)
+        return std::nullopt;
+    auto& acc = a.left().as<NamedValueExpression>().symbol;
+    auto& bin = a.right().as<BinaryExpression>();
+    const Expression* operand = &bin.right();
+    if (!a.isCompound()) {
+        if (refersTo(bin.right(), acc))
+            operand = &bin.left();
+        else if (!refersTo(bin.left(), acc))
+            return std::nullopt;
+    }
+
+    LoopReduction red;
+    red.acc = &acc;
+    switch (bin.op) {
+        case BinaryOperator::BinaryXor:
+            red.op = ir::Op::Xor;
+            break;
+        case BinaryOperator::BinaryOr:
+            red.op = ir::Op::Or;
+            break;
+        case BinaryOperator::BinaryAnd:
+            red.op = ir::Op::And;
+            break;
+        case BinaryOperator::Add:
+            red.op = ir::Op::Add;
+            break;
+        default:
+            return std::nullopt;
+    }
+
+    // `x[i]`, zero-extended to the accumulator, over single bits of a packed vector.
+    while (operand->kind == ExpressionKind::Conversion) {
+        auto& conv = operand->as<ConversionExpression>();
+        if (conv.operand().type->isSigned())
+            return std::nullopt;
+        operand = &conv.operand();
+    }
+    if (operand->kind != ExpressionKind::ElementSelect)
+        return std::nullopt;
+    auto& sel = operand->as<ElementSelectExpression>();
+    if (!refersTo(sel.selector(), *bounds.var) ||
+        sel.value().kind != ExpressionKind::NamedValue)
+        return std::nullopt;
+    auto& source = sel.value().as<NamedValueExpression>().symbol;
+    const Type& type = *sel.value().type;
+    if (&source == &acc || &source == bounds.var || !type.isIntegral() ||
+        type.getBitWidth() > 64)
+        return std::nullopt;
+    ConstantRange range = type.getFixedRange();
+    if (range.width() != type.getBitWidth())
+        return std::nullopt;
+
+    // The bits visited must be distinct and contiguous; their order does not matter.
+    bool isSigned = bounds.var->getType().isSigned();
+    int64_t lo = INT64_MAX;
+    int64_t hi = INT64_MIN;
+    for (uint64_t v : bounds.values) {
+        int64_t index = isSigned ? static_cast<int64_t>(sext(v, bounds.width))
+                                 : static_cast<int64_t>(v);
+        int64_t bit = range.isLittleEndian() ? index - range.lower() : range.upper() - index;
+        if (bit < 0 || bit >= static_cast<int64_t>(range.width()))
+            return std::nullopt;
+        lo = std::min(lo, bit);
+        hi = std::max(hi, bit);
+    }
+    if (bounds.values.empty() || hi - lo + 1 != static_cast<int64_t>(bounds.values.size()))
+        return std::nullopt;
+    red.source = &sel.value();
+    red.offset = static_cast<uint32_t>(lo);
+    red.count = static_cast<uint32_t>(bounds.values.size());
+    return red;
+}
+
+} // namespace
+
+std::optional<ConstantLoop> constantLoop(const ForLoopStatement& loop) {
+    ConstantLoop result;
+    const Expression* init = nullptr;
+    if (loop.loopVars.size() == 1 && loop.initializers.empty()) {
+        result.var = loop.loopVars[0];
+        result.declared = true;
+        init = result.var->getInitializer();
+    } else if (loop.loopVars.empty() && loop.initializers.size() == 1 &&
+               loop.initializers[0]->kind == ExpressionKind::Assignment) {
+        auto& a = loop.initializers[0]->as<AssignmentExpression>();
+        if (!a.isCompound() && a.left().kind == ExpressionKind::NamedValue) {
+            result.var = &a.left().as<NamedValueExpression>().symbol;
+            init = &a.right();
+        }
+    }
+    if (!result.var || !init || !loop.stopExpr || loop.steps.size() != 1 ||
+        loop.stopExpr->kind != ExpressionKind::BinaryOp)
+        return std::nullopt;
+    const Type& type = result.var->getType();
+    result.width = type.isIntegral() ? type.getBitWidth() : 0;
+    auto start = constantInt(*init);
+    auto step = loopStep(*loop.steps[0], *result.var);
+    if (result.width == 0 || result.width > 64 || !start || !step || *step == 0 ||
+        writes(loop.body, *result.var))
+        return std::nullopt;
+
+    // `var op bound` or `bound op var`, compared in the operands' common type.
+    auto& stop = loop.stopExpr->as<BinaryExpression>();
+    bool varLeft = refersTo(stop.left(), *result.var);
+    if (!varLeft && !refersTo(stop.right(), *result.var))
+        return std::nullopt;
+    auto bound = constantInt(varLeft ? stop.right() : stop.left());
+    uint32_t cmpWidth = exprWidth(stop.left());
+    if (!bound || cmpWidth == 0)
+        return std::nullopt;
+    bool cmpSigned = stop.left().type->isSigned();
+    uint64_t limit = static_cast<uint64_t>(*bound) & widthMask(cmpWidth);
+    auto holds = [&](uint64_t v) {
+        uint64_t value = type.isSigned() ? sext(v, result.width) : v;
+        value &= widthMask(cmpWidth);
+        uint64_t l = varLeft ? value : limit;
+        uint64_t r = varLeft ? limit : value;
+        switch (stop.op) {
+            case BinaryOperator::LessThan:
+                return cmpSigned ? slt(l, r, cmpWidth) : l < r;
+            case BinaryOperator::LessThanEqual:
+                return cmpSigned ? sle(l, r, cmpWidth) : l <= r;
+            case BinaryOperator::GreaterThan:
+                return cmpSigned ? slt(r, l, cmpWidth) : r < l;
+            case BinaryOperator::GreaterThanEqual:
+                return cmpSigned ? sle(r, l, cmpWidth) : r <= l;
+            case BinaryOperator::Inequality:
+                return l != r;
+            default:
+                return false;
+        }
+    };
+    switch (stop.op) {
+        case BinaryOperator::LessThan:
+        case BinaryOperator::LessThanEqual:
+        case BinaryOperator::GreaterThan:
+        case BinaryOperator::GreaterThanEqual:
+        case BinaryOperator::Inequality:
+            break;
+        default:
+            return std::nullopt;
+    }
+
+    uint64_t mask = widthMask(result.width);
+    uint64_t v = static_cast<uint64_t>(*start) & mask;
+    while (holds(v)) {
+        if (result.values.size() == kMaxLoopTrips)
+            return std::nullopt;
+        result.values.push_back(v);
+        v = (v + static_cast<uint64_t>(*step)) & mask;
+    }
+    result.exit = v;
+    result.reduction = loopReduction(loop, result);
+    return result;
+}
+
+LoweredModule lowerModule(const InstanceBodySymbol& body, bool optimize) {
+    LoweredModule lowered;
+    Lowering lowering{body, lowered, {}, {}};
+    lowering.run();
+    if (optimize)
+        lowered.stats = ir::optimize(lowered.ir);
+    lowered.shared = ir::sharedNodes(lowered.ir);
+    return lowered;
+}
+
+} // namespace sim
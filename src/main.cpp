@@ -1,3 +1,5 @@
+#include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <memory>
@@ -6,11 +8,12 @@
 #include <vector>
 
 #include "slang/ast/Compilation.h"
-#include "slang/diagnostics/DiagnosticEngine.h"
 
 #include "sim/codegen.h"
 #include "sim/frontend.h"
+#include "sim/runtime.h"
 #include "sim/simulator.h"
+#include "sim/watch.h"
 
 namespace {
 
@@ -56,7 +59,12 @@ int main(int argc, char** argv) {
     std::string topName;
     std::string astOutPath;
     std::string cppOutDir;
+    std::string watchExec;
+    sim::CodegenOptions codegenOptions;
     bool runSim = true;
+    bool watch = false;
+    bool stats = false;
+    uint64_t seed = 0;
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -66,6 +74,38 @@ int main(int argc, char** argv) {
             cppOutDir = argv[++i];
         } else if (arg == "--no-sim") {
             runSim = false;
+        } else if (arg == "--lanes" && i + 1 < argc) {
+            int lanes = std::atoi(argv[++i]);
+            if (lanes < 1 || lanes > 64) {
+                std::cerr << "--lanes must be between 1 and 64\n";
+                return 1;
+            }
+            codegenOptions.lanes = static_cast<uint32_t>(lanes);
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg == "--four-state") {
+            codegenOptions.fourState = true;
+        } else if (arg == "--coverage") {
+            codegenOptions.coverage = true;
+        } else if (arg == "--cycle") {
+            codegenOptions.cycle = true;
+        } else if (arg == "--no-opt") {
+            codegenOptions.optimize = false;
+        } else if (arg == "--ir-stats") {
+            codegenOptions.irStats = true;
+        } else if (arg == "--partition" && i + 1 < argc) {
+            codegenOptions.partitions.push_back(argv[++i]);
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--watch-exec" && i + 1 < argc) {
+            watchExec = argv[++i];
+        } else if (arg.rfind("+seed=", 0) == 0) {
+            char* end = nullptr;
+            seed = std::strtoull(arg.c_str() + 6, &end, 0);
+            if (end == arg.c_str() + 6 || *end != '\0') {
+                std::cerr << "Invalid seed plusarg: " << arg << "\n";
+                return 1;
+            }
         } else if (arg == "--top" && i + 1 < argc) {
             topName = argv[++i];
         } else if (arg == "-file" && i + 1 < argc) {
@@ -95,7 +135,23 @@ int main(int argc, char** argv) {
         return 1;
     }
 
+    if (watch) {
+        if (cppOutDir.empty()) {
+            std::cerr << "--watch requires --cpp-out <dir>\n";
+            return 1;
+        }
+        sim::WatchOptions options;
+        options.files = inputFiles;
+        options.topName = topName;
+        options.cppOutDir = cppOutDir;
+        options.codegen = codegenOptions;
+        options.onChange = watchExec;
+        options.runSim = runSim;
+        return sim::runWatch(options);
+    }
+
     slang::ast::Compilation compilation;
+    sim::registerSystemTasks(compilation);
     std::vector<std::shared_ptr<slang::syntax::SyntaxTree>> trees;
     for (const auto& path : inputFiles) {
         auto tree = sim::loadFile(path);
@@ -107,16 +163,7 @@ int main(int argc, char** argv) {
     for (const auto& tree : trees)
         compilation.addSyntaxTree(tree);
 
-    const auto& diags = compilation.getAllDiagnostics();
-    if (!diags.empty()) {
-        const auto* sourceManager = compilation.getSourceManager();
-        if (sourceManager) {
-            std::string report = slang::DiagnosticEngine::reportAll(*sourceManager, diags);
-            if (!report.empty())
-                std::cerr << report;
-        }
-    }
-    if (compilation.hasIssuedErrors())
+    if (!sim::reportDiagnostics(compilation))
         return 1;
 
     if (!astOutPath.empty()) {
@@ -131,14 +178,23 @@ int main(int argc, char** argv) {
     }
 
     if (!cppOutDir.empty()) {
-        if (!sim::writeCppOutput(*top, cppOutDir))
+        if (!sim::writeCppOutput(*top, cppOutDir, codegenOptions))
             return 1;
     }
 
     if (runSim) {
-        sim::Simulator sim(compilation, *top);
+        auto start = std::chrono::steady_clock::now();
+        sim::Simulator sim(compilation, *top, codegenOptions.optimize);
         sim.build();
+        sim.setSeed(seed);
+        if (codegenOptions.irStats)
+            sim.reportIr(std::cerr);
         sim.run();
+        if (stats) {
+            double seconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            sim::reportStats(std::cerr, sim.eventCount(), sim.time(), seconds);
+        }
     }
     return 0;
 }
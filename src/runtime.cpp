@@ -1,8 +1,38 @@
 #include "sim/runtime.h"
 
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "sim/format.h"
+#include "sim/partition.h"
+#include "sim/stimulus.h"
 
 namespace sim {
 
@@ -15,9 +45,38 @@ uint64_t maskToWidth(uint64_t value, uint32_t width) {
     return value & mask;
 }
 
+enum class Level {
+    Zero,
+    One,
+    Unknown
+};
+
+Level levelOf(uint64_t value, uint64_t unknown) {
+    if (unknown & 1)
+        return Level::Unknown;
+    return (value & 1) ? Level::One : Level::Zero;
+}
+
+std::atomic<uint64_t> droppedSamples{0};
+std::atomic<uint32_t> profilerHz{0};
+
+// The kernel whose run() is executing on this thread, for the SIGPROF handler.
+thread_local Kernel* runningKernel = nullptr;
+
 } // namespace
 
-Signal::Signal(uint32_t width) : width_(width ? width : 1) {}
+Signal::Signal(uint32_t width, Init init) : width_(width ? width : 1) {
+    if (init == Init::X) {
+        value_ = maskToWidth(~0ULL, width_);
+        unknown_ = value_;
+    } else if (init == Init::Z) {
+        unknown_ = maskToWidth(~0ULL, width_);
+    }
+}
+
+Kernel::Kernel() {
+    sourceSites.push_back({"", "<kernel>", "", 0});
+}
 
 void Signal::attach(Kernel* kernel) {
     if (!kernel_)
@@ -26,19 +85,62 @@ void Signal::attach(Kernel* kernel) {
 
 void Signal::set(uint64_t value) {
     uint64_t masked = maskToWidth(value, width_);
-    if (value_ == masked)
+    if (value_ == masked && unknown_ == 0)
+        return;
+
+    uint64_t old = value_;
+    uint64_t oldUnknown = unknown_;
+    value_ = masked;
+    unknown_ = 0;
+    if (toggle_)
+        toggle_->record(old & ~oldUnknown, masked & ~oldUnknown);
+
+    if (kernel_)
+        kernel_->onSignalChange(*this, old, masked, oldUnknown, 0);
+}
+
+void Signal::set(Logic4 value) {
+    uint64_t masked = maskToWidth(value.value, width_);
+    uint64_t maskedUnknown = maskToWidth(value.unknown, width_);
+    if (value_ == masked && unknown_ == maskedUnknown)
         return;
 
     uint64_t old = value_;
+    uint64_t oldUnknown = unknown_;
     value_ = masked;
+    unknown_ = maskedUnknown;
+    if (toggle_) {
+        // Only transitions between known values count.
+        uint64_t known = ~(oldUnknown | maskedUnknown);
+        toggle_->record(old & known, masked & known);
+    }
+
+    if (kernel_)
+        kernel_->onSignalChange(*this, old, masked, oldUnknown, maskedUnknown);
+}
 
+void Signal::notifyChange(uint64_t oldValue, uint64_t newValue) {
+    value_ = newValue;
     if (kernel_)
-        kernel_->onSignalChange(*this, old, masked);
+        kernel_->onSignalChange(*this, oldValue, newValue);
+}
+
+void Signal::dpiCommit(uint64_t oldValue, uint64_t oldUnknown, uint32_t bits, bool isSigned) {
+    uint64_t raw = value_;
+    if (bits < 64) {
+        raw &= widthMask(bits);
+        if (isSigned && bits > 0 && ((raw >> (bits - 1)) & 1))
+            raw |= ~widthMask(bits);
+    }
+    value_ = oldValue;
+    unknown_ = oldUnknown;
+    set(raw);
 }
 
 void Kernel::register_continuous(Callback cb, const std::vector<Signal*>& deps) {
     auto proc = std::make_unique<Process>();
     proc->run = std::move(cb);
+    proc->site = site();
 
     for (auto* sig : deps) {
         if (!sig)
@@ -54,6 +156,7 @@ void Kernel::register_continuous(Callback cb, const std::vector<Signal*>& deps)
 void Kernel::register_edge(Callback cb, const std::vector<EdgeEvent>& deps) {
     auto proc = std::make_unique<Process>();
     proc->run = std::move(cb);
+    proc->site = site();
 
     for (const auto& dep : deps) {
         if (!dep.signal)
@@ -77,58 +180,38 @@ void Kernel::register_edge(Callback cb, const std::vector<EdgeEvent>& deps) {
 }
 
 void Kernel::register_monitor(const std::string& format, const std::vector<MonitorArg>& args) {
+    enable_monitor(define_monitor(format, args));
+}
+
+uint32_t Kernel::define_monitor(const std::string& format, const std::vector<MonitorArg>& args) {
     auto mon = std::make_unique<Monitor>();
     mon->format = format;
     mon->args = args;
+    monitors.push_back(std::move(mon));
+    return static_cast<uint32_t>(monitors.size() - 1);
+}
+
+void Kernel::enable_monitor(uint32_t id) {
+    enableMonitor(id, true);
+}
+
+void Kernel::enableMonitor(uint32_t id, bool printNow) {
+    if (id >= monitors.size() || monitors[id]->enabled)
+        return;
+    Monitor* mon = monitors[id].get();
+    mon->enabled = true;
 
     auto proc = std::make_unique<Process>();
-    proc->run = [this, monPtr = mon.get()]() {
-        std::string out;
-        size_t argIndex = 0;
-        for (size_t i = 0; i < monPtr->format.size(); ++i) {
-            if (monPtr->format[i] != '%' || i + 1 >= monPtr->format.size()) {
-                out.push_back(monPtr->format[i]);
-                continue;
-            }
-            if (monPtr->format[i + 1] == '%') {
-                out.push_back('%');
-                i++;
-                continue;
-            }
-            std::string spec;
-            spec.push_back(monPtr->format[i + 1]);
-            if (monPtr->format[i + 1] == '0' && i + 2 < monPtr->format.size()) {
-                spec.push_back(monPtr->format[i + 2]);
-                i++;
-            }
-            i++;
-            if (argIndex >= monPtr->args.size())
-                continue;
-            const auto& arg = monPtr->args[argIndex++];
-            uint64_t value = 0;
-            uint32_t width = 64;
-            if (arg.kind == MonitorArgKind::Time) {
-                value = currentTime;
-                width = 64;
-            } else if (arg.signal) {
-                value = arg.signal->value();
-                width = arg.signal->width();
-            }
-            if (spec == "0t") {
-                out += std::to_string(value);
-            } else if (spec == "b") {
-                std::string bits;
-                for (int bit = int(width) - 1; bit >= 0; --bit)
-                    bits.push_back(((value >> bit) & 1U) ? '1' : '0');
-                out += bits;
-            } else if (spec == "d") {
-                out += std::to_string(value);
-            } else {
-                out.push_back('%');
-                out += spec;
-            }
+    proc->site = site();
+    proc->run = [this, mon]() {
+        // Multi-lane designs print one line per lane.
+        uint32_t lanes = 1;
+        for (const auto& arg : mon->args) {
+            if (arg.kind == MonitorArgKind::Signal && arg.signal)
+                lanes = std::max(lanes, arg.signal->laneCount());
         }
-        std::cout << out << "\n";
+        for (uint32_t lane = 0; lane < lanes; ++lane)
+            output() << formatMonitor(*mon, lane, lanes) << "\n";
     };
 
     for (const auto& arg : mon->args) {
@@ -138,35 +221,248 @@ void Kernel::register_monitor(const std::string& format, const std::vector<Monit
         arg.signal->monitorSensitive.push_back(proc.get());
     }
 
-    monitors.push_back(std::move(mon));
     processes.push_back(std::move(proc));
+    if (printNow)
+        scheduleProcess(*processes.back(), currentTime);
+}
 
-    scheduleProcess(*processes.back(), currentTime);
+std::string Kernel::formatMonitor(const Monitor& mon, uint32_t lane, uint32_t laneCount) const {
+    std::string out;
+    if (laneCount > 1)
+        out += "[lane " + std::to_string(lane) + "] ";
+    size_t argIndex = 0;
+    for (size_t i = 0; i < mon.format.size(); ++i) {
+        if (mon.format[i] != '%' || i + 1 >= mon.format.size()) {
+            out.push_back(mon.format[i]);
+            continue;
+        }
+        if (mon.format[i + 1] == '%') {
+            out.push_back('%');
+            i++;
+            continue;
+        }
+        std::string spec;
+        spec.push_back(mon.format[i + 1]);
+        if (mon.format[i + 1] == '0' && i + 2 < mon.format.size()) {
+            spec.push_back(mon.format[i + 2]);
+            i++;
+        }
+        i++;
+        if (argIndex >= mon.args.size())
+            continue;
+        const auto& arg = mon.args[argIndex++];
+        uint64_t value = 0;
+        uint64_t unknown = 0;
+        uint32_t width = 64;
+        if (arg.kind == MonitorArgKind::Time) {
+            value = currentTime;
+            width = 64;
+        } else if (arg.signal) {
+            value = arg.signal->laneValue(std::min(lane, arg.signal->laneCount() - 1));
+            unknown = arg.signal->unknown();
+            width = arg.signal->width();
+        }
+        if (!formatMonitorValue(out, spec, value, unknown, width)) {
+            out.push_back('%');
+            out += spec;
+        }
+    }
+    return out;
 }
 
 void Kernel::schedule_at(uint64_t time, Callback cb) {
-    scheduleAt(time, std::move(cb));
+    scheduleAt(time, std::move(cb), site());
+}
+
+uint32_t Kernel::add_resumable(Resumable fn) {
+    resumables.push_back({std::move(fn), site()});
+    return static_cast<uint32_t>(resumables.size() - 1);
+}
+
+void Kernel::schedule_resumable(uint64_t time, uint32_t id) {
+    scheduleResumable(time, nextOrder++, id);
+}
+
+void Kernel::scheduleResumable(uint64_t time, uint64_t order, uint32_t id) {
+    Event event{time, order, [this, id]() { resumables[id].fn(id); }, resumables[id].site, id};
+    if (time == currentTime)
+        activeQueue.push_back(std::move(event));
+    else
+        eventQueue.push(std::move(event));
+}
+
+void Kernel::track(std::initializer_list<Signal*> signals) {
+    for (auto* sig : signals) {
+        if (sig)
+            trackedSignals.push_back(sig);
+    }
+}
+
+void Kernel::track(std::string_view scope,
+                   std::initializer_list<std::pair<const char*, Signal*>> signals) {
+    for (const auto& [name, sig] : signals) {
+        if (!sig)
+            continue;
+        trackedSignals.push_back(sig);
+        if (toggleEnabled) {
+            trackedNames.resize(trackedSignals.size() - 1);
+            trackedNames.push_back(std::string(scope) + "." + name);
+        }
+    }
+}
+
+bool Kernel::collect_toggle_coverage(ToggleCoverage& db) const {
+    // The design may already be destroyed; everything needed was captured by run().
+    ToggleCoverage run;
+    run.signature = toggleSignature;
+    run.runs = 1;
+    run.widths = toggleWidths;
+    run.counters = toggleCounters;
+    run.names.resize(toggleCounters.size());
+    for (size_t i = 0; i < run.names.size(); ++i) {
+        run.names[i] = i < trackedNames.size() && !trackedNames[i].empty()
+                           ? trackedNames[i]
+                           : "signal" + std::to_string(i);
+    }
+    return db.merge(run);
+}
+
+bool ToggleCoverage::merge(const ToggleCoverage& other) {
+    if (other.empty())
+        return true;
+    if (empty()) {
+        *this = other;
+        return true;
+    }
+    if (signature != other.signature || widths != other.widths) {
+        std::cerr << "toggle coverage: databases are from different designs\n";
+        return false;
+    }
+    runs += other.runs;
+    for (size_t i = 0; i < counters.size(); ++i)
+        counters[i].merge(other.counters[i]);
+    return true;
+}
+
+bool LineCoverage::merge(const LineCoverage& other) {
+    if (other.empty())
+        return true;
+    if (empty()) {
+        *this = other;
+        return true;
+    }
+    // Check every class first so a mismatch leaves this database untouched.
+    std::vector<Module*> targets;
+    for (const auto& theirs : other.modules) {
+        auto it = std::find_if(modules.begin(), modules.end(),
+                               [&](const Module& m) { return m.name == theirs.name; });
+        if (it != modules.end() &&
+            (it->lines != theirs.lines || it->files != theirs.files || it->kinds != theirs.kinds)) {
+            std::cerr << "line coverage: " << theirs.name
+                      << " has different coverage points; databases are from different sources\n";
+            return false;
+        }
+        targets.push_back(it != modules.end() ? &*it : nullptr);
+    }
+    for (size_t m = 0; m < other.modules.size(); ++m) {
+        if (!targets[m]) {
+            modules.push_back(other.modules[m]);
+            continue;
+        }
+        for (size_t i = 0; i < targets[m]->counts.size(); ++i)
+            targets[m]->counts[i] += other.modules[m].counts[i];
+    }
+    runs += other.runs;
+    return true;
+}
+
+uint64_t* Kernel::cover(const char* module, const CoverPoint* points, uint32_t count) {
+    for (auto& region : coverRegions) {
+        if (region.module == module && region.count == count)
+            return region.counters.get();
+    }
+    coverRegions.push_back({module, points, count, std::make_unique<uint64_t[]>(count)});
+    return coverRegions.back().counters.get();
+}
+
+bool Kernel::collect_line_coverage(LineCoverage& db) const {
+    LineCoverage run;
+    run.runs = 1;
+    for (const auto& region : coverRegions) {
+        LineCoverage::Module module;
+        module.name = region.module;
+        for (uint32_t i = 0; i < region.count; ++i) {
+            module.kinds.emplace_back(region.points[i].kind);
+            module.files.emplace_back(region.points[i].file);
+            module.lines.push_back(region.points[i].line);
+            module.counts.push_back(region.counters[i]);
+        }
+        run.modules.push_back(std::move(module));
+    }
+    return db.merge(run);
+}
+
+void Kernel::track_memory(std::initializer_list<Memory*> memories) {
+    for (auto* mem : memories) {
+        if (mem)
+            trackedMemories.push_back(mem);
+    }
+}
+
+void Kernel::track_random(std::initializer_list<ProcessRandom*> streams) {
+    for (auto* stream : streams) {
+        if (stream)
+            trackedRandoms.push_back(stream);
+    }
+}
+
+uint32_t Kernel::add_site(std::string scope, std::string process, std::string file,
+                          uint32_t line) {
+    sourceSites.push_back({std::move(scope), std::move(process), std::move(file), line});
+    return static_cast<uint32_t>(sourceSites.size() - 1);
 }
 
 void Kernel::nba_assign(Signal& signal, uint64_t value) {
     signal.attach(this);
-    nbaQueue.push_back({&signal, value});
+    nbaQueue.push_back({&signal, value, 0});
+}
+
+void Kernel::nba_assign(Signal& signal, Logic4 value) {
+    signal.attach(this);
+    nbaQueue.push_back({&signal, value.value, value.unknown});
+}
+
+void Kernel::nba_assign(Signal& signal, uint64_t value, uint64_t mask) {
+    signal.attach(this);
+    nbaQueue.push_back({&signal, value, 0, mask});
 }
 
-void Kernel::scheduleAt(uint64_t time, Callback action) {
+void Kernel::nba_write(Memory& mem, uint64_t addr, uint64_t value) {
+    mem.attach(this);
+    memoryNbaQueue.push_back({&mem, addr, value});
+}
+
+void Kernel::nba_defer(Callback commit) {
+    nbaDeferred.push_back(std::move(commit));
+}
+
+void Kernel::scheduleAt(uint64_t time, Callback action, uint32_t site) {
     uint64_t order = nextOrder++;
     if (time == currentTime) {
-        activeQueue.push_back(Event{time, order, std::move(action)});
+        activeQueue.push_back(Event{time, order, std::move(action), site});
         return;
     }
-    eventQueue.push(Event{time, order, std::move(action)});
+    eventQueue.push(Event{time, order, std::move(action), site});
 }
 
 void Kernel::scheduleProcess(Process& proc, uint64_t at) {
-    scheduleAt(at, [&proc]() {
-        proc.scheduled = false;
-        proc.run();
-    });
+    scheduleAt(
+        at,
+        [&proc]() {
+            proc.scheduled = false;
+            proc.run();
+        },
+        proc.site);
     proc.scheduled = true;
 }
 
@@ -174,28 +470,49 @@ void Kernel::applyNba() {
     auto pending = std::move(nbaQueue);
     nbaQueue.clear();
     for (const auto& nba : pending) {
-        if (nba.signal)
-            nba.signal->set(nba.value);
+        if (!nba.signal)
+            continue;
+        uint64_t value = sim::deposit(nba.signal->value(), nba.value, nba.mask);
+        uint64_t unknown = sim::deposit(nba.signal->unknown(), nba.unknown, nba.mask);
+        if (unknown)
+            nba.signal->set(Logic4{value, unknown});
+        else
+            nba.signal->set(value);
     }
+
+    auto memoryWrites = std::move(memoryNbaQueue);
+    memoryNbaQueue.clear();
+    for (const auto& write : memoryWrites)
+        write.memory->write(write.addr, write.value);
+
+    auto deferred = std::move(nbaDeferred);
+    nbaDeferred.clear();
+    for (auto& commit : deferred)
+        commit();
 }
 
-void Kernel::onSignalChange(Signal& signal, uint64_t oldValue, uint64_t newValue) {
+void Kernel::onSignalChange(Signal& signal, uint64_t oldValue, uint64_t newValue,
+                            uint64_t oldUnknown, uint64_t newUnknown) {
     for (auto* proc : signal.levelSensitive) {
         if (!proc->scheduled)
             scheduleProcess(*proc, currentTime);
     }
 
-    bool oldZero = (oldValue == 0);
-    bool newZero = (newValue == 0);
+    // Edges follow IEEE 1800 table 9-2 on the least significant bit: posedge is 0->1/X/Z
+    // or X/Z->1, negedge is 1->0/X/Z or X/Z->0.
+    Level oldLevel = levelOf(oldValue, oldUnknown);
+    Level newLevel = levelOf(newValue, newUnknown);
 
-    if (oldZero && !newZero) {
+    if ((oldLevel == Level::Zero && newLevel != Level::Zero) ||
+        (oldLevel == Level::Unknown && newLevel == Level::One)) {
         for (auto* proc : signal.posedgeSensitive) {
             if (!proc->scheduled)
                 scheduleProcess(*proc, currentTime);
         }
     }
 
-    if (!oldZero && newZero) {
+    if ((oldLevel == Level::One && newLevel != Level::One) ||
+        (oldLevel == Level::Unknown && newLevel == Level::Zero)) {
         for (auto* proc : signal.negedgeSensitive) {
             if (!proc->scheduled)
                 scheduleProcess(*proc, currentTime);
@@ -208,27 +525,2013 @@ void Kernel::onSignalChange(Signal& signal, uint64_t oldValue, uint64_t newValue
     }
 }
 
-void Kernel::run() {
-    while (!finished && (!eventQueue.empty() || !activeQueue.empty() || !nbaQueue.empty())) {
-        if (activeQueue.empty() && !eventQueue.empty()) {
-            uint64_t nextTime = eventQueue.top().time;
-            currentTime = nextTime;
-            while (!eventQueue.empty() && eventQueue.top().time == nextTime) {
-                Event event = eventQueue.top();
-                eventQueue.pop();
-                activeQueue.push_back(std::move(event));
+std::ostream& Kernel::output() {
+    return outputStream ? *outputStream : std::cout;
+}
+
+bool Kernel::test_plusargs(std::string_view name) const {
+    for (const auto& arg : plusargs) {
+        if (arg.size() > 1 && std::string_view(arg).substr(1).rfind(name, 0) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool Kernel::value_plusargs(std::string_view prefix, std::string& value) const {
+    for (const auto& arg : plusargs) {
+        std::string_view text(arg);
+        if (text.size() > 1 && text.substr(1).rfind(prefix, 0) == 0) {
+            value = std::string(text.substr(1 + prefix.size()));
+            return true;
+        }
+    }
+    return false;
+}
+
+void Kernel::set_fork_options(std::string outPrefix,
+                              std::vector<std::vector<std::string>> childPlusargs, bool enabled) {
+    forkPrefix = std::move(outPrefix);
+    forkPlusargs = std::move(childPlusargs);
+    forkEnabled = enabled;
+}
+
+int Kernel::sim_fork(uint32_t count) {
+    // fork() only duplicates the calling thread, so other kernels' threads would vanish in
+    // the children mid-step; runBatch only enables forking for a single instance.
+    if (!forkEnabled || forkIndex != kNotForked) {
+        std::cerr << "$sim_fork: only supported in a single-instance, non-forked run\n";
+        forkFailed = true;
+        finished = true;
+        return -1;
+    }
+
+    // Anything still buffered would otherwise be written once per child.
+    output().flush();
+    std::cout.flush();
+    std::cerr.flush();
+
+    std::vector<pid_t> children;
+    for (uint32_t i = 0; i < count; ++i) {
+        pid_t pid = ::fork();
+        if (pid < 0) {
+            std::cerr << "$sim_fork: fork failed for child " << i << "\n";
+            forkFailed = true;
+            break;
+        }
+        if (pid == 0) {
+            forkIndex = i;
+            seedValue += i + 1;
+            if (!forkPlusargs.empty()) {
+                const auto& extra = forkPlusargs[i % forkPlusargs.size()];
+                plusargs.insert(plusargs.end(), extra.begin(), extra.end());
             }
+            plusargs.push_back("+fork_index=" + std::to_string(i));
+            std::string path = forkPrefix + std::to_string(i) + ".log";
+            auto log = std::make_shared<std::ofstream>(path);
+            if (!*log) {
+                std::cerr << "Failed to open output file: " << path << "\n";
+                forkFailed = true;
+                finished = true;
+                return static_cast<int>(i);
+            }
+            forkLog = log;
+            outputStream = forkLog.get();
+            // A child does not inherit the parent's interval timer; keep sampling it.
+            if (uint32_t hz = profilerHz.load())
+                startProfiler(hz);
+            return static_cast<int>(i);
         }
+        children.push_back(pid);
+    }
 
-        while (!activeQueue.empty()) {
-            auto event = std::move(activeQueue.front());
-            activeQueue.pop_front();
-            event.action();
+    for (size_t i = 0; i < children.size(); ++i) {
+        int status = 0;
+        while (waitpid(children[i], &status, 0) < 0 && errno == EINTR) {
         }
+        int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        std::ifstream log(forkPrefix + std::to_string(i) + ".log");
+        if (log && log.peek() != std::ifstream::traits_type::eof())
+            output() << log.rdbuf();
+        std::cerr << "fork: child " << i << " exited with status " << code << "\n";
+        if (code != 0)
+            forkFailed = true;
+    }
 
-        if (!nbaQueue.empty())
-            applyNba();
+    // The children carry the rest of the run.
+    activeQueue.clear();
+    nbaQueue.clear();
+    memoryNbaQueue.clear();
+    nbaDeferred.clear();
+    finished = true;
+    return -1;
+}
+
+DpiScope* Kernel::dpi_scope(std::string name, void* instance, const void* type) {
+    auto scope = std::make_unique<DpiScope>();
+    scope->name = std::move(name);
+    scope->instance = instance;
+    scope->type = type;
+    scope->kernel = this;
+    dpiScopes.push_back(std::move(scope));
+    return dpiScopes.back().get();
+}
+
+DpiScope* Kernel::find_dpi_scope(std::string_view name) const {
+    for (const auto& scope : dpiScopes) {
+        if (scope->name == name)
+            return scope.get();
     }
+    return nullptr;
 }
 
-} // namespace sim
+void dpiScopeError(const char* function) {
+    std::cerr << "DPI export " << function << " called "
+              << (dpiScope ? "from scope " + dpiScope->name + ", which does not export it"
+                           : std::string("without a current scope"))
+              << "\n";
+    std::abort();
+}
+
+void onProfileSample(int) {
+    Kernel* kernel = runningKernel;
+    if (!kernel) {
+        droppedSamples.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint32_t site = kernel->currentSite.load(std::memory_order_relaxed);
+    if (site < kernel->siteSamples.size())
+        kernel->siteSamples[site]++;
+    else
+        droppedSamples.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool startProfiler(uint32_t hz) {
+    if (hz == 0 || hz > 1000000) {
+        errno = EINVAL;
+        return false;
+    }
+    struct sigaction action {};
+    action.sa_handler = onProfileSample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, nullptr) != 0)
+        return false;
+    // tv_usec must stay below one second, so 1 Hz is a whole second and no microseconds.
+    itimerval timer{};
+    timer.it_interval.tv_sec = static_cast<time_t>(1 / hz);
+    timer.it_interval.tv_usec = static_cast<suseconds_t>((1000000 / hz) % 1000000);
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        int error = errno;
+        signal(SIGPROF, SIG_IGN);
+        errno = error;
+        return false;
+    }
+    profilerHz = hz;
+    return true;
+}
+
+void stopProfiler() {
+    itimerval timer{};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    signal(SIGPROF, SIG_IGN);
+    profilerHz = 0;
+}
+
+uint64_t droppedProfileSamples() {
+    return droppedSamples.load(std::memory_order_relaxed);
+}
+
+bool writeProfile(const std::string& path, const std::vector<SourceSite>& sites,
+                  const std::vector<uint64_t>& samples, uint32_t hz) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to open profile file: " << path << "\n";
+        return false;
+    }
+    out << "# sim-profile hz=" << hz << " dropped=" << droppedProfileSamples() << "\n";
+    for (size_t i = 0; i < sites.size() && i < samples.size(); ++i) {
+        if (samples[i] == 0)
+            continue;
+        const auto& site = sites[i];
+        out << samples[i] << "\t" << site.scope << "\t" << site.process << "\t" << site.file
+            << "\t" << site.line << "\n";
+    }
+    return true;
+}
+
+namespace {
+
+// Per-byte digit classes for memory image files: 0..15 is a digit value.
+constexpr uint8_t kUnknownDigit = 0x40; // x/z, loaded as 0 by the 2-state storage
+constexpr uint8_t kSeparator = 0x41; // '_'
+constexpr uint8_t kSpace = 0x42;
+constexpr uint8_t kInvalid = 0xFF;
+
+std::array<uint8_t, 256> makeDigitTable(uint32_t radix) {
+    std::array<uint8_t, 256> table;
+    table.fill(kInvalid);
+    for (uint32_t d = 0; d < radix && d < 10; ++d)
+        table['0' + d] = static_cast<uint8_t>(d);
+    for (uint32_t d = 10; d < radix; ++d) {
+        table['a' + d - 10] = static_cast<uint8_t>(d);
+        table['A' + d - 10] = static_cast<uint8_t>(d);
+    }
+    for (char c : {'x', 'X', 'z', 'Z', '?'})
+        table[static_cast<uint8_t>(c)] = kUnknownDigit;
+    table['_'] = kSeparator;
+    for (char c : {' ', '\t', '\n', '\r', '\f', '\v'})
+        table[static_cast<uint8_t>(c)] = kSpace;
+    return table;
+}
+
+const std::array<uint8_t, 256> kHexDigits = makeDigitTable(16);
+const std::array<uint8_t, 256> kBinaryDigits = makeDigitTable(2);
+
+// A read-only mapping of a whole file; the pages are faulted in sequentially by the parser.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st {};
+        if (fstat(fd, &st) != 0)
+            return;
+        length = static_cast<size_t>(st.st_size);
+        if (length == 0) {
+            valid = true;
+            return;
+        }
+        void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+            return;
+        madvise(addr, length, MADV_SEQUENTIAL);
+        bytes = static_cast<const char*>(addr);
+        valid = true;
+    }
+    ~MappedFile() {
+        if (bytes)
+            munmap(const_cast<char*>(bytes), length);
+        if (fd >= 0)
+            ::close(fd);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return valid; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    int fd = -1;
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool valid = false;
+};
+
+// Continues accumulating digits of one word from `p`; returns the first byte past the word.
+const char* parseDigits(const char* p, const char* end, const std::array<uint8_t, 256>& table,
+                        uint32_t bitsPerDigit, uint64_t& value) {
+    for (; p < end; ++p) {
+        uint8_t d = table[static_cast<uint8_t>(*p)];
+        if (d < 16)
+            value = (value << bitsPerDigit) | d;
+        else if (d == kUnknownDigit)
+            value <<= bitsPerDigit;
+        else if (d != kSeparator)
+            break;
+    }
+    return p;
+}
+
+#if defined(__SSE2__)
+// Packs 8 nibbles (one per byte, first digit in the lowest byte) into a 32-bit value.
+inline uint64_t packNibbles(uint64_t v) {
+    v = ((v << 4) | (v >> 8)) & 0x00FF00FF00FF00FFULL;
+    v = ((v << 8) | (v >> 16)) & 0x0000FFFF0000FFFFULL;
+    return ((v << 16) | (v >> 32)) & 0xFFFFFFFFULL;
+}
+
+const std::array<uint8_t, 256> kReversedBytes = [] {
+    std::array<uint8_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < 8; ++b)
+            r |= ((i >> b) & 1) << (7 - b);
+        table[i] = static_cast<uint8_t>(r);
+    }
+    return table;
+}();
+
+// Hex words of up to 16 plain digits: classify and convert 16 bytes at once. Anything else
+// (separators, x/z, longer words, the last 15 bytes of the file) takes the scalar loop.
+const char* parseHexWord(const char* p, const char* end, uint64_t& value) {
+    value = 0;
+    if (end - p < 16)
+        return parseDigits(p, end, kHexDigits, 4, value);
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i folded = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(folded, _mm_set1_epi8('f' + 1)));
+    uint32_t valid = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(digit, alpha)));
+    uint32_t len = static_cast<uint32_t>(__builtin_ctz(~valid));
+    const char* next = p + len;
+    if (len == 0 || (next < end && kHexDigits[static_cast<uint8_t>(*next)] != kSpace &&
+                     *next != '/'))
+        return parseDigits(p, end, kHexDigits, 4, value);
+
+    __m128i nibbles = _mm_add_epi8(_mm_and_si128(c, _mm_set1_epi8(0x0F)),
+                                   _mm_and_si128(alpha, _mm_set1_epi8(9)));
+    __m128i index = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    nibbles = _mm_and_si128(nibbles,
+                            _mm_cmplt_epi8(index, _mm_set1_epi8(static_cast<char>(len))));
+    uint64_t low = static_cast<uint64_t>(_mm_cvtsi128_si64(nibbles));
+    uint64_t high = static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(nibbles, nibbles)));
+    uint64_t all = (packNibbles(low) << 32) | packNibbles(high);
+    value = len == 16 ? all : all >> (4 * (16 - len));
+    return next;
+}
+
+// Binary words: 16 digits per step via a byte mask of '1's.
+const char* parseBinaryWord(const char* p, const char* end, uint64_t& value) {
+    value = 0;
+    while (end - p >= 16) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i ones = _mm_cmpeq_epi8(c, _mm_set1_epi8('1'));
+        __m128i bit = _mm_or_si128(ones, _mm_cmpeq_epi8(c, _mm_set1_epi8('0')));
+        uint32_t valid = static_cast<uint32_t>(_mm_movemask_epi8(bit));
+        uint32_t len = static_cast<uint32_t>(__builtin_ctz(~valid));
+        if (len == 0)
+            break;
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(ones)) & ((1U << len) - 1);
+        // movemask puts the first digit in bit 0; words are written MSB first.
+        uint32_t reversed = (static_cast<uint32_t>(kReversedBytes[mask & 0xFF]) << 8) |
+                            kReversedBytes[mask >> 8];
+        value = (value << len) | (reversed >> (16 - len));
+        p += len;
+        if (len < 16)
+            break;
+    }
+    return parseDigits(p, end, kBinaryDigits, 1, value);
+}
+#else
+const char* parseHexWord(const char* p, const char* end, uint64_t& value) {
+    value = 0;
+    return parseDigits(p, end, kHexDigits, 4, value);
+}
+
+const char* parseBinaryWord(const char* p, const char* end, uint64_t& value) {
+    value = 0;
+    return parseDigits(p, end, kBinaryDigits, 1, value);
+}
+#endif
+
+size_t lineOf(const char* begin, const char* p) {
+    return 1 + static_cast<size_t>(std::count(begin, p, '\n'));
+}
+
+} // namespace
+
+bool readMemFile(MemoryStorage& storage, int64_t lower, const std::string& path,
+                 MemFileFormat format, int64_t start, int64_t end, bool& changed) {
+    changed = false;
+    MappedFile file(path);
+    if (!file.ok()) {
+        std::cerr << "$readmem: cannot open " << path << "\n";
+        return false;
+    }
+
+    int64_t upper = lower + static_cast<int64_t>(storage.depth()) - 1;
+    int64_t first = start == kNoAddress ? lower : start;
+    int64_t last = end == kNoAddress ? upper : end;
+    int64_t step = last < first ? -1 : 1;
+    int64_t rangeLow = std::min(first, last);
+    int64_t rangeHigh = std::max(first, last);
+    if (rangeLow < lower || rangeHigh > upper) {
+        std::cerr << "$readmem: address range [" << first << ":" << last << "] of " << path
+                  << " is outside the array\n";
+        return false;
+    }
+
+    const char* begin = file.data();
+    const char* p = begin;
+    const char* stop = begin + file.size();
+    const auto& table = format == MemFileFormat::Hex ? kHexDigits : kBinaryDigits;
+    int64_t addr = first;
+    auto fail = [&](const char* at, const char* what) {
+        std::cerr << path << ":" << lineOf(begin, at) << ": $readmem: " << what << "\n";
+        return false;
+    };
+
+    while (p < stop) {
+        uint8_t cls = table[static_cast<uint8_t>(*p)];
+        if (cls == kSpace) {
+            ++p;
+            continue;
+        }
+        if (*p == '/') {
+            if (p + 1 < stop && p[1] == '/') {
+                const char* eol = static_cast<const char*>(std::memchr(p, '\n', stop - p));
+                p = eol ? eol : stop;
+            } else if (p + 1 < stop && p[1] == '*') {
+                std::string_view rest(p + 2, static_cast<size_t>(stop - p - 2));
+                auto close = rest.find("*/");
+                if (close == std::string_view::npos)
+                    return fail(p, "unterminated comment");
+                p += 2 + close + 2;
+            } else {
+                return fail(p, "unexpected '/'");
+            }
+            continue;
+        }
+        if (*p == '@') {
+            uint64_t target = 0;
+            const char* next = parseDigits(p + 1, stop, kHexDigits, 4, target);
+            if (next == p + 1)
+                return fail(p, "missing address after '@'");
+            auto index = static_cast<int64_t>(target);
+            if (index < rangeLow || index > rangeHigh)
+                return fail(p, "address out of range");
+            addr = index;
+            p = next;
+            continue;
+        }
+
+        uint64_t value = 0;
+        const char* next = format == MemFileFormat::Hex ? parseHexWord(p, stop, value)
+                                                        : parseBinaryWord(p, stop, value);
+        if (next == p || (next < stop && table[static_cast<uint8_t>(*next)] != kSpace &&
+                          *next != '/'))
+            return fail(next == p ? p : next, "invalid digit");
+        if (addr < rangeLow || addr > rangeHigh) {
+            std::cerr << path << ":" << lineOf(begin, p)
+                      << ": $readmem: more words than the address range, ignoring the rest\n";
+            return true;
+        }
+        if (storage.write(static_cast<uint64_t>(addr - lower), value))
+            changed = true;
+        addr += step;
+        p = next;
+    }
+    return true;
+}
+
+bool writeMemFile(const MemoryStorage& storage, int64_t lower, const std::string& path,
+                  MemFileFormat format, int64_t start, int64_t end) {
+    int64_t upper = lower + static_cast<int64_t>(storage.depth()) - 1;
+    int64_t first = start == kNoAddress ? lower : start;
+    int64_t last = end == kNoAddress ? upper : end;
+    if (std::min(first, last) < lower || std::max(first, last) > upper) {
+        std::cerr << "$writemem: address range [" << first << ":" << last << "] of " << path
+                  << " is outside the array\n";
+        return false;
+    }
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "$writemem: cannot open " << path << "\n";
+        return false;
+    }
+
+    uint32_t bitsPerDigit = format == MemFileFormat::Hex ? 4 : 1;
+    uint32_t digits = (storage.width() + bitsPerDigit - 1) / bitsPerDigit;
+    std::string buffer;
+    buffer.reserve(1 << 20);
+    auto flush = [&]() {
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    };
+    auto put = [&](uint64_t value) {
+        static constexpr char kDigits[] = "0123456789abcdef";
+        size_t at = buffer.size();
+        buffer.resize(at + digits + 1);
+        for (uint32_t i = digits; i-- > 0;) {
+            buffer[at + i] = kDigits[value & ((1U << bitsPerDigit) - 1)];
+            value >>= bitsPerDigit;
+        }
+        buffer[at + digits] = '\n';
+        if (buffer.size() >= (1 << 20))
+            flush();
+    };
+    auto putAddress = [&](int64_t addr) {
+        std::ostringstream line;
+        line << "@" << std::hex << addr << "\n";
+        buffer += line.str();
+    };
+
+    if (first > last) {
+        putAddress(first);
+        for (int64_t addr = first; addr >= last; --addr)
+            put(storage.read(static_cast<uint64_t>(addr - lower)));
+    } else {
+        // Runs that do not continue where a reader would be (starting at `lower`) get an
+        // `@addr` line, which is what keeps sparse dumps proportional to the touched pages.
+        int64_t expected = lower;
+        storage.for_each_block([&](uint64_t offset, const uint64_t* words, uint64_t count) {
+            int64_t blockFirst = std::max(lower + static_cast<int64_t>(offset), first);
+            int64_t blockLast = std::min(lower + static_cast<int64_t>(offset + count) - 1, last);
+            if (blockFirst > blockLast)
+                return;
+            if (blockFirst != expected)
+                putAddress(blockFirst);
+            for (int64_t addr = blockFirst; addr <= blockLast; ++addr)
+                put(words[addr - lower - static_cast<int64_t>(offset)]);
+            expected = blockLast + 1;
+        });
+    }
+    flush();
+    if (!out) {
+        std::cerr << "$writemem: failed writing " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool Memory::load(const std::string& path, MemFileFormat format, int64_t start, int64_t end) {
+    bool changed = false;
+    bool ok = readMemFile(storage, lower_, path, format, start, end, changed);
+    if (changed)
+        notifyChange(value(), value() + 1);
+    return ok;
+}
+
+bool Memory::dump(const std::string& path, MemFileFormat format, int64_t start,
+                  int64_t end) const {
+    return writeMemFile(storage, lower_, path, format, start, end);
+}
+
+namespace {
+
+constexpr char kSnapshotMagic[8] = {'S', 'I', 'M', 'S', 'N', 'A', 'P', '3'};
+
+template<typename T>
+void writePod(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readPod(std::istream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+constexpr char kToggleMagic[8] = {'S', 'I', 'M', 'T', 'C', 'O', 'V', '1'};
+constexpr char kLineMagic[8] = {'S', 'I', 'M', 'L', 'C', 'O', 'V', '1'};
+
+void writeString(std::ostream& out, const std::string& text) {
+    writePod(out, static_cast<uint32_t>(text.size()));
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+bool readString(std::istream& in, std::string& text) {
+    uint32_t length = 0;
+    if (!readPod(in, length))
+        return false;
+    text.resize(length);
+    return static_cast<bool>(in.read(text.data(), length));
+}
+
+} // namespace
+
+// Header (magic, signature, runs, entry count), then per signal: width, change count,
+// rose and fell bitmaps, name length and name.
+bool ToggleCoverage::write(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to open coverage file: " << path << "\n";
+        return false;
+    }
+    out.write(kToggleMagic, sizeof(kToggleMagic));
+    writePod(out, signature);
+    writePod(out, runs);
+    writePod(out, static_cast<uint64_t>(counters.size()));
+    for (size_t i = 0; i < counters.size(); ++i) {
+        writePod(out, widths[i]);
+        writePod(out, counters[i].changes);
+        writePod(out, counters[i].rose);
+        writePod(out, counters[i].fell);
+        writePod(out, static_cast<uint32_t>(names[i].size()));
+        out.write(names[i].data(), static_cast<std::streamsize>(names[i].size()));
+    }
+    if (!out) {
+        std::cerr << "Failed writing coverage file: " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool ToggleCoverage::read(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open coverage file: " << path << "\n";
+        return false;
+    }
+    char magic[sizeof(kToggleMagic)] = {};
+    uint64_t count = 0;
+    ToggleCoverage db;
+    if (!in.read(magic, sizeof(magic)) ||
+        !std::equal(magic, magic + sizeof(magic), kToggleMagic) || !readPod(in, db.signature) ||
+        !readPod(in, db.runs) || !readPod(in, count)) {
+        std::cerr << path << ": not a toggle coverage database\n";
+        return false;
+    }
+    db.names.resize(count);
+    db.widths.resize(count);
+    db.counters.resize(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        uint32_t length = 0;
+        if (!readPod(in, db.widths[i]) || !readPod(in, db.counters[i].changes) ||
+            !readPod(in, db.counters[i].rose) || !readPod(in, db.counters[i].fell) ||
+            !readPod(in, length)) {
+            std::cerr << path << ": truncated toggle coverage database\n";
+            return false;
+        }
+        db.names[i].resize(length);
+        if (!in.read(db.names[i].data(), length)) {
+            std::cerr << path << ": truncated toggle coverage database\n";
+            return false;
+        }
+    }
+    *this = std::move(db);
+    return true;
+}
+
+// Header (magic, runs, module count), then per class: name, point count and per point its
+// kind, file, line and hit count.
+bool LineCoverage::write(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to open coverage file: " << path << "\n";
+        return false;
+    }
+    out.write(kLineMagic, sizeof(kLineMagic));
+    writePod(out, runs);
+    writePod(out, static_cast<uint64_t>(modules.size()));
+    for (const auto& module : modules) {
+        writeString(out, module.name);
+        writePod(out, static_cast<uint64_t>(module.counts.size()));
+        for (size_t i = 0; i < module.counts.size(); ++i) {
+            writeString(out, module.kinds[i]);
+            writeString(out, module.files[i]);
+            writePod(out, module.lines[i]);
+            writePod(out, module.counts[i]);
+        }
+    }
+    if (!out) {
+        std::cerr << "Failed writing coverage file: " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool LineCoverage::read(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open coverage file: " << path << "\n";
+        return false;
+    }
+    char magic[sizeof(kLineMagic)] = {};
+    uint64_t moduleCount = 0;
+    LineCoverage db;
+    if (!in.read(magic, sizeof(magic)) ||
+        !std::equal(magic, magic + sizeof(magic), kLineMagic) || !readPod(in, db.runs) ||
+        !readPod(in, moduleCount)) {
+        std::cerr << path << ": not a line coverage database\n";
+        return false;
+    }
+    db.modules.resize(moduleCount);
+    for (auto& module : db.modules) {
+        uint64_t count = 0;
+        if (!readString(in, module.name) || !readPod(in, count)) {
+            std::cerr << path << ": truncated line coverage database\n";
+            return false;
+        }
+        module.kinds.resize(count);
+        module.files.resize(count);
+        module.lines.resize(count);
+        module.counts.resize(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            if (!readString(in, module.kinds[i]) || !readString(in, module.files[i]) ||
+                !readPod(in, module.lines[i]) || !readPod(in, module.counts[i])) {
+                std::cerr << path << ": truncated line coverage database\n";
+                return false;
+            }
+        }
+    }
+    *this = std::move(db);
+    return true;
+}
+
+// FNV-1a over the shape of the design, so a snapshot is only restored into the design
+// (and codegen options) that produced it.
+uint64_t Kernel::designSignature() const {
+    uint64_t hash = 1469598103934665603ULL;
+    auto mix = [&hash](uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            hash ^= (value >> (i * 8)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    };
+    mix(trackedSignals.size());
+    for (const auto* sig : trackedSignals)
+        mix(sig->width());
+    mix(trackedMemories.size());
+    for (const auto* mem : trackedMemories) {
+        mix(mem->words().width());
+        mix(mem->words().depth());
+    }
+    mix(trackedRandoms.size());
+    mix(resumables.size());
+    mix(monitors.size());
+    return hash;
+}
+
+void Kernel::set_checkpoint(uint64_t time, std::string path, bool exitAfter) {
+    checkpointTime = time;
+    checkpointPath = std::move(path);
+    checkpointExit = exitAfter;
+}
+
+bool Kernel::save_snapshot(const std::string& path) {
+    if (!activeQueue.empty() || !memoryNbaQueue.empty() || !nbaDeferred.empty()) {
+        std::cerr << "snapshot: only possible between time steps\n";
+        return false;
+    }
+
+    std::unordered_map<const Signal*, uint32_t> signalIndex;
+    for (size_t i = 0; i < trackedSignals.size(); ++i) {
+        if (trackedSignals[i]->laneCount() > 1) {
+            std::cerr << "snapshot: multi-lane designs cannot be checkpointed\n";
+            return false;
+        }
+        signalIndex[trackedSignals[i]] = static_cast<uint32_t>(i);
+    }
+
+    // priority_queue has no iteration; snapshots are rare, so drain a copy.
+    std::vector<Event> events;
+    for (auto pending = eventQueue; !pending.empty(); pending.pop()) {
+        const Event& event = pending.top();
+        if (event.resumable == kNotResumable) {
+            std::cerr << "snapshot: event at time " << event.time
+                      << " is not resumable (scheduled with schedule_at)\n";
+            return false;
+        }
+        events.push_back(event);
+    }
+    for (const auto& nba : nbaQueue) {
+        if (!signalIndex.count(nba.signal)) {
+            std::cerr << "snapshot: pending NBA to an untracked signal\n";
+            return false;
+        }
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to open snapshot file: " << path << "\n";
+        return false;
+    }
+    out.write(kSnapshotMagic, sizeof(kSnapshotMagic));
+    writePod(out, designSignature());
+    writePod(out, currentTime);
+    writePod(out, nextOrder);
+
+    writePod(out, static_cast<uint32_t>(trackedSignals.size()));
+    for (const auto* sig : trackedSignals) {
+        writePod(out, sig->value_);
+        writePod(out, sig->unknown_);
+    }
+
+    // Memories as (first address, word count, words) runs: one per allocated page when
+    // sparse, so the snapshot is as small as the touched footprint.
+    for (const auto* mem : trackedMemories) {
+        uint32_t blocks = 0;
+        mem->words().for_each_block([&](uint64_t, const uint64_t*, uint64_t) { blocks++; });
+        writePod(out, blocks);
+        mem->words().for_each_block([&](uint64_t first, const uint64_t* words, uint64_t count) {
+            writePod(out, first);
+            writePod(out, count);
+            out.write(reinterpret_cast<const char*>(words),
+                      static_cast<std::streamsize>(count * sizeof(uint64_t)));
+        });
+    }
+
+    // Random streams: whether and from which kernel seed each was seeded, and its state.
+    for (const auto* stream : trackedRandoms) {
+        writePod(out, static_cast<uint8_t>(stream->seeded_));
+        writePod(out, stream->seed_);
+        for (uint64_t word : stream->random_.s_)
+            writePod(out, word);
+    }
+
+    std::vector<uint32_t> enabled;
+    for (size_t i = 0; i < monitors.size(); ++i) {
+        if (monitors[i]->enabled)
+            enabled.push_back(static_cast<uint32_t>(i));
+    }
+    writePod(out, static_cast<uint32_t>(enabled.size()));
+    for (uint32_t id : enabled)
+        writePod(out, id);
+
+    writePod(out, static_cast<uint32_t>(events.size()));
+    for (const auto& event : events) {
+        writePod(out, event.time);
+        writePod(out, event.order);
+        writePod(out, event.resumable);
+    }
+
+    writePod(out, static_cast<uint32_t>(nbaQueue.size()));
+    for (const auto& nba : nbaQueue) {
+        writePod(out, signalIndex[nba.signal]);
+        writePod(out, nba.value);
+        writePod(out, nba.unknown);
+        writePod(out, nba.mask);
+    }
+
+    if (!out) {
+        std::cerr << "Failed to write snapshot file: " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool Kernel::restore_snapshot(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open snapshot file: " << path << "\n";
+        return false;
+    }
+    auto corrupt = [&path]() {
+        std::cerr << "snapshot: " << path << " is truncated or corrupt\n";
+        return false;
+    };
+
+    char magic[sizeof(kSnapshotMagic)] = {};
+    uint64_t signature = 0;
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), kSnapshotMagic))
+        return corrupt();
+    if (!readPod(in, signature))
+        return corrupt();
+    if (signature != designSignature()) {
+        std::cerr << "snapshot: " << path << " was taken from a different design\n";
+        return false;
+    }
+
+    uint64_t time = 0;
+    uint64_t order = 0;
+    uint32_t count = 0;
+    if (!readPod(in, time) || !readPod(in, order) || !readPod(in, count) ||
+        count != trackedSignals.size())
+        return corrupt();
+    std::vector<std::pair<uint64_t, uint64_t>> values(count);
+    for (auto& [value, unknown] : values) {
+        if (!readPod(in, value) || !readPod(in, unknown))
+            return corrupt();
+    }
+
+    // Memory contents are staged so a corrupt file leaves the design untouched.
+    struct MemoryBlock {
+        Memory* memory;
+        uint64_t first;
+        std::vector<uint64_t> words;
+    };
+    std::vector<MemoryBlock> blocks;
+    for (auto* mem : trackedMemories) {
+        if (!readPod(in, count))
+            return corrupt();
+        for (uint32_t i = 0; i < count; ++i) {
+            MemoryBlock block{mem, 0, {}};
+            uint64_t words = 0;
+            if (!readPod(in, block.first) || !readPod(in, words) ||
+                block.first > mem->words().depth() ||
+                words > mem->words().depth() - block.first)
+                return corrupt();
+            block.words.resize(static_cast<size_t>(words));
+            if (!in.read(reinterpret_cast<char*>(block.words.data()),
+                         static_cast<std::streamsize>(words * sizeof(uint64_t))))
+                return corrupt();
+            blocks.push_back(std::move(block));
+        }
+    }
+
+    struct RandomState {
+        uint8_t seeded = 0;
+        uint64_t seed = 0;
+        uint64_t words[4] = {};
+    };
+    std::vector<RandomState> randoms(trackedRandoms.size());
+    for (auto& state : randoms) {
+        if (!readPod(in, state.seeded) || !readPod(in, state.seed) || state.seeded > 1)
+            return corrupt();
+        for (uint64_t& word : state.words) {
+            if (!readPod(in, word))
+                return corrupt();
+        }
+    }
+
+    std::vector<uint32_t> enabled;
+    if (!readPod(in, count))
+        return corrupt();
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t id = 0;
+        if (!readPod(in, id) || id >= monitors.size())
+            return corrupt();
+        enabled.push_back(id);
+    }
+
+    struct SavedEvent {
+        uint64_t time;
+        uint64_t order;
+        uint32_t id;
+    };
+    std::vector<SavedEvent> events;
+    if (!readPod(in, count))
+        return corrupt();
+    for (uint32_t i = 0; i < count; ++i) {
+        SavedEvent event{};
+        if (!readPod(in, event.time) || !readPod(in, event.order) || !readPod(in, event.id) ||
+            event.id >= resumables.size())
+            return corrupt();
+        events.push_back(event);
+    }
+
+    std::vector<NbaAssign> nbas;
+    if (!readPod(in, count))
+        return corrupt();
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t index = 0;
+        NbaAssign nba;
+        if (!readPod(in, index) || !readPod(in, nba.value) || !readPod(in, nba.unknown) ||
+            !readPod(in, nba.mask) || index >= trackedSignals.size())
+            return corrupt();
+        nba.signal = trackedSignals[index];
+        nbas.push_back(nba);
+    }
+
+    // Drop everything the constructor scheduled; the snapshot describes the whole future.
+    eventQueue = {};
+    activeQueue.clear();
+    memoryNbaQueue.clear();
+    nbaDeferred.clear();
+    for (auto& proc : processes)
+        proc->scheduled = false;
+
+    currentTime = time;
+    nextOrder = order;
+    // Values are written directly: the snapshot state is already settled, so nothing may
+    // wake up or see an edge.
+    for (size_t i = 0; i < trackedSignals.size(); ++i) {
+        trackedSignals[i]->value_ = values[i].first;
+        trackedSignals[i]->unknown_ = values[i].second;
+    }
+    for (auto* mem : trackedMemories)
+        mem->storage.clear();
+    for (const auto& block : blocks) {
+        for (size_t i = 0; i < block.words.size(); ++i)
+            block.memory->storage.write(block.first + i, block.words[i]);
+    }
+    for (size_t i = 0; i < trackedRandoms.size(); ++i) {
+        ProcessRandom& stream = *trackedRandoms[i];
+        stream.seeded_ = randoms[i].seeded != 0;
+        stream.seed_ = randoms[i].seed;
+        std::copy(randoms[i].words, randoms[i].words + 4, stream.random_.s_);
+    }
+    for (uint32_t id : enabled)
+        enableMonitor(id, false);
+    for (const auto& event : events)
+        scheduleResumable(event.time, event.order, event.id);
+    nbaQueue = std::move(nbas);
+    return true;
+}
+
+void Kernel::start() {
+    dpiKernel = this;
+    if (started)
+        return;
+    started = true;
+    if (toggleEnabled && toggleCounters.size() != trackedSignals.size()) {
+        toggleCounters.assign(trackedSignals.size(), ToggleCounters{});
+        toggleWidths.clear();
+        for (size_t i = 0; i < trackedSignals.size(); ++i) {
+            trackedSignals[i]->toggle_ = &toggleCounters[i];
+            toggleWidths.push_back(trackedSignals[i]->width());
+        }
+        toggleSignature = designSignature();
+    }
+    if (!restorePath.empty()) {
+        std::string path = std::move(restorePath);
+        restorePath.clear();
+        if (!restore_snapshot(path)) {
+            snapshotFailed = true;
+            finished = true;
+        }
+    }
+}
+
+void Kernel::run() {
+    run_until(UINT64_MAX);
+    if (!checkpointPath.empty()) {
+        std::cerr << "snapshot: simulation ended before checkpoint time " << checkpointTime
+                  << "\n";
+        checkpointPath.clear();
+        snapshotFailed = true;
+    }
+}
+
+void Kernel::run_until(uint64_t limit) {
+    start();
+
+    // Samples are only recorded while a profiler is running; the buffer is sized up front
+    // so the signal handler never allocates.
+    if (profilerHz && siteSamples.size() < sourceSites.size())
+        siteSamples.resize(sourceSites.size(), 0);
+    Kernel* previousKernel = runningKernel;
+    runningKernel = this;
+
+    while (!finished && (!eventQueue.empty() || !activeQueue.empty() || !nbaQueue.empty() ||
+                         !memoryNbaQueue.empty() || !nbaDeferred.empty())) {
+        if (activeQueue.empty() && !eventQueue.empty()) {
+            uint64_t nextTime = eventQueue.top().time;
+            bool settled = nbaQueue.empty() && memoryNbaQueue.empty() && nbaDeferred.empty();
+            if (nextTime > limit && settled)
+                break;
+            if (!checkpointPath.empty() && nextTime > checkpointTime && settled) {
+                std::string path = std::move(checkpointPath);
+                checkpointPath.clear();
+                if (!save_snapshot(path))
+                    snapshotFailed = true;
+                if (checkpointExit || snapshotFailed)
+                    break;
+            }
+            if (nextTime <= limit) {
+                currentTime = nextTime;
+                while (!eventQueue.empty() && eventQueue.top().time == nextTime) {
+                    Event event = eventQueue.top();
+                    eventQueue.pop();
+                    activeQueue.push_back(std::move(event));
+                }
+            }
+        }
+
+        while (!activeQueue.empty()) {
+            auto event = std::move(activeQueue.front());
+            activeQueue.pop_front();
+            executedEvents++;
+            currentSite.store(event.site, std::memory_order_relaxed);
+            event.action();
+        }
+
+        if (!nbaQueue.empty() || !memoryNbaQueue.empty() || !nbaDeferred.empty()) {
+            currentSite.store(0, std::memory_order_relaxed);
+            applyNba();
+        }
+    }
+
+    runningKernel = previousKernel;
+    if (!finished && limit != UINT64_MAX && currentTime < limit)
+        currentTime = limit;
+}
+
+namespace {
+
+bool parseCount(const char* text, uint64_t& value) {
+    char* end = nullptr;
+    value = std::strtoull(text, &end, 0);
+    return end && *end == '\0';
+}
+
+bool loadInstanceArgs(const std::string& path, std::vector<std::vector<std::string>>& lines) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open instance argument file: " << path << "\n";
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream words(line);
+        std::vector<std::string> args;
+        std::string word;
+        while (words >> word)
+            args.push_back(word);
+        lines.push_back(std::move(args));
+    }
+    return true;
+}
+
+} // namespace
+
+void reportStats(std::ostream& out, uint64_t events, uint64_t time, double seconds) {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    out << "stats: events=" << events << " time=" << time << " wall_s=" << seconds
+        << " peak_rss_kb=" << usage.ru_maxrss << "\n";
+}
+
+bool parseBatchArgs(int argc, char** argv, BatchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        uint64_t value = 0;
+        if (arg == "--instances" && i + 1 < argc) {
+            if (!parseCount(argv[++i], value) || value == 0) {
+                std::cerr << "Invalid --instances value: " << argv[i] << "\n";
+                return false;
+            }
+            options.instances = static_cast<uint32_t>(value);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            if (!parseCount(argv[++i], value) || value == 0) {
+                std::cerr << "Invalid --threads value: " << argv[i] << "\n";
+                return false;
+            }
+            options.threads = static_cast<uint32_t>(value);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            if (!parseCount(argv[++i], value)) {
+                std::cerr << "Invalid --seed value: " << argv[i] << "\n";
+                return false;
+            }
+            options.seed = value;
+        } else if (arg == "--cycles" && i + 1 < argc) {
+            if (!parseCount(argv[++i], value)) {
+                std::cerr << "Invalid --cycles value: " << argv[i] << "\n";
+                return false;
+            }
+            options.cycles = value;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--profile" && i + 1 < argc) {
+            options.profilePath = argv[++i];
+        } else if (arg == "--profile-hz" && i + 1 < argc) {
+            if (!parseCount(argv[++i], value) || value == 0 || value > 1000000) {
+                std::cerr << "Invalid --profile-hz value: " << argv[i] << "\n";
+                return false;
+            }
+            options.profileHz = static_cast<uint32_t>(value);
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            options.checkpointPath = argv[++i];
+        } else if (arg == "--checkpoint-at" && i + 1 < argc) {
+            if (!parseCount(argv[++i], value)) {
+                std::cerr << "Invalid --checkpoint-at value: " << argv[i] << "\n";
+                return false;
+            }
+            options.checkpointTime = value;
+        } else if (arg == "--checkpoint-exit") {
+            options.checkpointExit = true;
+        } else if (arg == "--restore" && i + 1 < argc) {
+            options.restorePath = argv[++i];
+        } else if (arg == "--toggle-cov" && i + 1 < argc) {
+            options.toggleCoveragePath = argv[++i];
+        } else if (arg == "--line-cov" && i + 1 < argc) {
+            options.lineCoveragePath = argv[++i];
+        } else if (arg == "--stimulus" && i + 1 < argc) {
+            options.stimulusPath = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            options.recordPath = argv[++i];
+        } else if (arg == "--record-matrix") {
+            options.recordMatrix = true;
+        } else if (arg == "--partition-region" && i + 1 < argc) {
+            options.partitionRegion = argv[++i];
+        } else if (arg == "--partition-index" && i + 1 < argc) {
+            if (!parseCount(argv[++i], value) || value == 0 || value > UINT32_MAX) {
+                std::cerr << "Invalid --partition-index value: " << argv[i] << "\n";
+                return false;
+            }
+            options.partitionIndex = static_cast<uint32_t>(value);
+        } else if (arg == "--out-prefix" && i + 1 < argc) {
+            options.outPrefix = argv[++i];
+        } else if (arg == "--instance-args" && i + 1 < argc) {
+            if (!loadInstanceArgs(argv[++i], options.instancePlusargs))
+                return false;
+        } else if (arg == "--fork-args" && i + 1 < argc) {
+            if (!loadInstanceArgs(argv[++i], options.forkPlusargs))
+                return false;
+        } else if (!arg.empty() && arg[0] == '+') {
+            if (arg.rfind("+seed=", 0) == 0) {
+                if (!parseCount(arg.c_str() + 6, value)) {
+                    std::cerr << "Invalid seed plusarg: " << arg << "\n";
+                    return false;
+                }
+                options.seed = value;
+            }
+            options.plusargs.push_back(arg);
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int runBatch(const BatchOptions& options, const std::function<void(Kernel&)>& body) {
+    uint32_t instances = std::max<uint32_t>(options.instances, 1);
+    uint32_t threads = std::min(std::max<uint32_t>(options.threads, 1), instances);
+
+    std::atomic<uint32_t> nextInstance{0};
+    std::atomic<uint64_t> totalEvents{0};
+    std::atomic<uint64_t> totalTime{0};
+    std::atomic<bool> failed{false};
+    std::mutex errorMutex;
+
+    // Instances share one hierarchy, so their per-site samples are summed by site index.
+    std::vector<SourceSite> profileSites;
+    std::vector<uint64_t> profileSamples;
+    std::mutex profileMutex;
+
+    // Instances of one design add up to a single toggle coverage database.
+    bool toggleCoverage = !options.toggleCoveragePath.empty();
+    ToggleCoverage toggleDb;
+    bool lineCoverage = !options.lineCoveragePath.empty();
+    LineCoverage lineDb;
+    uint32_t forkIndex = Kernel::kNotForked;
+    bool profiling = !options.profilePath.empty();
+    if (profiling && !startProfiler(options.profileHz)) {
+        std::cerr << "Failed to start profiler at " << options.profileHz
+                  << " Hz: " << std::strerror(errno) << "\n";
+        profiling = false;
+    }
+
+    auto worker = [&]() {
+        while (true) {
+            uint32_t index = nextInstance.fetch_add(1);
+            if (index >= instances)
+                return;
+
+            Kernel kernel;
+            kernel.set_seed(options.seed + index);
+            kernel.set_instance(index);
+            std::vector<std::string> args = options.plusargs;
+            if (!options.instancePlusargs.empty()) {
+                const auto& extra =
+                    options.instancePlusargs[index % options.instancePlusargs.size()];
+                args.insert(args.end(), extra.begin(), extra.end());
+            }
+            kernel.set_plusargs(std::move(args));
+            if (!options.checkpointPath.empty()) {
+                std::string path = options.checkpointPath;
+                if (instances > 1)
+                    path += "." + std::to_string(index);
+                kernel.set_checkpoint(options.checkpointTime, std::move(path),
+                                      options.checkpointExit);
+            }
+            if (!options.restorePath.empty())
+                kernel.set_restore(options.restorePath);
+            kernel.set_fork_options(options.outPrefix + "fork.", options.forkPlusargs,
+                                    instances == 1);
+            kernel.set_toggle_coverage(toggleCoverage);
+
+            std::ofstream log;
+            if (instances > 1) {
+                std::string path = options.outPrefix + std::to_string(index) + ".log";
+                log.open(path);
+                if (!log) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    std::cerr << "Failed to open output file: " << path << "\n";
+                    failed = true;
+                    continue;
+                }
+                kernel.set_output(log);
+            }
+
+            body(kernel);
+            if (kernel.snapshot_failed() || kernel.fork_failed())
+                failed = true;
+            totalEvents += kernel.event_count();
+            totalTime += kernel.time();
+            if (kernel.fork_index() != Kernel::kNotForked)
+                forkIndex = kernel.fork_index();
+
+            if (toggleCoverage || lineCoverage) {
+                std::lock_guard<std::mutex> lock(profileMutex);
+                if (toggleCoverage && !kernel.collect_toggle_coverage(toggleDb))
+                    failed = true;
+                if (lineCoverage && !kernel.collect_line_coverage(lineDb))
+                    failed = true;
+            }
+
+            if (profiling) {
+                std::lock_guard<std::mutex> lock(profileMutex);
+                const auto& samples = kernel.site_samples();
+                if (profileSites.size() < kernel.sites().size())
+                    profileSites = kernel.sites();
+                if (profileSamples.size() < samples.size())
+                    profileSamples.resize(samples.size(), 0);
+                for (size_t i = 0; i < samples.size(); ++i)
+                    profileSamples[i] += samples[i];
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    if (threads == 1) {
+        worker();
+    } else {
+        std::vector<std::thread> pool;
+        pool.reserve(threads);
+        for (uint32_t i = 0; i < threads; ++i)
+            pool.emplace_back(worker);
+        for (auto& thread : pool)
+            thread.join();
+    }
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // The processes of a partitioned run each simulate a different part of the design.
+    std::string partSuffix =
+        options.partitionIndex ? ".part." + std::to_string(options.partitionIndex) : "";
+    // A forked child carries on from here too; keep its files apart from the parent's.
+    std::string forkSuffix =
+        forkIndex != Kernel::kNotForked ? ".fork." + std::to_string(forkIndex) : "";
+    if (profiling) {
+        stopProfiler();
+        if (!writeProfile(options.profilePath + partSuffix + forkSuffix, profileSites,
+                          profileSamples, options.profileHz))
+            failed = true;
+    }
+    if (toggleCoverage &&
+        !toggleDb.write(options.toggleCoveragePath + partSuffix + forkSuffix))
+        failed = true;
+    if (lineCoverage && !lineDb.write(options.lineCoveragePath + partSuffix + forkSuffix))
+        failed = true;
+
+    if (instances > 1) {
+        double events = static_cast<double>(totalEvents.load());
+        std::cerr << "batch: " << instances << " instance(s) on " << threads << " thread(s) in "
+                  << seconds << " s, " << totalEvents.load() << " events, "
+                  << (seconds > 0 ? events / seconds : 0.0) << " events/s, "
+                  << (seconds > 0 ? instances / seconds : 0.0) << " instances/s, "
+                  << totalTime.load() << " simulated time units\n";
+    }
+    if (options.stats)
+        reportStats(std::cerr, totalEvents.load(), totalTime.load(), seconds);
+    return failed ? 1 : 0;
+}
+
+namespace {
+
+constexpr uint64_t kRegionMagic = 0x31545241504d4953ULL; // "SIMPART1"
+
+void cpuRelax() {
+#if defined(__SSE2__)
+    _mm_pause();
+#endif
+}
+
+} // namespace
+
+// The start of the shared region. The rings follow on their own cache lines, two per
+// partition k >= 1: 2(k-1) carries partition 0's frames to k, 2(k-1)+1 the way back.
+struct Partition::Region {
+    uint64_t magic = 0;
+    uint32_t parts = 0;
+    std::atomic<uint32_t> aborted{0};
+    std::atomic<uint32_t> attached{0};
+
+    static size_t ringOffset(uint32_t ring) {
+        return (sizeof(Region) + 63) / 64 * 64 + ring * sizeof(PartitionRing);
+    }
+    PartitionRing* ring(uint32_t index) {
+        return reinterpret_cast<PartitionRing*>(reinterpret_cast<char*>(this) +
+                                                ringOffset(index));
+    }
+};
+
+bool PartitionLink::waitForSpace() {
+    out_->head.store(head_, std::memory_order_release);
+    for (uint32_t spins = 0;; ++spins) {
+        tailCache_ = out_->tail.load(std::memory_order_acquire);
+        if (head_ - tailCache_ < PartitionRing::kSlots)
+            return true;
+        if (!owner_->keepWaiting(spins, this))
+            return false;
+    }
+}
+
+bool PartitionLink::waitForData() {
+    // The producer may be blocked on a frame larger than the ring.
+    in_->tail.store(tail_, std::memory_order_release);
+    for (uint32_t spins = 0;; ++spins) {
+        headCache_ = in_->head.load(std::memory_order_acquire);
+        if (headCache_ != tail_)
+            return true;
+        if (!owner_->keepWaiting(spins, this)) {
+            // A peer that exited may have published its last frame just before.
+            headCache_ = in_->head.load(std::memory_order_acquire);
+            return headCache_ != tail_;
+        }
+    }
+}
+
+bool PartitionLink::outOfStep(uint64_t expected, uint64_t received) {
+    std::cerr << "partition " << owner_->index() << ": expected frame " << expected
+              << ", received " << received << "\n";
+    owner_->abort();
+    return false;
+}
+
+Partition::~Partition() {
+    if (!children_.empty()) {
+        abort();
+        finish();
+    }
+    if (region_)
+        munmap(region_, size_);
+    if (created_)
+        shm_unlink(name_.c_str());
+}
+
+bool Partition::map(bool create, uint32_t parts) {
+    int fd = shm_open(name_.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "partition: cannot open shared region " << name_ << ": "
+                  << std::strerror(errno) << "\n";
+        return false;
+    }
+    created_ = create;
+    struct stat st = {};
+    if (create) {
+        size_ = Region::ringOffset(2 * (parts - 1));
+    } else if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Region)) {
+        size_ = static_cast<size_t>(st.st_size);
+    }
+    if (size_ == 0 || (create && ftruncate(fd, static_cast<off_t>(size_)) != 0)) {
+        std::cerr << "partition: cannot size shared region " << name_ << "\n";
+        close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "partition: cannot map shared region " << name_ << ": "
+                  << std::strerror(errno) << "\n";
+        size_ = 0;
+        return false;
+    }
+    region_ = static_cast<Region*>(base);
+
+    if (create) {
+        // The region starts zeroed, which is also every ring's empty state.
+        new (base) Region();
+        for (uint32_t ring = 0; ring < 2 * (parts - 1); ++ring)
+            new (region_->ring(ring)) PartitionRing();
+        region_->parts = parts;
+        region_->magic = kRegionMagic;
+    } else if (region_->magic != kRegionMagic || index_ >= region_->parts ||
+               size_ < Region::ringOffset(2 * (region_->parts - 1))) {
+        std::cerr << "partition " << index_ << ": " << name_ << " is not a matching region\n";
+        return false;
+    }
+
+    auto addLink = [&](uint32_t out, uint32_t in) {
+        PartitionLink link;
+        link.owner_ = this;
+        link.out_ = region_->ring(out);
+        link.in_ = region_->ring(in);
+        links_.push_back(link);
+    };
+    if (index_ == 0) {
+        for (uint32_t k = 1; k < parts; ++k)
+            addLink(2 * (k - 1), 2 * (k - 1) + 1);
+    } else {
+        addLink(2 * (index_ - 1) + 1, 2 * (index_ - 1));
+        // Once every partition is attached the name is no longer needed, and unlinking it
+        // now keeps a killed run from leaving the region behind.
+        if (region_->attached.fetch_add(1) + 2 == region_->parts)
+            shm_unlink(name_.c_str());
+    }
+    return true;
+}
+
+bool Partition::start(const std::vector<std::pair<std::string, std::string>>& parts,
+                      const std::vector<std::string>& args) {
+    name_ = "/sim_part." + std::to_string(getpid());
+    index_ = 0;
+    root_ = getpid();
+    if (!map(true, static_cast<uint32_t>(parts.size() + 1)))
+        return false;
+
+    char self[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    std::string dir = ".";
+    if (length > 0) {
+        dir.assign(self, static_cast<size_t>(length));
+        dir = dir.substr(0, dir.rfind('/'));
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    for (size_t k = 1; k <= parts.size(); ++k) {
+        const auto& [scope, executable] = parts[k - 1];
+        std::vector<std::string> childArgs{dir + "/" + executable};
+        childArgs.insert(childArgs.end(), args.begin(), args.end());
+        childArgs.insert(childArgs.end(), {"--partition-region", name_, "--partition-index",
+                                           std::to_string(k)});
+        std::vector<char*> argv;
+        for (auto& arg : childArgs)
+            argv.push_back(arg.data());
+        argv.push_back(nullptr);
+
+        pid_t pid = 0;
+        int error = posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ);
+        if (error != 0) {
+            std::cerr << "partition: cannot start " << childArgs[0] << ": "
+                      << std::strerror(error) << "\n";
+            return false;
+        }
+        scopes_.push_back(scope);
+        children_.push_back(pid);
+        exitCodes_.push_back(-1);
+    }
+    return true;
+}
+
+bool Partition::attach(const std::string& region, uint32_t index) {
+    name_ = region;
+    index_ = index;
+    root_ = getppid();
+    return map(false, 0);
+}
+
+bool Partition::finish() {
+    bool ok = !failed();
+    for (size_t i = 0; i < children_.size(); ++i) {
+        if (exitCodes_[i] < 0) {
+            int status = 0;
+            while (waitpid(children_[i], &status, 0) < 0 && errno == EINTR) {
+            }
+            exitCodes_[i] = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        }
+        if (exitCodes_[i] != 0) {
+            std::cerr << "partition: " << scopes_[i] << " exited with status " << exitCodes_[i]
+                      << "\n";
+            ok = false;
+        }
+    }
+    children_.clear();
+    return ok;
+}
+
+PartitionLink* Partition::link(std::string_view scope) {
+    if (index_ != 0)
+        return links_.empty() ? nullptr : &links_[0];
+    for (size_t i = 0; i < scopes_.size(); ++i) {
+        if (scopes_[i] == scope)
+            return &links_[i];
+    }
+    return nullptr;
+}
+
+bool Partition::failed() const {
+    return region_ && region_->aborted.load(std::memory_order_relaxed) != 0;
+}
+
+void Partition::abort() {
+    if (region_)
+        region_->aborted.store(1, std::memory_order_relaxed);
+}
+
+bool Partition::keepWaiting(uint32_t spins, const PartitionLink* link) {
+    // Peers usually answer within the spin; past it, share the core (partitions may
+    // outnumber cores) and check now and then that the peer is still there.
+    if (spins < 1024) {
+        cpuRelax();
+        return true;
+    }
+    if (failed())
+        return false;
+    if (spins % 16 == 0) {
+        if (index_ != 0) {
+            if (getppid() != root_) {
+                std::cerr << "partition " << index_ << ": partition 0 exited\n";
+                abort();
+                return false;
+            }
+        } else {
+            for (size_t i = 0; i < children_.size(); ++i) {
+                if (exitCodes_[i] >= 0)
+                    continue;
+                int status = 0;
+                if (waitpid(children_[i], &status, WNOHANG) != children_[i])
+                    continue;
+                exitCodes_[i] = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                if (exitCodes_[i] != 0)
+                    abort();
+            }
+            size_t peer = static_cast<size_t>(link - links_.data());
+            if (failed() || (peer < exitCodes_.size() && exitCodes_[peer] >= 0))
+                return false;
+        }
+    }
+    std::this_thread::yield();
+    return true;
+}
+
+int runPartitioned(const BatchOptions& options,
+                   const std::vector<std::pair<std::string, std::string>>& parts, int argc,
+                   char** argv, const std::function<void(Kernel&)>& body) {
+    if (options.instances != 1) {
+        std::cerr << "--instances is not supported by a partitioned simulation\n";
+        return 1;
+    }
+    Partition partition;
+    if (!options.partitionRegion.empty()) {
+        if (!partition.attach(options.partitionRegion, options.partitionIndex))
+            return 1;
+    } else if (parts.empty()) {
+        std::cerr << "This partition is started by partition 0 (sim_part0)\n";
+        return 1;
+    } else if (!partition.start(parts, std::vector<std::string>(argv + 1, argv + argc))) {
+        return 1;
+    }
+
+    bool ok = true;
+    int status = runBatch(options, [&](Kernel& kernel) {
+        kernel.set_partition(&partition);
+        body(kernel);
+        ok = partition.finish();
+    });
+    return status == 0 && ok ? 0 : 1;
+}
+
+// The mapping behind a StimulusFile; MappedFile is only visible in this file.
+struct StimulusFile::Mapping {
+    explicit Mapping(const std::string& path) : file(path) {}
+    MappedFile file;
+};
+
+StimulusFile::StimulusFile() = default;
+StimulusFile::~StimulusFile() = default;
+
+bool StimulusFile::open(const std::string& path,
+                        const std::vector<std::pair<std::string, uint32_t>>& ports, bool cycles,
+                        uint32_t lanes) {
+    auto mapping = std::make_unique<Mapping>(path);
+    const MappedFile& file = mapping->file;
+    if (!file.ok()) {
+        std::cerr << "stimulus: cannot open " << path << "\n";
+        return false;
+    }
+    auto malformed = [&](const char* what) {
+        std::cerr << "stimulus: " << path << ": " << what << "\n";
+        return false;
+    };
+    StimulusHeader header;
+    if (file.size() < sizeof(header))
+        return malformed("not a stimulus file");
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, StimulusHeader::kMagic, sizeof(header.magic)) != 0)
+        return malformed("not a stimulus file");
+    if (header.layout != StimulusLayout::Records && header.layout != StimulusLayout::Matrix)
+        return malformed("unknown layout");
+    if (header.layout == StimulusLayout::Matrix && !cycles && header.period == 0)
+        return malformed("a matrix needs a period in event mode");
+
+    size_t offset = sizeof(header);
+    std::vector<uint32_t> columnPort;
+    std::vector<uint32_t> columnLane;
+    for (uint32_t column = 0; column < header.signals; ++column) {
+        StimulusColumn entry;
+        if (file.size() - offset < sizeof(entry))
+            return malformed("truncated signal table");
+        std::memcpy(&entry, file.data() + offset, sizeof(entry));
+        offset += sizeof(entry);
+        if (file.size() - offset < entry.nameLength)
+            return malformed("truncated signal table");
+        std::string_view name(file.data() + offset, entry.nameLength);
+        offset += (static_cast<size_t>(entry.nameLength) + 7) / 8 * 8;
+        auto it = std::find_if(ports.begin(), ports.end(),
+                               [&](const auto& port) { return port.first == name; });
+        if (it == ports.end() || it->second != entry.width || entry.lane >= lanes) {
+            std::cerr << "stimulus: " << path << ": no input port " << name << " ["
+                      << entry.width << "] lane " << entry.lane << "\n";
+            return false;
+        }
+        columnPort.push_back(static_cast<uint32_t>(it - ports.begin()));
+        columnLane.push_back(entry.lane);
+    }
+
+    size_t entrySize = header.layout == StimulusLayout::Records
+                           ? sizeof(StimulusRecord)
+                           : sizeof(uint64_t) * header.signals;
+    if (offset > file.size() ||
+        (entrySize && header.count > (file.size() - offset) / entrySize))
+        return malformed("truncated data");
+    if (header.layout == StimulusLayout::Records) {
+        records_ = reinterpret_cast<const StimulusRecord*>(file.data() + offset);
+        // One pass up front, so replay can trust every record.
+        for (uint64_t i = 0; i < header.count; ++i) {
+            if (records_[i].signal >= header.signals)
+                return malformed("record for an unknown signal");
+            if (i && records_[i].time < records_[i - 1].time)
+                return malformed("records out of time order");
+        }
+    } else {
+        rows_ = reinterpret_cast<const uint64_t*>(file.data() + offset);
+    }
+    layout_ = header.layout;
+    count_ = header.count;
+    period_ = header.period;
+    columnPort_ = std::move(columnPort);
+    columnLane_ = std::move(columnLane);
+    mapping_ = std::move(mapping);
+    return true;
+}
+
+void StimulusReplay::schedule(Kernel& kernel) {
+    if (!file_.is_open() || file_.count_ == 0)
+        return;
+    uint32_t id = kernel.add_resumable([this, &kernel](uint32_t self) {
+        uint64_t now = kernel.time();
+        if (file_.layout_ == StimulusLayout::Matrix) {
+            uint64_t row = now / file_.period_;
+            applyRow(row);
+            if (row + 1 < file_.count_)
+                kernel.schedule_resumable((row + 1) * file_.period_, self);
+        } else {
+            applyRecords(now);
+            if (cursor_ < file_.count_)
+                kernel.schedule_resumable(file_.records_[cursor_].time, self);
+        }
+    });
+    uint64_t first = file_.layout_ == StimulusLayout::Matrix ? 0 : file_.records_[0].time;
+    kernel.schedule_resumable(std::max(first, kernel.time()), id);
+}
+
+bool StimulusReplay::apply(uint64_t cycle) {
+    if (!file_.is_open())
+        return false;
+    if (file_.layout_ == StimulusLayout::Records)
+        return applyRecords(cycle);
+    if (cycle >= file_.count_)
+        return false;
+    applyRow(cycle);
+    return true;
+}
+
+bool StimulusReplay::applyRecords(uint64_t time) {
+    const StimulusRecord* records = file_.records_;
+    uint64_t count = file_.count_;
+    // The cursor is right unless time jumped (a restored snapshot, a skipped cycle).
+    if (cursor_ >= count || records[cursor_].time != time ||
+        (cursor_ && records[cursor_ - 1].time >= time)) {
+        cursor_ = static_cast<uint64_t>(
+            std::lower_bound(records, records + count, time,
+                             [](const StimulusRecord& r, uint64_t t) { return r.time < t; }) -
+            records);
+    }
+    bool applied = false;
+    for (; cursor_ < count && records[cursor_].time == time; ++cursor_) {
+        set(records[cursor_].signal, records[cursor_].value);
+        applied = true;
+    }
+    return applied;
+}
+
+void StimulusReplay::applyRow(uint64_t row) {
+    size_t columns = file_.columnPort_.size();
+    const uint64_t* values = file_.rows_ + row * columns;
+    for (size_t column = 0; column < columns; ++column)
+        set(static_cast<uint32_t>(column), values[column]);
+}
+
+void StimulusReplay::set(uint32_t column, uint64_t value) {
+    Signal& port = *ports_[file_.columnPort_[column]];
+    if (setLane_)
+        setLane_(port, file_.columnLane_[column], value);
+    else
+        port.set(value);
+}
+
+bool StimulusRecorder::open(const std::string& path, StimulusLayout layout,
+                            std::vector<std::pair<std::string, Signal*>> ports) {
+    out_.open(path, std::ios::binary | std::ios::trunc);
+    if (!out_) {
+        std::cerr << "stimulus: cannot create " << path << "\n";
+        return false;
+    }
+    path_ = path;
+    layout_ = layout;
+    uint32_t columns = 0;
+    for (auto& port : ports) {
+        firstColumn_.push_back(columns);
+        columns += port.second->laneCount();
+    }
+    StimulusHeader header;
+    std::memcpy(header.magic, StimulusHeader::kMagic, sizeof(header.magic));
+    header.layout = layout;
+    header.signals = columns;
+    // Event-mode matrices are not recorded; a recorded matrix row is one cycle.
+    header.period = 1;
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    static const char kPadding[8] = {};
+    for (auto& [name, signal] : ports) {
+        for (uint32_t lane = 0; lane < signal->laneCount(); ++lane) {
+            StimulusColumn entry{signal->width(), lane, static_cast<uint32_t>(name.size()), 0};
+            out_.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            out_.write(name.data(), static_cast<std::streamsize>(name.size()));
+            out_.write(kPadding, static_cast<std::streamsize>((8 - name.size() % 8) % 8));
+        }
+        ports_.push_back(signal);
+    }
+    last_.assign(columns, 0);
+    recorded_.assign(columns, false);
+    count_ = 0;
+    if (!out_) {
+        std::cerr << "stimulus: cannot write " << path << "\n";
+        failed_ = true;
+    }
+    return !failed_;
+}
+
+void StimulusRecorder::watch(Kernel& kernel) {
+    if (!is_open())
+        return;
+    for (uint32_t i = 0; i < ports_.size(); ++i) {
+        // Runs once at registration, which records the starting values.
+        kernel.register_continuous([this, &kernel, i] { record(kernel.time(), i); },
+                                   {ports_[i]});
+    }
+}
+
+void StimulusRecorder::sample(uint64_t cycle) {
+    if (!is_open())
+        return;
+    if (layout_ == StimulusLayout::Matrix) {
+        for (Signal* signal : ports_) {
+            for (uint32_t lane = 0; lane < signal->laneCount(); ++lane) {
+                uint64_t value = signal->laneValue(lane);
+                out_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+        }
+        count_++;
+        return;
+    }
+    for (uint32_t i = 0; i < ports_.size(); ++i)
+        record(cycle, i);
+}
+
+void StimulusRecorder::record(uint64_t time, uint32_t port) {
+    const Signal& signal = *ports_[port];
+    for (uint32_t lane = 0; lane < signal.laneCount(); ++lane) {
+        uint32_t column = firstColumn_[port] + lane;
+        uint64_t value = signal.laneValue(lane);
+        if (recorded_[column] && value == last_[column])
+            continue;
+        recorded_[column] = true;
+        last_[column] = value;
+        write(time, column, value);
+    }
+}
+
+void StimulusRecorder::write(uint64_t time, uint32_t signal, uint64_t value) {
+    StimulusRecord record{time, signal, 0, value};
+    out_.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    count_++;
+}
+
+bool StimulusRecorder::close() {
+    if (!is_open())
+        return !failed_;
+    out_.seekp(offsetof(StimulusHeader, count));
+    out_.write(reinterpret_cast<const char*>(&count_), sizeof(count_));
+    out_.close();
+    if (!out_) {
+        std::cerr << "stimulus: cannot write " << path_ << "\n";
+        failed_ = true;
+    }
+    return !failed_;
+}
+
+std::string batchFilePath(const std::string& path, uint32_t instances, uint32_t index) {
+    return instances > 1 ? path + "." + std::to_string(index) : path;
+}
+
+} // namespace sim
+
+// svdpi.h. Open array handles are sim::Memory objects, indexed by SV index.
+namespace {
+
+const sim::Memory& openArray(const svOpenArrayHandle h) {
+    return *static_cast<const sim::Memory*>(h);
+}
+
+int arrayLow(const svOpenArrayHandle h) {
+    return static_cast<int>(openArray(h).lower());
+}
+
+int arrayHigh(const svOpenArrayHandle h) {
+    return static_cast<int>(openArray(h).upper());
+}
+
+// The declared bounds: `m[7:0]` has left 7 and right 0, `m[0:7]` and `m[8]` left 0.
+int arrayLeft(const svOpenArrayHandle h) {
+    return openArray(h).descending() ? arrayHigh(h) : arrayLow(h);
+}
+
+int arrayRight(const svOpenArrayHandle h) {
+    return openArray(h).descending() ? arrayLow(h) : arrayHigh(h);
+}
+
+} // namespace
+
+extern "C" {
+
+svScope svGetScope(void) {
+    return sim::dpiScope;
+}
+
+svScope svSetScope(const svScope scope) {
+    svScope previous = sim::dpiScope;
+    sim::dpiScope = static_cast<sim::DpiScope*>(scope);
+    return previous;
+}
+
+const char* svGetNameFromScope(const svScope scope) {
+    return scope ? static_cast<const sim::DpiScope*>(scope)->name.c_str() : nullptr;
+}
+
+svScope svGetScopeFromName(const char* scopeName) {
+    sim::Kernel* kernel = sim::dpiScope ? sim::dpiScope->kernel : sim::dpiKernel;
+    return kernel && scopeName ? kernel->find_dpi_scope(scopeName) : nullptr;
+}
+
+svBit svGetBitselBit(const svBitVecVal* s, int i) {
+    return static_cast<svBit>((s[i >> 5] >> (i & 31)) & 1);
+}
+
+void svPutBitselBit(svBitVecVal* d, int i, svBit s) {
+    uint32_t bit = 1U << (i & 31);
+    d[i >> 5] = (s & 1) ? (d[i >> 5] | bit) : (d[i >> 5] & ~bit);
+}
+
+svLogic svGetBitselLogic(const svLogicVecVal* s, int i) {
+    const auto& chunk = s[i >> 5];
+    return static_cast<svLogic>(((chunk.aval >> (i & 31)) & 1) |
+                                (((chunk.bval >> (i & 31)) & 1) << 1));
+}
+
+void svPutBitselLogic(svLogicVecVal* d, int i, svLogic s) {
+    uint32_t bit = 1U << (i & 31);
+    auto& chunk = d[i >> 5];
+    chunk.aval = (s & 1) ? (chunk.aval | bit) : (chunk.aval & ~bit);
+    chunk.bval = (s & 2) ? (chunk.bval | bit) : (chunk.bval & ~bit);
+}
+
+int svLeft(const svOpenArrayHandle h, int d) {
+    return d == 1 ? arrayLeft(h) : 0;
+}
+
+int svRight(const svOpenArrayHandle h, int d) {
+    return d == 1 ? arrayRight(h) : 0;
+}
+
+int svLow(const svOpenArrayHandle h, int d) {
+    return d == 1 ? arrayLow(h) : 0;
+}
+
+int svHigh(const svOpenArrayHandle h, int d) {
+    return d == 1 ? arrayHigh(h) : 0;
+}
+
+int svIncrement(const svOpenArrayHandle h, int d) {
+    if (d != 1)
+        return 0;
+    return arrayLeft(h) >= arrayRight(h) ? 1 : -1;
+}
+
+int svSize(const svOpenArrayHandle h, int d) {
+    return d == 1 ? static_cast<int>(openArray(h).words().depth()) : 0;
+}
+
+int svDimensions(const svOpenArrayHandle) {
+    return 1;
+}
+
+void* svGetArrayPtr(const svOpenArrayHandle h) {
+    return static_cast<sim::Memory*>(h)->dense_data();
+}
+
+int svSizeOfArray(const svOpenArrayHandle h) {
+    const auto& words = openArray(h).words();
+    return words.sparse() ? 0 : static_cast<int>(words.depth() * sizeof(uint64_t));
+}
+
+void* svGetArrElemPtr1(const svOpenArrayHandle h, int indx1) {
+    auto* mem = static_cast<sim::Memory*>(h);
+    return mem->word_ptr(static_cast<uint64_t>(static_cast<int64_t>(indx1) - mem->lower()));
+}
+
+void svGetBitArrElem1VecVal(svBitVecVal* d, const svOpenArrayHandle s, int indx1) {
+    const auto& mem = openArray(s);
+    uint64_t word = mem.read(static_cast<uint64_t>(static_cast<int64_t>(indx1) - mem.lower()));
+    d[0] = static_cast<uint32_t>(word);
+    if (mem.words().width() > 32)
+        d[1] = static_cast<uint32_t>(word >> 32);
+}
+
+void svPutBitArrElem1VecVal(const svOpenArrayHandle d, const svBitVecVal* s, int indx1) {
+    auto* mem = static_cast<sim::Memory*>(d);
+    uint64_t word = s[0];
+    if (mem->words().width() > 32)
+        word |= static_cast<uint64_t>(s[1]) << 32;
+    mem->write(static_cast<uint64_t>(static_cast<int64_t>(indx1) - mem->lower()), word);
+}
+
+} // extern "C"
@@ -5,6 +5,7 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <ostream>
 #include <optional>
 #include <queue>
 #include <string>
@@ -16,6 +17,13 @@
 #include "slang/ast/ASTVisitor.h"
 #include "slang/ast/Compilation.h"
 #include "slang/ast/TimingControl.h"
+#include "slang/ast/types/AllTypes.h"
+#include "sim/bits.h"
+#include "sim/format.h"
+#include "sim/frontend.h"
+#include "sim/ir_lower.h"
+#include "sim/memory.h"
+#include "sim/random.h"
 
 namespace sim {
 
@@ -56,6 +64,9 @@ struct Signal {
     std::string name;
     uint32_t width = 1;
     uint64_t value = 0;
+    // Set for unpacked arrays; element `i` is stored at offset `i - lower`.
+    std::unique_ptr<MemoryStorage> memory;
+    int64_t lower = 0;
     std::vector<Process*> levelSensitive;
     std::vector<Process*> posedgeSensitive;
     std::vector<Process*> negedgeSensitive;
@@ -92,6 +103,10 @@ struct EventCompare {
 struct NbaAssign {
     Signal* signal = nullptr;
     uint64_t value = 0;
+    // Element offset when `signal` is a memory.
+    uint64_t addr = 0;
+    // The bits written, for part-select and concatenation targets.
+    uint64_t mask = ~0ULL;
 };
 
 struct Monitor {
@@ -99,20 +114,36 @@ struct Monitor {
     std::vector<const Expression*> args;
 };
 
+// A child module's optimized IR, with its IR signals resolved to the interpreter's.
+struct LoweredBody {
+    LoweredModule module;
+    std::vector<Signal*> signals;
+    // Values of the module's shared nodes, and the root evaluation each belongs to.
+    mutable std::vector<uint64_t> memo;
+    mutable std::vector<uint32_t> memoEvaluation;
+    mutable uint32_t evaluations = 0;
+};
+
 } // namespace
 
 struct Simulator::Impl {
-    Impl(Compilation& compilation, const InstanceSymbol& top) :
-        compilation(compilation), top(top) {}
+    Impl(Compilation& compilation, const InstanceSymbol& top, bool optimize) :
+        compilation(compilation), top(top), optimize(optimize) {}
 
     void build() {
         collectSignals(top.body, std::string(top.name));
-        for (auto& inst : top.body.membersOfType<InstanceSymbol>())
-            collectSignals(inst.body, std::string(top.name) + "." + std::string(inst.name));
+        auto children = childInstances(top.body);
+        scopePaths[&top.body] = std::string(top.name);
+        for (const auto& child : children) {
+            std::string path = std::string(top.name) + "." + child.path();
+            scopePaths[&child.symbol->body] = path;
+            collectSignals(child.symbol->body, path);
+        }
 
-        for (auto& inst : top.body.membersOfType<InstanceSymbol>()) {
-            connectPorts(inst);
-            collectProcesses(inst.body);
+        for (const auto& child : children) {
+            connectPorts(*child.symbol);
+            lowerBody(child.symbol->body);
+            collectProcesses(child.symbol->body);
         }
 
         collectInitials(top.body);
@@ -137,6 +168,7 @@ struct Simulator::Impl {
             while (!activeQueue.empty()) {
                 auto action = std::move(activeQueue.front());
                 activeQueue.pop_front();
+                executedEvents++;
                 action();
             }
 
@@ -148,9 +180,11 @@ struct Simulator::Impl {
 
     Compilation& compilation;
     const InstanceSymbol& top;
+    bool optimize = true;
 
     uint64_t currentTime = 0;
     uint64_t nextOrder = 0;
+    uint64_t executedEvents = 0;
     bool finished = false;
 
     std::priority_queue<Event, std::vector<Event>, EventCompare> eventQueue;
@@ -160,6 +194,34 @@ struct Simulator::Impl {
     std::unordered_map<const ValueSymbol*, Signal*> signalMap;
     std::vector<std::unique_ptr<Process>> processes;
     std::vector<std::unique_ptr<Monitor>> monitors;
+    std::vector<std::unique_ptr<LoweredBody>> lowered;
+    // Right-hand sides, conditions and memory addresses of lowered processes.
+    std::unordered_map<const Expression*, std::pair<const LoweredBody*, ir::NodeId>> irRoots;
+    std::unordered_set<const Symbol*> deadProcesses;
+    // Case items as masks, computed on first use; nullopt for items evaluated every time.
+    std::unordered_map<const Expression*, std::optional<CasePattern>> casePatterns;
+    // Constant-bound loops, analyzed on first use.
+    std::unordered_map<const ForLoopStatement*, std::optional<ConstantLoop>> loops;
+    // Values of the running function's arguments and locals and of the loop variables
+    // currently iterating (which shadow a module-level variable of the same symbol).
+    using Frame = std::unordered_map<const ValueSymbol*, uint64_t>;
+    Frame locals;
+    // Set by `return` until the function call unwinds; statements are skipped meanwhile.
+    bool returning = false;
+    uint64_t returnValue = 0;
+    // Arguments and locals of the task whose body is being scheduled (see scheduleTask),
+    // shared by the events it schedules.
+    std::shared_ptr<Frame> taskFrame;
+    // The left-hand side of the assignment being evaluated, read by `a op= b`.
+    const Expression* compoundTarget = nullptr;
+    // Random streams by process (or function), named `<instance path>:<symbol index>` as in
+    // generated code; `running` is the process being evaluated and `schedulingBlock` the
+    // initial block whose statements are being scheduled.
+    uint64_t seed = 0;
+    std::unordered_map<const Scope*, std::string> scopePaths;
+    std::unordered_map<const Symbol*, Random> streams;
+    const Symbol* running = nullptr;
+    const Symbol* schedulingBlock = nullptr;
 
     void scheduleAt(uint64_t time, std::function<void()> action) {
         if (time == currentTime) {
@@ -180,8 +242,172 @@ struct Simulator::Impl {
     void applyNba() {
         auto pending = std::move(nbaQueue);
         nbaQueue.clear();
-        for (const auto& nba : pending)
-            setSignal(*nba.signal, nba.value);
+        for (const auto& nba : pending) {
+            if (nba.signal->memory)
+                writeElement(*nba.signal, nba.addr, nba.value);
+            else
+                setSignal(*nba.signal, deposit(nba.signal->value, nba.value, nba.mask));
+        }
+    }
+
+    // Memories wake their readers (registered on the whole array) only when a word changes.
+    void writeElement(Signal& sig, uint64_t addr, uint64_t value) {
+        if (sig.memory->write(addr, value))
+            wakeReaders(sig);
+    }
+
+    void wakeReaders(Signal& sig) {
+        for (auto* proc : sig.levelSensitive) {
+            if (!proc->scheduled)
+                scheduleProcess(*proc, currentTime);
+        }
+        for (auto* proc : sig.monitorSensitive) {
+            if (!proc->scheduled)
+                scheduleProcess(*proc, currentTime);
+        }
+    }
+
+    // Resolves `mem[i]` to the memory and the element offset.
+    Signal* getElementFromExpr(const Expression& expr, uint64_t& addr) {
+        if (expr.kind != ExpressionKind::ElementSelect)
+            return nullptr;
+        auto& sel = expr.as<ElementSelectExpression>();
+        Signal* sig = getSignalFromExpr(sel.value());
+        if (!sig || !sig->memory)
+            return nullptr;
+        addr = evalRoot(sel.selector()) - static_cast<uint64_t>(sig->lower);
+        return sig;
+    }
+
+    void assign(const AssignmentExpression& a, bool nonBlocking) {
+        compoundTarget = &a.left();
+        if (auto* sym = a.left().getSymbolReference();
+            a.left().kind == ExpressionKind::NamedValue && locals.count(&sym->as<ValueSymbol>())) {
+            locals[&sym->as<ValueSymbol>()] = maskToWidth(evalRoot(a.right()), exprWidth(a.left()));
+            return;
+        }
+        uint64_t addr = 0;
+        if (Signal* mem = getElementFromExpr(a.left(), addr)) {
+            uint64_t rhs = evalRoot(a.right());
+            if (nonBlocking)
+                nbaQueue.push_back({mem, rhs, addr});
+            else
+                writeElement(*mem, addr, rhs);
+            return;
+        }
+        if (a.left().kind == ExpressionKind::Concatenation ||
+            a.left().kind == ExpressionKind::ElementSelect ||
+            a.left().kind == ExpressionKind::RangeSelect) {
+            assignPart(a.left(), evalRoot(a.right()), nonBlocking);
+            return;
+        }
+        Signal* lhs = getSignalFromExpr(a.left());
+        if (!lhs)
+            return;
+        uint64_t rhs = evalRoot(a.right());
+        if (nonBlocking)
+            nbaQueue.push_back({lhs, rhs});
+        else
+            setSignal(*lhs, rhs);
+    }
+
+    // Calls `fn` for each index expression of an assignment target (`x[i]`, `x[i +: 4]` and
+    // concatenations of selects).
+    template<typename Fn>
+    static void forEachSelector(const Expression& target, Fn&& fn) {
+        switch (target.kind) {
+            case ExpressionKind::Concatenation:
+                for (auto* operand : target.as<ConcatenationExpression>().operands())
+                    forEachSelector(*operand, fn);
+                break;
+            case ExpressionKind::ElementSelect:
+                fn(target.as<ElementSelectExpression>().selector());
+                forEachSelector(target.as<ElementSelectExpression>().value(), fn);
+                break;
+            case ExpressionKind::RangeSelect:
+                fn(target.as<RangeSelectExpression>().left());
+                fn(target.as<RangeSelectExpression>().right());
+                forEachSelector(target.as<RangeSelectExpression>().value(), fn);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Writes the low bits of `rhs` to a part-select, bit-select or concatenation target. The
+    // bits are merged into each signal under a mask, also for `<=`, so that several partial
+    // NBAs to one signal combine.
+    void assignPart(const Expression& target, uint64_t rhs, bool nonBlocking) {
+        if (target.kind == ExpressionKind::Concatenation) {
+            auto& cat = target.as<ConcatenationExpression>();
+            uint32_t shift = 0;
+            for (size_t i = cat.operands().size(); i-- > 0;) {
+                assignPart(*cat.operands()[i], shr(rhs, shift), nonBlocking);
+                shift += cat.operands()[i]->type->getBitWidth();
+            }
+            return;
+        }
+        const Expression* value = &target;
+        if (target.kind == ExpressionKind::ElementSelect)
+            value = &target.as<ElementSelectExpression>().value();
+        else if (target.kind == ExpressionKind::RangeSelect)
+            value = &target.as<RangeSelectExpression>().value();
+        if (value->kind != ExpressionKind::NamedValue || !value->type->isIntegral())
+            return;
+        uint32_t from = widthOrDefault(value->type->getBitWidth(), 0);
+        uint32_t width = exprWidth(target);
+        if (from == 0 || from > 64)
+            return;
+
+        uint64_t offset = 0;
+        if (value != &target) {
+            ConstantRange range = value->type->getFixedRange();
+            if (range.width() == 0 || from % range.width() != 0)
+                return;
+            uint32_t elementWidth = from / range.width();
+            int64_t last = width / elementWidth - 1;
+            const Expression* lsb = nullptr;
+            int64_t adjust = 0;
+            if (target.kind == ExpressionKind::ElementSelect) {
+                lsb = &target.as<ElementSelectExpression>().selector();
+            } else {
+                auto& sel = target.as<RangeSelectExpression>();
+                switch (sel.getSelectionKind()) {
+                    case RangeSelectionKind::IndexedUp:
+                        lsb = &sel.left();
+                        adjust = range.isLittleEndian() ? 0 : last;
+                        break;
+                    case RangeSelectionKind::IndexedDown:
+                        lsb = &sel.left();
+                        adjust = range.isLittleEndian() ? -last : 0;
+                        break;
+                    default:
+                        lsb = &sel.right();
+                        break;
+                }
+            }
+            auto i = evalExpr(*lsb);
+            int64_t index = lsb->type->isSigned() ? static_cast<int64_t>(sext(i.value, i.width))
+                                                  : static_cast<int64_t>(i.value);
+            int64_t element = range.isLittleEndian() ? index + adjust - range.lower()
+                                                     : range.upper() - (index + adjust);
+            offset = static_cast<uint64_t>(element) * elementWidth;
+        }
+        uint64_t mask = shl(widthMask(width), offset) & widthMask(from);
+        uint64_t field = shl(maskToWidth(rhs, width), offset);
+
+        auto* sym = &value->as<NamedValueExpression>().symbol;
+        if (auto local = locals.find(sym); local != locals.end()) {
+            local->second = deposit(local->second, field, mask);
+            return;
+        }
+        Signal* sig = getSignalFromExpr(*value);
+        if (!sig || sig->memory)
+            return;
+        if (nonBlocking)
+            nbaQueue.push_back({sig, field, 0, mask});
+        else
+            setSignal(*sig, deposit(sig->value, field, mask));
     }
 
     void setSignal(Signal& sig, uint64_t value) {
@@ -218,6 +444,56 @@ struct Simulator::Impl {
         }
     }
 
+    // Evaluates through the optimized IR when `expr` is the root of a lowered process. The
+    // result may carry bits above the expression's width; every write masks them off.
+    uint64_t evalRoot(const Expression& expr) {
+        auto it = irRoots.find(&expr);
+        if (it == irRoots.end())
+            return evalExpr(expr).value;
+        const LoweredBody& body = *it->second.first;
+        // Evaluation 0 marks memo entries never written.
+        if (++body.evaluations == 0)
+            body.evaluations = 1;
+        return evalNode(body, it->second.second, body.evaluations);
+    }
+
+    // Shared nodes are evaluated once per root evaluation; a nested evaluation of the same
+    // body (through a function call) only makes the outer one recompute them.
+    uint64_t evalNode(const LoweredBody& body, ir::NodeId id, uint32_t evaluation) {
+        if (body.module.shared[id] && body.memoEvaluation[id] == evaluation)
+            return body.memo[id];
+        const ir::Node& node = body.module.ir.nodes[id];
+        uint64_t value = 0;
+        switch (node.op) {
+            case ir::Op::Const:
+                return node.value;
+            case ir::Op::Signal:
+                return body.signals[node.value]->value;
+            case ir::Op::MemRead:
+                value = body.signals[node.value]->memory->read(evalNode(body, node.a, evaluation));
+                break;
+            case ir::Op::Opaque:
+                return evalExpr(*body.module.opaque[node.value]).value;
+            case ir::Op::LogicAnd:
+                value = evalNode(body, node.a, evaluation) != 0 &&
+                        evalNode(body, node.b, evaluation) != 0;
+                break;
+            case ir::Op::LogicOr:
+                value = evalNode(body, node.a, evaluation) != 0 ||
+                        evalNode(body, node.b, evaluation) != 0;
+                break;
+            default:
+                value = ir::apply(node, evalNode(body, node.a, evaluation),
+                                  node.b != ir::kNoNode ? evalNode(body, node.b, evaluation) : 0);
+                break;
+        }
+        if (body.module.shared[id]) {
+            body.memo[id] = value;
+            body.memoEvaluation[id] = evaluation;
+        }
+        return value;
+    }
+
     Value evalExpr(const Expression& expr) {
         switch (expr.kind) {
             case ExpressionKind::IntegerLiteral: {
@@ -244,11 +520,74 @@ struct Simulator::Impl {
                     uint32_t w = exprWidth(expr);
                     return {maskToWidth(v, w), w};
                 }
+                if (auto local = locals.find(&named.symbol); local != locals.end())
+                    return {local->second, exprWidth(expr)};
                 auto it = signalMap.find(&sym);
                 if (it == signalMap.end())
                     return {0, 1};
                 return {it->second->value, it->second->width};
             }
+            case ExpressionKind::Conversion: {
+                // Operands of wider operators and comparisons arrive through conversions.
+                auto& conv = expr.as<ConversionExpression>();
+                auto v = evalExpr(conv.operand());
+                uint32_t w = exprWidth(expr);
+                uint64_t value = v.value;
+                if (w > v.width && v.width != 0 && conv.operand().type->isSigned())
+                    value = sext(value, v.width);
+                return {maskToWidth(value, w), w};
+            }
+            case ExpressionKind::ElementSelect: {
+                uint64_t addr = 0;
+                Signal* mem = getElementFromExpr(expr, addr);
+                if (!mem) {
+                    auto& sel = expr.as<ElementSelectExpression>();
+                    return evalSelect(sel.value(), sel.selector(), 0, exprWidth(expr));
+                }
+                return {mem->memory->read(addr), mem->memory->width()};
+            }
+            case ExpressionKind::RangeSelect: {
+                auto& sel = expr.as<RangeSelectExpression>();
+                const Type& type = *sel.value().type;
+                uint32_t w = exprWidth(expr);
+                if (!type.isIntegral())
+                    return {0, w};
+                ConstantRange range = type.getFixedRange();
+                if (range.width() == 0 || type.getBitWidth() % range.width() != 0)
+                    return {0, w};
+                int64_t last = w / (type.getBitWidth() / range.width()) - 1;
+                switch (sel.getSelectionKind()) {
+                    case RangeSelectionKind::IndexedUp:
+                        return evalSelect(sel.value(), sel.left(),
+                                          range.isLittleEndian() ? 0 : last, w);
+                    case RangeSelectionKind::IndexedDown:
+                        return evalSelect(sel.value(), sel.left(),
+                                          range.isLittleEndian() ? -last : 0, w);
+                    default:
+                        return evalSelect(sel.value(), sel.right(), 0, w);
+                }
+            }
+            case ExpressionKind::Concatenation: {
+                auto& cat = expr.as<ConcatenationExpression>();
+                uint64_t result = 0;
+                uint32_t shift = 0;
+                for (size_t i = cat.operands().size(); i-- > 0;) {
+                    auto v = evalExpr(*cat.operands()[i]);
+                    result |= shl(v.value, shift);
+                    shift += cat.operands()[i]->type->getBitWidth();
+                }
+                uint32_t w = exprWidth(expr);
+                return {maskToWidth(result, w), w};
+            }
+            case ExpressionKind::Replication: {
+                auto& rep = expr.as<ReplicationExpression>();
+                auto v = evalExpr(rep.concat());
+                uint32_t w = exprWidth(expr);
+                uint64_t result = 0;
+                for (uint32_t bit = 0; v.width != 0 && bit < w; bit += v.width)
+                    result |= shl(v.value, bit);
+                return {maskToWidth(result, w), w};
+            }
             case ExpressionKind::UnaryOp: {
                 auto& un = expr.as<UnaryExpression>();
                 auto v = evalExpr(un.operand());
@@ -257,9 +596,23 @@ struct Simulator::Impl {
                         uint64_t inv = ~v.value;
                         return {maskToWidth(inv, v.width), v.width};
                     }
-                    case UnaryOperator::LogicalNot: {
+                    case UnaryOperator::LogicalNot:
+                    case UnaryOperator::BitwiseNor:
                         return {v.value == 0 ? 1U : 0U, 1};
+                    case UnaryOperator::Minus: {
+                        uint32_t w = exprWidth(expr);
+                        return {maskToWidth(0 - v.value, w), w};
                     }
+                    case UnaryOperator::BitwiseAnd:
+                        return {red_and(v.value, v.width), 1};
+                    case UnaryOperator::BitwiseNand:
+                        return {red_and(v.value, v.width) ^ 1, 1};
+                    case UnaryOperator::BitwiseOr:
+                        return {v.value != 0 ? 1U : 0U, 1};
+                    case UnaryOperator::BitwiseXor:
+                        return {parity(v.value), 1};
+                    case UnaryOperator::BitwiseXnor:
+                        return {parity(v.value) ^ 1, 1};
                     default:
                         return {0, exprWidth(expr)};
                 }
@@ -269,6 +622,7 @@ struct Simulator::Impl {
                 auto lhs = evalExpr(bin.left());
                 auto rhs = evalExpr(bin.right());
                 uint32_t w = exprWidth(expr);
+                bool isSigned = bin.left().type->isSigned() && bin.right().type->isSigned();
                 uint64_t result = 0;
                 switch (bin.op) {
                     case BinaryOperator::Add:
@@ -283,6 +637,59 @@ struct Simulator::Impl {
                     case BinaryOperator::Divide:
                         result = rhs.value ? (lhs.value / rhs.value) : 0;
                         break;
+                    case BinaryOperator::BinaryAnd:
+                        result = lhs.value & rhs.value;
+                        break;
+                    case BinaryOperator::BinaryOr:
+                        result = lhs.value | rhs.value;
+                        break;
+                    case BinaryOperator::BinaryXor:
+                        result = lhs.value ^ rhs.value;
+                        break;
+                    case BinaryOperator::BinaryXnor:
+                        result = ~(lhs.value ^ rhs.value);
+                        break;
+                    case BinaryOperator::LogicalAnd:
+                        result = lhs.value != 0 && rhs.value != 0;
+                        break;
+                    case BinaryOperator::LogicalOr:
+                        result = lhs.value != 0 || rhs.value != 0;
+                        break;
+                    case BinaryOperator::Equality:
+                    case BinaryOperator::CaseEquality:
+                        result = lhs.value == rhs.value;
+                        break;
+                    case BinaryOperator::Inequality:
+                    case BinaryOperator::CaseInequality:
+                        result = lhs.value != rhs.value;
+                        break;
+                    case BinaryOperator::LessThan:
+                        result = isSigned ? slt(lhs.value, rhs.value, lhs.width)
+                                          : lhs.value < rhs.value;
+                        break;
+                    case BinaryOperator::LessThanEqual:
+                        result = isSigned ? sle(lhs.value, rhs.value, lhs.width)
+                                          : lhs.value <= rhs.value;
+                        break;
+                    case BinaryOperator::GreaterThan:
+                        result = isSigned ? slt(rhs.value, lhs.value, lhs.width)
+                                          : rhs.value < lhs.value;
+                        break;
+                    case BinaryOperator::GreaterThanEqual:
+                        result = isSigned ? sle(rhs.value, lhs.value, lhs.width)
+                                          : rhs.value <= lhs.value;
+                        break;
+                    case BinaryOperator::LogicalShiftLeft:
+                    case BinaryOperator::ArithmeticShiftLeft:
+                        result = shl(lhs.value, rhs.value);
+                        break;
+                    case BinaryOperator::LogicalShiftRight:
+                        result = shr(lhs.value, rhs.value);
+                        break;
+                    case BinaryOperator::ArithmeticShiftRight:
+                        result = bin.left().type->isSigned() ? sar(lhs.value, rhs.value, lhs.width)
+                                                             : shr(lhs.value, rhs.value);
+                        break;
                     default:
                         result = 0;
                         break;
@@ -293,13 +700,151 @@ struct Simulator::Impl {
                 auto& call = expr.as<CallExpression>();
                 if (call.isSystemCall() && call.getSubroutineName() == "$time")
                     return {currentTime, 64};
+                if (auto kind = randomCall(call); kind != RandomCall::None)
+                    return {maskToWidth(evalRandom(call, kind), exprWidth(expr)), exprWidth(expr)};
+                if (!call.isSystemCall() &&
+                    std::holds_alternative<const SubroutineSymbol*>(call.subroutine)) {
+                    auto* sub = std::get<const SubroutineSymbol*>(call.subroutine);
+                    if (sub && !sub->thisVar && !sub->flags.has(MethodFlags::DPIImport))
+                        return callFunction(call, *sub);
+                }
                 return {0, exprWidth(expr)};
             }
+            case ExpressionKind::LValueReference:
+                if (compoundTarget)
+                    return evalExpr(*compoundTarget);
+                return {0, exprWidth(expr)};
             default:
                 return {0, exprWidth(expr)};
         }
     }
 
+    std::string streamName(const Symbol* process) const {
+        if (!process)
+            return {};
+        auto path = scopePaths.find(process->getParentScope());
+        return (path != scopePaths.end() ? path->second : std::string()) + ":" +
+               std::to_string(static_cast<uint32_t>(process->getIndex()));
+    }
+
+    Random& stream() {
+        auto it = streams.find(running);
+        if (it == streams.end())
+            it = streams.emplace(running, Random(seed, streamName(running))).first;
+        return it->second;
+    }
+
+    // Writes a random call's variable: a local or a whole signal.
+    bool writeVariable(const Expression& arg, uint64_t value) {
+        const Expression* target = &arg;
+        if (target->kind == ExpressionKind::Assignment)
+            target = &target->as<AssignmentExpression>().left();
+        if (target->kind != ExpressionKind::NamedValue)
+            return false;
+        auto* sym = &target->as<NamedValueExpression>().symbol;
+        if (auto it = locals.find(sym); it != locals.end()) {
+            it->second = maskToWidth(value, exprWidth(*target));
+            return true;
+        }
+        Signal* sig = getSignalFromExpr(*target);
+        if (!sig || sig->memory)
+            return false;
+        setSignal(*sig, value);
+        return true;
+    }
+
+    uint64_t evalRandom(const CallExpression& call, RandomCall kind) {
+        auto args = call.arguments();
+        switch (kind) {
+            case RandomCall::Urandom:
+                if (!args.empty()) {
+                    uint64_t restart = evalExpr(*args[0]).value;
+                    Random& rng = stream();
+                    rng.reseed(restart, streamName(running));
+                    return rng.urandom();
+                }
+                return stream().urandom();
+            case RandomCall::UrandomRange: {
+                if (args.empty())
+                    return 0;
+                uint64_t a = evalExpr(*args[0]).value;
+                uint64_t b = args.size() > 1 ? evalExpr(*args[1]).value : 0;
+                return stream().urandom_range(a, b);
+            }
+            case RandomCall::Random: {
+                if (args.empty())
+                    return stream().urandom();
+                SeededRandom next = random_step(evalExpr(*args[0]).value);
+                writeVariable(*args[0], next.seed);
+                return next.value;
+            }
+            case RandomCall::Randomize: {
+                if (constrainedRandomize(call))
+                    return 0;
+                for (auto* arg : args) {
+                    uint32_t width = widthOrDefault(arg->type->getBitWidth(), 0);
+                    if (width != 0 && width <= 64)
+                        writeVariable(*arg, stream().bits(width));
+                }
+                return 1;
+            }
+            default:
+                return 0;
+        }
+    }
+
+    // Runs a function (or a task without timing) in a frame of its own: input arguments are
+    // evaluated in the caller's, then bound as locals of the callee.
+    Value callFunction(const CallExpression& call, const SubroutineSymbol& sub) {
+        uint32_t width = exprWidth(call);
+        auto formals = sub.getArguments();
+        auto actuals = call.arguments();
+        if (formals.size() != actuals.size())
+            return {0, width};
+        Frame frame;
+        for (size_t i = 0; i < formals.size(); ++i) {
+            if (formals[i]->direction != ArgumentDirection::In)
+                return {0, width};
+            uint32_t argWidth = widthOrDefault(formals[i]->getType().getBitWidth(), 64);
+            frame[formals[i]] = maskToWidth(evalExpr(*actuals[i]).value, argWidth);
+        }
+        if (sub.returnValVar)
+            frame[sub.returnValVar] = 0;
+        const Expression* savedTarget = compoundTarget;
+        // Functions draw from a stream of their own, as in generated code.
+        const Symbol* caller = std::exchange(running, &sub);
+        std::swap(locals, frame);
+        evalStatement(sub.getBody(), false);
+        uint64_t result = returning ? returnValue
+                                    : (sub.returnValVar ? locals[sub.returnValVar] : 0);
+        returning = false;
+        std::swap(locals, frame);
+        running = caller;
+        compoundTarget = savedTarget;
+        return {maskToWidth(result, width), width};
+    }
+
+    // The `width`-bit part select of `value`'s packed elements from element index `lsb` (plus
+    // `adjust`), counting from the declared range.
+    Value evalSelect(const Expression& value, const Expression& lsb, int64_t adjust,
+                     uint32_t width) {
+        const Type& type = *value.type;
+        uint32_t from = type.isIntegral() ? widthOrDefault(type.getBitWidth(), 0) : 0;
+        if (from == 0 || from > 64)
+            return {0, width};
+        ConstantRange range = type.getFixedRange();
+        if (from % range.width() != 0)
+            return {0, width};
+        auto v = evalExpr(value);
+        auto i = evalExpr(lsb);
+        int64_t index = lsb.type->isSigned() ? static_cast<int64_t>(sext(i.value, i.width))
+                                             : static_cast<int64_t>(i.value);
+        int64_t element = range.isLittleEndian() ? index + adjust - range.lower()
+                                                 : range.upper() - (index + adjust);
+        uint64_t offset = static_cast<uint64_t>(element) * (from / range.width());
+        return {bits(v.value, offset, width), width};
+    }
+
     uint64_t evalConstExpr(const Expression& expr) {
         auto v = evalExpr(expr);
         return v.value;
@@ -350,6 +895,27 @@ struct Simulator::Impl {
                     collectStatementSymbols(*cond.ifFalse, deps);
                 break;
             }
+            case StatementKind::Case: {
+                auto& cs = stmt.as<CaseStatement>();
+                collectExprSymbols(cs.expr, deps);
+                for (auto& group : cs.items) {
+                    for (auto* item : group.expressions)
+                        collectExprSymbols(*item, deps);
+                    collectStatementSymbols(*group.stmt, deps);
+                }
+                if (cs.defaultCase)
+                    collectStatementSymbols(*cs.defaultCase, deps);
+                break;
+            }
+            case StatementKind::ForLoop: {
+                auto& loop = stmt.as<ForLoopStatement>();
+                std::unordered_set<const ValueSymbol*> body;
+                collectStatementSymbols(loop.body, body);
+                if (auto* bounds = constantLoop(loop))
+                    body.erase(bounds->var);
+                deps.insert(body.begin(), body.end());
+                break;
+            }
             case StatementKind::Timed: {
                 auto& ts = stmt.as<TimedStatement>();
                 if (ts.timing.kind == TimingControlKind::Delay) {
@@ -364,6 +930,8 @@ struct Simulator::Impl {
                 if (es.expr.kind == ExpressionKind::Assignment) {
                     auto& a = es.expr.as<AssignmentExpression>();
                     collectExprSymbols(a.right(), deps);
+                    forEachSelector(a.left(),
+                                    [&](const Expression& sel) { collectExprSymbols(sel, deps); });
                 } else {
                     collectExprSymbols(es.expr, deps);
                 }
@@ -391,6 +959,23 @@ struct Simulator::Impl {
                 continue;
 
             auto& val = member.as<ValueSymbol>();
+            const Type& type = val.getType().getCanonicalType();
+            if (type.kind == SymbolKind::FixedSizeUnpackedArrayType) {
+                auto& array = type.as<FixedSizeUnpackedArrayType>();
+                uint32_t elementWidth = widthOrDefault(array.elementType.getBitWidth(), 0);
+                if (!array.elementType.isIntegral() || elementWidth == 0 || elementWidth > 64)
+                    continue;
+                auto sig = std::make_unique<Signal>();
+                sig->symbol = &val;
+                sig->name = prefix + "." + std::string(val.name);
+                sig->width = elementWidth;
+                sig->memory = std::make_unique<MemoryStorage>(elementWidth, array.range.width());
+                sig->lower = array.range.lower();
+                signalMap[&val] = sig.get();
+                signalStore.push_back(std::move(sig));
+                continue;
+            }
+
             auto width = val.getType().getBitWidth();
             uint32_t w = widthOrDefault(width, 1);
             auto sig = std::make_unique<Signal>();
@@ -421,16 +1006,85 @@ struct Simulator::Impl {
             const Expression* actualExpr = conn->getExpression();
             if (!actualExpr)
                 continue;
-            auto* actualSignal = getSignalFromExpr(*actualExpr);
-            if (!actualSignal)
+            // Output connections come wrapped in an assignment to the actual.
+            const Expression& target = actualExpr->kind == ExpressionKind::Assignment
+                                           ? actualExpr->as<AssignmentExpression>().left()
+                                           : *actualExpr;
+            if (target.kind == ExpressionKind::NamedValue) {
+                if (auto* actualSignal = getSignalFromExpr(target))
+                    signalMap[internal] = actualSignal;
+                continue;
+            }
+            // Anything else keeps the port's own signal, copied through a process.
+            auto it = signalMap.find(internal);
+            if (it == signalMap.end())
                 continue;
+            if (port.direction == ArgumentDirection::In)
+                connectInput(*it->second, target);
+            else if (!connectOutput(*it->second, target))
+                std::cerr << "warning: port " << port.name << " of " << inst.name
+                          << " is connected to neither a signal nor a constant select of one;"
+                          << " leaving it unconnected\n";
+        }
+    }
+
+    // An input port connected to an expression: the port follows it like an `assign`.
+    void connectInput(Signal& port, const Expression& actual) {
+        auto proc = std::make_unique<Process>();
+        proc->kind = ProcessKind::ContinuousAssign;
+        proc->run = [this, &port, &actual]() { setSignal(port, evalExpr(actual).value); };
+        std::unordered_set<const ValueSymbol*> deps;
+        collectExprSymbols(actual, deps);
+        registerDependencies(*proc, deps);
+        processes.push_back(std::move(proc));
+    }
 
-            signalMap[internal] = actualSignal;
+    // An output port connected to a constant select (`.y(out[i])`): writes of the port
+    // update those bits of the actual.
+    bool connectOutput(Signal& port, const Expression& actual) {
+        auto slice = signalSlice(actual);
+        auto it = slice ? signalMap.find(slice->signal) : signalMap.end();
+        if (it == signalMap.end() || it->second->memory)
+            return false;
+        Signal& target = *it->second;
+        uint64_t mask = widthMask(slice->width) << slice->offset;
+        auto proc = std::make_unique<Process>();
+        proc->kind = ProcessKind::ContinuousAssign;
+        proc->run = [this, &port, &target, mask, offset = slice->offset]() {
+            setSignal(target, (target.value & ~mask) | ((port.value << offset) & mask));
+        };
+        port.levelSensitive.push_back(proc.get());
+        processes.push_back(std::move(proc));
+        return true;
+    }
+
+    // Lowers and optimizes one child module. Its dead processes are never created; the live
+    // ones evaluate their expressions through the IR (see evalRoot).
+    void lowerBody(const InstanceBodySymbol& body) {
+        auto entry = std::make_unique<LoweredBody>();
+        entry->module = lowerModule(body, optimize);
+        entry->memo.assign(entry->module.shared.size(), 0);
+        entry->memoEvaluation.assign(entry->module.shared.size(), 0);
+        for (const auto* sym : entry->module.symbols) {
+            auto it = signalMap.find(sym);
+            entry->signals.push_back(it != signalMap.end() ? it->second : nullptr);
         }
+        for (const auto& [expr, root] : entry->module.roots) {
+            ir::NodeId node = entry->module.ir.roots[root].node;
+            if (node != ir::kNoNode)
+                irRoots[expr] = {entry.get(), node};
+        }
+        for (const auto& [symbol, process] : entry->module.processes) {
+            if (!entry->module.ir.processes[process].live)
+                deadProcesses.insert(symbol);
+        }
+        lowered.push_back(std::move(entry));
     }
 
     void collectProcesses(const Scope& scope) {
         for (auto& member : scope.members()) {
+            if (deadProcesses.count(&member))
+                continue;
             if (member.kind == SymbolKind::ContinuousAssign)
                 addContinuousAssign(member.as<ContinuousAssignSymbol>());
             else if (member.kind == SymbolKind::ProceduralBlock)
@@ -444,18 +1098,22 @@ struct Simulator::Impl {
             return;
 
         auto& a = expr.as<AssignmentExpression>();
-        Signal* lhs = getSignalFromExpr(a.left());
-        if (!lhs)
+        bool drivesSignal = false;
+        a.left().visitSymbolReferences([&](const Expression&, const Symbol& sym) {
+            if (ValueSymbol::isKind(sym.kind) && signalMap.count(&sym.as<ValueSymbol>()))
+                drivesSignal = true;
+        });
+        if (!drivesSignal)
             return;
 
         auto proc = std::make_unique<Process>();
         proc->kind = ProcessKind::ContinuousAssign;
-        proc->run = [this, lhs, &a]() {
-            auto rhs = evalExpr(a.right());
-            setSignal(*lhs, rhs.value);
+        proc->run = [this, &a, process = &assign]() {
+            running = process;
+            this->assign(a, false);
         };
 
-        a.right().visitSymbolReferences([&](const Expression&, const Symbol& sym) {
+        auto dependsOn = [&](const Expression&, const Symbol& sym) {
             if (!ValueSymbol::isKind(sym.kind))
                 return;
             if (sym.kind == SymbolKind::Parameter)
@@ -463,7 +1121,10 @@ struct Simulator::Impl {
             auto it = signalMap.find(&sym.as<ValueSymbol>());
             if (it != signalMap.end())
                 it->second->levelSensitive.push_back(proc.get());
-        });
+        };
+        a.right().visitSymbolReferences(dependsOn);
+        forEachSelector(a.left(),
+                        [&](const Expression& sel) { sel.visitSymbolReferences(dependsOn); });
 
         processes.push_back(std::move(proc));
     }
@@ -481,7 +1142,10 @@ struct Simulator::Impl {
 
             auto proc = std::make_unique<Process>();
             proc->kind = ProcessKind::AlwaysFF;
-            proc->run = [this, stmtBody]() { evalStatement(*stmtBody, /*allowNba*/ true); };
+            proc->run = [this, stmtBody, &block]() {
+                running = &block;
+                evalStatement(*stmtBody, /*allowNba*/ true);
+            };
 
             if (timing) {
                 registerEventSensitivity(*timing, *proc);
@@ -496,7 +1160,10 @@ struct Simulator::Impl {
             const Statement* stmtBody = &body;
             auto proc = std::make_unique<Process>();
             proc->kind = ProcessKind::AlwaysComb;
-            proc->run = [this, stmtBody]() { evalStatement(*stmtBody, /*allowNba*/ false); };
+            proc->run = [this, stmtBody, &block]() {
+                running = &block;
+                evalStatement(*stmtBody, /*allowNba*/ false);
+            };
 
             std::unordered_set<const ValueSymbol*> deps;
             collectStatementSymbols(*stmtBody, deps);
@@ -526,6 +1193,8 @@ struct Simulator::Impl {
     }
 
     void evalStatement(const Statement& stmt, bool allowNba) {
+        if (returning)
+            return;
         switch (stmt.kind) {
             case StatementKind::Block: {
                 auto& block = stmt.as<BlockStatement>();
@@ -540,35 +1209,99 @@ struct Simulator::Impl {
             }
             case StatementKind::Conditional: {
                 auto& cond = stmt.as<ConditionalStatement>();
-                auto v = evalExpr(*cond.conditions[0].expr);
-                if (v.value != 0) {
+                if (evalRoot(*cond.conditions[0].expr) != 0) {
                     evalStatement(cond.ifTrue, allowNba);
                 } else if (cond.ifFalse) {
                     evalStatement(*cond.ifFalse, allowNba);
                 }
                 break;
             }
+            case StatementKind::Case: {
+                auto& cs = stmt.as<CaseStatement>();
+                if (cs.condition == CaseStatementCondition::Inside)
+                    break;
+                uint64_t sel = maskToWidth(evalRoot(cs.expr), exprWidth(cs.expr));
+                if (const Statement* arm = matchCase(cs, sel))
+                    evalStatement(*arm, allowNba);
+                break;
+            }
+            case StatementKind::ForLoop: {
+                auto& loop = stmt.as<ForLoopStatement>();
+                if (auto* bounds = constantLoop(loop))
+                    runLoop(loop, *bounds, allowNba);
+                break;
+            }
             case StatementKind::ExpressionStatement: {
                 auto& es = stmt.as<ExpressionStatement>();
                 if (es.expr.kind == ExpressionKind::Assignment) {
                     auto& a = es.expr.as<AssignmentExpression>();
-                    Signal* lhs = getSignalFromExpr(a.left());
-                    if (!lhs)
-                        break;
-                    auto rhs = evalExpr(a.right());
-                    if (a.isNonBlocking() && allowNba) {
-                        nbaQueue.push_back({lhs, rhs.value});
-                    } else {
-                        setSignal(*lhs, rhs.value);
-                    }
+                    assign(a, a.isNonBlocking() && allowNba);
+                } else {
+                    // Calls, including `void'(std::randomize(x))`.
+                    evalExpr(es.expr);
                 }
                 break;
             }
+            case StatementKind::VariableDeclaration: {
+                auto& var = stmt.as<VariableDeclStatement>().symbol;
+                uint32_t width = widthOrDefault(var.getType().getBitWidth(), 64);
+                auto* init = var.getInitializer();
+                locals[&var] = init ? maskToWidth(evalRoot(*init), width) : 0;
+                break;
+            }
+            case StatementKind::Return: {
+                auto& ret = stmt.as<ReturnStatement>();
+                returnValue = ret.expr ? evalRoot(*ret.expr) : 0;
+                returning = true;
+                break;
+            }
             default:
                 break;
         }
     }
 
+    const ConstantLoop* constantLoop(const ForLoopStatement& loop) {
+        auto it = loops.find(&loop);
+        if (it == loops.end())
+            it = loops.emplace(&loop, sim::constantLoop(loop)).first;
+        return it->second ? &*it->second : nullptr;
+    }
+
+    void runLoop(const ForLoopStatement& loop, const ConstantLoop& bounds, bool allowNba) {
+        auto acc = bounds.reduction ? signalMap.find(bounds.reduction->acc) : signalMap.end();
+        if (acc != signalMap.end()) {
+            uint64_t source = evalExpr(*bounds.reduction->source).value;
+            setSignal(*acc->second, bounds.reduction->apply(acc->second->value, source));
+        } else {
+            for (uint64_t v : bounds.values) {
+                locals[bounds.var] = v;
+                evalStatement(loop.body, allowNba);
+            }
+            locals.erase(bounds.var);
+        }
+        // A module-level loop variable is written once, with the value it leaves with.
+        if (auto var = signalMap.find(bounds.var); !bounds.declared && var != signalMap.end())
+            setSignal(*var->second, bounds.exit);
+    }
+
+    // The arm of the first item matching `sel`, the default arm or nullptr.
+    const Statement* matchCase(const CaseStatement& cs, uint64_t sel) {
+        uint32_t width = exprWidth(cs.expr);
+        for (auto& group : cs.items) {
+            for (auto* item : group.expressions) {
+                auto it = casePatterns.find(item);
+                if (it == casePatterns.end())
+                    it = casePatterns.emplace(item, casePattern(cs, *item)).first;
+                const auto& pattern = it->second;
+                bool match = pattern ? !pattern->never && (sel & pattern->mask) == pattern->value
+                                     : maskToWidth(evalRoot(*item), width) == sel;
+                if (match)
+                    return group.stmt;
+            }
+        }
+        return cs.defaultCase;
+    }
+
     void collectInitials(const Scope& scope) {
         for (auto& block : scope.membersOfType<ProceduralBlockSymbol>()) {
             if (block.procedureKind != ProceduralBlockKind::Initial)
@@ -578,7 +1311,9 @@ struct Simulator::Impl {
                 setupClock(body.as<ForeverLoopStatement>());
             } else {
                 uint64_t t = 0;
+                schedulingBlock = &block;
                 scheduleSequential(body, t);
+                schedulingBlock = nullptr;
             }
         }
     }
@@ -599,8 +1334,7 @@ struct Simulator::Impl {
         if (es.expr.kind != ExpressionKind::Assignment)
             return;
         auto& a = es.expr.as<AssignmentExpression>();
-        Signal* lhs = getSignalFromExpr(a.left());
-        if (!lhs)
+        if (!getSignalFromExpr(a.left()) && a.left().kind != ExpressionKind::Concatenation)
             return;
 
         uint64_t delayTicks = evalConstExpr(delay.expr);
@@ -608,9 +1342,8 @@ struct Simulator::Impl {
             return;
 
         auto tick = std::make_shared<std::function<void()>>();
-        *tick = [this, lhs, &a, delayTicks, tick]() {
-            auto rhs = evalExpr(a.right());
-            setSignal(*lhs, rhs.value);
+        *tick = [this, &a, delayTicks, tick]() {
+            assign(a, false);
             scheduleAt(currentTime + delayTicks, *tick);
         };
 
@@ -634,7 +1367,9 @@ struct Simulator::Impl {
                 auto& ts = stmt.as<TimedStatement>();
                 if (ts.timing.kind == TimingControlKind::Delay) {
                     auto& delay = ts.timing.as<DelayControl>();
-                    time += evalConstExpr(delay.expr);
+                    uint64_t ticks = 0;
+                    inContext(schedulingBlock, taskFrame.get(), [&] { ticks = evalConstExpr(delay.expr); });
+                    time += ticks;
                     scheduleSequential(ts.stmt, time);
                 }
                 break;
@@ -642,15 +1377,36 @@ struct Simulator::Impl {
             case StatementKind::ExpressionStatement: {
                 auto& es = stmt.as<ExpressionStatement>();
                 if (es.expr.kind == ExpressionKind::Call) {
-                    handleSystemTask(es.expr.as<CallExpression>(), time);
+                    auto& call = es.expr.as<CallExpression>();
+                    if (call.isSystemCall())
+                        handleSystemTask(call, time);
+                    else if (!scheduleTask(call, time))
+                        scheduleAt(time, [this, &call, frame = taskFrame, block = schedulingBlock]() {
+                            inContext(block, frame.get(), [&] { evalExpr(call); });
+                        });
                 } else if (es.expr.kind == ExpressionKind::Assignment) {
                     auto& a = es.expr.as<AssignmentExpression>();
-                    Signal* lhs = getSignalFromExpr(a.left());
-                    if (!lhs)
-                        break;
-                    scheduleAt(time, [this, lhs, &a]() {
-                        auto rhs = evalExpr(a.right());
-                        setSignal(*lhs, rhs.value);
+                    scheduleAt(time, [this, &a, frame = taskFrame, block = schedulingBlock]() {
+                        inContext(block, frame.get(), [&] { assign(a, a.isNonBlocking()); });
+                    });
+                } else {
+                    // `void'(std::randomize(x))` and other casts of calls.
+                    scheduleAt(time, [this, &es, frame = taskFrame, block = schedulingBlock]() {
+                        inContext(block, frame.get(), [&] { evalExpr(es.expr); });
+                    });
+                }
+                break;
+            }
+            case StatementKind::VariableDeclaration: {
+                auto& var = stmt.as<VariableDeclStatement>().symbol;
+                if (taskFrame)
+                    (*taskFrame)[&var] = 0;
+                if (auto* init = var.getInitializer(); init && taskFrame) {
+                    scheduleAt(time, [this, &var, init, frame = taskFrame, block = schedulingBlock]() {
+                        inContext(block, frame.get(), [&] {
+                            locals[&var] = maskToWidth(
+                                evalRoot(*init), widthOrDefault(var.getType().getBitWidth(), 64));
+                        });
                     });
                 }
                 break;
@@ -660,6 +1416,48 @@ struct Simulator::Impl {
         }
     }
 
+    // Runs `fn` as part of `process` (for its random stream) with `frame` (if any) as the
+    // locals, keeping what it writes for the next event.
+    template <typename Fn>
+    void inContext(const Symbol* process, Frame* frame, Fn&& fn) {
+        running = process;
+        if (!frame) {
+            fn();
+            return;
+        }
+        std::swap(locals, *frame);
+        fn();
+        std::swap(locals, *frame);
+    }
+
+    // A task called from an initial block whose arguments are all constant: its body is
+    // scheduled in line like the block's own statements, so delays inside it advance the
+    // caller's time. Other calls run as a whole at the time they are reached.
+    bool scheduleTask(const CallExpression& call, uint64_t& time) {
+        if (!std::holds_alternative<const SubroutineSymbol*>(call.subroutine))
+            return false;
+        auto* sub = std::get<const SubroutineSymbol*>(call.subroutine);
+        if (!sub || sub->subroutineKind != SubroutineKind::Task || sub->thisVar ||
+            sub->flags.has(MethodFlags::DPIImport))
+            return false;
+        auto formals = sub->getArguments();
+        auto actuals = call.arguments();
+        if (formals.size() != actuals.size())
+            return false;
+        auto frame = std::make_shared<Frame>();
+        for (size_t i = 0; i < formals.size(); ++i) {
+            auto value = evalConstant(*actuals[i], *sub->getParentScope());
+            if (formals[i]->direction != ArgumentDirection::In || !value)
+                return false;
+            uint32_t argWidth = widthOrDefault(formals[i]->getType().getBitWidth(), 64);
+            (*frame)[formals[i]] = maskToWidth(*value, argWidth);
+        }
+        auto saved = std::exchange(taskFrame, frame);
+        scheduleSequential(sub->getBody(), time);
+        taskFrame = saved;
+        return true;
+    }
+
     void handleSystemTask(const CallExpression& call, uint64_t time) {
         if (!call.isSystemCall())
             return;
@@ -667,6 +1465,35 @@ struct Simulator::Impl {
             scheduleAt(time, [this]() { finished = true; });
             return;
         }
+        auto name = call.getSubroutineName();
+        if (name == "$readmemh" || name == "$readmemb" || name == "$writememh" ||
+            name == "$writememb") {
+            auto args = call.arguments();
+            if (args.size() < 2 || args.size() > 4 ||
+                args[0]->kind != ExpressionKind::StringLiteral)
+                return;
+            Signal* mem = getSignalFromExpr(*args[1]);
+            if (!mem || !mem->memory)
+                return;
+            std::string path(args[0]->as<StringLiteral>().getValue());
+            scheduleAt(time, [this, &call, mem, path, name]() {
+                auto args = call.arguments();
+                int64_t start = args.size() > 2 ? static_cast<int64_t>(evalExpr(*args[2]).value)
+                                                : kNoAddress;
+                int64_t end = args.size() > 3 ? static_cast<int64_t>(evalExpr(*args[3]).value)
+                                              : kNoAddress;
+                auto format = name.ends_with("h") ? MemFileFormat::Hex : MemFileFormat::Binary;
+                if (name.starts_with("$writemem")) {
+                    writeMemFile(*mem->memory, mem->lower, path, format, start, end);
+                    return;
+                }
+                bool changed = false;
+                readMemFile(*mem->memory, mem->lower, path, format, start, end, changed);
+                if (changed)
+                    wakeReaders(*mem);
+            });
+            return;
+        }
         if (call.getSubroutineName() == "$monitor") {
             if (call.arguments().empty())
                 return;
@@ -703,20 +1530,8 @@ struct Simulator::Impl {
                     i++;
                     if (argIndex >= monPtr->args.size())
                         continue;
-                    const Expression* expr = monPtr->args[argIndex++];
-                    if (spec == "0t") {
-                        auto v = evalExpr(*expr);
-                        out += std::to_string(v.value);
-                    } else if (spec == "b") {
-                        auto v = evalExpr(*expr);
-                        std::string bits;
-                        for (int bit = int(v.width) - 1; bit >= 0; --bit)
-                            bits.push_back(((v.value >> bit) & 1) ? '1' : '0');
-                        out += bits;
-                    } else if (spec == "d") {
-                        auto v = evalExpr(*expr);
-                        out += std::to_string(v.value);
-                    } else {
+                    auto v = evalExpr(*monPtr->args[argIndex++]);
+                    if (!formatMonitorValue(out, spec, v.value, 0, v.width)) {
                         out.push_back('%');
                         out += spec;
                     }
@@ -751,8 +1566,8 @@ struct Simulator::Impl {
 
 namespace sim {
 
-Simulator::Simulator(Compilation& compilation, const InstanceSymbol& top) :
-    impl(std::make_unique<Impl>(compilation, top)) {}
+Simulator::Simulator(Compilation& compilation, const InstanceSymbol& top, bool optimize) :
+    impl(std::make_unique<Impl>(compilation, top, optimize)) {}
 
 Simulator::~Simulator() = default;
 
@@ -760,8 +1575,25 @@ void Simulator::build() {
     impl->build();
 }
 
+void Simulator::setSeed(uint64_t seed) {
+    impl->seed = seed;
+}
+
 void Simulator::run() {
     impl->run();
 }
 
+uint64_t Simulator::time() const {
+    return impl->currentTime;
+}
+
+uint64_t Simulator::eventCount() const {
+    return impl->executedEvents;
+}
+
+void Simulator::reportIr(std::ostream& out) const {
+    for (const auto& body : impl->lowered)
+        ir::printStats(out, body->module.ir, body->module.stats);
+}
+
 } // namespace sim
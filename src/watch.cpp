@@ -0,0 +1,269 @@
+#include "sim/watch.h"
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "slang/ast/Compilation.h"
+#include "slang/syntax/SyntaxTree.h"
+#include "slang/text/SourceManager.h"
+
+#include "sim/codegen.h"
+#include "sim/frontend.h"
+#include "sim/simulator.h"
+
+namespace sim {
+
+using slang::SourceManager;
+using slang::ast::Compilation;
+using slang::syntax::SyntaxTree;
+
+namespace {
+
+struct SourceEntry {
+    std::string path;
+    std::filesystem::path canonical;
+    std::string text;
+    size_t hash = 0;
+    bool loaded = false;
+};
+
+// One parse of every input file. A change to any file reparses all of them: a Compilation
+// needs all its trees from one SourceManager, a SourceManager refuses a second buffer for a
+// path it already holds and serves includes from its cache, and it never frees a buffer. So
+// each generation has its own manager; replacing the generation frees the old buffers, and
+// includes are read afresh.
+struct Generation {
+    std::unique_ptr<SourceManager> sourceManager;
+    std::vector<std::shared_ptr<SyntaxTree>> trees;
+    // Canonical paths of the files the trees `include, which are watched too.
+    std::unordered_set<std::string> includes;
+};
+
+// Milliseconds to keep collecting events after the first one so that editors writing a
+// file in several steps (truncate, write, rename) trigger a single regeneration.
+constexpr int kDebounceMs = 50;
+
+std::optional<std::string> readText(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open " << path << "\n";
+        return std::nullopt;
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+std::filesystem::path canonicalPath(const std::filesystem::path& path) {
+    std::error_code ec;
+    auto canonical = std::filesystem::weakly_canonical(path, ec);
+    return ec ? path : canonical;
+}
+
+// Rereads the entry. Returns false on read failure and leaves the previous text in place.
+bool refresh(SourceEntry& entry, bool& changed) {
+    changed = false;
+    auto text = readText(entry.path);
+    if (!text)
+        return false;
+
+    size_t hash = std::hash<std::string>{}(*text);
+    if (entry.loaded && hash == entry.hash)
+        return true;
+    entry.text = std::move(*text);
+    entry.hash = hash;
+    entry.loaded = true;
+    changed = true;
+    return true;
+}
+
+// Parses every entry into a fresh generation; nullopt if any file fails to parse.
+std::optional<Generation> parse(const std::vector<SourceEntry>& entries) {
+    Generation generation;
+    generation.sourceManager = std::make_unique<SourceManager>();
+    for (const auto& entry : entries) {
+        auto tree = loadText(entry.path, entry.text, *generation.sourceManager);
+        if (!tree)
+            return std::nullopt;
+        for (const auto& include : (*tree)->getIncludeDirectives()) {
+            if (include.buffer.valid()) {
+                generation.includes.insert(
+                    canonicalPath(generation.sourceManager->getFullPath(include.buffer))
+                        .string());
+            }
+        }
+        generation.trees.push_back(std::move(*tree));
+    }
+    return generation;
+}
+
+bool regenerate(const Generation& generation, const WatchOptions& options) {
+    auto start = std::chrono::steady_clock::now();
+
+    // A Compilation is immutable once elaborated, so it is rebuilt from the generation's
+    // trees every time.
+    Compilation compilation;
+    registerSystemTasks(compilation);
+    for (const auto& tree : generation.trees)
+        compilation.addSyntaxTree(tree);
+
+    if (!reportDiagnostics(compilation))
+        return false;
+
+    auto* top = findTop(compilation, options.topName);
+    if (!top) {
+        std::cerr << "Top module " << options.topName << " not found\n";
+        return false;
+    }
+
+    CodegenResult result;
+    if (!writeCppOutput(*top, options.cppOutDir, options.codegen, &result))
+        return false;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::cerr << "[watch] regenerated " << result.written.size() << " file(s), "
+              << result.unchanged.size() << " unchanged (" << elapsed.count() << " ms)\n";
+    for (const auto& path : result.written)
+        std::cerr << "[watch]   " << path << "\n";
+
+    if (!result.written.empty() && !options.onChange.empty()) {
+        int status = std::system(options.onChange.c_str());
+        if (status != 0)
+            std::cerr << "[watch] command exited with status " << status << "\n";
+    }
+
+    if (options.runSim) {
+        Simulator sim(compilation, *top, options.codegen.optimize);
+        sim.build();
+        sim.run();
+    }
+    return true;
+}
+
+} // namespace
+
+int runWatch(const WatchOptions& options) {
+    std::vector<SourceEntry> entries;
+    for (const auto& path : options.files) {
+        SourceEntry entry;
+        entry.path = path;
+        entry.canonical = canonicalPath(path);
+        bool changed = false;
+        if (!refresh(entry, changed))
+            return 1;
+        entries.push_back(std::move(entry));
+    }
+    auto generation = parse(entries);
+    if (!generation)
+        return 1;
+
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Failed to initialize inotify\n";
+        return 1;
+    }
+
+    // Watch the parent directories rather than the files themselves: editors commonly
+    // save by writing a temporary file and renaming it over the original, which would
+    // silently drop a watch placed on the old inode.
+    std::unordered_map<int, std::filesystem::path> watchDirs;
+    std::unordered_set<std::string> watchedDirNames;
+    auto watchDir = [&](const std::filesystem::path& dir) {
+        if (watchedDirNames.count(dir.string()))
+            return true;
+        int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0) {
+            std::cerr << "Failed to watch directory: " << dir << "\n";
+            return false;
+        }
+        watchedDirNames.insert(dir.string());
+        watchDirs.emplace(wd, dir);
+        return true;
+    };
+    for (const auto& entry : entries) {
+        if (!watchDir(entry.canonical.parent_path())) {
+            close(fd);
+            return 1;
+        }
+    }
+    // Include directories can change between generations; one that cannot be watched only
+    // costs updates to its files.
+    auto watchIncludes = [&]() {
+        for (const auto& include : generation->includes)
+            watchDir(std::filesystem::path(include).parent_path());
+    };
+    watchIncludes();
+
+    if (!regenerate(*generation, options))
+        return 1;
+    std::cerr << "[watch] watching " << entries.size() << " file(s) and "
+              << generation->includes.size() << " include(s)\n";
+
+    alignas(inotify_event) char buffer[16 * 1024];
+    while (true) {
+        std::unordered_set<std::string> touched;
+        int timeout = -1;
+        while (true) {
+            pollfd pfd{fd, POLLIN, 0};
+            int ready = poll(&pfd, 1, timeout);
+            if (ready <= 0)
+                break;
+
+            ssize_t len = read(fd, buffer, sizeof(buffer));
+            if (len <= 0)
+                break;
+            for (char* ptr = buffer; ptr < buffer + len;) {
+                auto* event = reinterpret_cast<inotify_event*>(ptr);
+                auto it = watchDirs.find(event->wd);
+                if (it != watchDirs.end() && event->len > 0)
+                    touched.insert((it->second / event->name).string());
+                ptr += sizeof(inotify_event) + event->len;
+            }
+            timeout = kDebounceMs;
+        }
+
+        // Included files are not hashed: touching one reparses everything.
+        bool anyChanged = false;
+        bool ok = true;
+        for (const auto& path : touched)
+            anyChanged = anyChanged || generation->includes.count(path);
+        for (auto& entry : entries) {
+            if (touched.find(entry.canonical.string()) == touched.end())
+                continue;
+            bool changed = false;
+            ok = refresh(entry, changed) && ok;
+            anyChanged = anyChanged || changed;
+        }
+        if (!ok || !anyChanged)
+            continue;
+
+        // On a parse error the previous generation stays until the next change.
+        auto next = parse(entries);
+        if (!next)
+            continue;
+        // Trees go before the SourceManager they point into.
+        generation.reset();
+        generation = std::move(next);
+        watchIncludes();
+        if (!regenerate(*generation, options))
+            std::cerr << "[watch] regeneration failed; waiting for the next change\n";
+    }
+}
+
+} // namespace sim
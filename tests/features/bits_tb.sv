@@ -0,0 +1,42 @@
+// Bit selects, part selects and concatenations, read and written: constant and variable
+// offsets, indexed part selects, partial NBAs to one register and concatenation targets.
+module bits_tb();
+    logic clk = 1'b0;
+    initial forever #5 clk = ~clk;
+
+    logic [7:0] step = 8'd0;
+    logic [15:0] word = 16'h0;
+    logic [7:0] high = 8'h0;
+    logic [3:0] nib = 4'h0;
+    logic [1:0] tail = 2'b00;
+    logic [15:0] swapped;
+    logic [11:0] packed_out;
+    logic parity;
+    wire [7:0] mid;
+
+    always_ff @(posedge clk) begin
+        step <= step + 8'd1;
+        word[3:0] <= step[3:0];
+        word[15:12] <= ~step[3:0];
+        word[step[1:0] * 2 +: 2] <= step[7:6] ^ 2'b11;
+        {high[7:4], nib, tail} <= {step, 2'b10};
+        high[3:0] <= step[7:4];
+    end
+
+    always_comb begin
+        swapped = 16'h0;
+        swapped[15:8] = word[7:0];
+        swapped[7:0] = word[15:8];
+        packed_out = {word[11:8], word[3:0], word[15:12]};
+        parity = ^word;
+    end
+
+    assign mid[7:4] = step[3:0];
+    assign mid[3:0] = step[7:4];
+
+    initial begin
+        $monitor("bits: t=%0t word=%h swapped=%h packed=%h high=%h nib=%h tail=%b mid=%h p=%b",
+                 $time, word, swapped, packed_out, high, nib, tail, mid, parity);
+        #200 $finish;
+    end
+endmodule
@@ -0,0 +1,57 @@
+// case and casez: a one-hot decoder and a priority encoder, driven by a counter.
+module decoder (
+    input  logic [2:0] sel,
+    output logic [7:0] onehot
+);
+    always_comb begin
+        case (sel)
+            3'd0: onehot = 8'b0000_0001;
+            3'd1: onehot = 8'b0000_0010;
+            3'd2: onehot = 8'b0000_0100;
+            3'd3: onehot = 8'b0000_1000;
+            3'd4, 3'd5: onehot = 8'b0011_0000;
+            default: onehot = 8'b1000_0000;
+        endcase
+    end
+endmodule
+
+module prio (
+    input  logic [3:0] req,
+    output logic [1:0] idx,
+    output logic       valid
+);
+    always_comb begin
+        valid = 1'b1;
+        casez (req)
+            4'b1???: idx = 2'd3;
+            4'b01??: idx = 2'd2;
+            4'b001?: idx = 2'd1;
+            4'b0001: idx = 2'd0;
+            default: begin
+                idx = 2'd0;
+                valid = 1'b0;
+            end
+        endcase
+    end
+endmodule
+
+module case_tb();
+    logic clk = 1'b0;
+    initial forever #5 clk = ~clk;
+
+    logic [3:0] count = 4'd0;
+    always_ff @(posedge clk)
+        count <= count + 4'd1;
+
+    logic [7:0] onehot;
+    logic [1:0] idx;
+    logic valid;
+    decoder dec (.sel(count[2:0]), .onehot(onehot));
+    prio enc (.req(count), .idx(idx), .valid(valid));
+
+    initial begin
+        $monitor("case: t=%0t count=%0d onehot=%b idx=%0d valid=%b", $time, count, onehot, idx,
+                 valid);
+        #170 $finish;
+    end
+endmodule
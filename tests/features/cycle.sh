@@ -0,0 +1,15 @@
+# The interpreter runs cycle_tb; the generated side is cycle_dut in cycle mode, driven
+# through its model by cycle_driver.cpp. A fallback to the event kernel fails the fixture.
+build_cpp() {
+    "$SIM" --top cycle_dut "$src" --cpp-out "$out/gen" --no-sim --cycle > "$out/gen.log" 2>&1
+    if grep -q "using the event kernel" "$out/gen.log"; then
+        echo "FAIL $name: cycle_dut was not generated in cycle mode (see $out/gen.log)"
+        exit 1
+    fi
+    # shellcheck disable=SC2086
+    "$CXX" $FEATURES_CXXFLAGS -Iinclude -I"$out/gen" -pthread tests/features/cycle_driver.cpp \
+        "$out/gen/cycle_dut_model.cpp" src/runtime.cpp -o "$out/gen/driver"
+}
+run_cpp() {
+    "$out/gen/driver" > "$out/cpp.log" 2>&1
+}
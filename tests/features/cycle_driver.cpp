@@ -0,0 +1,18 @@
+// Drives the cycle-mode model of cycle_dut for 20 clock periods and prints what cycle_tb's
+// $monitor prints: the outputs after each rising edge, stamped with the falling edge's time.
+#include <cstdio>
+
+#include "cycle_dut_model.h"
+
+int main() {
+    gen::cycle_dut_model dut;
+    std::printf("cycle: t=0 count=0 total=0 mixed=00\n");
+    for (unsigned period = 1; period <= 20; ++period) {
+        dut.tick();
+        std::printf("cycle: t=%u count=%u total=%u mixed=%02x\n", period * 10,
+                    static_cast<unsigned>(dut.count), static_cast<unsigned>(dut.total),
+                    static_cast<unsigned>(dut.mixed));
+    }
+    dut.final();
+    return 0;
+}
@@ -0,0 +1,49 @@
+// Cycle mode. cycle.sh generates cycle_dut with --cycle and drives its embeddable model from
+// cycle_driver.cpp, one tick() per clock period; the interpreter runs cycle_tb, which clocks
+// the same design and samples its outputs on the falling edge. The DUT has flops, a memory
+// written through CycleWrites, continuous assigns and a child with a registered output.
+module cycle_acc(input logic clk, input logic [7:0] in, output logic [15:0] total);
+    logic [15:0] sum = 16'd0;
+    always_ff @(posedge clk)
+        sum <= sum + {8'd0, in};
+    assign total = sum;
+endmodule
+
+module cycle_dut(input logic clk, output logic [7:0] count, output logic [15:0] total,
+                 output logic [7:0] mixed);
+    logic [7:0] count_q = 8'd0;
+    logic [7:0] hist [4];
+    always_ff @(posedge clk) begin
+        count_q <= count_q + 8'd3;
+        hist[count_q[1:0]] <= count_q ^ 8'h5a;
+    end
+    assign count = count_q;
+    assign mixed = hist[count_q[1:0]] + count_q;
+    cycle_acc acc(.clk(clk), .in(count_q), .total(total));
+endmodule
+
+module cycle_tb();
+    logic clk = 1'b0;
+    initial forever #5 clk = ~clk;
+
+    logic [7:0] count;
+    logic [15:0] total;
+    logic [7:0] mixed;
+    cycle_dut dut(.clk(clk), .count(count), .total(total), .mixed(mixed));
+
+    // Sampled together on the falling edge, so each period prints one settled line.
+    logic [7:0] seen_count = 8'd0;
+    logic [15:0] seen_total = 16'd0;
+    logic [7:0] seen_mixed = 8'd0;
+    always_ff @(negedge clk) begin
+        seen_count <= count;
+        seen_total <= total;
+        seen_mixed <= mixed;
+    end
+
+    initial begin
+        $monitor("cycle: t=%0t count=%0d total=%0d mixed=%h", $time, seen_count, seen_total,
+                 seen_mixed);
+        #205 $finish;
+    end
+endmodule
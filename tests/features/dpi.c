@@ -0,0 +1,39 @@
+/* C side of dpi_tb. */
+#include "sim_dpi.h"
+
+int dpi_mix(int a, int b) {
+    return a * 31 + b;
+}
+
+void dpi_split(const svBitVecVal* word, svBitVecVal* high) {
+    *high = (*word >> 8) & 0xff;
+}
+
+/* Walks from svLeft to svRight, so data[3:0] gets 0x11 at index 3 ... 0x44 at index 0.
+ * Returns the bounds as left * 100 + right * 10 + (1 if svIncrement is 1, 2 if -1). */
+int dpi_fill(svOpenArrayHandle data) {
+    int left = svLeft(data, 1);
+    int right = svRight(data, 1);
+    int increment = svIncrement(data, 1);
+    for (int i = 0; i < svSize(data, 1); ++i) {
+        svBitVecVal value = (svBitVecVal)(0x11 * (i + 1));
+        svPutBitArrElem1VecVal(data, &value, left - i * increment);
+    }
+    return left * 100 + right * 10 + (increment == 1 ? 1 : 2);
+}
+
+/* Each element times one more than its index, so the result depends on the order. */
+int dpi_weigh(const svOpenArrayHandle data) {
+    int total = 0;
+    for (int i = svLow(data, 1); i <= svHigh(data, 1); ++i) {
+        svBitVecVal value = 0;
+        svGetBitArrElem1VecVal(&value, data, i);
+        total += (int)value * (i + 1);
+    }
+    return total;
+}
+
+/* Context import: sv_triple runs on the calling instance's scope. */
+int dpi_call_back(int x) {
+    return sv_triple(x) + 1;
+}
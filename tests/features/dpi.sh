@@ -0,0 +1,5 @@
+# The interpreter does not call DPI-C imports: compare with a golden file and link the C side.
+EXTRA_SRCS=(tests/features/dpi.c)
+run_reference() {
+    golden
+}
@@ -0,0 +1,36 @@
+// DPI-C imports called from an initial block: integer arguments, an output vector written in
+// place, an inout open array over a descending [3:0] range (filled from svLeft towards
+// svRight), an input open array, and a context import calling an exported SV function.
+// The interpreter does not run DPI, so dpi.sh compares against dpi.golden.
+module dpi_tb();
+    import "DPI-C" function int dpi_mix(input int a, input int b);
+    import "DPI-C" function void dpi_split(input bit [15:0] word, output bit [7:0] high);
+    import "DPI-C" function int dpi_fill(inout bit [7:0] data[]);
+    import "DPI-C" function int dpi_weigh(input bit [7:0] data[]);
+    import "DPI-C" context function int dpi_call_back(input int x);
+    export "DPI-C" function sv_triple;
+
+    function int sv_triple(input int x);
+        return 3 * x;
+    endfunction
+
+    bit [7:0] data [3:0];
+    int mixed = 0;
+    bit [7:0] high = 8'h00;
+    int bounds = 0;
+    int weight = 0;
+    int tripled = 0;
+
+    initial begin
+        #10 mixed = dpi_mix(7, 5);
+        #10 dpi_split(16'hbeef, high);
+        #10 bounds = dpi_fill(data);
+        #10 weight = dpi_weigh(data);
+        #10 tripled = dpi_call_back(14);
+        #10 $finish;
+    end
+
+    initial
+        $monitor("dpi: t=%0t mixed=%0d high=%h bounds=%0d weight=%0d tripled=%0d", $time, mixed,
+                 high, bounds, weight, tripled);
+endmodule
@@ -0,0 +1,47 @@
+// Functions called from always_comb (one with a loop) and a task with delays called
+// from an initial block with constant arguments.
+module funcs_tb();
+    logic clk = 1'b0;
+    initial forever #5 clk = ~clk;
+
+    function automatic logic [7:0] sat_add(input logic [7:0] x, input logic [7:0] y);
+        logic [8:0] total;
+        total = x + y;
+        return total[8] ? 8'hff : total[7:0];
+    endfunction
+
+    function automatic logic [7:0] reverse(input logic [7:0] value);
+        logic [7:0] result;
+        result = '0;
+        for (int i = 0; i < 8; i++)
+            result = {result[6:0], value[i]};
+        return result;
+    endfunction
+
+    logic [7:0] a = 8'd0;
+    always_ff @(posedge clk)
+        a <= a + 8'd37;
+
+    logic [7:0] sum;
+    logic [7:0] flipped;
+    always_comb begin
+        sum = sat_add(a, 8'd100);
+        flipped = reverse(a);
+    end
+
+    logic go = 1'b0;
+    task automatic pulse(input logic [3:0] gap);
+        #gap go = 1'b1;
+        #2 go = 1'b0;
+    endtask
+
+    initial begin
+        pulse(4'd3);
+        pulse(4'd7);
+    end
+
+    initial begin
+        $monitor("funcs: t=%0t a=%0d sum=%0d flipped=%b go=%b", $time, a, sum, flipped, go);
+        #120 $finish;
+    end
+endmodule
@@ -0,0 +1,34 @@
+// A generate-for row of registers wired to part selects of two packed buses, so the
+// replicas become one sim::Replicas member with sliced port connections.
+module stage (
+    input  logic       clk,
+    input  logic [7:0] d,
+    output logic [7:0] q
+);
+    logic [7:0] r = 8'd0;
+    always_ff @(posedge clk)
+        r <= d + 8'd1;
+    assign q = r;
+endmodule
+
+module gen_for_tb();
+    logic clk = 1'b0;
+    initial forever #5 clk = ~clk;
+
+    logic [7:0] in = 8'd0;
+    logic [31:0] din = '0;
+    logic [31:0] dout;
+    always_ff @(posedge clk) begin
+        in <= in + 8'd16;
+        din <= {dout[23:0], in};
+    end
+
+    for (genvar i = 0; i < 4; i++) begin : g
+        stage u (.clk(clk), .d(din[i*8 +: 8]), .q(dout[i*8 +: 8]));
+    end
+
+    initial begin
+        $monitor("gen_for: t=%0t din=%h dout=%h", $time, din, dout);
+        #120 $finish;
+    end
+endmodule
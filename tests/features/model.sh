@@ -0,0 +1,13 @@
+# The model is driven from C++, which the interpreter cannot do: compare with model.golden.
+build_cpp() {
+    compile_generated
+    # shellcheck disable=SC2086
+    "$CXX" $FEATURES_CXXFLAGS -Iinclude -I"$out/gen" -pthread tests/features/model_driver.cpp \
+        "$out/gen/model_tb_model.cpp" src/runtime.cpp -o "$out/gen/driver"
+}
+run_reference() {
+    golden
+}
+run_cpp() {
+    "$out/gen/driver" > "$out/cpp.log" 2>&1
+}
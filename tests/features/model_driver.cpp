@@ -0,0 +1,37 @@
+// Drives the event-mode model of model_tb and prints its outputs after each call.
+#include <cstdio>
+
+#include "model_tb_model.h"
+
+namespace {
+
+void show(const gen::model_tb_model& dut, const char* step) {
+    std::printf("model: %s t=%llu acc=%u doubled=%u done=%u finished=%d\n", step,
+                static_cast<unsigned long long>(dut.time()), static_cast<unsigned>(dut.acc),
+                static_cast<unsigned>(dut.doubled), static_cast<unsigned>(dut.done),
+                dut.got_finish() ? 1 : 0);
+}
+
+} // namespace
+
+int main() {
+    gen::model_tb_model dut;
+    dut.en = 1;
+    dut.din = 5;
+    dut.eval();
+    show(dut, "eval");
+    for (int i = 0; i < 3; ++i) {
+        dut.tick();
+        show(dut, "tick");
+    }
+    dut.en = 0;
+    dut.din = 7;
+    dut.tick();
+    show(dut, "tick");
+    dut.advance(40);
+    show(dut, "advance");
+    dut.advance(20);
+    show(dut, "advance");
+    dut.final();
+    return 0;
+}
@@ -0,0 +1,21 @@
+// The embeddable model API in event mode. model.sh generates model_tb (the design itself,
+// no testbench) and drives gen::model_tb_model from model_driver.cpp: eval() settles logic
+// fed straight from an input, tick() clocks the accumulator without advancing time,
+// advance() runs the design's own timed initial block, and got_finish() sees its $finish.
+// The interpreter cannot be driven from C++, so the output is compared with model.golden.
+module model_tb(input logic clk, input logic en, input logic [7:0] din,
+                output logic [7:0] acc, output logic [7:0] doubled, output logic done);
+    logic [7:0] acc_q = 8'd0;
+    always_ff @(posedge clk)
+        if (en)
+            acc_q <= acc_q + din;
+    assign acc = acc_q;
+    assign doubled = din << 1;
+
+    logic done_q = 1'b0;
+    initial begin
+        #50 done_q = 1'b1;
+        #10 $finish;
+    end
+    assign done = done_q;
+endmodule
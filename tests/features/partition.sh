@@ -0,0 +1,24 @@
+# The single-process cycle-mode simulator is the reference for the partitioned build: both
+# record partition_dut's outputs once per cycle, compared as hex dumps of the recordings.
+build_cpp() {
+    "$SIM" --top partition_dut "$src" --cpp-out "$out/gen" --no-sim \
+        --partition partition_core > "$out/gen.log" 2>&1
+    for main in "$out"/gen/sim_main.cpp "$out"/gen/sim_part*.cpp; do
+        # shellcheck disable=SC2086
+        "$CXX" $FEATURES_CXXFLAGS -Iinclude -I"$out/gen" -pthread "$main" src/runtime.cpp \
+            -o "${main%.cpp}"
+    done
+}
+stim_lines() {
+    od -An -v -tx1 "$1" | sed 's/^ */partition: /'
+}
+run_reference() {
+    "$out/gen/sim_main" --cycles 40 --record-matrix --record "$out/single.stim" \
+        > "$out/single.log" 2>&1
+    stim_lines "$out/single.stim" > "$out/interp.log"
+}
+run_cpp() {
+    "$out/gen/sim_part0" --cycles 40 --record-matrix --record "$out/part.stim" \
+        > "$out/part.log" 2>&1
+    stim_lines "$out/part.stim" > "$out/cpp.log"
+}
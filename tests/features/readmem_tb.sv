@@ -0,0 +1,32 @@
+// $readmemh into a whole array and $readmemb into a descending address range of an array
+// whose indices start at 4, both from files with comments and @ jumps, read back through
+// continuous assigns. Paths are relative to the repository root, where run.sh runs.
+module readmem_tb();
+    logic clk = 1'b0;
+    initial forever #5 clk = ~clk;
+
+    logic [15:0] rom [0:15];
+    logic [7:0] tbl [4:11];
+    initial begin
+        $readmemh("tests/features/readmem.hex", rom);
+        $readmemb("tests/features/readmem.bin", tbl, 10, 5);
+    end
+
+    logic [3:0] addr = 4'd0;
+    logic [3:0] slot = 4'd4;
+    always_ff @(posedge clk) begin
+        addr <= addr + 4'd1;
+        slot <= slot == 4'd11 ? 4'd4 : slot + 4'd1;
+    end
+
+    logic [15:0] word;
+    logic [7:0] entry;
+    assign word = rom[addr];
+    assign entry = tbl[slot];
+
+    initial begin
+        $monitor("readmem: t=%0t addr=%0d word=%h slot=%0d entry=%b", $time, addr, word, slot,
+                 entry);
+        #170 $finish;
+    end
+endmodule
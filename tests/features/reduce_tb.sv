@@ -0,0 +1,43 @@
+// Constant-bound for loops in always_comb: a popcount and a parity loop over a
+// pseudo-random word, which codegen turns into word operations.
+module reduce (
+    input  logic [15:0] data,
+    output logic [4:0]  ones,
+    output logic        parity,
+    output logic        any
+);
+    always_comb begin
+        ones = '0;
+        for (int i = 0; i < 16; i++)
+            ones = ones + data[i];
+    end
+
+    always_comb begin
+        parity = 1'b0;
+        any = 1'b0;
+        for (int i = 0; i < 16; i++) begin
+            parity = parity ^ data[i];
+            any = any | data[i];
+        end
+    end
+endmodule
+
+module reduce_tb();
+    logic clk = 1'b0;
+    initial forever #5 clk = ~clk;
+
+    logic [15:0] data = 16'd0;
+    always_ff @(posedge clk)
+        data <= data * 16'd25173 + 16'd13849;
+
+    logic [4:0] ones;
+    logic parity;
+    logic any;
+    reduce dut (.data(data), .ones(ones), .parity(parity), .any(any));
+
+    initial begin
+        $monitor("reduce: t=%0t data=%h ones=%0d parity=%b any=%b", $time, data, ones, parity,
+                 any);
+        #200 $finish;
+    end
+endmodule
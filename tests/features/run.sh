@@ -0,0 +1,88 @@
+#!/usr/bin/env bash
+# Builds and runs each feature fixture (tests/features/<name>_tb.sv, top <name>_tb) with
+# the interpreter and as generated C++, and checks that both print the same lines. Every
+# fixture prefixes its output with `<name>:`.
+#
+# A fixture that needs more than one plain run has a tests/features/<name>.sh, sourced with
+# `name`, `src` and `out` set. It may set GEN_ARGS (extra generator flags) and EXTRA_SRCS
+# (sources compiled into the generated simulator, e.g. DPI-C models), and redefine any of
+# these steps, which run in this order:
+#   build_cpp      generates and compiles $out/gen/sim (default: compile_generated)
+#   run_reference  writes $out/interp.log (default: interpreter)
+#   run_cpp        writes $out/cpp.log (default: $out/gen/sim)
+# run_reference may also use the built simulator, or `golden`, which copies
+# tests/features/<name>.golden to $out/interp.log.
+#
+# Usage: tests/features/run.sh [name...]
+# Environment: SIM (./sim), FEATURES_DIR (tests/features/out), CXX (g++),
+#              FEATURES_CXXFLAGS (-std=c++20 -O2).
+set -euo pipefail
+
+SIM=${SIM:-./sim}
+FEATURES_DIR=${FEATURES_DIR:-tests/features/out}
+CXX=${CXX:-g++}
+FEATURES_CXXFLAGS=${FEATURES_CXXFLAGS:--std=c++20 -O2}
+
+if [ $# -eq 0 ]; then
+    set -- $(for tb in tests/features/*_tb.sv; do basename "$tb" _tb.sv; done)
+fi
+
+interpreter() {
+    "$SIM" --top "${name}_tb" "$src" > "$out/interp.log" 2>&1
+}
+
+golden() {
+    cp "tests/features/${name}.golden" "$out/interp.log"
+}
+
+compile_generated() {
+    "$SIM" --top "${name}_tb" "$src" --cpp-out "$out/gen" --no-sim \
+        ${GEN_ARGS[@]+"${GEN_ARGS[@]}"} > "$out/gen.log" 2>&1
+    # shellcheck disable=SC2086
+    "$CXX" $FEATURES_CXXFLAGS -Iinclude -I"$out/gen" -pthread "$out/gen/sim_main.cpp" \
+        src/runtime.cpp ${EXTRA_SRCS[@]+"${EXTRA_SRCS[@]}"} -o "$out/gen/sim"
+}
+
+# The default steps; a fixture's .sh overrides them for its own run only.
+defaults() {
+    GEN_ARGS=()
+    EXTRA_SRCS=()
+    build_cpp() {
+        compile_generated
+    }
+    run_reference() {
+        interpreter
+    }
+    run_cpp() {
+        "$out/gen/sim" > "$out/cpp.log" 2>&1
+    }
+}
+
+failed=0
+for name in "$@"; do
+    src="tests/features/${name}_tb.sv"
+    out="$FEATURES_DIR/$name"
+    mkdir -p "$out"
+
+    defaults
+    if [ -f "tests/features/${name}.sh" ]; then
+        # shellcheck disable=SC1090
+        source "tests/features/${name}.sh"
+    fi
+    build_cpp
+    run_reference
+    run_cpp
+
+    grep "^$name:" "$out/interp.log" > "$out/interp.lines" || true
+    grep "^$name:" "$out/cpp.log" > "$out/cpp.lines" || true
+    if [ ! -s "$out/interp.lines" ]; then
+        echo "FAIL $name: no output (see $out/interp.log)"
+        failed=1
+    elif ! diff -u "$out/interp.lines" "$out/cpp.lines" > "$out/diff.txt"; then
+        echo "FAIL $name: generated C++ differs from the reference (see $out/diff.txt)"
+        failed=1
+    else
+        echo "ok   $name ($(wc -l < "$out/interp.lines") lines)"
+    fi
+done
+exit $failed
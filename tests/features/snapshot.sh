@@ -0,0 +1,6 @@
+# Checkpoint the generated simulator at t=95 and finish the run from the snapshot.
+run_cpp() {
+    "$out/gen/sim" --checkpoint "$out/snap.bin" --checkpoint-at 95 --checkpoint-exit \
+        > "$out/cpp.log" 2>&1
+    "$out/gen/sim" --restore "$out/snap.bin" >> "$out/cpp.log" 2>&1
+}
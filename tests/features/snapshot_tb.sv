@@ -0,0 +1,38 @@
+// State that a checkpoint must carry: registers, a memory, a process's random stream, an
+// enabled $monitor and timed initial statements pending past the checkpoint. snapshot.sh
+// checkpoints the generated simulator at t=95, restores it in a second run and compares the
+// two runs' output together with one uninterrupted interpreter run.
+module snapshot_tb();
+    logic clk = 1'b0;
+    initial forever #5 clk = ~clk;
+
+    logic [7:0] count = 8'd0;
+    logic [15:0] mem [16];
+    logic [3:0] wr = 4'd0;
+    logic [3:0] rd = 4'd0;
+    logic [31:0] draw = '0;
+    always_ff @(posedge clk) begin
+        count <= count + 8'd1;
+        mem[wr] <= {count, ~count};
+        wr <= wr + 4'd1;
+        rd <= wr - 4'd3;
+        draw <= $urandom;
+    end
+
+    // Reads an entry written three cycles earlier, never the one being written.
+    logic [15:0] back;
+    assign back = mem[rd];
+
+    logic [3:0] phase = 4'd0;
+    initial begin
+        #42 phase = 4'd1;
+        #60 phase = 4'd2;
+        #31 phase = 4'd3;
+    end
+
+    initial begin
+        $monitor("snapshot: t=%0t count=%0d back=%h draw=%h phase=%0d", $time, count, back,
+                 draw, phase);
+        #200 $finish;
+    end
+endmodule
@@ -0,0 +1,15 @@
+# The interpreter runs stimulus_tb. The generated side is two simulators: stimulus_src records
+# its outputs and stimulus_dut replays them, so the file round-trips through both ends.
+build_cpp() {
+    "$SIM" --top stimulus_src "$src" --cpp-out "$out/src" --no-sim > "$out/gen_src.log" 2>&1
+    "$SIM" --top stimulus_dut "$src" --cpp-out "$out/gen" --no-sim > "$out/gen.log" 2>&1
+    for dir in "$out/src" "$out/gen"; do
+        # shellcheck disable=SC2086
+        "$CXX" $FEATURES_CXXFLAGS -Iinclude -I"$dir" -pthread "$dir/sim_main.cpp" \
+            src/runtime.cpp -o "$dir/sim"
+    done
+}
+run_cpp() {
+    "$out/src/sim" --record "$out/src.stim" > "$out/src.log" 2>&1
+    "$out/gen/sim" --stimulus "$out/src.stim" > "$out/cpp.log" 2>&1
+}
@@ -0,0 +1,46 @@
+// Stimulus recording and replay. stimulus.sh generates stimulus_src and records its outputs
+// with --record, then generates stimulus_dut and replays that file into its inputs with
+// --stimulus; the interpreter runs stimulus_tb, which wires the two together. The DUT's
+// $monitor must print the same lines either way, including flops clocked by the replayed
+// clock.
+module stimulus_src(output logic clk, output logic [7:0] a, output logic [3:0] b);
+    initial begin
+        clk = 1'b0;
+        forever #5 clk = ~clk;
+    end
+    initial begin
+        a = 8'h10;
+        b = 4'h1;
+        #12 a = 8'h2c;
+        #15 b = 4'h7;
+        #14 a = 8'hf0;
+        b = 4'h3;
+        #20 a = 8'h05;
+        #39 $finish;
+    end
+endmodule
+
+module stimulus_dut(input logic clk, input logic [7:0] a, input logic [3:0] b,
+                    output logic [7:0] sum, output logic [7:0] acc);
+    logic [7:0] acc_q = 8'd0;
+    always_ff @(posedge clk)
+        acc_q <= acc_q + sum;
+    assign sum = a + {4'h0, b};
+    assign acc = acc_q;
+
+    // Started after time 0, whose inputs come from another process on each side.
+    initial begin
+        #1 $monitor("stimulus: t=%0t a=%h b=%h sum=%h acc=%h", $time, a, b, sum, acc);
+        #97 $finish;
+    end
+endmodule
+
+module stimulus_tb();
+    logic clk;
+    logic [7:0] a;
+    logic [3:0] b;
+    logic [7:0] sum;
+    logic [7:0] acc;
+    stimulus_src src(.clk(clk), .a(a), .b(b));
+    stimulus_dut dut(.clk(clk), .a(a), .b(b), .sum(sum), .acc(acc));
+endmodule
@@ -0,0 +1,24 @@
+# The report of one whole run is the reference; the generated side merges the databases of
+# two runs split at a checkpoint. The run count is the only line that may differ.
+build_cpp() {
+    compile_generated
+    # shellcheck disable=SC2086
+    "$CXX" $FEATURES_CXXFLAGS -Iinclude -pthread tools/sim_cov.cpp src/runtime.cpp \
+        -o "$out/sim_cov"
+}
+report_lines() {
+    "$out/sim_cov" report --all "$1" | sed -e '/run(s)/d' -e 's/^/toggle: /'
+}
+run_reference() {
+    "$out/gen/sim" --toggle-cov "$out/whole.tdb" > "$out/whole.log" 2>&1
+    report_lines "$out/whole.tdb" > "$out/interp.log"
+}
+run_cpp() {
+    "$out/gen/sim" --toggle-cov "$out/first.tdb" --checkpoint "$out/snap.bin" \
+        --checkpoint-at 45 --checkpoint-exit > "$out/first.log" 2>&1
+    "$out/gen/sim" --toggle-cov "$out/second.tdb" --restore "$out/snap.bin" \
+        > "$out/second.log" 2>&1
+    "$out/sim_cov" merge -j 2 -o "$out/merged.tdb" "$out/first.tdb" "$out/second.tdb" \
+        > "$out/merge.log"
+    report_lines "$out/merged.tdb" > "$out/cpp.log"
+}
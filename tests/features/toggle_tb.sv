@@ -0,0 +1,25 @@
+// Toggle coverage merged across runs. toggle.sh runs the generated simulator twice, up to a
+// checkpoint at t=45 and from it to the end, each with its own --toggle-cov database, merges
+// the two with sim_cov and checks that the report matches one whole run's. `flag` only rises
+// before the checkpoint and only falls after it, so it is fully toggled only once merged;
+// count[3] only rises and `stuck` never changes.
+module toggle_tb();
+    logic clk = 1'b0;
+    initial forever #5 clk = ~clk;
+
+    logic [3:0] count = 4'd0;
+    always_ff @(posedge clk)
+        count <= count + 4'd1;
+
+    logic flag = 1'b0;
+    logic [1:0] stuck = 2'b01;
+    initial begin
+        #30 flag = 1'b1;
+        #40 flag = 1'b0;
+    end
+
+    initial begin
+        $monitor("toggle: t=%0t count=%0d flag=%b stuck=%b", $time, count, flag, stuck);
+        #90 $finish;
+    end
+endmodule
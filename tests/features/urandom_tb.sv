@@ -0,0 +1,28 @@
+// $urandom, $urandom_range, $urandom(seed) and $random(seed): each process draws from its
+// own stream, so the interpreter and the generated code print the same values.
+module urandom_tb();
+    logic clk = 1'b0;
+    initial forever #5 clk = ~clk;
+
+    logic [31:0] draw = '0;
+    logic [7:0] ranged = '0;
+    always_ff @(posedge clk) begin
+        draw <= $urandom;
+        ranged <= $urandom_range(200, 50);
+    end
+
+    logic [31:0] restarted = '0;
+    logic [31:0] seed = 32'd7;
+    logic [31:0] seeded = '0;
+    initial begin
+        #12 restarted = $urandom(42);
+        #10 seeded = $random(seed);
+        #10 seeded = $random(seed);
+    end
+
+    initial begin
+        $monitor("urandom: t=%0t draw=%h ranged=%0d restarted=%h seeded=%h seed=%h", $time,
+                 draw, ranged, restarted, seeded, seed);
+        #100 $finish;
+    end
+endmodule
@@ -0,0 +1,216 @@
+// Merges and reports coverage databases written by a generated simulator: toggle coverage
+// (`--toggle-cov <file>`) and line/branch coverage of designs generated with `--coverage`
+// (`--line-cov <file>`). The kind is taken from the file's magic.
+//
+// Usage: sim_cov merge [-j <threads>] -o <out> <db> [more dbs ...]
+//        sim_cov report [--all] <db>
+//
+// `merge` combines databases of one kind from the same design (a regression's runs, or the
+// `.fork.<i>` files of `$sim_fork` children): toggle rise/fall masks are ORed, counts summed.
+// The inputs are read and merged in parallel, one chunk per thread, then the partial results
+// are combined.
+// `report` prints per-signal bits toggled in both directions, or per-point hit counts as
+// `<sv file>:<line>`, plus the design total. Only incomplete signals and unhit points are
+// listed unless `--all` is given.
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sim/coverage.h"
+
+namespace {
+
+uint64_t widthMask(uint32_t width) {
+    return width >= 64 ? ~0ULL : (1ULL << width) - 1;
+}
+
+// True for a line coverage database, false for anything else (read() diagnoses those).
+bool isLineCoverage(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[8] = {};
+    return in.read(magic, sizeof(magic)) && std::string(magic, sizeof(magic)) == "SIMLCOV1";
+}
+
+template<typename Db>
+bool mergeChunk(const std::vector<std::string>& paths, size_t begin, size_t end, Db& out) {
+    for (size_t i = begin; i < end; ++i) {
+        Db db;
+        if (!db.read(paths[i]))
+            return false;
+        if (!out.merge(db)) {
+            std::cerr << paths[i] << ": skipped\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Db>
+int merge(const std::vector<std::string>& inputs, const std::string& outPath, unsigned threads) {
+    threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(inputs.size())));
+    std::vector<Db> partial(threads);
+    std::vector<char> ok(threads, 0);
+    std::vector<std::thread> workers;
+    size_t chunk = (inputs.size() + threads - 1) / threads;
+    for (unsigned t = 0; t < threads; ++t) {
+        size_t begin = std::min(inputs.size(), t * chunk);
+        size_t end = std::min(inputs.size(), begin + chunk);
+        workers.emplace_back([&, t, begin, end] {
+            ok[t] = mergeChunk(inputs, begin, end, partial[t]);
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    Db total;
+    for (unsigned t = 0; t < threads; ++t) {
+        if (!ok[t] || !total.merge(partial[t]))
+            return 1;
+    }
+    if (!total.write(outPath))
+        return 1;
+    std::cout << "merged " << inputs.size() << " database(s), " << total.runs << " run(s) into "
+              << outPath << "\n";
+    return 0;
+}
+
+int reportToggle(const std::string& path, bool all) {
+    sim::ToggleCoverage db;
+    if (!db.read(path))
+        return 1;
+
+    uint64_t totalBits = 0;
+    uint64_t toggledBits = 0;
+    size_t fullSignals = 0;
+    std::vector<size_t> listed;
+    for (size_t i = 0; i < db.counters.size(); ++i) {
+        uint32_t width = std::min<uint32_t>(db.widths[i], 64);
+        uint64_t both = db.counters[i].rose & db.counters[i].fell & widthMask(width);
+        uint32_t toggled = static_cast<uint32_t>(std::popcount(both));
+        totalBits += width;
+        toggledBits += toggled;
+        if (toggled == width)
+            fullSignals++;
+        if (all || toggled != width)
+            listed.push_back(i);
+    }
+
+    std::cout << "# toggle coverage: " << db.runs << " run(s), " << db.counters.size()
+              << " signal(s)\n";
+    std::cout << "# toggled\twidth\tchanges\tsignal\tuntoggled bits\n";
+    for (size_t i : listed) {
+        uint32_t width = std::min<uint32_t>(db.widths[i], 64);
+        const auto& c = db.counters[i];
+        std::string missing;
+        for (uint32_t bit = width; bit-- > 0;) {
+            bool rose = (c.rose >> bit) & 1;
+            bool fell = (c.fell >> bit) & 1;
+            if (rose && fell)
+                continue;
+            if (!missing.empty())
+                missing += ' ';
+            // 'r' only rose, 'f' only fell, '-' never changed.
+            missing += std::to_string(bit) + (rose ? "r" : fell ? "f" : "-");
+        }
+        std::cout << std::popcount(c.rose & c.fell & widthMask(width)) << "\t" << width << "\t"
+                  << c.changes << "\t" << db.names[i] << "\t" << missing << "\n";
+    }
+    double percent = totalBits ? 100.0 * static_cast<double>(toggledBits) /
+                                     static_cast<double>(totalBits)
+                               : 100.0;
+    std::cout << "# total: " << toggledBits << "/" << totalBits << " bits (" << std::fixed
+              << std::setprecision(1) << percent << "%), " << fullSignals << "/"
+              << db.counters.size() << " signals fully toggled\n";
+    return 0;
+}
+
+int reportLines(const std::string& path, bool all) {
+    sim::LineCoverage db;
+    if (!db.read(path))
+        return 1;
+
+    uint64_t points = 0;
+    uint64_t hitPoints = 0;
+    uint64_t branches = 0;
+    uint64_t hitBranches = 0;
+    std::cout << "# line coverage: " << db.runs << " run(s), " << db.modules.size()
+              << " class(es)\n";
+    std::cout << "# hits\tkind\tclass\tsv location\n";
+    for (const auto& module : db.modules) {
+        for (size_t i = 0; i < module.counts.size(); ++i) {
+            bool branch = module.kinds[i] == "if" || module.kinds[i] == "else" ||
+                          module.kinds[i] == "case" || module.kinds[i] == "default";
+            bool hit = module.counts[i] != 0;
+            points++;
+            hitPoints += hit;
+            branches += branch;
+            hitBranches += branch && hit;
+            if (!all && hit)
+                continue;
+            std::cout << module.counts[i] << "\t" << module.kinds[i] << "\t" << module.name
+                      << "\t" << module.files[i] << ":" << module.lines[i] << "\n";
+        }
+    }
+    auto percent = [](uint64_t part, uint64_t whole) {
+        return whole ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 100.0;
+    };
+    std::cout << std::fixed << std::setprecision(1) << "# total: " << hitPoints << "/"
+              << points << " points (" << percent(hitPoints, points) << "%), " << hitBranches
+              << "/" << branches << " branch arms (" << percent(hitBranches, branches) << "%)\n";
+    return 0;
+}
+
+void usage() {
+    std::cerr << "Usage: sim_cov merge [-j <threads>] -o <out> <db> [more dbs ...]\n"
+                 "       sim_cov report [--all] <db>\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    std::string command = argv[1];
+    std::string outPath;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool all = false;
+    std::vector<std::string> inputs;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (arg == "-j" && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--all") {
+            all = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+
+    if (command == "merge" && !outPath.empty() && !inputs.empty()) {
+        if (isLineCoverage(inputs[0]))
+            return merge<sim::LineCoverage>(inputs, outPath, threads);
+        return merge<sim::ToggleCoverage>(inputs, outPath, threads);
+    }
+    if (command == "report" && inputs.size() == 1) {
+        if (isLineCoverage(inputs[0]))
+            return reportLines(inputs[0], all);
+        return reportToggle(inputs[0], all);
+    }
+    usage();
+    return 1;
+}
@@ -0,0 +1,131 @@
+// Converts profiles written by a generated simulator (`--profile <file>`) into folded stacks
+// for flamegraph tools, keyed by SV hierarchy.
+//
+// Usage: sim_prof [--flat] [-o <out>] <profile> [more profiles ...]
+//
+// Each profile row `<samples> <scope> <process> <file> <line>` becomes the folded stack
+// `<scope components...>;<process>@<file>:<line> <samples>`, e.g.
+// `adder_tb;adder;always_ff@tests/adder.sv:12 314`. Rows from several profiles (or several
+// runs) with the same stack are summed. `--flat` prints a table sorted by samples instead.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool loadProfile(const std::string& path, std::map<std::string, uint64_t>& stacks,
+                 uint64_t& dropped) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open profile: " << path << "\n";
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty())
+            continue;
+        if (line[0] == '#') {
+            auto pos = line.find("dropped=");
+            if (pos != std::string::npos)
+                dropped += std::strtoull(line.c_str() + pos + 8, nullptr, 10);
+            continue;
+        }
+        std::vector<std::string> fields;
+        std::istringstream row(line);
+        std::string field;
+        while (std::getline(row, field, '\t'))
+            fields.push_back(field);
+        if (fields.size() < 5) {
+            std::cerr << path << ": malformed row: " << line << "\n";
+            return false;
+        }
+
+        std::string stack;
+        for (char c : fields[1])
+            stack.push_back(c == '.' ? ';' : c);
+        if (!stack.empty())
+            stack.push_back(';');
+        stack += fields[2];
+        if (!fields[3].empty())
+            stack += "@" + fields[3] + ":" + fields[4];
+        stacks[stack] += std::strtoull(fields[0].c_str(), nullptr, 10);
+    }
+    return true;
+}
+
+void writeFlat(std::ostream& out, const std::map<std::string, uint64_t>& stacks,
+               uint64_t dropped) {
+    std::vector<std::pair<uint64_t, std::string>> rows;
+    uint64_t total = dropped;
+    for (const auto& [stack, samples] : stacks) {
+        rows.emplace_back(samples, stack);
+        total += samples;
+    }
+    std::sort(rows.rbegin(), rows.rend());
+    out << std::fixed << std::setprecision(1);
+    for (const auto& [samples, stack] : rows) {
+        out << std::setw(10) << samples << std::setw(7)
+            << (total ? 100.0 * double(samples) / double(total) : 0.0) << "%  " << stack
+            << "\n";
+    }
+    if (dropped)
+        out << std::setw(10) << dropped << "         (outside the simulation kernel)\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool flat = false;
+    std::string outPath;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--flat") {
+            flat = true;
+        } else if (arg == "-o" && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty()) {
+        std::cerr << "Usage: sim_prof [--flat] [-o <out>] <profile> [more profiles ...]\n";
+        return 1;
+    }
+
+    std::map<std::string, uint64_t> stacks;
+    uint64_t dropped = 0;
+    for (const auto& path : inputs) {
+        if (!loadProfile(path, stacks, dropped))
+            return 1;
+    }
+
+    std::ofstream file;
+    if (!outPath.empty()) {
+        file.open(outPath);
+        if (!file) {
+            std::cerr << "Failed to open output file: " << outPath << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = outPath.empty() ? std::cout : file;
+
+    if (flat) {
+        writeFlat(out, stacks, dropped);
+        return 0;
+    }
+    for (const auto& [stack, samples] : stacks)
+        out << stack << " " << samples << "\n";
+    return 0;
+}